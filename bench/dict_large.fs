@@ -0,0 +1,24 @@
+// A large dict of str keys: inserts, lookups, membership and removals
+list<str> digits;
+push(digits, "0", "1", "2", "3", "4", "5", "6", "7", "8", "9");
+dict<str, i64> d;
+i64 count = 100000;
+i64 i = 0;
+while(i < count){
+	str key = digits[i % 10] + digits[(i / 10) % 10] + digits[(i / 100) % 10] + digits[(i / 1000) % 10] + digits[(i / 10000) % 10];
+	d[key] = i;
+	i = i + 1;
+}
+i64 total = 0;
+i = 0;
+while(i < count){
+	str key = digits[i % 10] + digits[(i / 10) % 10] + digits[(i / 100) % 10] + digits[(i / 1000) % 10] + digits[(i / 10000) % 10];
+	if(has(d, key)){
+		total = total + d[key];
+	}
+	if(i % 2 == 0){
+		remove(d, key);
+	}
+	i = i + 1;
+}
+print(total, " ", len(d));
@@ -0,0 +1,6 @@
+// Startup dominated by headers: include chains, guards, macros and constants
+#include "headers/module7.fh"
+#include "headers/module3.fh"
+#include "headers/module5.fh"
+
+print(module0_value_0 + module7_value_39, " ", module3_name_9);
@@ -0,0 +1,8 @@
+// Integer arithmetic in a hot loop
+i64 total = 0;
+i64 i = 0;
+while(i < 5000000){
+	total = total + (i * 7) % 13 - i % 4;
+	i = i + 1;
+}
+print(total);
@@ -0,0 +1,16 @@
+// A large list: pushes, indexed reads and writes, reductions and pops
+list<i64> xs;
+i64 count = 1000000;
+i64 i = 0;
+while(i < count){
+	push(xs, i % 1000);
+	i = i + 1;
+}
+for(i64 j : 0, count){
+	xs[j] = xs[j] * 2 + 1;
+}
+print(sum(xs), " ", min(xs), " ", max(xs));
+while(len(xs) > count / 2){
+	pop(xs);
+}
+print(len(xs));
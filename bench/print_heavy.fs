@@ -0,0 +1,6 @@
+// Many short lines of output (the harness sends them to /dev/null)
+i64 i = 0;
+while(i < 500000){
+	print("line ", i, " of output ", i * 3, " ", i % 7 == 0);
+	i = i + 1;
+}
@@ -0,0 +1,14 @@
+// fib(27) the recursive way, the calls kept on an explicit stack
+// (the language has no functions yet)
+list<i64> calls;
+push(calls, 27);
+i64 result = 0;
+while(len(calls) > 0){
+	i64 n = pop(calls);
+	if(n < 2){
+		result = result + n;
+	}else{
+		push(calls, n - 1, n - 2);
+	}
+}
+print(result);
@@ -0,0 +1,12 @@
+// Appending to a str and concatenating short ones
+list<str> digits;
+push(digits, "0", "1", "2", "3", "4", "5", "6", "7", "8", "9");
+str text = "";
+i64 i = 0;
+while(i < 300000){
+	str word = digits[i % 10] + digits[(i / 10) % 10] + digits[(i / 100) % 10];
+	text = text + word;
+	text = text + " ";
+	i = i + 1;
+}
+print(len(text));
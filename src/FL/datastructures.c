@@ -1,6 +1,6 @@
 #include "datastructures.h"
 
-uint16_t ds_error = DS_INVALID;
+FL_LOCAL uint16_t ds_error = DS_INVALID;
 const char* const ds_error_messages[] = {
 	"NULL pointer exception",
 	"failed to allocate memory",
@@ -34,7 +34,7 @@ bool dynamic_array_grow(dynamic_array_t* array, size_t size){
 		return false;
 	}
 	if(array->memsize - array->size < size){
-		array->memsize = size - (array->memsize - array->size);
+		array->memsize = array->size + size;
 		array->data = (const char*) realloc((void*)array->data, array->memsize * array->data_size);
 		if(!array->data){
 			DS_ERROR(DS_MEM_ERR);
@@ -112,36 +112,48 @@ void dynamic_array_free(dynamic_array_t* array){
 }
 
 bool hashtable_setup(hashtable_t* ht, size_t pair_size){
-	ht->sets = (hashset_t*) realloc((void*)ht->sets, sizeof(hashset_t) * (ht->set_count ? ht->set_count : HASHTABLE_START));
+	if(!ht){
+		DS_ERROR(DS_NULL_ERR);
+		return false;
+	}
+	if(!ht->set_count)
+		ht->set_count = HASHTABLE_START;
+	ht->sets = (hashset_t*) realloc((void*)ht->sets, sizeof(hashset_t) * ht->set_count);
 	if(!ht->sets){
 		DS_ERROR(DS_MEM_ERR);
 		return false;
 	}
 	for(size_t i = 0; i < ht->set_count; i++)
 		ht->sets[i] = (hashset_t) NEW_DYNAMIC_ARRAY(pair_size);
+	ht->pair_count = 0;
 	return true;
 }
 
+// Doubles the amount of sets and redistributes every pair
 bool hashtable_grow(hashtable_t* ht, size_t pair_size){
-	size_t start_size = ht->set_count;
+	hashset_t* old_sets = ht->sets;
+	size_t old_count = ht->set_count;
 	ht->set_count = ht->set_count ? HASHTABLE_GROW(ht->set_count) : HASHTABLE_START;
-	ht->sets = (hashset_t*) realloc((void*)ht->sets, sizeof(hashset_t) * ht->set_count);
+	ht->sets = (hashset_t*) malloc(sizeof(hashset_t) * ht->set_count);
 	if(!ht->sets){
+		ht->sets = old_sets;
+		ht->set_count = old_count;
 		DS_ERROR(DS_MEM_ERR);
 		return false;
 	}
-	if(ht->set_count - start_size > 0){
-		for(size_t i = start_size; i < ht->set_count; i++)
-			ht->sets[i] = (hashset_t) NEW_DYNAMIC_ARRAY(pair_size);
-		for(size_t i = 0; i < start_size; i++){
-			for(size_t j = ht->sets[i].size; j < ~0; j--){
-				void* pair = hashset_get(&ht->sets[i], j);
-				ht->sets[i].size--;
-				if(!hashtable_set(ht, pair))
-					return false;
-			}
+	for(size_t i = 0; i < ht->set_count; i++)
+		ht->sets[i] = (hashset_t) NEW_DYNAMIC_ARRAY(pair_size);
+	for(size_t i = 0; i < old_count; i++){
+		for(size_t j = 0; j < old_sets[i].size; j++){
+			void* pair = hashset_get(&old_sets[i], j);
+			size_t hash = ((ht->hashing_func) ? ht->hashing_func(pair) : (size_t) *((uint8_t*)pair)) % ht->set_count;
+			if(!dynamic_array_pushback((dynamic_array_t*)&ht->sets[hash], pair))
+				return false;
 		}
+		dynamic_array_free((dynamic_array_t*) &old_sets[i]);
 	}
+	free(old_sets);
+	ht->grows++;
 	return true;
 }
 
@@ -158,7 +170,10 @@ bool hashtable_set(hashtable_t* ht, const void* data){
 	}
 	if(!dynamic_array_pushback((dynamic_array_t*)&ht->sets[hash],data))
 		return false;
-	if(ht->sets[hash].size > ht->max_size)
+	ht->pair_count++;
+	// Pairs with equal hashes stay together however many sets there are,
+	// so a long set only grows a table holding more pairs than sets
+	if(ht->sets[hash].size > ht->max_size && ht->pair_count > ht->set_count)
 		return hashtable_grow(ht,ht->sets[hash].data_size);
 	return true;
 }
@@ -217,6 +232,27 @@ void hashtable_free(hashtable_t* ht){
 	for(size_t i = 0; i < ht->set_count; i++){
 		dynamic_array_free((dynamic_array_t*) &ht->sets[i]);
 	}
+	free(ht->sets);
+	ht->sets = NULL;
+	ht->set_count = 0;
+	ht->pair_count = 0;
+}
+
+void hashtable_stats(const hashtable_t* ht, hashtable_stats_t* stats){
+	memset(stats, 0, sizeof(*stats));
+	if(!ht)
+		return;
+	stats->sets = ht->sets ? ht->set_count : 0;
+	stats->grows = ht->grows;
+	for(size_t i = 0; i < stats->sets; i++){
+		size_t size = ht->sets[i].size;
+		stats->pairs += size;
+		stats->used_sets += (size != 0);
+		if(size > stats->max_chain)
+			stats->max_chain = size;
+		stats->histogram[(size < HASHTABLE_HISTOGRAM) ? size : HASHTABLE_HISTOGRAM - 1]++;
+	}
+	stats->load_factor = stats->sets ? (double) stats->pairs / stats->sets : 0.0;
 }
 
 bool arena_setup(arena_t* arena, size_t size){
@@ -7,6 +7,10 @@
 #include <stdint.h>
 #include <string.h>
 
+// State of one compilation (tokens, nodes, bytecode being built, errors)
+// is kept per thread, so --batch can compile scripts side by side
+#define FL_LOCAL _Thread_local
+
 enum{
 	DS_NULL_ERR = 0,
 	DS_MEM_ERR,
@@ -15,7 +19,7 @@ enum{
 	DS_INVALID,
 };
 
-extern uint16_t ds_error;
+extern FL_LOCAL uint16_t ds_error;
 #define DS_ERROR_MSG ds_error_messages[ds_error]
 extern const char* const ds_error_messages[];
 
@@ -45,6 +49,8 @@ typedef struct {
 	hashset_t* sets;
 	size_t set_count;
 	size_t max_size;	// Max amount of pairs in a single set
+	size_t pair_count;
+	size_t grows;		// Times the sets were doubled
 
 	// Hashing function
 	// const void* : pointer to key / value pair
@@ -61,10 +67,23 @@ typedef struct {
 	bool (*cmp_func)(const void*, const void*);
 } hashtable_t;
 
-#define NEW_HASHTABLE(_sz) {NULL,0,(_sz),NULL,NULL}
+#define NEW_HASHTABLE(_sz) {NULL,0,(_sz),0,0,NULL,NULL}
 #define HASHTABLE_GROW(x) (x) * 2
 #define HASHTABLE_START 8
 
+// How well the hashing function spreads the pairs of a table
+#define HASHTABLE_HISTOGRAM 8
+typedef struct {
+	size_t pairs;
+	size_t sets;
+	size_t used_sets;		// Sets with at least one pair
+	size_t max_chain;		// Pairs in the fullest set
+	double load_factor;		// Pairs per set
+	size_t grows;
+	// Sets by amount of pairs, the last one counts HASHTABLE_HISTOGRAM - 1 and more
+	size_t histogram[HASHTABLE_HISTOGRAM];
+} hashtable_stats_t;
+
 bool hashtable_setup(hashtable_t*,size_t);
 bool hashtable_grow(hashtable_t*,size_t);
 bool hashtable_set(hashtable_t*,const void*);
@@ -73,6 +92,7 @@ void* hashset_get(hashset_t*,size_t);
 void* hashtable_find(hashtable_t*,const void*);
 void hashtable_parse(hashtable_t*,void (*)(void*,void*),void*);
 void hashtable_free(hashtable_t*);
+void hashtable_stats(const hashtable_t*,hashtable_stats_t*);
 
 typedef struct{
 	size_t size;
@@ -1,46 +1,94 @@
 #include "filemanager.h"
+#include "stats.h"
 #include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+FL_LOCAL FILE* fl_output = NULL;
+
+// Loaded files are shared by every thread
+// Nodes are only ever appended, so a file_t* stays valid until free_file_list
 file_list_t file_list = {new_file(NULL),NULL};
+static pthread_mutex_t file_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
-bool load_file(file_t* file){
-	FILE* fptr = fopen(file->path, "rb");
-	if(!fptr){
-		printf("failed to open %s\n", file->path);
-		perror(NULL);
+// Store and look files up by their absolute path (--serve, whose
+// clients each have their own working directory)
+bool file_resolve_paths = false;
+
+// Maps a file read-only, pages are only read once touched
+// (terminated) makes the byte after the contents a '\0': the rest of the
+// last page of a file reads as zeros, and a file that fills its last page
+// gets an anonymous page after it
+// (*contents) is NULL for an empty file
+// Returns false with errno set if the file cannot be mapped
+bool map_file(const char* path, bool terminated, const char** contents, size_t* size){
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
 		return false;
+	struct stat st;
+	void* mem = NULL;
+	if(fstat(fd, &st) < 0)
+		mem = MAP_FAILED;
+	else if(S_ISDIR(st.st_mode)){
+		mem = MAP_FAILED;
+		errno = EISDIR;
 	}
-	fseek(fptr,0L,SEEK_END);
-	file->size = ftell(fptr);
-	rewind(fptr);
-	if(file->size <= 0){
-		fclose(fptr);
-		printf("File %s has invalid size!\n",file->path);
+	else if(st.st_size > 0 && terminated){
+		mem = mmap(NULL, st.st_size + 1, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mem != MAP_FAILED && mmap(mem, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED){
+			int err = errno;
+			munmap(mem, st.st_size + 1);
+			mem = MAP_FAILED;
+			errno = err;
+		}
+	}else if(st.st_size > 0)
+		mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	close(fd);
+	if(mem == MAP_FAILED){
+		errno = err;
 		return false;
 	}
-	file->contents = (const char*)realloc((void*)file->contents,file->size+1);
-	if(!file->contents){
-		fclose(fptr);
-		printf("Failed to allocate memory for file %s\n",file->path);
+	*contents = (const char*) mem;
+	*size = (mem) ? st.st_size : 0;
+	return true;
+}
+
+void unmap_file(const char* contents, size_t size, bool terminated){
+	if(contents)
+		munmap((void*) contents, size + terminated);
+}
+
+bool load_file(file_t* file){
+	uint64_t start = stats_format ? stats_clock() : 0;
+	close_file(file);
+	if(!map_file(file->path, true, &file->contents, &file->size)){
+		fprintf(FL_OUTPUT, "failed to open %s\n%s\n", file->path, strerror(errno));
 		return false;
 	}
-	if(fread((void*)file->contents,1,file->size,fptr) != file->size){
-		fclose(fptr);
-		printf("Failed to read file %s\n",file->path);
+	if(!file->size){
+		fprintf(FL_OUTPUT, "File %s has invalid size!\n",file->path);
 		return false;
 	}
-	((char*)file->contents)[file->size] = '\0';
-	fclose(fptr);
+	stats_file_t* stats = stats_format ? stats_file(file->path) : NULL;
+	if(stats){
+		stats->bytes += file->size;
+		stats->load_ns += stats_clock() - start;
+	}
 	return true;
 }
 
 void close_file(file_t* file){
-	if(file->contents)
-		free((void*)file->contents);
+	unmap_file(file->contents, file->size, true);
 	file->contents = NULL;
 }
 
-void append_file_list(file_t file){
+static file_t* append_file_list_locked(file_t file){
 	file_list_t* node = (file_list_t*) malloc(sizeof(file_list_t));
 	if(!node){
 		printf("failed to allocate %lu bytes for file list\n",sizeof(file_list_t));
@@ -50,6 +98,13 @@ void append_file_list(file_t file){
 	file_list_t* ptr = &file_list;
 	while(ptr->next) ptr = ptr->next;
 	ptr->next = node;
+	return &node->f;
+}
+
+void append_file_list(file_t file){
+	pthread_mutex_lock(&file_list_lock);
+	(void) append_file_list_locked(file);
+	pthread_mutex_unlock(&file_list_lock);
 }
 
 static bool strlen_cmp(const char* str1, const char* str2, uint32_t strlen){
@@ -62,7 +117,7 @@ static bool strlen_cmp(const char* str1, const char* str2, uint32_t strlen){
 	return !(*str1);
 }
 
-file_t* find_file(const char* str, uint32_t strlen){
+static file_t* find_file_locked(const char* str, uint32_t strlen){
 	file_list_t* ptr = file_list.next;
 	while(ptr){
 		if(strlen_cmp(ptr->f.path, str, strlen))
@@ -72,13 +127,92 @@ file_t* find_file(const char* str, uint32_t strlen){
 	return NULL;
 }
 
+file_t* find_file(const char* str, uint32_t strlen){
+	char* real = NULL;
+	if(file_resolve_paths){
+		char path[PATH_MAX];
+		if(strlen >= PATH_MAX)
+			return NULL;
+		memcpy(path, str, strlen);
+		path[strlen] = '\0';
+		if(!(real = realpath(path, NULL)))
+			return NULL;
+		str = real;
+		strlen = strnlen(real, PATH_MAX);
+	}
+	pthread_mutex_lock(&file_list_lock);
+	file_t* file = find_file_locked(str, strlen);
+	pthread_mutex_unlock(&file_list_lock);
+	free(real);
+	return file;
+}
+
+// Finds the loaded file whose contents contain ptr
+file_t* find_file_ptr(const char* ptr){
+	pthread_mutex_lock(&file_list_lock);
+	file_list_t* node = file_list.next;
+	while(node && !(node->f.contents && ptr >= node->f.contents && ptr <= node->f.contents + node->f.size))
+		node = node->next;
+	pthread_mutex_unlock(&file_list_lock);
+	return node ? &node->f : NULL;
+}
+
+// Loads the file at (path) once: later opens of the same path, from any
+// thread, share the file loaded first
+// A file closed since (--serve, once it changed on disk) is loaded again
+// Takes ownership of (path), NULL if the file cannot be loaded
+file_t* open_file(char* path){
+	if(file_resolve_paths){
+		char* real = realpath(path, NULL);
+		if(!real){
+			fprintf(FL_OUTPUT, "failed to open %s\n%s\n", path, strerror(errno));
+			free(path);
+			return NULL;
+		}
+		free(path);
+		path = real;
+	}
+	file_t* file = find_file(path, strlen(path));
+	if(file){
+		free(path);
+		if(!file->contents && !load_file(file))
+			return NULL;
+		return file;
+	}
+	// Loaded outside of the lock, the first thread to append it wins
+	file_t new_file = new_file(path);
+	if(!load_file(&new_file)){
+		free(path);
+		return NULL;
+	}
+	pthread_mutex_lock(&file_list_lock);
+	if((file = find_file_locked(path, strlen(path)))){
+		close_file(&new_file);
+		free(path);
+	}else
+		file = append_file_list_locked(new_file);
+	pthread_mutex_unlock(&file_list_lock);
+	return file;
+}
+
+// Line number (from 1) of a pointer into a file's contents
+unsigned int file_line(file_t* file, const char* ptr){
+	unsigned int line = 1;
+	for(const char* str = file->contents; str < ptr && *str; str++)
+		if(*str == '\n')
+			line++;
+	return line;
+}
+
 void free_file_list(void){
 	file_list_t* ptr = file_list.next;
 	if(!ptr) return;
 	while(ptr){
-		free((void*)ptr->f.contents);
+		close_file(&ptr->f);
+		free((void*)ptr->f.path);
 		void* node = ptr;
 		ptr = ptr->next;
 		free(node);
 	}
+	file_list.next = NULL;
 }
\ No newline at end of file
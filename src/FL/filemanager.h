@@ -7,6 +7,12 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "datastructures.h"
+
+// Where diagnostics of the current thread go (stdout when NULL)
+extern FL_LOCAL FILE* fl_output;
+#define FL_OUTPUT (fl_output ? fl_output : stdout)
+
 typedef struct{
 	const char* path;
 	const char* contents;
@@ -21,12 +27,18 @@ typedef struct file_list_t{
 } file_list_t;
 
 extern file_list_t file_list;
+extern bool file_resolve_paths;
 
+bool map_file(const char*,bool,const char**,size_t*);
+void unmap_file(const char*,size_t,bool);
 bool load_file(file_t*);
+file_t* open_file(char*);
 void close_file(file_t*);
 
 void append_file_list(file_t);
 file_t* find_file(const char*, uint32_t);
+file_t* find_file_ptr(const char*);
+unsigned int file_line(file_t*,const char*);
 void free_file_list(void);
 
 #endif
\ No newline at end of file
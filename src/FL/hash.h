@@ -0,0 +1,138 @@
+#ifndef FERRO_HASH_H
+#define FERRO_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hashing functions over bytes
+// hash_bytes is the one dicts use, the others are candidates measured
+// against it by ferro_bench_hash
+
+static inline uint64_t hash_read64(const char* p){
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t hash_read32(const char* p){
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Low and high halves of the 128 bit product, folded together
+static inline uint64_t hash_mul_fold(uint64_t a, uint64_t b){
+	__uint128_t r = (__uint128_t) a * b;
+	return (uint64_t) r ^ (uint64_t)(r >> 64);
+}
+
+// Finalizer of MurmurHash3, every bit of h affects every bit of the result
+static inline uint64_t hash_finalize(uint64_t h){
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= UINT64_C(0xc4ceb9fe1a85ec53);
+	return h ^ (h >> 33);
+}
+
+// 8 bytes at a time, then the finalizer (dict keys)
+static inline uint64_t hash_bytes(const char* p, size_t len){
+	uint64_t h = UINT64_C(0x9E3779B97F4A7C15) ^ len;
+	for(; len >= 8; p += 8, len -= 8){
+		h = (h ^ hash_read64(p)) * UINT64_C(0xbf58476d1ce4e5b9);
+		h ^= h >> 31;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, p, len);
+	return hash_finalize(h ^ tail);
+}
+
+// Sum of the bytes, what variable names were hashed with before they
+// were resolved to slots: anagrams always collide
+static inline uint64_t hash_sum(const char* p, size_t len){
+	uint64_t h = 0;
+	while(len--)
+		h += (uint8_t) *p++;
+	return h;
+}
+
+// FNV-1a, one byte at a time
+static inline uint64_t hash_fnv1a(const char* p, size_t len){
+	uint64_t h = UINT64_C(0xcbf29ce484222325);
+	while(len--){
+		h ^= (uint8_t) *p++;
+		h *= UINT64_C(0x100000001b3);
+	}
+	return h;
+}
+
+// After wyhash: up to 16 bytes are read as two overlapping words,
+// longer keys 16 bytes at a time, each mixed by a folded 128 bit product
+static inline uint64_t hash_wy(const char* p, size_t len){
+	static const uint64_t secret[3] = {
+		UINT64_C(0xa0761d6478bd642f), UINT64_C(0xe7037ed1a0b428db), UINT64_C(0x8ebc6af09c88c6e3)
+	};
+	uint64_t seed = hash_mul_fold(secret[0], secret[1]), a, b;
+	if(len <= 16){
+		if(len >= 4){
+			a = (hash_read32(p) << 32) | hash_read32(p + ((len >> 3) << 2));
+			b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - ((len >> 3) << 2));
+		}else if(len){
+			a = ((uint64_t)(uint8_t) p[0] << 16) | ((uint64_t)(uint8_t) p[len >> 1] << 8) | (uint8_t) p[len - 1];
+			b = 0;
+		}else
+			a = b = 0;
+	}else{
+		size_t i = len;
+		for(; i > 16; i -= 16, p += 16)
+			seed = hash_mul_fold(hash_read64(p) ^ secret[1], hash_read64(p + 8) ^ seed);
+		a = hash_read64(p + i - 16);
+		b = hash_read64(p + i - 8);
+	}
+	__uint128_t r = (__uint128_t)(a ^ secret[1]) * (b ^ seed);
+	return hash_mul_fold((uint64_t) r ^ secret[0] ^ len, (uint64_t)(r >> 64) ^ secret[1]);
+}
+
+// After XXH3: a formula per length class (1-3, 4-8, 9-16, longer) keyed
+// with secret words, longer keys folded 16 bytes at a time from both ends
+static inline uint64_t hash_xxh3_avalanche(uint64_t h){
+	h ^= h >> 37;
+	h *= UINT64_C(0x165667919E3779F9);
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t hash_xxh3(const char* p, size_t len){
+	static const uint64_t secret[8] = {
+		UINT64_C(0xbe4ba423396cfeb8), UINT64_C(0x1cad21f72c81017c), UINT64_C(0xdb979083e96dd4de), UINT64_C(0x1f67b3b7a4a44072),
+		UINT64_C(0x78e5c0cc4ee679cb), UINT64_C(0x2172ffcc7dd05a82), UINT64_C(0x8e2443f7744608b8), UINT64_C(0x4c263a81e69035e0)
+	};
+	const uint64_t prime = UINT64_C(0x9E3779B185EBCA87);
+	if(len > 16){
+		uint64_t acc = len * prime;
+		for(size_t i = 0, j = len - 16; i < j; i += 16, j -= 16){
+			size_t k = (i / 16) % 3 * 2;
+			acc += hash_mul_fold(hash_read64(p + i) ^ secret[k], hash_read64(p + i + 8) ^ secret[k + 1]);
+			acc += hash_mul_fold(hash_read64(p + j) ^ secret[k + 2], hash_read64(p + j + 8) ^ secret[k + 1]);
+		}
+		acc += hash_mul_fold(hash_read64(p + len - 16) ^ secret[6], hash_read64(p + len - 8) ^ secret[7]);
+		return hash_xxh3_avalanche(acc);
+	}
+	if(len > 8){
+		uint64_t lo = hash_read64(p) ^ (secret[3] ^ secret[4]);
+		uint64_t hi = hash_read64(p + len - 8) ^ (secret[5] ^ secret[6]);
+		return hash_xxh3_avalanche(len + __builtin_bswap64(lo) + hi + hash_mul_fold(lo, hi));
+	}
+	if(len >= 4){
+		uint64_t v = (hash_read32(p + len - 4) + (hash_read32(p) << 32)) ^ (secret[1] ^ secret[2]);
+		v ^= (v << 49 | v >> 15) ^ (v << 24 | v >> 40);
+		v *= UINT64_C(0x9FB21C651E98DF25);
+		v ^= (v >> 35) + len;
+		v *= UINT64_C(0x9FB21C651E98DF25);
+		return v ^ (v >> 28);
+	}
+	uint64_t combined = len ? ((uint64_t)(uint8_t) p[0] << 16) | ((uint64_t)(uint8_t) p[len >> 1] << 24) | ((uint64_t)(uint8_t) p[len - 1]) | (len << 8) : 0;
+	return hash_finalize(combined ^ (uint32_t)(secret[0] ^ (secret[0] >> 32)));
+}
+
+#endif
@@ -3,31 +3,67 @@
 #include "datastructures.h"
 #include "tokenizer.h"
 
-arena_t parser_arena;
-file_t* parser_file;
+FL_LOCAL arena_t parser_arena;
+FL_LOCAL file_t* parser_file;
+size_t parser_max_depth = PARSER_MAX_DEPTH;
 
 static void parser_arena_error(const char* func){
 	printf(RED_FG BOLD "parser arena - %s:" YELLOW_FG " %s" RESET_ATTR "\n",func,DS_ERROR_MSG);
 	exit(EXIT_FAILURE);
 }
 
+// Arena blocks the parser already filled up
+static FL_LOCAL parser_arena_list full_arenas = NEW_DYNAMIC_ARRAY(sizeof(arena_t));
+
+// Allocate memory for nodes in the parser arena
+// Chains a new arena block when the current one is full,
+// so previously returned nodes never move
+void* parser_alloc(size_t size){
+	void* ptr = arena_alloc(&parser_arena, size);
+	if(ptr)
+		return ptr;
+	if(!dynamic_array_pushback((dynamic_array_t*)&full_arenas, &parser_arena))
+		parser_arena_error("parser_alloc");
+	parser_arena = (arena_t) NEW_ARENA();
+	if(!arena_setup(&parser_arena, (size > PARSER_ARENA_BLOCK) ? size : PARSER_ARENA_BLOCK))
+		parser_arena_error("parser_alloc");
+	return arena_alloc(&parser_arena, size);
+}
+
 // Get the binary precedence of an operator
 // -1 if it's not an operator
 int8_t tk_bin_prec(token* tk){
 	switch(tk->type){
+	case tk_or:
+		return 0;
+	case tk_xor:
+		return 1;
+	case tk_and:
+		return 2;
+	case tk_cmp_eq:
+	case tk_cmp_neq:
+	case tk_cmp_l:
+	case tk_cmp_leq:
+	case tk_cmp_g:
+	case tk_cmp_geq:
+	case tk_cmp_strict:
+	case tk_cmp_type:
+		return 3;
 	case tk_plus:
 	case tk_minus:
-		return 0;
+		return 4;
 	case tk_mul:
 	case tk_div:
 	case tk_mod:
-		return 1;
+		return 5;
 	default:
 		return -1;
 	}
 }
 
-// Parse a term (unique expression)
+// Parse a term (literal or plain symbol)
+// Composite terms (calls, parentheses, negation) are handled
+// by parse_expr's work stacks so they never recurse
 bool parse_term_expr(node_expr* expr){
 	if(!expr || !tk_peek(0))
 		return false;
@@ -44,89 +80,231 @@ bool parse_term_expr(node_expr* expr){
 	case tk_str_lit:
 		*expr = (node_expr){.str_lit=*tk_consume(0)};
 		break;
-	case tk_symbol:
-		if(tk_peek(1) && tk_peek(1)->type == tk_oparent){
-			*expr = (node_expr){.func_call={tk_func_call, tk_consume(0), (node_expr*)parser_arena.ptr, 0}};
-			(void) tk_consume(0);
-			parse_args(&expr->func_call);
-			if(tk_peek(-1)->type != tk_cparent)
-				tk_error("expected ')'",tk_peek(-1),parser_file);
-		}else
-			*expr = (node_expr){.symbol=*tk_consume(0)};
-		break;
-	case tk_minus:{
-		tk_consume(0);
-		*expr = (node_expr){.binexpr = {tk_binexpr, tk_negation, NULL, NULL}};
-		expr->binexpr.lhs = (node_expr*) arena_alloc(&parser_arena, sizeof(node_expr));
-		if(!expr->binexpr.lhs)
-			parser_arena_error("parse_term_expr");
-		if(!parse_expr(expr->binexpr.lhs, 0))
-			return tk_error("expected valid expression",tk_peek(-1),parser_file);
+	case tk_bool_lit:
+		*expr = (node_expr){.bool_lit=*tk_consume(0)};
 		break;
-	}case tk_oparent:{
-		tk_consume(0);
-		*expr = (node_expr){.binexpr = {tk_binexpr, tk_oparent, NULL, NULL}};
-		expr->binexpr.lhs = (node_expr*) arena_alloc(&parser_arena, sizeof(node_expr));
-		if(!expr->binexpr.lhs)
-			parser_arena_error("parse_term_expr");
-		if(!parse_expr(expr->binexpr.lhs, 0))
-			return tk_error("expected valid expression",tk_peek(-1),parser_file);
-		if(tk_peek(0) && tk_peek(0)->type != tk_cparent)
-			return tk_error("expected ')'",tk_peek(-1),parser_file);
-		(void) tk_consume(0);
+	case tk_symbol:
+		*expr = (node_expr){.symbol=*tk_consume(0)};
 		break;
-	}default:
-		return tk_error("term expression not implemented yet.",tk_peek(0),parser_file);
+	default:
+		return false;
 	}
 	return true;
 }
 
-// Parse an expression recursively with operator precedence
+// Pending operators and open groups of parse_expr
+enum{
+	PARSE_OP_BINARY = 0,
+	PARSE_OP_PREFIX,
+	PARSE_OP_PAREN,
+	PARSE_OP_CALL,
+	PARSE_OP_INDEX,
+};
+typedef struct{
+	uint8_t kind;
+	int8_t prec;
+	token_t op;
+	token* tk;
+	size_t operand_base;	// Operand stack size when a group was opened
+} parse_op;
+
+#define PREFIX_PREC 6
+
+typedef DYNAMIC_ARRAY(parse_op* ops) parse_op_stack;
+typedef DYNAMIC_ARRAY(node_expr** exprs) parse_expr_stack;
+static FL_LOCAL parse_op_stack op_stack = NEW_DYNAMIC_ARRAY(sizeof(parse_op));
+static FL_LOCAL parse_expr_stack expr_stack = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));
+static FL_LOCAL size_t group_depth = 0;
+
+static void push_operand(node_expr* expr){
+	if(!dynamic_array_pushback((dynamic_array_t*)&expr_stack, &expr))
+		parser_arena_error("parse_expr (operand stack)");
+}
+
+static bool push_op(parse_op op){
+	if(op.kind != PARSE_OP_BINARY && ++group_depth > parser_max_depth){
+		char msg[96];
+		snprintf(msg, sizeof(msg), "expression nesting exceeds maximum depth (%lu)", (unsigned long) parser_max_depth);
+		return tk_error(msg, op.tk, parser_file);
+	}
+	if(!dynamic_array_pushback((dynamic_array_t*)&op_stack, &op))
+		parser_arena_error("parse_expr (operator stack)");
+	return true;
+}
+
+// Pops the top operator and folds its operands into a node
+static void reduce_op(void){
+	parse_op op = op_stack.ops[--op_stack.size];
+	node_expr* node = (node_expr*) parser_alloc(sizeof(node_expr));
+	if(op.kind == PARSE_OP_BINARY){
+		node_expr* rhs = expr_stack.exprs[--expr_stack.size];
+		node_expr* lhs = expr_stack.exprs[--expr_stack.size];
+		*node = (node_expr){.binexpr = {tk_binexpr, op.op, lhs, rhs, op.tk}};
+	}else{
+		group_depth--;
+		node_expr* lhs = expr_stack.exprs[--expr_stack.size];
+		*node = (node_expr){.binexpr = {tk_binexpr, op.op, lhs, NULL, op.tk}};
+	}
+	push_operand(node);
+}
+
+// Reduces every operator above the innermost open group
+// whose precedence is at least min_prec
+static void reduce_ops(int8_t min_prec){
+	while(op_stack.size){
+		parse_op* top = &op_stack.ops[op_stack.size-1];
+		if(top->kind >= PARSE_OP_PAREN || top->prec < min_prec)
+			break;
+		reduce_op();
+	}
+}
+
+// Closes the innermost group (parentheses, call arguments or index)
+static void close_group(void){
+	parse_op group = op_stack.ops[--op_stack.size];
+	group_depth--;
+	node_expr* node = (node_expr*) parser_alloc(sizeof(node_expr));
+	if(group.kind == PARSE_OP_PAREN){
+		node_expr* lhs = expr_stack.exprs[--expr_stack.size];
+		*node = (node_expr){.binexpr = {tk_binexpr, tk_oparent, lhs, NULL, group.tk}};
+	}else if(group.kind == PARSE_OP_INDEX){
+		node_expr* key = expr_stack.exprs[--expr_stack.size];
+		*node = (node_expr){.index = {tk_subscript, group.tk, key}};
+	}else{
+		size_t count = expr_stack.size - group.operand_base;
+		node_expr* args = count ? (node_expr*) parser_alloc(count * sizeof(node_expr)) : NULL;
+		for(size_t i = 0; i < count; i++)
+			args[i] = *expr_stack.exprs[group.operand_base + i];
+		expr_stack.size = group.operand_base;
+		*node = (node_expr){.func_call = {tk_func_call, group.tk, args, count}};
+	}
+	push_operand(node);
+}
+
+// Parse an expression with operator precedence
 // Expressions work like binary trees, where the children of nodes
 // are the left hand side and right hand side expressions in an
 // arithmetic operation
+// Nesting is tracked on heap-backed stacks instead of the C stack,
+// and is limited to parser_max_depth open groups / prefix operators
 bool parse_expr(node_expr* expr, int8_t min_prec){
 	if(!expr)
 		parser_arena_error("parse_expr (arg)");
-	if(parse_term_expr(expr)){
-		while(true){
-			token* op_token = tk_peek(0);
-			if(!op_token)
-				break;
-			int8_t op_prec = tk_bin_prec(op_token);
-			if(op_prec == -1 || op_prec < min_prec)
-				break;
-			(void) tk_consume(0);
-
-			// Set the left hand side as expr
-			node_expr* expr_lhs = (node_expr*) arena_alloc(&parser_arena, sizeof(node_expr));
-			if(!expr_lhs)
-				parser_arena_error("parse_expr");
-			*expr_lhs = *expr;
-
-			// Setup the binary expression
-			*expr = (node_expr){.binexpr = {tk_binexpr, op_token->type, expr_lhs, NULL}};
-
-			// Parse the right hand size
-			expr->binexpr.rhs = (node_expr*) arena_alloc(&parser_arena, sizeof(node_expr));
-			if(!expr->binexpr.rhs)
-				parser_arena_error("parse_expr");
-			if(!parse_expr(expr->binexpr.rhs, op_prec + 1))
-				return tk_error("expected expression",tk_peek(-1),parser_file);
+	size_t op_base = op_stack.size, expr_base = expr_stack.size, depth_base = group_depth;
+	bool expect_operand = true;
+	size_t open_groups = 0;
+	while(true){
+		token* tk = tk_peek(0);
+		if(expect_operand){
+			if(!tk)
+				goto fail_expected;
+			if(tk->type == tk_minus){
+				(void) tk_consume(0);
+				if(!push_op((parse_op){PARSE_OP_PREFIX, PREFIX_PREC, tk_negation, tk, 0}))
+					goto fail;
+			}else if(tk->type == tk_oparent){
+				(void) tk_consume(0);
+				if(!push_op((parse_op){PARSE_OP_PAREN, -1, tk_oparent, tk, expr_stack.size}))
+					goto fail;
+				open_groups++;
+			}else if(tk->type == tk_symbol && tk_peek(1) && tk_peek(1)->type == tk_oparent){
+				(void) tk_consume(0);
+				(void) tk_consume(0);
+				if(!push_op((parse_op){PARSE_OP_CALL, -1, tk_func_call, tk, expr_stack.size}))
+					goto fail;
+				open_groups++;
+				if(tk_peek(0) && tk_peek(0)->type == tk_cparent){
+					(void) tk_consume(0);
+					close_group();
+					open_groups--;
+					expect_operand = false;
+				}
+			}else if(tk->type == tk_symbol && tk_peek(1) && tk_peek(1)->type == tk_obracket){
+				(void) tk_consume(0);
+				(void) tk_consume(0);
+				if(!push_op((parse_op){PARSE_OP_INDEX, -1, tk_subscript, tk, expr_stack.size}))
+					goto fail;
+				open_groups++;
+			}else{
+				node_expr* term = (node_expr*) parser_alloc(sizeof(node_expr));
+				if(!parse_term_expr(term)){
+					if(tk_bin_prec(tk) != -1 || tk->type == tk_cparent || tk->type == tk_cbracket || tk->type == tk_comma || tk->type == tk_semicolon)
+						goto fail_expected;
+					tk_error("term expression not implemented yet.",tk,parser_file);
+					goto fail;
+				}
+				push_operand(term);
+				expect_operand = false;
+			}
+			continue;
 		}
-		return true;
+		if(!tk)
+			break;
+		int8_t prec = tk_bin_prec(tk);
+		if(prec != -1 && (open_groups || prec >= min_prec)){
+			(void) tk_consume(0);
+			reduce_ops(prec);
+			if(!push_op((parse_op){PARSE_OP_BINARY, prec, tk->type, tk, 0}))
+				goto fail;
+			expect_operand = true;
+		}else if(open_groups && tk->type == tk_comma && op_stack.size > op_base){
+			reduce_ops(-1);
+			if(op_stack.ops[op_stack.size-1].kind != PARSE_OP_CALL){
+				tk_error((op_stack.ops[op_stack.size-1].kind == PARSE_OP_INDEX) ? "expected ']'" : "expected ')'",tk_peek(-1),parser_file);
+				goto fail;
+			}
+			(void) tk_consume(0);
+			expect_operand = true;
+		}else if(open_groups && (tk->type == tk_cparent || tk->type == tk_cbracket)){
+			reduce_ops(-1);
+			if((op_stack.ops[op_stack.size-1].kind == PARSE_OP_INDEX) != (tk->type == tk_cbracket)){
+				tk_error((tk->type == tk_cbracket) ? "expected ')'" : "expected ']'",tk_peek(-1),parser_file);
+				goto fail;
+			}
+			(void) tk_consume(0);
+			close_group();
+			open_groups--;
+		}else
+			break;
+	}
+	if(open_groups){
+		tk_error("expected ')'",tk_peek(-1),parser_file);
+		goto fail;
 	}
+	reduce_ops(min_prec);
+	*expr = *expr_stack.exprs[--expr_stack.size];
+	return true;
+
+fail_expected:
+	tk_error("expected valid expression",tk_peek(-1),parser_file);
+fail:
+	op_stack.size = op_base;
+	expr_stack.size = expr_base;
+	group_depth = depth_base;
 	return false;
 }
 
+// Argument buffer shared by statement level calls
+typedef DYNAMIC_ARRAY(node_expr* exprs) parse_arg_buffer;
+static FL_LOCAL parse_arg_buffer arg_buffer = NEW_DYNAMIC_ARRAY(sizeof(node_expr));
+
 // Parse the arguments of a function with format:
 // argument, argument, argument ...
+// The arguments are stored contiguously in the parser arena
 bool parse_args(node_func_call* stmt){
+	arg_buffer.size = 0;
+	stmt->exprs = NULL;
+	stmt->expr_count = 0;
+	if(tk_peek(0) && tk_peek(0)->type == tk_cparent){
+		(void) tk_consume(0);
+		return true;
+	}
 	while(true){
-		node_expr* arg = (node_expr*) arena_alloc(&parser_arena, sizeof(node_expr));
-		if(!parse_expr(arg,0))
-			return tk_error("expected valid expression",tk_peek(-1),parser_file);
-		stmt->expr_count++;
+		node_expr arg;
+		if(!parse_expr(&arg,0))
+			return false;
+		if(!dynamic_array_pushback((dynamic_array_t*)&arg_buffer, &arg))
+			parser_arena_error("parse_args");
 		if(tk_peek(0)){
 			if(tk_peek(0)->type == tk_comma){
 				(void) tk_consume(0);
@@ -139,6 +317,164 @@ bool parse_args(node_func_call* stmt){
 			return tk_error("expected token",tk_peek(-1),parser_file);
 		break;
 	}
+	stmt->expr_count = arg_buffer.size;
+	stmt->exprs = (node_expr*) parser_alloc(arg_buffer.size * sizeof(node_expr));
+	memcpy(stmt->exprs, arg_buffer.exprs, arg_buffer.size * sizeof(node_expr));
+	return true;
+}
+
+// Consume preprocessor markers left in the token stream
+// (include boundaries and macro definitions), switching
+// parser_file when crossing include boundaries
+bool parse_directives(void){
+	token* tk;
+	while((tk = tk_peek(0))){
+		switch(tk->type){
+		case tk_end_include:
+		case tk_include:{
+			file_t* new_file = find_file(tk->str,tk->strlen);
+			if(!new_file)
+				return tk_error("failed to find header file",tk,parser_file);
+			parser_file = new_file;
+			(void) tk_consume(0);
+			break;
+		}default:
+			return true;
+		}
+	}
+	return true;
+}
+
+// Parse a condition with format:
+// ( expression )
+bool parse_condition(node_expr* expr){
+	if(!tk_peek(0) || tk_peek(0)->type != tk_oparent)
+		return tk_error("expected '('",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	if(!parse_expr(expr,0))
+		return false;
+	if(!tk_peek(0) || tk_peek(0)->type != tk_cparent)
+		return tk_error("expected ')'",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	return true;
+}
+
+// Parse a block that follows a condition / else
+static bool parse_body(node_scope* body){
+	if(!tk_peek(0) || tk_peek(0)->type != tk_obrace)
+		return tk_error("expected '{'",tk_peek(-1),parser_file);
+	return parse_scope(body);
+}
+
+// Parse an if statement with format:
+// if ( condition ) { ... } elif ( condition ) { ... } else { ... }
+// Every elif becomes an if node in the else branch of the previous one
+bool parse_if(node_stmt* stmt){
+	while(true){
+		stmt->if_stmt = (node_if){.type = tk_if};
+		if(!parse_condition(&stmt->if_stmt.cond) || !parse_body(&stmt->if_stmt.body))
+			return false;
+		if(!tk_peek(0) || (tk_peek(0)->type != tk_elif && tk_peek(0)->type != tk_else))
+			return true;
+		node_stmt* else_body = (node_stmt*) parser_alloc(sizeof(node_stmt));
+		stmt->if_stmt.else_body = else_body;
+		if(tk_consume(0)->type == tk_else){
+			else_body->type = tk_scope;
+			return parse_body(&else_body->scope);
+		}
+		stmt = else_body;
+	}
+}
+
+static bool is_primitive_type(token*);
+
+// Parse a for loop with format:
+// for [parallel] ( type symbol : start, end ) { ... }
+// for [parallel] ( type symbol : list ) { ... }
+// The variable takes every value in [start, end), or every index of the list
+bool parse_for(node_stmt* stmt){
+	stmt->for_stmt = (node_for){.type = tk_for};
+	if(tk_peek(0) && tk_peek(0)->type == tk_obracket){
+		(void) tk_consume(0);
+		if(!tk_peek(0) || tk_peek(0)->type != tk_symbol || !tk_cmp_str(tk_peek(0), "parallel"))
+			return tk_error("expected 'parallel'",tk_peek(0) ? tk_peek(0) : tk_peek(-1),parser_file);
+		(void) tk_consume(0);
+		if(!tk_peek(0) || tk_peek(0)->type != tk_cbracket)
+			return tk_error("expected ']'",tk_peek(-1),parser_file);
+		(void) tk_consume(0);
+		stmt->for_stmt.parallel = true;
+	}
+	if(!tk_peek(0) || tk_peek(0)->type != tk_oparent)
+		return tk_error("expected '('",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	if(!is_primitive_type(tk_peek(0)))
+		return tk_error("expected loop variable type",tk_peek(-1),parser_file);
+	stmt->for_stmt.var_type = tk_consume(0)->type;
+	if(!tk_peek(0) || tk_peek(0)->type != tk_symbol)
+		return tk_error("expected loop variable name",tk_peek(-1),parser_file);
+	stmt->for_stmt.symbol = tk_consume(0);
+	if(!tk_peek(0) || tk_peek(0)->type != tk_colon)
+		return tk_error("expected ':'",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	if(!parse_expr(&stmt->for_stmt.end,0))
+		return false;
+	if(tk_peek(0) && tk_peek(0)->type == tk_comma){
+		(void) tk_consume(0);
+		stmt->for_stmt.start = (node_expr*) parser_alloc(sizeof(node_expr));
+		*stmt->for_stmt.start = stmt->for_stmt.end;
+		if(!parse_expr(&stmt->for_stmt.end,0))
+			return false;
+	}
+	if(!tk_peek(0) || tk_peek(0)->type != tk_cparent)
+		return tk_error("expected ')'",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	return parse_body(&stmt->for_stmt.body);
+}
+
+// Primitive types (what lists and dicts can hold)
+static bool is_primitive_type(token* tk){
+	if(!tk)
+		return false;
+	switch(tk->type){
+	case tk_char:
+	case tk_i8:
+	case tk_u8:
+	case tk_i16:
+	case tk_u16:
+	case tk_i32:
+	case tk_u32:
+	case tk_i64:
+	case tk_u64:
+	case tk_f32:
+	case tk_f64:
+	case tk_str:
+	case tk_bool:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Parse the element types of a container with format:
+// list<type> or dict<key type, value type>
+static bool parse_container_types(token_t type, token_t* elem_type, token_t* key_type){
+	if(!tk_peek(0) || tk_peek(0)->type != tk_cmp_l)
+		return tk_error("expected '<'",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
+	if(type == tk_dict){
+		if(!is_primitive_type(tk_peek(0)))
+			return tk_error("expected key type",tk_peek(-1),parser_file);
+		*key_type = tk_consume(0)->type;
+		if(!tk_peek(0) || tk_peek(0)->type != tk_comma)
+			return tk_error("expected ','",tk_peek(-1),parser_file);
+		(void) tk_consume(0);
+	}
+	if(!is_primitive_type(tk_peek(0)))
+		return tk_error("expected element type",tk_peek(-1),parser_file);
+	*elem_type = tk_consume(0)->type;
+	if(!tk_peek(0) || tk_peek(0)->type != tk_cmp_g)
+		return tk_error("expected '>'",tk_peek(-1),parser_file);
+	(void) tk_consume(0);
 	return true;
 }
 
@@ -159,30 +495,37 @@ bool parse_stmt(node_stmt* stmt){
 	case tk_u32:
 	case tk_i64:
 	case tk_u64:
+	case tk_f32:
+	case tk_f64:
 	case tk_str:
-	case tk_bool:{
+	case tk_bool:
+	case tk_list:
+	case tk_dict:{
 		bool var_const = (tk_peek(0)->type == tk_const);
 		if(var_const) tk_consume(0);
 		if(!tk_peek(0))
 			return tk_error("expected token",tk_peek(-1),parser_file);
 		token_t type = tk_consume(0)->type;
+		token_t elem_type = tk_invalid, key_type = tk_invalid;
+		if((type == tk_list || type == tk_dict) && !parse_container_types(type, &elem_type, &key_type))
+			return false;
 		if(tk_peek(0) && tk_peek(0)->type != tk_symbol)
 			return tk_error("expected symbol after type",tk_peek(-1),parser_file);
 		token* symbol = tk_consume(0);
 		node_expr* expr = NULL;
 		if(tk_peek(0) && tk_peek(0)->type == tk_assign){
 			tk_consume(0);
-			expr = (node_expr*) arena_alloc(&parser_arena,sizeof(node_expr));
-			if(!expr)
-				parser_arena_error("parse_stmt");
+			expr = (node_expr*) parser_alloc(sizeof(node_expr));
 			if(!parse_expr(expr,0))
-				return tk_error("expected valid expression",tk_peek(-1),parser_file);
+				return false;
 			if(!tk_peek(0) || tk_peek(0)->type != tk_semicolon)
 				return tk_error("expected semicolon",tk_peek(-1),parser_file);
 			(void) tk_consume(0);
 		}else if(!tk_peek(0) || tk_peek(0)->type != tk_semicolon)
 			return tk_error("expected semicolon",tk_peek(-1),parser_file);
-		*stmt = (node_stmt){.var_decl=(node_var_decl){tk_var_decl,type,symbol,expr,var_const}};
+		else
+			(void) tk_consume(0);
+		*stmt = (node_stmt){.var_decl=(node_var_decl){tk_var_decl,type,symbol,expr,var_const,elem_type,key_type}};
 		break;
 	}case tk_symbol:{
 		token* symbol = tk_consume(0);
@@ -192,12 +535,29 @@ bool parse_stmt(node_stmt* stmt){
 				(void) tk_consume(0);
 				node_expr expr;
 				if(!parse_expr(&expr,0))
-					return tk_error("expected valid expression",tk_peek(-1),parser_file);
-				*stmt = (node_stmt){.var_assign={tk_var_assign,symbol,expr}};
+					return false;
+				*stmt = (node_stmt){.var_assign={tk_var_assign,symbol,expr,NULL}};
 				break;
+			case tk_obracket:{
+				(void) tk_consume(0);
+				node_expr* index = (node_expr*) parser_alloc(sizeof(node_expr));
+				if(!parse_expr(index,0))
+					return false;
+				if(!tk_peek(0) || tk_peek(0)->type != tk_cbracket)
+					return tk_error("expected ']'",tk_peek(-1),parser_file);
+				(void) tk_consume(0);
+				if(!tk_peek(0) || tk_peek(0)->type != tk_assign)
+					return tk_error("expected '='",tk_peek(-1),parser_file);
+				(void) tk_consume(0);
+				node_expr expr;
+				if(!parse_expr(&expr,0))
+					return false;
+				*stmt = (node_stmt){.var_assign={tk_var_assign,symbol,expr,index}};
+				break;
+			}
 			case tk_oparent:
 				(void) tk_consume(0);
-				*stmt = (node_stmt){.func_call={tk_func_call,symbol,(node_expr*)parser_arena.ptr,0}};
+				*stmt = (node_stmt){.func_call={tk_func_call,symbol,NULL,0}};
 				if(!parse_args(&stmt->func_call))
 					return false;
 				if(tk_peek(-1)->type != tk_cparent)
@@ -213,10 +573,11 @@ bool parse_stmt(node_stmt* stmt){
 			return tk_error("unexpected symbol",tk_peek(-1),parser_file);
 		break;
 	}case tk_getchar:
+	case tk_flush:
 	case tk_input:
 	case tk_putchar:
 	case tk_print:
-		*stmt = (node_stmt){.func_call={tk_peek(0)->type, tk_consume(0), (node_expr*)parser_arena.ptr, 0}};
+		*stmt = (node_stmt){.func_call={tk_peek(0)->type, tk_consume(0), NULL, 0}};
 		if(!tk_peek(0) || tk_peek(0)->type != tk_oparent)
 			return tk_error("expected '('",tk_peek(-1),parser_file);
 		(void) tk_consume(0);
@@ -228,46 +589,215 @@ bool parse_stmt(node_stmt* stmt){
 			return tk_error("expected semicolon",tk_peek(-1),parser_file);
 		(void) tk_consume(0);
 		break;
-	case tk_end_include:
-	case tk_include:{
-		file_t* new_file = find_file(tk_peek(0)->str,tk_peek(0)->strlen);
-		if(!new_file)
-			return tk_error("failed to find header file",tk_peek(0),parser_file);
-		parser_file = new_file;
+	case tk_exit:
+		*stmt = (node_stmt){.exit={tk_exit}};
+		(void) tk_consume(0);
+		if(!tk_peek(0) || tk_peek(0)->type != tk_oparent)
+			return tk_error("expected '('",tk_peek(-1),parser_file);
+		if(!parse_expr(&stmt->exit.expr,0))
+			return false;
+		if(!tk_peek(0) || tk_peek(0)->type != tk_semicolon)
+			return tk_error("expected semicolon",tk_peek(-1),parser_file);
 		(void) tk_consume(0);
-		return parse_stmt(stmt);
 		break;
-	case tk_ifdef:
-	case tk_ifndef:
-	case tk_macro:
+	case tk_obrace:
+		return parse_scope(&stmt->scope);
+	case tk_if:
+		(void) tk_consume(0);
+		return parse_if(stmt);
+	case tk_while:
+		(void) tk_consume(0);
+		stmt->while_stmt = (node_while){.type = tk_while};
+		return parse_condition(&stmt->while_stmt.cond) && parse_body(&stmt->while_stmt.body);
+	case tk_for:
+		(void) tk_consume(0);
+		return parse_for(stmt);
+	case tk_break:
+		*stmt = (node_stmt){.type=tk_break};
+		(void) tk_consume(0);
+		if(!tk_peek(0) || tk_peek(0)->type != tk_semicolon)
+			return tk_error("expected semicolon",tk_peek(-1),parser_file);
 		(void) tk_consume(0);
-		while(tk_peek(0) && tk_peek(0)->type != tk_end_macro)
-			(void) tk_consume(0);
-		tk_consume(0);
-		return parse_stmt(stmt);
 		break;
-	}default:
+	case tk_elif:
+	case tk_else:
+		return tk_error("expected if before elif / else",tk_peek(0),parser_file);
+	default:
 		return tk_error("statement not implemented yet",tk_peek(0),parser_file);
 	}
 	return true;
 }
 
+// Parse a scope with format:
+// { statement statement ... }
+// The statements are stored contiguously in the parser arena
+bool parse_scope(node_scope* scope){
+	static FL_LOCAL size_t scope_depth = 0;
+	token* obrace = tk_consume(0);
+	if(scope_depth >= parser_max_depth){
+		char msg[96];
+		snprintf(msg, sizeof(msg), "scope nesting exceeds maximum depth (%lu)", (unsigned long) parser_max_depth);
+		return tk_error(msg, obrace, parser_file);
+	}
+	scope_depth++;
+	DYNAMIC_ARRAY(node_stmt* stmts) stmts = NEW_DYNAMIC_ARRAY(sizeof(node_stmt));
+	bool success = true;
+	while(true){
+		if(!(success = parse_directives()))
+			break;
+		if(!tk_peek(0)){
+			success = tk_error("expected '}'",tk_peek(-1),parser_file);
+			break;
+		}
+		if(tk_peek(0)->type == tk_cbrace){
+			(void) tk_consume(0);
+			break;
+		}
+		node_stmt stmt;
+		if(!(success = parse_stmt(&stmt)))
+			break;
+		if(!dynamic_array_pushback((dynamic_array_t*)&stmts, &stmt))
+			parser_arena_error("parse_scope");
+	}
+	scope_depth--;
+	if(success){
+		*scope = (node_scope){tk_scope, (node_stmt*) parser_alloc(stmts.size * sizeof(node_stmt)), stmts.size};
+		memcpy(scope->stmts, stmts.stmts, stmts.size * sizeof(node_stmt));
+	}
+	dynamic_array_free((dynamic_array_t*)&stmts);
+	return success;
+}
+
 // Free all resources the parser takes up
 void parser_free(node_prog* prog){
 	if(prog)
 		dynamic_array_free((dynamic_array_t*)prog);
+	for(size_t i = 0; i < full_arenas.size; i++)
+		arena_destroy(&full_arenas.arenas[i]);
+	dynamic_array_free((dynamic_array_t*)&full_arenas);
 	arena_destroy(&parser_arena);
+	dynamic_array_free((dynamic_array_t*)&op_stack);
+	dynamic_array_free((dynamic_array_t*)&expr_stack);
+	dynamic_array_free((dynamic_array_t*)&arg_buffer);
+}
+
+// Moves every arena block of the parsed program into (arenas), so its nodes
+// outlive parser_free and the parser can start on another program
+void parser_take_arenas(parser_arena_list* arenas){
+	if(parser_arena.memory && !dynamic_array_pushback((dynamic_array_t*)&full_arenas, &parser_arena))
+		parser_arena_error("parser_take_arenas");
+	*arenas = full_arenas;
+	full_arenas = (parser_arena_list) NEW_DYNAMIC_ARRAY(sizeof(arena_t));
+	parser_arena = (arena_t) NEW_ARENA();
+}
+
+void parser_free_arenas(parser_arena_list* arenas){
+	for(size_t i = 0; i < arenas->size; i++)
+		arena_destroy(&arenas->arenas[i]);
+	dynamic_array_free((dynamic_array_t*)arenas);
+}
+
+// Bytes handed out by the parser arena
+// Nodes are never freed before parser_free, so this is also the high-water mark
+size_t parser_arena_used(void){
+	size_t used = parser_arena.ptr - parser_arena.memory;
+	for(size_t i = 0; i < full_arenas.size; i++)
+		used += full_arenas.arenas[i].ptr - full_arenas.arenas[i].memory;
+	return used;
+}
+
+// Expression nodes of an expression, walked with a work stack
+// since operator chains can be arbitrarily deep
+static size_t count_expr(node_expr* expr){
+	parse_expr_stack work = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));
+	size_t count = 0;
+	while(expr){
+		count++;
+		if(expr->type == tk_binexpr){
+			if(expr->binexpr.rhs && !dynamic_array_pushback((dynamic_array_t*)&work, &expr->binexpr.rhs))
+				parser_arena_error("parser_count_nodes");
+			if(!dynamic_array_pushback((dynamic_array_t*)&work, &expr->binexpr.lhs))
+				parser_arena_error("parser_count_nodes");
+		}else if(expr->type == tk_subscript){
+			if(!dynamic_array_pushback((dynamic_array_t*)&work, &expr->index.key))
+				parser_arena_error("parser_count_nodes");
+		}else if(expr->type == tk_func_call){
+			for(size_t i = 0; i < expr->func_call.expr_count; i++){
+				node_expr* arg = &expr->func_call.exprs[i];
+				if(!dynamic_array_pushback((dynamic_array_t*)&work, &arg))
+					parser_arena_error("parser_count_nodes");
+			}
+		}
+		expr = work.size ? work.exprs[--work.size] : NULL;
+	}
+	dynamic_array_free((dynamic_array_t*)&work);
+	return count;
+}
+
+static size_t count_scope(node_scope*);
+
+static size_t count_stmt(node_stmt* stmt){
+	size_t count = 0;
+	// elif chains are followed in a loop, scopes are bounded by parser_max_depth
+	while(stmt){
+		count++;
+		switch(stmt->type){
+		case tk_var_decl:
+			return count + (stmt->var_decl.expr ? count_expr(stmt->var_decl.expr) : 0);
+		case tk_var_assign:
+			return count + count_expr(&stmt->var_assign.expr) + (stmt->var_assign.index ? count_expr(stmt->var_assign.index) : 0);
+		case tk_exit:
+			return count + count_expr(&stmt->exit.expr);
+		case tk_scope:
+			return count + count_scope(&stmt->scope);
+		case tk_while:
+			return count + count_expr(&stmt->while_stmt.cond) + count_scope(&stmt->while_stmt.body);
+		case tk_for:
+			return count + (stmt->for_stmt.start ? count_expr(stmt->for_stmt.start) : 0)
+				+ count_expr(&stmt->for_stmt.end) + count_scope(&stmt->for_stmt.body);
+		case tk_if:
+			count += count_expr(&stmt->if_stmt.cond) + count_scope(&stmt->if_stmt.body);
+			stmt = stmt->if_stmt.else_body;
+			break;
+		case tk_break:
+			return count;
+		default:	// Function calls and built-in statements
+			for(size_t i = 0; i < stmt->func_call.expr_count; i++)
+				count += count_expr(&stmt->func_call.exprs[i]);
+			return count;
+		}
+	}
+	return count;
+}
+
+static size_t count_scope(node_scope* scope){
+	size_t count = 0;
+	for(size_t i = 0; i < scope->stmt_count; i++)
+		count += count_stmt(&scope->stmts[i]);
+	return count;
+}
+
+// Statement and expression nodes of a parsed program
+size_t parser_count_nodes(node_prog* prog){
+	size_t count = 0;
+	for(size_t i = 0; i < prog->size; i++)
+		count += count_stmt(&prog->stmts[i]);
+	return count;
 }
 
 // Parse all tokens created during the tokenization phase,
 // as a node_prog dynamic array
 bool parse(node_prog* prog, file_t* file){
 	parser_file = file;
-	tk_index = 0;
-	if(!arena_setup(&parser_arena, 64*KB))
+	tk_rewind();
+	if(!arena_setup(&parser_arena, PARSER_ARENA_BLOCK))
 		parser_arena_error("parse");
 	*prog = (node_prog) NEW_DYNAMIC_ARRAY(sizeof(node_stmt));
-	while(tk_peek(0)){
+	while(true){
+		if(!parse_directives())
+			return false;
+		if(!tk_peek(0))
+			break;
 		node_stmt stmt;
 		if(!parse_stmt(&stmt))
 			return false;
@@ -11,8 +11,17 @@
 #include <stdint.h>
 #include <string.h>
 
-extern arena_t parser_arena;
-extern file_t* parser_file;
+extern FL_LOCAL arena_t parser_arena;
+extern FL_LOCAL file_t* parser_file;
+
+// Maximum amount of nested groups / prefix operators in an expression
+#define PARSER_MAX_DEPTH 4096
+extern size_t parser_max_depth;
+
+#define PARSER_ARENA_BLOCK 64*KB
+
+// Arena blocks holding the nodes of a program
+typedef DYNAMIC_ARRAY(arena_t* arenas) parser_arena_list;
 
 typedef token_t node_t;
 
@@ -23,6 +32,7 @@ typedef struct{
 	node_t type;	// tk_binexpr
 	token_t op;		// operator (tk_plus, tk_minus, tk_mul, etc.)
 	union node_expr *lhs, *rhs;
+	token* op_token;
 } node_binexpr;
 
 typedef struct{
@@ -32,6 +42,12 @@ typedef struct{
 	size_t expr_count;
 } node_func_call;
 
+typedef struct{
+	node_t type;	// tk_subscript
+	token* symbol;	// list / dict variable
+	union node_expr* key;
+} node_index;
+
 typedef struct{
 	node_t type;
 	token* symbol;
@@ -48,11 +64,13 @@ typedef union node_expr {
 	token int_lit;			// tk_int_lit
 	token float_lit;		// tk_float_lit
 	token str_lit;			// tk_str_lit
+	token bool_lit;			// tk_bool_lit
 	token symbol;			// tk_symbol
 	node_func_call func_call;// tk_func_call
 	node_sizeof size_of;	// tk_sizeof
 	node_sizeof type_of;	// tk_typeof
 	node_binexpr binexpr;	// tk_binexpr
+	node_index index;		// tk_subscript
 } node_expr;
 
 typedef struct{
@@ -67,12 +85,15 @@ typedef struct{
 	token* symbol;
 	node_expr* expr;
 	bool constant;
+	token_t elem_type;	// list / dict element (value) type
+	token_t key_type;	// dict key type
 } node_var_decl;
 
 typedef struct{
 	node_t type;	// tk_var_assign
 	token* symbol;
 	node_expr expr;
+	node_expr* index;	// symbol[index] = expr, NULL for the variable itself
 } node_var_assign;
 
 typedef struct{
@@ -80,6 +101,29 @@ typedef struct{
 	node_expr expr;
 } node_exit;
 
+typedef struct{
+	node_t type;	// tk_if
+	node_expr cond;
+	node_scope body;
+	union node_stmt* else_body;	// tk_if (elif), tk_scope (else) or NULL
+} node_if;
+
+typedef struct{
+	node_t type;	// tk_while
+	node_expr cond;
+	node_scope body;
+} node_while;
+
+typedef struct{
+	node_t type;	// tk_for
+	token_t var_type;
+	token* symbol;
+	node_expr* start;	// NULL: the indices of the list (end)
+	node_expr end;
+	node_scope body;
+	bool parallel;
+} node_for;
+
 typedef union node_stmt {
 	node_t type;
 	node_var_decl var_decl;
@@ -87,20 +131,31 @@ typedef union node_stmt {
 	node_func_call func_call;
 	node_scope scope;
 	node_exit exit;
+	node_if if_stmt;
+	node_while while_stmt;
+	node_for for_stmt;
 } node_stmt;
 
 typedef DYNAMIC_ARRAY(node_stmt* stmts) node_prog;
 
+void* parser_alloc(size_t);
 int8_t tk_bin_prec(token*);
 bool parse_term_expr(node_expr*);
 bool parse_expr(node_expr*,int8_t);
 bool parse_cmp(node_expr*);
 bool parse_condition(node_expr*);
 bool parse_args(node_func_call*);
+bool parse_directives(void);
 bool parse_stmt(node_stmt*);
 bool parse_scope(node_scope*);
+bool parse_if(node_stmt*);
+bool parse_for(node_stmt*);
 void parser_free_stmt(node_stmt*);
 void parser_free(node_prog*);
+void parser_take_arenas(parser_arena_list*);
+void parser_free_arenas(parser_arena_list*);
+size_t parser_arena_used(void);
+size_t parser_count_nodes(node_prog*);
 
 bool parse(node_prog*,file_t*);
 
@@ -0,0 +1,115 @@
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+uint8_t stats_format = stats_off;
+size_t stats_arena_peak = 0;
+
+typedef DYNAMIC_ARRAY(stats_file_t* files) stats_file_list;
+typedef DYNAMIC_ARRAY(stats_phase_t* phases) stats_phase_list;
+static stats_file_list files = NEW_DYNAMIC_ARRAY(sizeof(stats_file_t));
+static stats_phase_list phases = NEW_DYNAMIC_ARRAY(sizeof(stats_phase_t));
+
+uint64_t stats_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Record of a file, created the first time it is asked for
+// A file included several times adds up in the same record
+// NULL when out of memory, in which case nothing is recorded
+stats_file_t* stats_file(const char* path){
+	for(size_t i = 0; i < files.size; i++)
+		if(!strcmp(files.files[i].path, path))
+			return &files.files[i];
+	stats_file_t file = {path, 0, 0, 0, 0, 0};
+	if(!dynamic_array_pushback((dynamic_array_t*)&files, &file))
+		return NULL;
+	return &files.files[files.size-1];
+}
+
+void stats_phase(const char* name, uint64_t ns, const char* unit, size_t count){
+	stats_phase_t phase = {name, ns, unit, count};
+	(void) dynamic_array_pushback((dynamic_array_t*)&phases, &phase);
+}
+
+static void json_string(FILE* out, const char* str){
+	fputc('"', out);
+	for(; *str; str++){
+		if(*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char) *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+static void print_json(FILE* out){
+	fprintf(out, "{\"files\":[");
+	for(size_t i = 0; i < files.size; i++){
+		stats_file_t* file = &files.files[i];
+		fprintf(out, i ? ",{\"path\":" : "{\"path\":");
+		json_string(out, file->path);
+		fprintf(out, ",\"bytes\":%lu,\"load_ms\":%.3f,\"tokenize_ms\":%.3f,\"tokens\":%lu,\"macro_expansions\":%lu}",
+			(unsigned long) file->bytes, file->load_ns / 1e6, file->tokenize_ns / 1e6,
+			(unsigned long) file->tokens, (unsigned long) file->macro_expansions);
+	}
+	fprintf(out, "],\"phases\":[");
+	for(size_t i = 0; i < phases.size; i++){
+		stats_phase_t* phase = &phases.phases[i];
+		fprintf(out, i ? ",{\"name\":" : "{\"name\":");
+		json_string(out, phase->name);
+		fprintf(out, ",\"ms\":%.3f", phase->ns / 1e6);
+		if(phase->unit){
+			fputc(',', out);
+			json_string(out, phase->unit);
+			fprintf(out, ":%lu", (unsigned long) phase->count);
+		}
+		fputc('}', out);
+	}
+	fprintf(out, "],\"parser_arena_peak\":%lu}\n", (unsigned long) stats_arena_peak);
+}
+
+static void print_text(FILE* out){
+	size_t bytes = 0, tokens = 0, macros = 0;
+	uint64_t load_ns = 0, tokenize_ns = 0;
+	fprintf(out, "stats: %10s %10s %12s %10s %8s  %s\n", "bytes", "load ms", "tokenize ms", "tokens", "macros", "file");
+	for(size_t i = 0; i < files.size; i++){
+		stats_file_t* file = &files.files[i];
+		fprintf(out, "stats: %10lu %10.3f %12.3f %10lu %8lu  %s\n",
+			(unsigned long) file->bytes, file->load_ns / 1e6, file->tokenize_ns / 1e6,
+			(unsigned long) file->tokens, (unsigned long) file->macro_expansions, file->path);
+		bytes += file->bytes;
+		load_ns += file->load_ns;
+		tokenize_ns += file->tokenize_ns;
+		tokens += file->tokens;
+		macros += file->macro_expansions;
+	}
+	if(files.size > 1)
+		fprintf(out, "stats: %10lu %10.3f %12.3f %10lu %8lu  [total]\n",
+			(unsigned long) bytes, load_ns / 1e6, tokenize_ns / 1e6, (unsigned long) tokens, (unsigned long) macros);
+	for(size_t i = 0; i < phases.size; i++){
+		stats_phase_t* phase = &phases.phases[i];
+		fprintf(out, "stats: %s %.3f ms", phase->name, phase->ns / 1e6);
+		if(phase->unit)
+			fprintf(out, ", %lu %s", (unsigned long) phase->count, phase->unit);
+		fputc('\n', out);
+	}
+	fprintf(out, "stats: parser arena peak %lu bytes\n", (unsigned long) stats_arena_peak);
+}
+
+void stats_print(FILE* out){
+	if(stats_format == stats_json)
+		print_json(out);
+	else if(stats_format == stats_text)
+		print_text(out);
+}
+
+void stats_free(void){
+	dynamic_array_free((dynamic_array_t*)&files);
+	dynamic_array_free((dynamic_array_t*)&phases);
+}
@@ -0,0 +1,47 @@
+#ifndef FERRO_STATS_H
+#define FERRO_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "datastructures.h"
+
+// Front-end statistics (--stats)
+// Every loaded file records its size and how long it took to load and
+// tokenize; tokenize time, tokens and macro expansions of a file exclude
+// the files it includes
+// The phases after tokenization are recorded as a whole, with a count
+// of what they produced
+enum{
+	stats_off = 0,
+	stats_text,
+	stats_json,
+};
+
+typedef struct{
+	const char* path;
+	size_t bytes;
+	uint64_t load_ns;
+	uint64_t tokenize_ns;
+	size_t tokens;
+	size_t macro_expansions;
+} stats_file_t;
+
+typedef struct{
+	const char* name;
+	uint64_t ns;
+	const char* unit;	// What count is (NULL for none)
+	size_t count;
+} stats_phase_t;
+
+extern uint8_t stats_format;
+extern size_t stats_arena_peak;	// Bytes of parser arena in use after parsing
+
+uint64_t stats_clock(void);
+stats_file_t* stats_file(const char*);
+void stats_phase(const char*,uint64_t,const char*,size_t);
+void stats_print(FILE*);
+void stats_free(void);
+
+#endif
@@ -1,6 +1,7 @@
 #include "tokenizer.h"
 #include "datastructures.h"
 #include "filemanager.h"
+#include "stats.h"
 
 // All basic keywords
 struct tk_keyword{
@@ -13,13 +14,21 @@ static const struct tk_keyword tk_keywords[] = {
 	TK_KW(constexpr),
 	TK_KW(char),
 	TK_KW(i8),
+	TK_KW(u8),
 	TK_KW(i16),
+	TK_KW(u16),
 	TK_KW(i32),
+	TK_KW(u32),
 	TK_KW(i64),
+	TK_KW(u64),
+	TK_KW(f32),
+	TK_KW(f64),
 	TK_KW(bool),
 	TK_KW(str),
 	TK_KW(arr),
 	TK_KW(ptr),
+	TK_KW(list),
+	TK_KW(dict),
 	{"true",tk_bool_lit},
 	{"false",tk_bool_lit},
 	TK_KW(if),
@@ -27,6 +36,7 @@ static const struct tk_keyword tk_keywords[] = {
 	TK_KW(else),
 	TK_KW(while),
 	TK_KW(for),
+	TK_KW(break),
 	TK_KW(ret),
 	TK_KW(sizeof),
 	TK_KW(typeof),
@@ -34,6 +44,7 @@ static const struct tk_keyword tk_keywords[] = {
 	TK_KW(putchar),
 	TK_KW(input),
 	TK_KW(getchar),
+	TK_KW(flush),
 	TK_KW(exit),
 	TK_KW(or),
 	TK_KW(and),
@@ -42,11 +53,20 @@ static const struct tk_keyword tk_keywords[] = {
 };
 
 // Token dynamic array
-tk_array_t tk_array = NEW_DYNAMIC_ARRAY(sizeof(token));
-size_t tk_index = 0;
+FL_LOCAL tk_array_t tk_array = NEW_DYNAMIC_ARRAY(sizeof(token));
+FL_LOCAL size_t tk_index = 0;
 
 // Macro dynamic array
-macro_array_t macro_array = NEW_DYNAMIC_ARRAY(sizeof(macro));
+FL_LOCAL macro_array_t macro_array = NEW_DYNAMIC_ARRAY(sizeof(macro));
+
+// Conditional regions being tokenized, true once in their #else
+typedef DYNAMIC_ARRAY(bool* elses) tk_condition_stack;
+static FL_LOCAL tk_condition_stack tk_conditions = NEW_DYNAMIC_ARRAY(sizeof(bool));
+
+// Macro bodies the cursor is in, innermost last
+FL_LOCAL tk_expansion_stack tk_expansions = NEW_DYNAMIC_ARRAY(sizeof(tk_expansion));
+FL_LOCAL tk_use_list tk_uses = NEW_DYNAMIC_ARRAY(sizeof(tk_use));
+static FL_LOCAL token* tk_prev = NULL;	// Last consumed token
 
 // Push token to the back of tk_array
 // Grows tk_array if needed
@@ -61,22 +81,118 @@ void tk_pushback(token tk){
 void tk_free(void){
 	dynamic_array_free((dynamic_array_t*) &tk_array);
 	dynamic_array_free((dynamic_array_t*) &macro_array);
+	dynamic_array_free((dynamic_array_t*) &tk_expansions);
+	tk_free_uses(&tk_uses);
+	dynamic_array_free((dynamic_array_t*) &tk_conditions);
+	tk_prev = NULL;
+}
+
+void tk_free_uses(tk_use_list* uses){
+	for(size_t i = 0; i < uses->size; i++)
+		free(uses->uses[i].tks);
+	dynamic_array_free((dynamic_array_t*) uses);
+}
+
+// Token at index (i) as the parser sees it, with the (depth) innermost
+// frames of tk_expansions around it: in a body, the copy of its use
+static token* tk_at(size_t i, size_t depth){
+	if(depth && depth <= tk_expansions.size){
+		tk_use* use = &tk_uses.uses[tk_expansions.frames[depth-1].use];
+		if(i >= use->body && i < use->body + use->size)
+			return &use->tks[i - use->body];
+	}
+	return &tk_array.tks[i];
+}
+
+// Starts a use of the macro referenced at index (i)
+// Returns its index in tk_uses
+static size_t tk_new_use(size_t i){
+	size_t depth = tk_expansions.size;
+	tk_use use = {
+		tk_at(i, depth), depth ? tk_expansions.frames[depth-1].use : TK_NO_USE,
+		macro_array.macros[tk_array.tks[i].strlen].macro_start + 1, 0, NULL
+	};
+	while(use.body + use.size < tk_array.size && tk_array.tks[use.body + use.size].type != tk_end_macro)
+		use.size++;
+	use.tks = (token*) malloc(use.size * sizeof(token));
+	if(!use.tks || !dynamic_array_pushback((dynamic_array_t*) &tk_uses, &use)){
+		printf("token array error: %s\n",DS_ERROR_MSG);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(use.tks, tk_array.tks + use.body, use.size * sizeof(token));
+	return tk_uses.size - 1;
+}
+
+// Moves index (i) to the next token the parser sees:
+// skips macro definitions, enters macro references
+// and returns from the end of macro bodies
+// (depth) is the number of bodies (i) is in. Frames are only pushed when
+// (depth) is the size of tk_expansions, lookahead just descends and keeps
+// in (known) how many of the frames it is still in:
+// macro bodies are never empty, so no return follows before a plain token
+static size_t tk_settle(size_t i, size_t* depth, size_t* known){
+	bool push = (depth == &tk_expansions.size);
+	while(i < tk_array.size){
+		token* tk = &tk_array.tks[i];
+		if(tk->type == tk_end_macro && *depth){
+			i = tk_expansions.frames[--(*depth)].ret;
+			if(known && *depth < *known)
+				*known = *depth;
+		}
+		else if(tk->type == tk_macro){
+			while(i < tk_array.size && tk_array.tks[i].type != tk_end_macro)
+				i++;
+			i++;
+		}else if(tk->type == tk_macro_ref){
+			if(push){
+				tk_expansion frame = {i+1, tk_new_use(i)};
+				if(!dynamic_array_pushback((dynamic_array_t*) &tk_expansions, &frame)){
+					printf("token array error: %s\n",DS_ERROR_MSG);
+					exit(EXIT_FAILURE);
+				}
+			}else
+				(*depth)++;
+			i = macro_array.macros[tk->strlen].macro_start + 1;
+		}else
+			break;
+	}
+	return i;
+}
+
+// Puts the cursor back on the first token
+// Uses walked into before are dropped
+void tk_rewind(void){
+	tk_free_uses(&tk_uses);
+	tk_expansions.size = 0;
+	tk_prev = NULL;
+	tk_index = tk_settle(0, &tk_expansions.size, NULL);
 }
 
 // Get the nth token after current index,
 // without changing the index
+// Looks from one token back (-1) up to one token ahead (1)
 token* tk_peek(int n){
-	if(tk_index+n < 0 || tk_index+n >= tk_array.size)
+	if(n < 0)
+		return (n == -1) ? tk_prev : NULL;
+	if(n > 1 || tk_index >= tk_array.size)
 		return NULL;
-	return &tk_array.tks[tk_index+n];
+	if(!n)
+		return tk_at(tk_index, tk_expansions.size);
+	// A use lookahead enters has no copies yet, its tokens are the originals
+	size_t depth = tk_expansions.size, known = depth;
+	size_t i = tk_settle(tk_index+1, &depth, &known);
+	return (i < tk_array.size) ? tk_at(i, (depth <= known) ? depth : 0) : NULL;
 }
 
 // Consume the nth token after current index,
-// incrementing the index by one
+// moving the index to the next token
 token* tk_consume(int n){
-	if(tk_index+n < 0 || tk_index+n >= tk_array.size)
+	token* tk = tk_peek(n);
+	if(!tk)
 		return NULL;
-	return &tk_array.tks[n+(tk_index++)];
+	tk_prev = tk_at(tk_index, tk_expansions.size);
+	tk_index = tk_settle(tk_index+1, &tk_expansions.size, NULL);
+	return tk;
 }
 
 // Prints the full line of code where the token comes from
@@ -86,7 +202,7 @@ void tk_print_context(const char* tk, uint32_t len, const char* src){
 	line_start--;
 	int line_end = 1;
 	for(; *(tk+line_end+len) &&  *(tk+line_end+len) != '\n'; line_end++);
-	printf(
+	fprintf(FL_OUTPUT,
 		RESET_ATTR BOLD BLACK_FG ">>>>>------------------<<<<<"
 		"\n" WHITE_FG "%.*s" UNDERLINED YELLOW_FG "%.*s" NOT_UNDERLINED WHITE_FG "%.*s\n"
 		BLACK_FG">>>>>------------------<<<<<" RESET_ATTR "\n\n",
@@ -120,29 +236,87 @@ bool tk_cmp_strlen(token* tk1, const char* str, uint32_t strlen){
 	return true;
 }
 
+// Use of a macro the token is a copy from (TK_NO_USE if none)
+size_t tk_use_of(const token* tk){
+	for(size_t i = 0; i < tk_uses.size; i++)
+		if(tk >= tk_uses.uses[i].tks && tk < tk_uses.uses[i].tks + tk_uses.uses[i].size)
+			return i;
+	return TK_NO_USE;
+}
+
 bool tk_error(const char* msg, token* tk, file_t* file){
-	unsigned int line_number = 1;
 	if(!tk)
 		tk = &tk_array.tks[0];
-	const char* str = tk->str;
-	for(;str >= file->contents && *str; str++)
-		if(*str == '\n')
-			line_number++;
-	printf("\n" RESET_ATTR GREEN_FG BOLD ITALIC "%s:%u" RESET_ATTR " - " RED_FG BOLD,file->path,line_number);
-	puts(msg);
-	tk_print_context(tk->str, tk->strlen, file->contents);
+	// Tokens of a macro body point into the file defining it
+	file_t* tk_file = find_file_ptr(tk->str);
+	if(!tk_file)
+		tk_file = file;
+	unsigned int line_number = file_line(tk_file, tk->str);
+	fprintf(FL_OUTPUT, "\n" RESET_ATTR GREEN_FG BOLD ITALIC "%s:%u" RESET_ATTR " - " RED_FG BOLD "%s\n",tk_file->path,line_number,msg);
+	tk_print_context(tk->str, tk->strlen, tk_file->contents);
+	// Uses of the macros the token was expanded from, innermost first
+	for(size_t i = tk_use_of(tk); i != TK_NO_USE; i = tk_uses.uses[i].parent){
+		token* ref = tk_uses.uses[i].ref;
+		macro* m = &macro_array.macros[ref->strlen];
+		file_t* ref_file = find_file_ptr(ref->str);
+		if(!ref_file)
+			continue;
+		fprintf(FL_OUTPUT, RESET_ATTR GREEN_FG BOLD ITALIC "%s:%u" RESET_ATTR " - in expansion of macro %.*s\n",
+			ref_file->path,file_line(ref_file, ref->str),m->symbol_len,m->symbol);
+		tk_print_context(ref->str, m->symbol_len, ref_file->contents);
+	}
 	return false;
 }
 
 #define TOKENIZE_ERR(_msg) do{ (void) tk_error((_msg),&tk,file); tk_free(); return false;}while(0)
 
+#define TK_DIRECTIVE(_str, _len, _name) ((_len) == sizeof(_name)-1 && !memcmp((_str), (_name), (_len)))
+
+// Skips an inactive conditional region, starting after its directive
+// Inactive code is never tokenized: only lines starting with '#' are
+// looked at, found with memchr, to follow nested conditionals
+// Stops after the #endif closing the region, or its #else when (at_else)
+// is given, which is then set if that is where it stopped
+// NULL if the region is not closed before (end)
+static const char* tk_skip_region(const char* str, const char* end, bool* at_else){
+	size_t depth = 0;
+	while((str = (const char*) memchr(str, '#', end - str))){
+		if(*(str-1) != '\n'){
+			str++;
+			continue;
+		}
+		const char* word = ++str;
+		while(isalpha(*str)) str++;
+		size_t len = str - word;
+		if(TK_DIRECTIVE(word, len, "ifdef") || TK_DIRECTIVE(word, len, "ifndef"))
+			depth++;
+		else if(TK_DIRECTIVE(word, len, "endif")){
+			if(!depth)
+				return str;
+			depth--;
+		}else if(TK_DIRECTIVE(word, len, "else") && !depth && at_else){
+			*at_else = true;
+			return str;
+		}
+	}
+	return NULL;
+}
+
+// Time, tokens and macro expansions of the files included
+// by the one being tokenized, subtracted from its own
+static FL_LOCAL uint64_t included_ns = 0;
+static FL_LOCAL size_t included_tokens = 0;
+static FL_LOCAL size_t macro_expansions = 0;
+
 // Tokenizes (classifies words as tokens)
 // the contents of the file passed as arg
-bool tokenize(file_t* file){
+static bool tokenize_file(file_t* file){
 	bool recording_macro = false;
 	if(!file->contents)
 		return false;
 	const char* str = file->contents;
+	const char* end = file->contents + file->size;
+	size_t conditions_base = tk_conditions.size;	// Conditionals close in the file opening them
 	while(*str){
 		if(recording_macro && *str == '\n' && *(str-1) != '\\'){
 			tk_pushback((token){tk_end_macro,0,NULL});
@@ -165,21 +339,14 @@ bool tokenize(file_t* file){
 			if(tk.type == tk_symbol){
 				for(size_t i = 0; i < macro_array.size; i++)
 					if(tk_cmp_strlen(&tk, macro_array.macros[i].symbol, macro_array.macros[i].symbol_len)){
-						// Fixed
-						token* tk_ptr = &tk_array.tks[macro_array.macros[i].macro_start+1];
-						size_t macro_size = 0;
-						while(tk_ptr->type != tk_end_macro){
-							macro_size++;
-							tk_ptr++;
-						}
-						dynamic_array_grow((dynamic_array_t*)&tk_array, macro_size);
-
-						tk_ptr -= macro_size;
-						while(tk_ptr->type != tk_end_macro){
-							tk_pushback(*tk_ptr);
-							tk_ptr++;
-						}
+						if(recording_macro && i == macro_array.size-1)
+							TOKENIZE_ERR("macro refers to itself");
+						// Empty macros expand to nothing, so every reference
+						// has at least one token to walk into
+						if(tk_array.tks[macro_array.macros[i].macro_start+1].type != tk_end_macro)
+							tk_pushback((token){tk_macro_ref, (uint32_t) i, tk.str});
 						tk.type = tk_invalid;
+						macro_expansions++;
 						break;
 					}
 			}
@@ -328,13 +495,12 @@ bool tokenize(file_t* file){
 						char* file_path = (char*) malloc(tk.strlen+1);
 						memcpy((void*)file_path,(void*)tk.str,tk.strlen);
 						file_path[tk.strlen] = '\0';
-						file_t include_file = new_file(file_path);
-						if(!load_file(&include_file)){
+						file_t* include_file = open_file(file_path);
+						if(!include_file){
 							tk_free();
 							return false;
 						}
-						append_file_list(include_file);
-						if(!tokenize(&include_file))
+						if(!tokenize(include_file))
 							return false;
 						tk.type = tk_end_include;
 						tk.str = file->path;
@@ -357,7 +523,11 @@ bool tokenize(file_t* file){
 						macro new_macro = {tk.str, tk_array.size, tk.strlen};
 						dynamic_array_pushback((dynamic_array_t*) &macro_array, &new_macro);
 						recording_macro = true;
-					}else if(tk_cmp_str(&tk, "#ifdef")){
+						// The newline after the name ends an empty macro
+						tk_pushback(tk);
+						tk.type = tk_invalid;
+					}else if(tk_cmp_str(&tk, "#ifdef") || tk_cmp_str(&tk, "#ifndef")){
+						bool ifndef = tk_cmp_str(&tk, "#ifndef");
 						while(isspace(*str)){
 							if(*str == '\n')
 								TOKENIZE_ERR("expected macro name");
@@ -368,21 +538,33 @@ bool tokenize(file_t* file){
 							TOKENIZE_ERR("macro name should start with a letter (A-Z)");
 						str++;
 						while(isalnum(*str) || *str == '_') str++;
-						tk = (token) {tk_ifdef, str - tk.str, tk.str};
-					}else if(tk_cmp_str(&tk, "#ifndef")){
-						while(isspace(*str)){
-							if(*str == '\n')
-								TOKENIZE_ERR("expected macro name");
-							str++;
+						tk.strlen = str - tk.str;
+						bool defined = false;
+						for(size_t i = 0; i < macro_array.size && !defined; i++)
+							defined = tk_cmp_strlen(&tk, macro_array.macros[i].symbol, macro_array.macros[i].symbol_len);
+						bool in_else = false;
+						if(defined == ifndef && !(str = tk_skip_region(str, end, &in_else)))
+							TOKENIZE_ERR("conditional was not closed before end of file");
+						// Whichever branch is taken is tokenized up to its #else / #endif
+						if((defined != ifndef || in_else) && !dynamic_array_pushback((dynamic_array_t*) &tk_conditions, &in_else)){
+							printf("token array error: %s\n",DS_ERROR_MSG);
+							exit(EXIT_FAILURE);
 						}
-						tk.str = str;
-						if(!isalpha(*str))
-							TOKENIZE_ERR("macro name should start with a letter (A-Z)");
-						str++;
-						while(isalnum(*str) || *str == '_') str++;
-						tk = (token) {tk_ifndef, str - tk.str, tk.str};
+						tk.type = tk_invalid;
+					}else if(tk_cmp_str(&tk, "#else")){
+						if(tk_conditions.size == conditions_base)
+							TOKENIZE_ERR("#else without #ifdef / #ifndef");
+						if(tk_conditions.elses[tk_conditions.size-1])
+							TOKENIZE_ERR("conditional already has an #else");
+						if(!(str = tk_skip_region(str, end, NULL)))
+							TOKENIZE_ERR("conditional was not closed before end of file");
+						tk_conditions.size--;
+						tk.type = tk_invalid;
 					}else if(tk_cmp_str(&tk, "#endif")){
-						tk.type = tk_endif;
+						if(tk_conditions.size == conditions_base)
+							TOKENIZE_ERR("#endif without #ifdef / #ifndef");
+						tk_conditions.size--;
+						tk.type = tk_invalid;
 					}else
 						TOKENIZE_ERR("unknown preprocessor directive:");
 					break;
@@ -399,9 +581,39 @@ bool tokenize(file_t* file){
 		}
 	}
 	if(recording_macro){
-		printf("%s: macro was not completed before end of file!\n", file->path);
+		fprintf(FL_OUTPUT, "%s: macro was not completed before end of file!\n", file->path);
+		tk_free();
+		return false;
+	}
+	if(tk_conditions.size != conditions_base){
+		fprintf(FL_OUTPUT, "%s: conditional was not closed before end of file!\n", file->path);
 		tk_free();
 		return false;
 	}
 	return true;
 }
+
+bool tokenize(file_t* file){
+	if(!stats_format)
+		return tokenize_file(file);
+	uint64_t outer_ns = included_ns;
+	size_t outer_tokens = included_tokens, outer_macros = macro_expansions;
+	included_ns = 0;
+	included_tokens = macro_expansions = 0;
+	size_t start_tokens = tk_array.size;
+	uint64_t start = stats_clock();
+	if(!tokenize_file(file))
+		return false;
+	uint64_t ns = stats_clock() - start;
+	size_t tokens = tk_array.size - start_tokens;
+	stats_file_t* stats = stats_file(file->path);
+	if(stats){
+		stats->tokenize_ns += ns - included_ns;
+		stats->tokens += tokens - included_tokens;
+		stats->macro_expansions += macro_expansions;
+	}
+	included_ns = outer_ns + ns;
+	included_tokens = outer_tokens + tokens;
+	macro_expansions = outer_macros;
+	return true;
+}
@@ -79,6 +79,7 @@ enum{
 	tk_putchar,
 	tk_input,
 	tk_getchar,
+	tk_flush,
 	tk_exit,
 
 	// Comparison operators
@@ -101,6 +102,7 @@ enum{
 	tk_end_include,
 	tk_macro,
 	tk_end_macro,
+	tk_macro_ref,
 	tk_ifdef,
 	tk_ifndef,
 	tk_endif,
@@ -115,6 +117,11 @@ enum{
 	tk_binexpr,
 	tk_negation,
 	tk_scope,
+	tk_subscript,
+
+	// Operators only created by optimization passes (no syntax)
+	tk_shl,			// x << n
+	tk_band,		// x & n
 };
 typedef uint32_t token_t;
 
@@ -125,20 +132,51 @@ typedef struct{
 } token;
 
 typedef DYNAMIC_ARRAY(token* tks) tk_array_t;
-extern tk_array_t tk_array;
-extern size_t tk_index;
+extern FL_LOCAL tk_array_t tk_array;
+extern FL_LOCAL size_t tk_index;
 
 typedef struct{
 	const char* symbol;
-	size_t macro_start;
+	size_t macro_start;		// Index of its tk_macro token, the body follows
 	uint32_t symbol_len;
 } macro;
 
 typedef DYNAMIC_ARRAY(macro* macros) macro_array_t;
-extern macro_array_t macro_array;
+extern FL_LOCAL macro_array_t macro_array;
+
+// Macro uses are not copied: the token stream holds a tk_macro_ref
+// (str is the use site, strlen the index of the macro in macro_array)
+// and tk_peek / tk_consume walk into the macro body and back out
+// Definitions are skipped, so the parser only sees expanded tokens
+typedef struct{
+	size_t ret;		// Index after the reference
+	size_t use;		// Index in tk_uses
+} tk_expansion;
+
+typedef DYNAMIC_ARRAY(tk_expansion* frames) tk_expansion_stack;
+extern FL_LOCAL tk_expansion_stack tk_expansions;
+
+// A use of a macro the parser walked into
+// The parser is handed copies of the body tokens, one set per use, so
+// errors reported after parsing (compiler, runtime) can still tell which
+// use a token came from. tk_array itself only grows with the source
+#define TK_NO_USE SIZE_MAX
+typedef struct{
+	token* ref;			// The tk_macro_ref, a copy itself if in another body
+	size_t parent;		// Use the reference is in (TK_NO_USE if none)
+	size_t body;		// Index of the first body token in tk_array
+	size_t size;
+	token* tks;			// Copies of the body tokens
+} tk_use;
+
+typedef DYNAMIC_ARRAY(tk_use* uses) tk_use_list;
+extern FL_LOCAL tk_use_list tk_uses;
 
 void tk_pushback(token);
 void tk_free(void);
+void tk_free_uses(tk_use_list*);
+size_t tk_use_of(const token*);
+void tk_rewind(void);
 token* tk_peek(int);
 token* tk_consume(int);
 void tk_print_context(const char*, uint32_t, const char*);
@@ -0,0 +1,447 @@
+// sched_setaffinity
+#define _GNU_SOURCE
+
+#include "../FL/textstyle.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Runtime benchmarks
+// Runs every program of the benchmark directory through ferro_interpreter
+// a number of times, on one CPU, and reports the median, 95th percentile
+// and fastest wall time of each with its heap allocations (--gc-stats)
+// and peak memory. Results can be written as JSON and compared against
+// the JSON of an earlier run (another build, another release)
+// Programs run from the benchmark directory with their output discarded
+#define BENCH_RUNS 10
+#define BENCH_WARMUP 1
+#define BENCH_THRESHOLD 5.0		// Percent slower than the baseline that counts as a regression
+#define BENCH_MAX_OPTIONS 32
+
+typedef struct{
+	char* name;				// File name without .fs
+	double* ms;				// Wall time of every run
+	double median_ms, p95_ms, min_ms;
+	unsigned long long allocations;
+	long peak_rss_kb;
+	int status;				// Exit status of the first failed run, 0 if none
+	double baseline_ms;		// Median in the baseline, 0 if absent
+} bench_t;
+
+static const char* interpreter = BENCH_INTERPRETER;
+static const char* bench_dir = BENCH_DIR;
+static const char* json_path = NULL;
+static const char* baseline_path = NULL;
+static unsigned int runs = BENCH_RUNS;
+static unsigned int warmup = BENCH_WARMUP;
+static double threshold = BENCH_THRESHOLD;
+static int cpu = -1;		// -1 for the first CPU this process may run on
+static bool pin = true;
+static const char* options[BENCH_MAX_OPTIONS];	// Passed on to the interpreter
+static int option_count = 0;
+
+static bench_t* benches = NULL;
+static size_t bench_count = 0, bench_capacity = 0;
+
+static void show_usage(const char* msg){
+	if(msg){
+		printf(BOLD YELLOW_FG "! ");
+		puts(msg);
+	}
+	printf(
+		RESET_ATTR "Usage:" BOLD DEFAULT_FG " ferro_bench_runtime [-options] [benchmarks...] [-- interpreter options]\n"
+		RESET_ATTR "Options:\n"
+		"	-h : Help\n"
+		"	--interpreter=<path> : Interpreter to measure (default the one built with this)\n"
+		"	--dir=<dir> : Directory of the benchmark programs (default " BENCH_DIR ")\n"
+		"	--runs=<n> : Measured runs of each benchmark (default %d)\n"
+		"	--warmup=<n> : Runs before measuring (default %d)\n"
+		"	--cpu=<n> : CPU to run on (default the first one available)\n"
+		"	--no-pin : Let the scheduler place the runs\n"
+		"	--json=<file> : Write the results as JSON\n"
+		"	--baseline=<file> : Compare with the JSON of an earlier run, failing on regressions\n"
+		"	--threshold=<percent> : Slowdown of a median that is a regression (default %.0f)\n"
+		"Benchmarks are named after their file without .fs, all of them run by default\n",
+		BENCH_RUNS, BENCH_WARMUP, BENCH_THRESHOLD
+	);
+	exit(EXIT_FAILURE);
+}
+
+static double bench_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool parse_count(const char* arg, unsigned int* count, bool zero){
+	char* end = NULL;
+	unsigned long value = strtoul(arg, &end, 10);
+	if(!end || *end || end == arg || (!value && !zero) || value > 100000)
+		return false;
+	*count = value;
+	return true;
+}
+
+static void* bench_alloc(size_t size){
+	void* ptr = calloc(1, size);
+	if(!ptr){
+		fprintf(stderr, "ferro_bench_runtime: failed to allocate %lu bytes\n", (unsigned long) size);
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+static bench_t* add_bench(const char* name, size_t len){
+	if(bench_count == bench_capacity){
+		bench_capacity = bench_capacity ? bench_capacity * 2 : 16;
+		bench_t* grown = (bench_t*) realloc(benches, bench_capacity * sizeof(bench_t));
+		if(!grown){
+			fprintf(stderr, "ferro_bench_runtime: failed to allocate benchmarks\n");
+			exit(EXIT_FAILURE);
+		}
+		benches = grown;
+	}
+	bench_t* bench = &benches[bench_count++];
+	memset(bench, 0, sizeof(*bench));
+	bench->name = (char*) bench_alloc(len + 1);
+	memcpy(bench->name, name, len);
+	bench->ms = (double*) bench_alloc(runs * sizeof(double));
+	return bench;
+}
+
+static int compare_names(const void* a, const void* b){
+	return strcmp(((const bench_t*) a)->name, ((const bench_t*) b)->name);
+}
+
+static int compare_ms(const void* a, const void* b){
+	double x = *(const double*) a, y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+// Every .fs file of the benchmark directory, by name
+static bool find_benches(void){
+	DIR* dir = opendir(bench_dir);
+	if(!dir){
+		fprintf(stderr, "ferro_bench_runtime: failed to open %s\n%s\n", bench_dir, strerror(errno));
+		return false;
+	}
+	struct dirent* entry;
+	while((entry = readdir(dir))){
+		size_t len = strlen(entry->d_name);
+		if(len > 3 && !strcmp(entry->d_name + len - 3, ".fs"))
+			(void) add_bench(entry->d_name, len - 3);
+	}
+	closedir(dir);
+	qsort(benches, bench_count, sizeof(bench_t), compare_names);
+	return true;
+}
+
+// Keeps the benchmarks named on the command line, in that order
+static bool select_benches(char** names, int count){
+	bench_t* selected = (bench_t*) bench_alloc(count * sizeof(bench_t));
+	for(int i = 0; i < count; i++){
+		size_t j = 0;
+		while(j < bench_count && strcmp(benches[j].name, names[i]))
+			j++;
+		if(j == bench_count){
+			fprintf(stderr, "ferro_bench_runtime: no benchmark %s in %s\n", names[i], bench_dir);
+			return false;
+		}
+		selected[i] = benches[j];
+	}
+	benches = selected;
+	bench_count = count;
+	return true;
+}
+
+// Runs a benchmark once
+// Returns false if the interpreter could not be started
+static bool run_once(bench_t* bench, double* ms, unsigned long long* allocations, long* rss_kb, int* status){
+	char script[PATH_MAX];
+	snprintf(script, sizeof(script), "%s.fs", bench->name);
+	const char* argv[BENCH_MAX_OPTIONS + 4] = {interpreter, "--gc-stats"};
+	int argc = 2;
+	for(int i = 0; i < option_count; i++)
+		argv[argc++] = options[i];
+	argv[argc++] = script;
+	argv[argc] = NULL;
+
+	int err[2];
+	if(pipe(err))
+		return false;
+	double start = bench_clock();
+	pid_t pid = fork();
+	if(pid < 0){
+		close(err[0]);
+		close(err[1]);
+		return false;
+	}
+	if(!pid){
+		int null = open("/dev/null", O_RDWR);
+		if(null < 0 || chdir(bench_dir))
+			_exit(127);
+		dup2(null, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		close(null);
+		close(err[0]);
+		close(err[1]);
+		execv(interpreter, (char* const*) argv);
+		_exit(127);
+	}
+	close(err[1]);
+
+	// Only the end of stderr matters, where the heap statistics are
+	char output[4096];
+	size_t len = 0;
+	ssize_t n;
+	while((n = read(err[0], output + len, sizeof(output) - 1 - len)) != 0){
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		len += n;
+		if(len == sizeof(output) - 1){
+			memmove(output, output + len / 2, len - len / 2);
+			len -= len / 2;
+		}
+	}
+	close(err[0]);
+	output[len] = '\0';
+
+	int wstatus;
+	struct rusage usage;
+	while(wait4(pid, &wstatus, 0, &usage) < 0)
+		if(errno != EINTR)
+			return false;
+	*ms = bench_clock() - start;
+	*rss_kb = usage.ru_maxrss;
+	*status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+	const char* stats = strstr(output, "heap: ");
+	*allocations = 0;
+	if(stats)
+		(void) sscanf(stats, "heap: %llu allocations", allocations);
+	return *status != 127;
+}
+
+static bool run_bench(bench_t* bench){
+	for(unsigned int i = 0; i < warmup + runs; i++){
+		double ms;
+		unsigned long long allocations;
+		long rss_kb;
+		int status;
+		if(!run_once(bench, &ms, &allocations, &rss_kb, &status)){
+			fprintf(stderr, "ferro_bench_runtime: failed to run %s\n", interpreter);
+			return false;
+		}
+		if(status && !bench->status)
+			bench->status = status;
+		if(i < warmup)
+			continue;
+		bench->ms[i - warmup] = ms;
+		bench->allocations = allocations;
+		if(rss_kb > bench->peak_rss_kb)
+			bench->peak_rss_kb = rss_kb;
+	}
+	double* sorted = (double*) bench_alloc(runs * sizeof(double));
+	memcpy(sorted, bench->ms, runs * sizeof(double));
+	qsort(sorted, runs, sizeof(double), compare_ms);
+	bench->min_ms = sorted[0];
+	bench->median_ms = (runs % 2) ? sorted[runs / 2] : (sorted[runs / 2 - 1] + sorted[runs / 2]) / 2;
+	// Nearest rank
+	bench->p95_ms = sorted[(runs * 95 + 99) / 100 - 1];
+	free(sorted);
+	return true;
+}
+
+// Takes the medians of an earlier --json, one benchmark per line
+static bool read_baseline(void){
+	FILE* file = fopen(baseline_path, "r");
+	if(!file){
+		fprintf(stderr, "ferro_bench_runtime: failed to open %s\n%s\n", baseline_path, strerror(errno));
+		return false;
+	}
+	char line[1024];
+	size_t found = 0;
+	while(fgets(line, sizeof(line), file)){
+		const char* name = strstr(line, "\"name\": \"");
+		const char* median = strstr(line, "\"median_ms\": ");
+		if(!name || !median)
+			continue;
+		name += 9;
+		const char* end = strchr(name, '"');
+		if(!end)
+			continue;
+		for(size_t i = 0; i < bench_count; i++)
+			if(strlen(benches[i].name) == (size_t)(end - name) && !strncmp(benches[i].name, name, end - name)){
+				benches[i].baseline_ms = strtod(median + 13, NULL);
+				found++;
+			}
+	}
+	fclose(file);
+	if(!found)
+		fprintf(stderr, BOLD YELLOW_FG "! " RESET_ATTR "%s has none of these benchmarks\n", baseline_path);
+	return true;
+}
+
+static void json_string(FILE* file, const char* str){
+	fputc('"', file);
+	for(; *str; str++){
+		if(*str == '"' || *str == '\\')
+			fputc('\\', file);
+		if((unsigned char) *str >= ' ')
+			fputc(*str, file);
+	}
+	fputc('"', file);
+}
+
+static bool write_json(void){
+	FILE* file = fopen(json_path, "w");
+	if(!file){
+		fprintf(stderr, "ferro_bench_runtime: failed to open %s\n%s\n", json_path, strerror(errno));
+		return false;
+	}
+	fprintf(file, "{\n\t\"interpreter\": ");
+	json_string(file, interpreter);
+	fprintf(file, ",\n\t\"options\": [");
+	for(int i = 0; i < option_count; i++){
+		if(i)
+			fprintf(file, ", ");
+		json_string(file, options[i]);
+	}
+	fprintf(file, "],\n\t\"runs\": %u,\n\t\"warmup\": %u,\n\t\"cpu\": %d,\n\t\"benchmarks\": [\n", runs, warmup, pin ? cpu : -1);
+	for(size_t i = 0; i < bench_count; i++){
+		bench_t* bench = &benches[i];
+		fprintf(file, "\t\t{\"name\": ");
+		json_string(file, bench->name);
+		fprintf(file, ", \"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f, \"allocations\": %llu, \"peak_rss_kb\": %ld, \"status\": %d}%s\n",
+			bench->median_ms, bench->p95_ms, bench->min_ms, bench->allocations, bench->peak_rss_kb, bench->status,
+			(i + 1 < bench_count) ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	bool success = !ferror(file);
+	return !fclose(file) && success;
+}
+
+// Runs on a single CPU, which the interpreter inherits
+static void pin_cpu(void){
+	cpu_set_t set;
+	if(cpu < 0){
+		if(sched_getaffinity(0, sizeof(set), &set))
+			return;
+		for(cpu = 0; cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &set); cpu++);
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set)){
+		fprintf(stderr, BOLD YELLOW_FG "! " RESET_ATTR "failed to run on CPU %d: %s\n", cpu, strerror(errno));
+		pin = false;
+	}
+}
+
+int main(int argc, char* argv[]){
+	char* names[argc];
+	int name_count = 0;
+	for(int i = 1; i < argc; i++){
+		const char* arg = argv[i];
+		if(!strcmp(arg, "--")){
+			for(i++; i < argc; i++){
+				if(option_count == BENCH_MAX_OPTIONS)
+					show_usage("Too many interpreter options.");
+				options[option_count++] = argv[i];
+			}
+		}else if(!strcmp(arg, "-h"))
+			show_usage(NULL);
+		else if(!strncmp(arg, "--interpreter=", 14))
+			interpreter = arg + 14;
+		else if(!strncmp(arg, "--dir=", 6))
+			bench_dir = arg + 6;
+		else if(!strncmp(arg, "--runs=", 7)){
+			if(!parse_count(arg + 7, &runs, false))
+				show_usage("Invalid run count.");
+		}else if(!strncmp(arg, "--warmup=", 9)){
+			if(!parse_count(arg + 9, &warmup, true))
+				show_usage("Invalid warmup count.");
+		}else if(!strncmp(arg, "--cpu=", 6)){
+			unsigned int n;
+			if(!parse_count(arg + 6, &n, true) || n >= CPU_SETSIZE)
+				show_usage("Invalid CPU.");
+			cpu = n;
+		}else if(!strcmp(arg, "--no-pin"))
+			pin = false;
+		else if(!strncmp(arg, "--json=", 7))
+			json_path = arg + 7;
+		else if(!strncmp(arg, "--baseline=", 11))
+			baseline_path = arg + 11;
+		else if(!strncmp(arg, "--threshold=", 12)){
+			char* end = NULL;
+			threshold = strtod(arg + 12, &end);
+			if(!end || *end || threshold < 0)
+				show_usage("Invalid threshold.");
+		}else if(arg[0] == '-')
+			show_usage("Invalid argument.");
+		else
+			names[name_count++] = argv[i];
+	}
+
+	// The runs change directory
+	static char interpreter_path[PATH_MAX];
+	if(!realpath(interpreter, interpreter_path)){
+		fprintf(stderr, "ferro_bench_runtime: failed to open %s\n%s\n", interpreter, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	interpreter = interpreter_path;
+	if(!find_benches() || (name_count && !select_benches(names, name_count)))
+		return EXIT_FAILURE;
+	if(!bench_count){
+		fprintf(stderr, "ferro_bench_runtime: no benchmarks in %s\n", bench_dir);
+		return EXIT_FAILURE;
+	}
+	if(baseline_path && !read_baseline())
+		return EXIT_FAILURE;
+	if(pin)
+		pin_cpu();
+
+	printf(BOLD "%-20s %10s %10s %10s %12s %12s", "benchmark", "median ms", "p95 ms", "min ms", "allocations", "peak RSS KB");
+	if(baseline_path)
+		printf(" %12s", "vs baseline");
+	printf(RESET_ATTR "\n");
+	bool success = true;
+	for(size_t i = 0; i < bench_count; i++){
+		bench_t* bench = &benches[i];
+		if(!run_bench(bench))
+			return EXIT_FAILURE;
+		printf("%-20s %10.2f %10.2f %10.2f %12llu %12ld", bench->name, bench->median_ms, bench->p95_ms,
+			bench->min_ms, bench->allocations, bench->peak_rss_kb);
+		if(baseline_path && bench->baseline_ms > 0){
+			double change = (bench->median_ms - bench->baseline_ms) / bench->baseline_ms * 100;
+			bool regression = change > threshold;
+			printf(" %s%+11.1f%%" RESET_ATTR, regression ? RED_FG BOLD : (change < -threshold) ? GREEN_FG : "", change);
+			if(regression)
+				success = false;
+		}else if(baseline_path)
+			printf(" %12s", "new");
+		if(bench->status){
+			printf(RED_FG BOLD "  exit %d" RESET_ATTR, bench->status);
+			success = false;
+		}
+		putchar('\n');
+		fflush(stdout);
+	}
+	if(json_path && !write_json())
+		return EXIT_FAILURE;
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,333 @@
+#include "../FL/tokenizer.h"
+#include "../FL/hash.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Hash function quality
+// Tokenizes FerroLang sources (their includes too) and runs every
+// candidate hashing function over the identifiers they use, reporting:
+// - ns per hash over every occurrence, the fastest of a number of passes
+// - collisions of the full 64 bits and of the 32 bits dicts keep, among
+//   the distinct identifiers
+// - the hashtable_stats of a hashtable_t holding the distinct identifiers
+#define HASH_BENCH_PASSES 200
+#define HASH_BENCH_SET_SIZE 4	// max_size of the tables
+
+typedef uint64_t (*hash_func_t)(const char*,size_t);
+
+typedef struct{
+	const char* name;
+	hash_func_t func;
+} candidate_t;
+
+static const candidate_t candidates[] = {
+	{"sum", hash_sum},
+	{"fnv1a", hash_fnv1a},
+	{"dict", hash_bytes},
+	{"wyhash", hash_wy},
+	{"xxh3", hash_xxh3},
+};
+#define CANDIDATE_COUNT (sizeof(candidates) / sizeof(candidates[0]))
+
+typedef struct{
+	const char* str;
+	uint32_t len;
+} ident_t;
+
+typedef DYNAMIC_ARRAY(ident_t* idents) ident_array_t;
+
+static ident_array_t occurrences = NEW_DYNAMIC_ARRAY(sizeof(ident_t));
+static ident_array_t distinct = NEW_DYNAMIC_ARRAY(sizeof(ident_t));
+static hashtable_t distinct_table = NEW_HASHTABLE(HASH_BENCH_SET_SIZE);
+static unsigned int passes = HASH_BENCH_PASSES;
+static hash_func_t table_hash = hash_bytes;		// Hashing function of the tables
+
+static void show_usage(const char* msg){
+	if(msg){
+		printf(BOLD YELLOW_FG "! ");
+		puts(msg);
+	}
+	printf(
+		RESET_ATTR "Usage:" BOLD DEFAULT_FG " ferro_bench_hash [-options] [sources...]\n"
+		RESET_ATTR "Options:\n"
+		"	-h : Help\n"
+		"	--passes=<n> : Passes over the identifiers timing each hash (default %d)\n"
+		"Sources are .fs files or directories of them, by default " HASH_BENCH_ROOT "/bench and " HASH_BENCH_ROOT "/examples\n",
+		HASH_BENCH_PASSES
+	);
+	exit(EXIT_FAILURE);
+}
+
+static double bench_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void* bench_alloc(size_t size){
+	void* ptr = malloc(size);
+	if(!ptr){
+		fprintf(stderr, "ferro_bench_hash: failed to allocate %lu bytes\n", (unsigned long) size);
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+static void bench_push(ident_array_t* array, ident_t ident){
+	if(!dynamic_array_pushback((dynamic_array_t*) array, &ident)){
+		fprintf(stderr, "ferro_bench_hash: failed to allocate identifiers\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static size_t ident_hash(const void* pair){
+	const ident_t* ident = (const ident_t*) pair;
+	return (size_t) table_hash(ident->str, ident->len);
+}
+
+static bool ident_cmp(const void* a, const void* b){
+	const ident_t* x = (const ident_t*) a;
+	const ident_t* y = (const ident_t*) b;
+	return x->len == y->len && !memcmp(x->str, y->str, x->len);
+}
+
+// Copies the identifier the first time it is seen, the tokens point
+// into files that are unmapped once tokenized
+static void add_ident(const char* str, uint32_t len){
+	ident_t key = {str, len};
+	ident_t* found = (ident_t*) hashtable_find(&distinct_table, &key);
+	if(!found){
+		char* copy = (char*) bench_alloc(len);
+		memcpy(copy, str, len);
+		key.str = copy;
+		if(!hashtable_set(&distinct_table, &key)){
+			fprintf(stderr, "ferro_bench_hash: failed to allocate identifiers\n");
+			exit(EXIT_FAILURE);
+		}
+		bench_push(&distinct, key);
+		found = &key;
+	}
+	bench_push(&occurrences, *found);
+}
+
+// Tokenizes a source from (dir), where its includes are relative to
+static bool tokenize_source(const char* dir, const char* name){
+	char cwd[PATH_MAX];
+	if(!getcwd(cwd, sizeof(cwd))){
+		perror("ferro_bench_hash: failed to get the working directory");
+		exit(EXIT_FAILURE);
+	}
+	if(chdir(dir)){
+		fprintf(stderr, "ferro_bench_hash: failed to open %s\n%s\n", dir, strerror(errno));
+		return false;
+	}
+	file_t file = new_file(NULL);
+	size_t len = strlen(name) + 1;
+	file.path = (const char*) bench_alloc(len);
+	memcpy((void*) file.path, name, len);
+	bool success = load_file(&file);
+	if(success){
+		append_file_list(file);
+		success = tokenize(&file);
+	}else
+		free((void*) file.path);
+	if(success){
+		for(size_t i = 0; i < tk_array.size; i++){
+			token* tk = &tk_array.tks[i];
+			if(tk->type == tk_symbol)
+				add_ident(tk->str, tk->strlen);
+		}
+	}
+	tk_free();
+	free_file_list();
+	if(chdir(cwd)){
+		perror("ferro_bench_hash: failed to return to the working directory");
+		exit(EXIT_FAILURE);
+	}
+	return success;
+}
+
+// Includes are relative to the source (bench/) or to the root of the
+// repository (examples/), the errors of the first attempt are discarded
+static bool read_source(const char* path){
+	char real[PATH_MAX];
+	if(!realpath(path, real)){
+		fprintf(stderr, "ferro_bench_hash: failed to open %s\n%s\n", path, strerror(errno));
+		return false;
+	}
+	char* name = strrchr(real, '/');
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%.*s", (name == real) ? 1 : (int)(name - real), real);
+	fl_output = fopen("/dev/null", "w");
+	bool success = tokenize_source(dir, name + 1);
+	if(fl_output)
+		fclose(fl_output);
+	fl_output = NULL;
+	if(!success && !tokenize_source(HASH_BENCH_ROOT, real))
+		fprintf(stderr, "ferro_bench_hash: skipped %s\n", path);
+	return true;
+}
+
+// A file, or every .fs file of a directory
+static bool read_sources(const char* path){
+	struct stat st;
+	if(stat(path, &st)){
+		fprintf(stderr, "ferro_bench_hash: failed to open %s\n%s\n", path, strerror(errno));
+		return false;
+	}
+	if(!S_ISDIR(st.st_mode))
+		return read_source(path);
+	DIR* dir = opendir(path);
+	if(!dir){
+		fprintf(stderr, "ferro_bench_hash: failed to open %s\n%s\n", path, strerror(errno));
+		return false;
+	}
+	struct dirent* entry;
+	bool success = true;
+	while(success && (entry = readdir(dir))){
+		size_t len = strlen(entry->d_name);
+		if(len <= 3 || strcmp(entry->d_name + len - 3, ".fs"))
+			continue;
+		char file[PATH_MAX];
+		snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+		success = read_source(file);
+	}
+	closedir(dir);
+	return success;
+}
+
+static int compare_u64(const void* a, const void* b){
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+// Distinct identifiers sharing a hash with an earlier one
+static size_t count_collisions(uint64_t* hashes, size_t count){
+	qsort(hashes, count, sizeof(uint64_t), compare_u64);
+	size_t collisions = 0;
+	for(size_t i = 1; i < count; i++)
+		collisions += (hashes[i] == hashes[i - 1]);
+	return collisions;
+}
+
+static double time_hash(hash_func_t func){
+	volatile uint64_t sink = 0;
+	double best = 0;
+	for(unsigned int pass = 0; pass < passes; pass++){
+		uint64_t h = 0;
+		double start = bench_clock();
+		for(size_t i = 0; i < occurrences.size; i++)
+			h ^= func(occurrences.idents[i].str, occurrences.idents[i].len);
+		double ns = bench_clock() - start;
+		sink ^= h;
+		if(!pass || ns < best)
+			best = ns;
+	}
+	(void) sink;
+	return best / occurrences.size;
+}
+
+static void table_stats(hash_func_t func, hashtable_stats_t* stats){
+	hashtable_t table = NEW_HASHTABLE(HASH_BENCH_SET_SIZE);
+	table.hashing_func = ident_hash;
+	table.cmp_func = ident_cmp;
+	table_hash = func;
+	if(!hashtable_setup(&table, sizeof(ident_t))){
+		fprintf(stderr, "ferro_bench_hash: failed to allocate a table\n");
+		exit(EXIT_FAILURE);
+	}
+	for(size_t i = 0; i < distinct.size; i++){
+		if(!hashtable_set(&table, &distinct.idents[i])){
+			fprintf(stderr, "ferro_bench_hash: failed to allocate a table\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	hashtable_stats(&table, stats);
+	hashtable_free(&table);
+}
+
+int main(int argc, char* argv[]){
+	const char* sources[argc + 2];
+	int source_count = 0;
+	for(int i = 1; i < argc; i++){
+		const char* arg = argv[i];
+		if(!strcmp(arg, "-h"))
+			show_usage(NULL);
+		else if(!strncmp(arg, "--passes=", 9)){
+			char* end = NULL;
+			unsigned long value = strtoul(arg + 9, &end, 10);
+			if(!end || *end || !value || value > 100000)
+				show_usage("Invalid pass count.");
+			passes = value;
+		}else if(arg[0] == '-')
+			show_usage("Invalid argument.");
+		else
+			sources[source_count++] = arg;
+	}
+	if(!source_count){
+		sources[source_count++] = HASH_BENCH_ROOT "/bench";
+		sources[source_count++] = HASH_BENCH_ROOT "/examples";
+	}
+
+	distinct_table.hashing_func = ident_hash;
+	distinct_table.cmp_func = ident_cmp;
+	if(!hashtable_setup(&distinct_table, sizeof(ident_t))){
+		fprintf(stderr, "ferro_bench_hash: failed to allocate identifiers\n");
+		return EXIT_FAILURE;
+	}
+	for(int i = 0; i < source_count; i++){
+		if(!read_sources(sources[i]))
+			return EXIT_FAILURE;
+	}
+	hashtable_free(&distinct_table);
+	if(!distinct.size){
+		fprintf(stderr, "ferro_bench_hash: no identifiers in the sources\n");
+		return EXIT_FAILURE;
+	}
+	printf("%lu identifiers, %lu distinct\n\n", (unsigned long) occurrences.size, (unsigned long) distinct.size);
+
+	uint64_t* hashes = (uint64_t*) bench_alloc(distinct.size * sizeof(uint64_t));
+	hashtable_stats_t stats[CANDIDATE_COUNT];
+	printf(BOLD "%-8s %8s %12s %12s %8s %8s %10s %6s %6s" RESET_ATTR "\n",
+		"hash", "ns/hash", "collisions", "32 bit", "sets", "used", "max chain", "load", "grows");
+	for(size_t c = 0; c < CANDIDATE_COUNT; c++){
+		hash_func_t func = candidates[c].func;
+		double ns = time_hash(func);
+		for(size_t i = 0; i < distinct.size; i++)
+			hashes[i] = func(distinct.idents[i].str, distinct.idents[i].len);
+		size_t collisions = count_collisions(hashes, distinct.size);
+		// Folded like the keys of dicts
+		for(size_t i = 0; i < distinct.size; i++)
+			hashes[i] = (uint32_t)(hashes[i] ^ (hashes[i] >> 32));
+		size_t collisions32 = count_collisions(hashes, distinct.size);
+		table_stats(func, &stats[c]);
+		printf("%-8s %8.2f %s%12lu" RESET_ATTR " %12lu %8lu %8lu %10lu %6.2f %6lu\n",
+			candidates[c].name, ns, collisions ? RED_FG BOLD : "", (unsigned long) collisions,
+			(unsigned long) collisions32, (unsigned long) stats[c].sets, (unsigned long) stats[c].used_sets,
+			(unsigned long) stats[c].max_chain, stats[c].load_factor, (unsigned long) stats[c].grows);
+	}
+	free(hashes);
+
+	// Sets of each table by amount of pairs
+	printf("\n" BOLD "%-8s", "pairs");
+	for(int i = 0; i < HASHTABLE_HISTOGRAM; i++)
+		printf(" %7d%s", i, (i == HASHTABLE_HISTOGRAM - 1) ? "+" : " ");
+	printf(RESET_ATTR "\n");
+	for(size_t c = 0; c < CANDIDATE_COUNT; c++){
+		printf("%-8s", candidates[c].name);
+		for(int i = 0; i < HASHTABLE_HISTOGRAM; i++)
+			printf(" %7lu ", (unsigned long) stats[c].histogram[i]);
+		putchar('\n');
+	}
+	return EXIT_SUCCESS;
+}
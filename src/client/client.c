@@ -0,0 +1,113 @@
+#include "../interpreter/server.h"
+#include "../FL/textstyle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Thin client of ferro_interpreter --serve
+// Sends the script with this process' working directory, stdin, stdout
+// and stderr, then exits with the status the script exited with
+
+static void show_usage(const char* msg){
+	if(msg){
+		printf(BOLD YELLOW_FG "! ");
+		puts(msg);
+	}
+	printf(
+		RESET_ATTR "Usage:" BOLD DEFAULT_FG " ferro_client <socket> <main.fs> [-options]\n"
+		RESET_ATTR "Options (applied to this run only):\n"
+		"	--buffer=<auto|line|full>, --gc-budget=<n>, --gc-stats, --threads=<n>, --no-io-uring,\n"
+		"	--no-jit, --jit-threshold=<n>\n"
+		"	(see ferro_interpreter -h)\n"
+	);
+	exit(EXIT_FAILURE);
+}
+
+static bool append(char* buffer, uint32_t* size, const char* str){
+	size_t len = strlen(str) + 1;
+	if(*size + len > SERVE_MAX_REQUEST)
+		return false;
+	memcpy(buffer + *size, str, len);
+	*size += len;
+	return true;
+}
+
+int main(int argc, char* argv[]){
+	if(argc < 3)
+		show_usage(argc < 2 ? "Missing socket." : "Missing input file.");
+
+	// Header paths resolve against the working directory, as they would for
+	// ferro_interpreter, so the script goes as an absolute path with it
+	static char request[sizeof(uint32_t) + SERVE_MAX_REQUEST];
+	char cwd[PATH_MAX], script[PATH_MAX];
+	uint32_t size = 0;
+	char* payload = request + sizeof(uint32_t);
+	if(!getcwd(cwd, sizeof(cwd))){
+		perror("ferro_client: getcwd");
+		return EXIT_FAILURE;
+	}
+	if(!realpath(argv[2], script)){
+		fprintf(stderr, "ferro_client: failed to open %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	bool fits = append(payload, &size, cwd) && append(payload, &size, script);
+	for(int i = 3; fits && i < argc; i++)
+		fits = append(payload, &size, argv[i]);
+	if(!fits)
+		show_usage("Too many options.");
+	memcpy(request, &size, sizeof(size));
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if(strlen(argv[1]) >= sizeof(addr.sun_path))
+		show_usage("Socket path is too long.");
+	strcpy(addr.sun_path, argv[1]);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr))){
+		fprintf(stderr, "ferro_client: no server on %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	// The fds ride along with the first byte
+	int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	union{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(fds))];
+	} control;
+	memset(&control, 0, sizeof(control));
+	size_t length = sizeof(uint32_t) + size;
+	struct iovec iov = {request, length};
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	for(size_t sent = (n > 0) ? n : 0; n > 0 && sent < length; sent += n)
+		n = send(fd, request + sent, length - sent, MSG_NOSIGNAL);
+	if(n <= 0){
+		perror("ferro_client: send");
+		return EXIT_FAILURE;
+	}
+
+	int32_t status;
+	size_t got = 0;
+	while(got < sizeof(status) && (n = recv(fd, (char*)&status + got, sizeof(status) - got, 0)) > 0)
+		got += n;
+	close(fd);
+	if(got < sizeof(status)){
+		fprintf(stderr, "ferro_client: server closed the connection\n");
+		return EXIT_FAILURE;
+	}
+	return status;
+}
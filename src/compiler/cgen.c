@@ -0,0 +1,851 @@
+#include "cgen.h"
+#include "prelude.h"
+#include "../FL/textstyle.h"
+
+#include <stdarg.h>
+#include <math.h>
+
+static FILE* out;
+static unsigned int indent;
+static uint32_t temp_count;
+static uint32_t var_count;
+static bool has_tmps;		// Current statement built temporary strings
+
+static bool cgen_error(const char* msg, token* tk){
+	file_t* file = (tk && tk->str) ? find_file_ptr(tk->str) : NULL;
+	return tk_error(msg, tk, file ? file : parser_file);
+}
+
+// Built-ins only the interpreter runs, reported as such rather than as unknown
+static const char* const interpreter_builtins[] = {
+	// Asynchronous file I/O (aio.h)
+	"async_open", "async_read", "async_write", "async_close", "async_read_file", "await", "await_str",
+	// Mapped files and str views (fstring.h)
+	"mapfile", "slice", "find",
+};
+
+static bool cgen_call_error(token* symbol){
+	for(size_t i = 0; i < sizeof(interpreter_builtins) / sizeof(interpreter_builtins[0]); i++)
+		if(tk_cmp_str(symbol, interpreter_builtins[i]))
+			return cgen_error("built-in not supported by ferro_compiler, run the script with ferro_interpreter", symbol);
+	return cgen_error("unknown function", symbol);
+}
+
+static void cgen_mem_error(const char* func){
+	printf(RED_FG BOLD "cgen - %s:" YELLOW_FG " %s" RESET_ATTR "\n",func,DS_ERROR_MSG);
+	exit(EXIT_FAILURE);
+}
+
+// Writes a full line at the current indentation
+static void emit_line(const char* fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	for(unsigned int i = 0; i < indent; i++)
+		fputc('\t', out);
+	vfprintf(out, fmt, args);
+	fputc('\n', out);
+	va_end(args);
+}
+
+// Starts a line that is finished with fprintf / end_line
+static void begin_line(void){
+	for(unsigned int i = 0; i < indent; i++)
+		fputc('\t', out);
+}
+
+static void end_line(const char* str){
+	fputs(str, out);
+	fputc('\n', out);
+}
+
+// Writes bytes as a C string literal
+static void write_c_string(const char* str, size_t len){
+	fputc('"', out);
+	for(size_t i = 0; i < len; i++){
+		unsigned char c = str[i];
+		if(c == '"' || c == '\\' || c == '?' || !isprint(c))
+			fprintf(out, "\\%03o", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+// Writes the "path:line" of a token as a C string literal, followed by
+// the uses of the macros it was expanded from, used by the runtime to
+// report errors
+static void write_loc(token* tk){
+	file_t* file = (tk && tk->str) ? find_file_ptr(tk->str) : NULL;
+	if(!file)
+		file = parser_file;
+	char loc[512];
+	int len = snprintf(loc, sizeof(loc), "%s:%u", file->path, (tk && tk->str) ? file_line(file, tk->str) : 0);
+	for(size_t i = tk_use_of(tk); i != TK_NO_USE && len < (int) sizeof(loc); i = tk_uses.uses[i].parent){
+		token* ref = tk_uses.uses[i].ref;
+		macro* m = &macro_array.macros[ref->strlen];
+		file_t* ref_file = find_file_ptr(ref->str);
+		if(ref_file)
+			len += snprintf(loc + len, sizeof(loc) - len, " (in expansion of macro %.*s at %s:%u)",
+				(int) m->symbol_len, m->symbol, ref_file->path, file_line(ref_file, ref->str));
+	}
+	write_c_string(loc, (len < (int) sizeof(loc)) ? (size_t) len : sizeof(loc) - 1);
+}
+
+// Ferro types are the tokens of their keyword
+static bool is_int(token_t type){
+	return type == tk_char || (type >= tk_i8 && type <= tk_u64);
+}
+
+static bool is_unsigned(token_t type){
+	return type == tk_u8 || type == tk_u16 || type == tk_u32 || type == tk_u64;
+}
+
+static bool is_float(token_t type){
+	return type == tk_f32 || type == tk_f64;
+}
+
+static bool is_numeric(token_t type){
+	return is_int(type) || is_float(type);
+}
+
+static const char* c_type(token_t type){
+	switch(type){
+	case tk_char: return "int8_t";
+	case tk_i8: return "int8_t";
+	case tk_u8: return "uint8_t";
+	case tk_i16: return "int16_t";
+	case tk_u16: return "uint16_t";
+	case tk_i32: return "int32_t";
+	case tk_u32: return "uint32_t";
+	case tk_i64: return "int64_t";
+	case tk_u64: return "uint64_t";
+	case tk_f32: return "float";
+	case tk_f64: return "double";
+	case tk_str: return "fl_str";
+	case tk_bool: return "bool";
+	default: return "void";
+	}
+}
+
+// Common type of two numeric operands, the same rules as the interpreter:
+// mixed with a float gives f64, two unsigned or any u64 give u64,
+// anything else i64
+static token_t promote(token_t a, token_t b){
+	if(a == b)
+		return a;
+	if(is_float(a) || is_float(b))
+		return tk_f64;
+	if((is_unsigned(a) && is_unsigned(b)) || a == tk_u64 || b == tk_u64)
+		return tk_u64;
+	return tk_i64;
+}
+
+// A C expression with a Ferro type
+// Always a plain identifier (a variable or a temporary), sized for the
+// longest name var_name writes so it is never truncated
+#define CGEN_SYMBOL_CHARS 20	// Characters of a Ferro name kept in its C name
+typedef struct{
+	token_t type;
+	char name[sizeof("v4294967295_") + CGEN_SYMBOL_CHARS];
+} cgen_val;
+
+static void new_temp(cgen_val* val, token_t type){
+	val->type = type;
+	snprintf(val->name, sizeof(val->name), "t%u", temp_count++);
+}
+
+// Range of an integer type, as C expressions (u64 has fl_f2u)
+static const char* int_min(token_t type){
+	switch(type){
+	case tk_char:
+	case tk_i8: return "INT8_MIN";
+	case tk_i16: return "INT16_MIN";
+	case tk_i32: return "INT32_MIN";
+	case tk_i64: return "INT64_MIN";
+	default: return "0";
+	}
+}
+
+static const char* int_max(token_t type){
+	switch(type){
+	case tk_char:
+	case tk_i8: return "INT8_MAX";
+	case tk_u8: return "UINT8_MAX";
+	case tk_i16: return "INT16_MAX";
+	case tk_u16: return "UINT16_MAX";
+	case tk_i32: return "INT32_MAX";
+	case tk_u32: return "UINT32_MAX";
+	default: return "INT64_MAX";
+	}
+}
+
+// Writes a value converted to another (non str) type
+// Floats saturate to the integer's range like in the interpreter
+static void write_conv(cgen_val* val, token_t type){
+	if(val->type == type)
+		fputs(val->name, out);
+	else if(type == tk_u64 && is_float(val->type))
+		fprintf(out, "fl_f2u(%s)", val->name);
+	else if(is_int(type) && is_float(val->type))
+		fprintf(out, "((%s)fl_f2i(%s, %s, %s))", c_type(type), val->name, int_min(type), int_max(type));
+	else
+		fprintf(out, "((%s)%s)", c_type(type), val->name);
+}
+
+// Variables visible at the current point of generation
+// Each declaration gets its own C name, so shadowing and
+// "i32 x = x;" keep Ferro's scoping
+typedef struct{
+	token* symbol;
+	token_t type;
+	uint32_t id;
+	uint16_t depth;
+	bool constant;
+} cgen_var;
+
+typedef DYNAMIC_ARRAY(cgen_var* vars) cgen_var_stack;
+static cgen_var_stack visible_vars = NEW_DYNAMIC_ARRAY(sizeof(cgen_var));
+static uint16_t scope_depth = 0;
+
+typedef DYNAMIC_ARRAY(uint16_t* depths) cgen_loop_stack;
+static cgen_loop_stack loops = NEW_DYNAMIC_ARRAY(sizeof(uint16_t));
+
+static cgen_var* resolve_var(token* symbol){
+	for(size_t i = visible_vars.size; i > 0; i--){
+		cgen_var* var = &visible_vars.vars[i-1];
+		if(tk_cmp_strlen(symbol, var->symbol->str, var->symbol->strlen))
+			return var;
+	}
+	return NULL;
+}
+
+static void var_name(cgen_var* var, cgen_val* val){
+	val->type = var->type;
+	// The id alone makes the name unique, the symbol keeps it readable
+	uint32_t len = (var->symbol->strlen > CGEN_SYMBOL_CHARS) ? CGEN_SYMBOL_CHARS : var->symbol->strlen;
+	snprintf(val->name, sizeof(val->name), "v%u_%.*s", var->id, (int) len, var->symbol->str);
+}
+
+static bool declare_var(token* symbol, token_t type, bool constant, cgen_val* val){
+	cgen_var* var = resolve_var(symbol);
+	if(var && var->depth == scope_depth)
+		return cgen_error("variable is already declared in this scope", symbol);
+	cgen_var new_var = {symbol, type, var_count++, scope_depth, constant};
+	if(!dynamic_array_pushback((dynamic_array_t*)&visible_vars, &new_var))
+		cgen_mem_error("declare_var");
+	var_name(&visible_vars.vars[visible_vars.size-1], val);
+	return true;
+}
+
+static bool lookup_var(token* symbol, cgen_var** out){
+	if(!(*out = resolve_var(symbol)))
+		return cgen_error("undefined variable", symbol);
+	return true;
+}
+
+// Frees the strings of the variables deeper than depth (-1 for all)
+static void free_vars(int depth){
+	for(size_t i = visible_vars.size; i > 0 && visible_vars.vars[i-1].depth > depth; i--){
+		cgen_val val;
+		if(visible_vars.vars[i-1].type != tk_str)
+			continue;
+		var_name(&visible_vars.vars[i-1], &val);
+		emit_line("fl_str_free(&%s);", val.name);
+	}
+}
+
+// Ends a statement, freeing the strings it built
+static void end_stmt(void){
+	if(has_tmps)
+		emit_line("fl_tmp_free();");
+	has_tmps = false;
+}
+
+static char unescape_char(char c){
+	switch(c){
+	case 'n': return '\n';
+	case 't': return '\t';
+	case 'r': return '\r';
+	case '0': return '\0';
+	default: return c;
+	}
+}
+
+static bool cgen_literal(token* tk, cgen_val* val){
+	char buffer[64];
+	switch(tk->type){
+	case tk_char_lit:
+		new_temp(val, tk_char);
+		emit_line("int8_t %s = %d;", val->name, (int)(int8_t)((tk->strlen == 2) ? unescape_char(tk->str[1]) : tk->str[0]));
+		return true;
+	case tk_bool_lit:
+		new_temp(val, tk_bool);
+		emit_line("bool %s = %s;", val->name, tk_cmp_str(tk, "true") ? "true" : "false");
+		return true;
+	case tk_int_lit:
+	case tk_float_lit:
+		if(tk->strlen >= sizeof(buffer))
+			return cgen_error("numeric literal is too long", tk);
+		memcpy(buffer, tk->str, tk->strlen);
+		buffer[tk->strlen] = '\0';
+		if(tk->type == tk_float_lit){
+			double f = strtod(buffer, NULL);
+			new_temp(val, tk_f64);
+			if(isinf(f))
+				emit_line("double %s = HUGE_VAL;", val->name);
+			else
+				emit_line("double %s = %.17g;", val->name, f);
+		}else{
+			unsigned long long u = strtoull(buffer, NULL, 10);
+			new_temp(val, (u > INT64_MAX) ? tk_u64 : tk_i64);
+			emit_line((u > INT64_MAX) ? "uint64_t %s = UINT64_C(%llu);" : "int64_t %s = INT64_C(%llu);", val->name, u);
+		}
+		return true;
+	case tk_str_lit:{
+		char* str = (char*) malloc(tk->strlen ? tk->strlen : 1);
+		if(!str)
+			cgen_mem_error("cgen_literal");
+		size_t len = 0;
+		for(uint32_t i = 0; i < tk->strlen; i++)
+			str[len++] = (tk->str[i] == '\\' && i+1 < tk->strlen) ? unescape_char(tk->str[++i]) : tk->str[i];
+		new_temp(val, tk_str);
+		begin_line();
+		fprintf(out, "fl_str %s = FL_STR(", val->name);
+		write_c_string(str, len);
+		fprintf(out, ", %lu);\n", (unsigned long) len);
+		free(str);
+		return true;
+	}default:
+		return cgen_error("invalid literal", tk);
+	}
+}
+
+static bool is_cmp(token_t op){
+	switch(op){
+	case tk_cmp_eq:
+	case tk_cmp_neq:
+	case tk_cmp_l:
+	case tk_cmp_leq:
+	case tk_cmp_g:
+	case tk_cmp_geq:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Comparison of a and b as C source, false for NaN operands like the interpreter
+static void write_cmp(token_t op, const char* a, const char* b){
+	switch(op){
+	case tk_cmp_eq: fprintf(out, "(%s == %s)", a, b); break;
+	case tk_cmp_neq: fprintf(out, "!(%s == %s)", a, b); break;
+	case tk_cmp_l: fprintf(out, "(%s < %s)", a, b); break;
+	case tk_cmp_leq: fprintf(out, "(%s <= %s)", a, b); break;
+	case tk_cmp_g: fprintf(out, "(%s > %s)", a, b); break;
+	case tk_cmp_geq: fprintf(out, "(%s >= %s)", a, b); break;
+	}
+}
+
+static bool cgen_binary(token* op_tk, token_t op, cgen_val* x, cgen_val* y, cgen_val* res){
+	switch(op){
+	case tk_and:
+	case tk_or:
+	case tk_xor:
+		if(x->type == tk_str || y->type == tk_str)
+			return cgen_error("invalid operands for logical operation", op_tk);
+		new_temp(res, tk_bool);
+		emit_line("bool %s = (bool)%s %s (bool)%s;", res->name, x->name, (op == tk_and) ? "&" : (op == tk_or) ? "|" : "!=", y->name);
+		return true;
+	case tk_cmp_type:
+		new_temp(res, tk_bool);
+		emit_line("bool %s = %s;", res->name, (x->type == y->type) ? "true" : "false");
+		return true;
+	case tk_cmp_strict:
+		if(x->type != y->type){
+			new_temp(res, tk_bool);
+			emit_line("bool %s = false;", res->name);
+			return true;
+		}
+		op = tk_cmp_eq;
+		break;
+	default:
+		break;
+	}
+
+	if(x->type == tk_str || y->type == tk_str){
+		if(x->type != y->type || (op != tk_plus && !is_cmp(op)))
+			return cgen_error("invalid operands for binary operation", op_tk);
+		if(op == tk_plus){
+			new_temp(res, tk_str);
+			begin_line();
+			fprintf(out, "fl_str %s = fl_concat(%s, %s, ", res->name, x->name, y->name);
+			write_loc(op_tk);
+			end_line(");");
+			has_tmps = true;
+			return true;
+		}
+		char cmp[sizeof("fl_str_cmp(, )") + 2 * sizeof(x->name)];
+		snprintf(cmp, sizeof(cmp), "fl_str_cmp(%s, %s)", x->name, y->name);
+		new_temp(res, tk_bool);
+		begin_line();
+		fprintf(out, "bool %s = ", res->name);
+		write_cmp(op, cmp, "0");
+		end_line(";");
+		return true;
+	}
+
+	if(x->type == tk_bool || y->type == tk_bool){
+		if(x->type != y->type || !is_cmp(op))
+			return cgen_error("invalid operands for binary operation", op_tk);
+		new_temp(res, tk_bool);
+		begin_line();
+		fprintf(out, "bool %s = ", res->name);
+		write_cmp(op, x->name, y->name);
+		end_line(";");
+		return true;
+	}
+
+	token_t type = promote(x->type, y->type);
+	cgen_val a = *x, b = *y;
+	if(a.type != type || b.type != type){
+		new_temp(&a, type);
+		begin_line();
+		fprintf(out, "%s %s = ", c_type(type), a.name);
+		write_conv(x, type);
+		fprintf(out, ", ");
+		new_temp(&b, type);
+		fprintf(out, "%s = ", b.name);
+		write_conv(y, type);
+		end_line(";");
+	}
+
+	if(is_cmp(op)){
+		new_temp(res, tk_bool);
+		begin_line();
+		fprintf(out, "bool %s = ", res->name);
+		write_cmp(op, a.name, b.name);
+		end_line(";");
+		return true;
+	}
+
+	new_temp(res, type);
+	const char* ctype = c_type(type);
+	switch(op){
+	case tk_plus:
+	case tk_minus:
+	case tk_mul:{
+		const char* c_op = (op == tk_plus) ? "+" : (op == tk_minus) ? "-" : "*";
+		// Integers wrap like the interpreter, without signed overflow
+		if(is_int(type))
+			emit_line("%s %s = (%s)((uint64_t)%s %s (uint64_t)%s);", ctype, res->name, ctype, a.name, c_op, b.name);
+		else
+			emit_line("%s %s = %s %s %s;", ctype, res->name, a.name, c_op, b.name);
+		return true;
+	}case tk_div:
+	case tk_mod:
+		begin_line();
+		if(is_float(type) && op == tk_div)
+			fprintf(out, "%s %s = %s / %s", ctype, res->name, a.name, b.name);
+		else if(is_float(type))
+			fprintf(out, "%s %s = %s(%s, %s)", ctype, res->name, (type == tk_f32) ? "fmodf" : "fmod", a.name, b.name);
+		else{
+			fprintf(out, "%s %s = (%s) fl_%s_%s(%s, %s, ", ctype, res->name, ctype,
+				(op == tk_div) ? "div" : "mod", is_unsigned(type) ? "u64" : "i64", a.name, b.name);
+			write_loc(op_tk);
+			fputc(')', out);
+		}
+		end_line(";");
+		return true;
+	default:
+		return cgen_error("invalid operands for arithmetic operation", op_tk);
+	}
+}
+
+// Binary expressions along the left spine of an expression
+typedef DYNAMIC_ARRAY(node_expr** exprs) spine_stack;
+static spine_stack spine = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));
+
+// Lowers an expression to a sequence of typed temporaries
+// Left-deep chains are walked iteratively, like the bytecode compiler
+static bool cgen_expr(node_expr* expr, cgen_val* val){
+	size_t spine_base = spine.size;
+	while(expr->type == tk_binexpr && expr->binexpr.rhs){
+		if(!dynamic_array_pushback((dynamic_array_t*)&spine, &expr))
+			cgen_mem_error("cgen_expr");
+		expr = expr->binexpr.lhs;
+	}
+
+	switch(expr->type){
+	case tk_char_lit:
+	case tk_int_lit:
+	case tk_float_lit:
+	case tk_str_lit:
+	case tk_bool_lit:
+		if(!cgen_literal(&expr->int_lit, val))
+			goto fail;
+		break;
+	case tk_symbol:{
+		cgen_var* var;
+		if(!lookup_var(&expr->symbol, &var))
+			goto fail;
+		var_name(var, val);
+		break;
+	}case tk_binexpr:
+		if(!cgen_expr(expr->binexpr.lhs, val))
+			goto fail;
+		if(expr->binexpr.op == tk_negation){
+			cgen_val x = *val;
+			if(!is_numeric(x.type)){
+				cgen_error("invalid operand for negation", expr->binexpr.op_token);
+				goto fail;
+			}
+			new_temp(val, x.type);
+			if(is_int(x.type))
+				emit_line("%s %s = (%s)(0 - (uint64_t)%s);", c_type(x.type), val->name, c_type(x.type), x.name);
+			else
+				emit_line("%s %s = -%s;", c_type(x.type), val->name, x.name);
+		}
+		break;
+	case tk_subscript:
+		cgen_error("lists and dicts are not supported by the compiler yet", expr->index.symbol);
+		goto fail;
+	case tk_func_call:
+		cgen_call_error(expr->func_call.symbol);
+		goto fail;
+	default:
+		cgen_error("expression not supported by the compiler", NULL);
+		goto fail;
+	}
+
+	while(spine.size > spine_base){
+		node_expr* binexpr = spine.exprs[--spine.size];
+		cgen_val lhs = *val, rhs;
+		if(!cgen_expr(binexpr->binexpr.rhs, &rhs))
+			goto fail;
+		if(!cgen_binary(binexpr->binexpr.op_token, binexpr->binexpr.op, &lhs, &rhs, val))
+			goto fail;
+	}
+	return true;
+
+fail:
+	spine.size = spine_base;
+	return false;
+}
+
+// Stores a value in a variable, converting it to the variable's type
+static bool cgen_store(cgen_val* var, cgen_val* val, token* tk){
+	if((var->type == tk_str) != (val->type == tk_str))
+		return cgen_error("value does not match the variable's type", tk);
+	if(var->type == tk_str)
+		emit_line("fl_str_set(&%s, %s);", var->name, val->name);
+	else{
+		begin_line();
+		fprintf(out, "%s = ", var->name);
+		write_conv(val, var->type);
+		end_line(";");
+	}
+	return true;
+}
+
+// Matches "s = s + a + b ...", appended to s in place
+// (see is_append in the bytecode compiler)
+static bool is_append(node_expr* expr, cgen_var* var){
+	if(expr->type != tk_binexpr || !expr->binexpr.rhs)
+		return false;
+	while(expr->type == tk_binexpr && expr->binexpr.rhs){
+		node_expr* rhs = expr->binexpr.rhs;
+		if(expr->binexpr.op != tk_plus)
+			return false;
+		if(rhs->type == tk_symbol){
+			if(resolve_var(&rhs->symbol) == var)
+				return false;
+		}else if(rhs->type != tk_str_lit)
+			return false;
+		expr = expr->binexpr.lhs;
+	}
+	return expr->type == tk_symbol && resolve_var(&expr->symbol) == var;
+}
+
+static bool cgen_append(node_expr* expr, cgen_val* var){
+	size_t spine_base = spine.size;
+	for(; expr->type == tk_binexpr && expr->binexpr.rhs; expr = expr->binexpr.lhs)
+		if(!dynamic_array_pushback((dynamic_array_t*)&spine, &expr))
+			cgen_mem_error("cgen_append");
+	while(spine.size > spine_base){
+		node_expr* binexpr = spine.exprs[--spine.size];
+		cgen_val rhs;
+		if(!cgen_expr(binexpr->binexpr.rhs, &rhs)){
+			spine.size = spine_base;
+			return false;
+		}
+		if(rhs.type != tk_str){
+			spine.size = spine_base;
+			return cgen_error("invalid operands for binary operation", binexpr->binexpr.op_token);
+		}
+		begin_line();
+		fprintf(out, "fl_str_append(&%s, %s, ", var->name, rhs.name);
+		write_loc(binexpr->binexpr.op_token);
+		end_line(");");
+	}
+	return true;
+}
+
+// Evaluates every argument of a built-in before it runs
+static bool cgen_args(node_func_call* call, cgen_val** vals){
+	*vals = (cgen_val*) malloc((call->expr_count ? call->expr_count : 1) * sizeof(cgen_val));
+	if(!*vals)
+		cgen_mem_error("cgen_args");
+	for(size_t i = 0; i < call->expr_count; i++)
+		if(!cgen_expr(&call->exprs[i], &(*vals)[i]))
+			return false;
+	return true;
+}
+
+static const char* print_func(token_t type){
+	switch(type){
+	case tk_str: return "fl_print_str";
+	case tk_char: return "fl_print_char";
+	case tk_bool: return "fl_print_bool";
+	case tk_f32:
+	case tk_f64: return "fl_print_f64";
+	default: return is_unsigned(type) ? "fl_print_u64" : "fl_print_i64";
+	}
+}
+
+static bool cgen_read(node_func_call* call, bool line){
+	if(!call->expr_count)
+		return cgen_error("expected variable(s) to read into", call->symbol);
+	for(size_t i = 0; i < call->expr_count; i++){
+		cgen_var* var;
+		cgen_val val;
+		if(call->exprs[i].type != tk_symbol)
+			return cgen_error("expected variable name", call->symbol);
+		if(!lookup_var(&call->exprs[i].symbol, &var))
+			return false;
+		if(var->constant)
+			return cgen_error("cannot read into a constant", &call->exprs[i].symbol);
+		var_name(var, &val);
+		if(!line){
+			if(var->type == tk_str)
+				return cgen_error("getchar expects a character variable", &call->exprs[i].symbol);
+			emit_line("%s = (%s) fl_getchar();", val.name, c_type(var->type));
+		}else if(var->type == tk_str)
+			emit_line("fl_input_str(&%s);", val.name);
+		else if(var->type == tk_char)
+			emit_line("%s = fl_input_char();", val.name);
+		else if(var->type == tk_bool)
+			emit_line("%s = fl_input_bool();", val.name);
+		else
+			emit_line("%s = (%s) fl_input_%s();", val.name, c_type(var->type),
+				is_float(var->type) ? "f64" : is_unsigned(var->type) ? "u64" : "i64");
+	}
+	return true;
+}
+
+static bool cgen_stmt(node_stmt*);
+
+static bool cgen_scope(node_scope* scope){
+	size_t var_base = visible_vars.size;
+	bool success = true;
+	emit_line("{");
+	indent++;
+	scope_depth++;
+	for(size_t i = 0; i < scope->stmt_count && success; i++)
+		success = cgen_stmt(&scope->stmts[i]);
+	free_vars(scope_depth - 1);
+	visible_vars.size = var_base;
+	scope_depth--;
+	indent--;
+	emit_line("}");
+	return success;
+}
+
+// Conditions are computed into a bool temporary before the branch
+static bool cgen_cond(node_expr* cond, cgen_val* val){
+	if(!cgen_expr(cond, val))
+		return false;
+	if(val->type == tk_str)
+		return cgen_error("condition should be a bool", NULL);
+	end_stmt();
+	return true;
+}
+
+static bool cgen_if(node_stmt* stmt){
+	unsigned int nested = 0;
+	for(; stmt && stmt->type == tk_if; stmt = stmt->if_stmt.else_body){
+		cgen_val cond;
+		if(!cgen_cond(&stmt->if_stmt.cond, &cond))
+			return false;
+		emit_line("if(%s)", cond.name);
+		if(!cgen_scope(&stmt->if_stmt.body))
+			return false;
+		if(!stmt->if_stmt.else_body)
+			break;
+		emit_line("else{");
+		indent++;
+		nested++;
+	}
+	if(stmt && stmt->type == tk_scope && !cgen_scope(&stmt->scope))
+		return false;
+	while(nested--){
+		indent--;
+		emit_line("}");
+	}
+	return true;
+}
+
+static bool cgen_while(node_while* loop){
+	cgen_val cond;
+	emit_line("for(;;){");
+	indent++;
+	if(!cgen_cond(&loop->cond, &cond))
+		return false;
+	emit_line("if(!%s)", cond.name);
+	emit_line("\tbreak;");
+	if(!dynamic_array_pushback((dynamic_array_t*)&loops, &scope_depth))
+		cgen_mem_error("cgen_while");
+	bool success = cgen_scope(&loop->body);
+	loops.size--;
+	indent--;
+	emit_line("}");
+	return success;
+}
+
+static bool cgen_stmt(node_stmt* stmt){
+	switch(stmt->type){
+	case tk_var_decl:{
+		node_var_decl* decl = &stmt->var_decl;
+		cgen_val init, var;
+		if(decl->var_type == tk_list || decl->var_type == tk_dict)
+			return cgen_error("lists and dicts are not supported by the compiler yet", decl->symbol);
+		if(decl->expr){
+			if(!cgen_expr(decl->expr, &init))
+				return false;
+		}else if(decl->constant)
+			return cgen_error("constant needs to be initialized", decl->symbol);
+		// Declared after the initializer, so "i32 x = x;" refers to an outer x
+		if(!declare_var(decl->symbol, decl->var_type, decl->constant, &var))
+			return false;
+		if(decl->expr && (var.type == tk_str) != (init.type == tk_str))
+			return cgen_error("value does not match the variable's type", decl->symbol);
+		if(var.type == tk_str){
+			emit_line("fl_str %s = FL_STR(\"\", 0);", var.name);
+			if(decl->expr)
+				emit_line("fl_str_set(&%s, %s);", var.name, init.name);
+		}else if(decl->expr){
+			begin_line();
+			fprintf(out, "%s%s %s = ", decl->constant ? "const " : "", c_type(var.type), var.name);
+			write_conv(&init, var.type);
+			end_line(";");
+		}else
+			emit_line("%s %s = 0;", c_type(var.type), var.name);
+		break;
+	}case tk_var_assign:{
+		cgen_var* var;
+		cgen_val val, dst;
+		if(!lookup_var(stmt->var_assign.symbol, &var))
+			return false;
+		if(var->constant)
+			return cgen_error("cannot assign to a constant", stmt->var_assign.symbol);
+		if(stmt->var_assign.index)
+			return cgen_error("lists and dicts are not supported by the compiler yet", stmt->var_assign.symbol);
+		var_name(var, &dst);
+		if(var->type == tk_str && is_append(&stmt->var_assign.expr, var)){
+			if(!cgen_append(&stmt->var_assign.expr, &dst))
+				return false;
+			break;
+		}
+		if(!cgen_expr(&stmt->var_assign.expr, &val) || !cgen_store(&dst, &val, stmt->var_assign.symbol))
+			return false;
+		break;
+	}case tk_print:
+	case tk_putchar:{
+		cgen_val* vals;
+		bool success = cgen_args(&stmt->func_call, &vals);
+		for(size_t i = 0; i < stmt->func_call.expr_count && success; i++){
+			if(stmt->type == tk_print)
+				emit_line("%s(%s);", print_func(vals[i].type), vals[i].name);
+			else if(vals[i].type == tk_str)
+				success = cgen_error("putchar expects a character", stmt->func_call.symbol);
+			else{
+				begin_line();
+				fputs("putchar((int)", out);
+				write_conv(&vals[i], tk_i64);
+				end_line(");");
+			}
+		}
+		if(success && stmt->type == tk_print)
+			emit_line("putchar('\\n');");
+		free(vals);
+		if(!success)
+			return false;
+		break;
+	}case tk_input:
+	case tk_getchar:
+		if(!cgen_read(&stmt->func_call, stmt->type == tk_input))
+			return false;
+		break;
+	case tk_flush:
+		if(stmt->func_call.expr_count)
+			return cgen_error("flush takes no arguments", stmt->func_call.symbol);
+		emit_line("fflush(stdout);");
+		break;
+	case tk_exit:{
+		cgen_val status;
+		if(!cgen_expr(&stmt->exit.expr, &status))
+			return false;
+		if(status.type == tk_str)
+			return cgen_error("exit status should be an integer", NULL);
+		begin_line();
+		fputs("fl_exit((int)", out);
+		write_conv(&status, tk_i64);
+		end_line(");");
+		break;
+	}case tk_scope:
+		return cgen_scope(&stmt->scope);
+	case tk_if:
+		return cgen_if(stmt);
+	case tk_while:
+		return cgen_while(&stmt->while_stmt);
+	case tk_for:
+		return cgen_error("for loops are not supported by the compiler yet", stmt->for_stmt.symbol);
+	case tk_break:
+		if(!loops.size)
+			return cgen_error("break outside of a loop", NULL);
+		free_vars(loops.depths[loops.size-1]);
+		emit_line("break;");
+		break;
+	case tk_func_call:
+		return cgen_call_error(stmt->func_call.symbol);
+	default:
+		return cgen_error("statement not supported by the compiler", NULL);
+	}
+	end_stmt();
+	return true;
+}
+
+// Writes the C translation of a program to (stream)
+// source is the path of the main file, noted in the output
+bool cgen(node_prog* prog, FILE* stream, const char* source){
+	out = stream;
+	indent = 0;
+	temp_count = var_count = 0;
+	scope_depth = 0;
+	has_tmps = false;
+	fprintf(out, "/* Generated by ferro_compiler from %s */\n", source);
+	fputs(cgen_prelude, out);
+	emit_line("int main(void){");
+	indent++;
+	bool success = true;
+	for(size_t i = 0; i < prog->size && success; i++)
+		success = cgen_stmt(&prog->stmts[i]);
+	free_vars(-1);
+	emit_line("fl_exit(EXIT_SUCCESS);");
+	emit_line("return 0;");
+	indent--;
+	emit_line("}");
+	dynamic_array_free((dynamic_array_t*)&visible_vars);
+	dynamic_array_free((dynamic_array_t*)&loops);
+	dynamic_array_free((dynamic_array_t*)&spine);
+	return success;
+}
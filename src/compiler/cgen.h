@@ -0,0 +1,14 @@
+#ifndef FERRO_CGEN_H
+#define FERRO_CGEN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../FL/parser.h"
+
+// Lowers a parsed program to a standalone C99 translation unit
+// Ferro's static types map directly onto C types, and every
+// intermediate value becomes a typed C temporary
+bool cgen(node_prog*,FILE*,const char*);
+
+#endif
@@ -0,0 +1,203 @@
+// mkstemps
+#define _DEFAULT_SOURCE
+
+#include "../FL/filemanager.h"
+#include "../FL/textstyle.h"
+#include "../FL/tokenizer.h"
+#include "../FL/parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "cgen.h"
+
+static void show_usage(const char* msg){
+	if(msg){
+		printf(BOLD YELLOW_FG "! ");
+		puts(msg);
+	}
+	printf(
+		RESET_ATTR "Usage:" BOLD DEFAULT_FG " ferro_compiler [-options] <main.fs>\n"
+		RESET_ATTR "Options:\n"
+		"	-h : Help\n"
+		"	-o <file> : Output executable (default a.out)\n"
+		"	--emit-c[=<file>] : Keep the generated C file (default <output>.c)\n"
+		"	--cc=<compiler> : C compiler used to build the output (default cc)\n"
+		"	--max-depth=<n> : Maximum expression nesting depth (default %d)\n"
+		, PARSER_MAX_DEPTH
+	);
+	exit(EXIT_FAILURE);
+}
+
+static file_t main_file = {NULL, NULL, 0};
+static const char* output_file = "a.out";
+static const char* c_compiler = "cc";
+static const char* emit_c = NULL;	// Where the generated C is kept, if anywhere
+
+static bool init_compiler(int argc, char* argv[]){
+	if(argc < 2)
+		show_usage("Missing input file.");
+
+	char* input_file = NULL;
+	for(int i = 1; i < argc; i++){
+		if(argv[i][0] == '-'){
+			switch(argv[i][1]){
+			case 'h':
+				show_usage(NULL);
+				break;
+			case 'o':
+				if(argv[i][2] || i+1 >= argc)
+					show_usage("Expected an output file after -o.");
+				output_file = argv[++i];
+				break;
+			case '-':
+				if(!strcmp(argv[i],"--help"))
+					show_usage(NULL);
+				else if(!strcmp(argv[i],"--emit-c"))
+					emit_c = "";
+				else if(!strncmp(argv[i],"--emit-c=",9) && argv[i][9])
+					emit_c = argv[i]+9;
+				else if(!strncmp(argv[i],"--cc=",5) && argv[i][5])
+					c_compiler = argv[i]+5;
+				else if(!strncmp(argv[i],"--max-depth=",12)){
+					char* end = NULL;
+					unsigned long depth = strtoul(argv[i]+12,&end,10);
+					if(!depth || !end || *end)
+						show_usage("Invalid maximum depth.");
+					parser_max_depth = depth;
+				}else{
+					char tmp[512];
+					sprintf(tmp,"Invalid argument %.*s",450,argv[i]);
+					show_usage(tmp);
+				}
+				break;
+			default:{
+				char tmp[32];
+				sprintf(tmp,"Invalid argument %.*s",2,argv[i]);
+				show_usage(tmp);
+			}}
+		}else if(input_file)
+			show_usage("Too many input files (only one required).");
+		else
+			input_file = argv[i];
+	}
+	if(!input_file)
+		show_usage("Missing input file.");
+
+	main_file.path = (char*) malloc(strlen(input_file)+1);
+	if(!main_file.path){
+		printf("failed to allocate %lu bytes.\n",strlen(input_file)+1);
+		return false;
+	}
+	memcpy((void*)main_file.path, (const void*)input_file, strlen(input_file)+1);
+	if(!load_file(&main_file)){
+		perror("Failed to open input file.");
+		return false;
+	};
+	append_file_list(main_file);
+	return true;
+}
+
+// Builds the generated C file with the system's C compiler
+static bool build_output(const char* c_file){
+	pid_t pid = fork();
+	if(pid < 0){
+		perror("Failed to start the C compiler");
+		return false;
+	}
+	if(!pid){
+		execlp(c_compiler, c_compiler, "-std=c99", "-O2", "-o", output_file, c_file, "-lm", (char*) NULL);
+		perror("Failed to start the C compiler");
+		_exit(127);
+	}
+	int status;
+	if(waitpid(pid, &status, 0) < 0){
+		perror("Failed to wait for the C compiler");
+		return false;
+	}
+	if(!WIFEXITED(status) || WEXITSTATUS(status)){
+		printf(RED_FG BOLD "C compiler failed on %s" RESET_ATTR "\n", c_file);
+		return false;
+	}
+	return true;
+}
+
+static void cleanup(node_prog* prog){
+	parser_free(prog);
+	tk_free();
+	free_file_list();
+}
+
+int main(int argc, char* argv[]){
+	if(!init_compiler(argc, argv)){
+		cleanup(NULL);
+		return EXIT_FAILURE;
+	}
+
+	if(!tokenize(&main_file)){
+		cleanup(NULL);
+		return EXIT_FAILURE;
+	}
+
+	node_prog prog;
+	if(!parse(&prog, &main_file)){
+		cleanup(&prog);
+		return EXIT_FAILURE;
+	}
+
+	// Without --emit-c the C file is a temporary one, so no file of the
+	// user's (like main.c next to -o main) is overwritten
+	char* c_file;
+	FILE* stream = NULL;
+	if(emit_c){
+		size_t c_file_len = *emit_c ? strlen(emit_c) + 1 : strlen(output_file) + 3;
+		c_file = (char*) malloc(c_file_len);
+		if(c_file){
+			snprintf(c_file, c_file_len, *emit_c ? "%s" : "%s.c", *emit_c ? emit_c : output_file);
+			stream = fopen(c_file, "w");
+		}
+	}else{
+		const char* tmp_dir = getenv("TMPDIR");
+		if(!tmp_dir || !*tmp_dir)
+			tmp_dir = "/tmp";
+		size_t c_file_len = strlen(tmp_dir) + sizeof("/ferro_XXXXXX.c");
+		c_file = (char*) malloc(c_file_len);
+		if(c_file){
+			snprintf(c_file, c_file_len, "%s/ferro_XXXXXX.c", tmp_dir);
+			int fd = mkstemps(c_file, 2);
+			if(fd >= 0 && !(stream = fdopen(fd, "w"))){
+				close(fd);
+				remove(c_file);
+			}
+		}
+	}
+	if(!c_file){
+		printf("failed to allocate the C output file name.\n");
+		cleanup(&prog);
+		return EXIT_FAILURE;
+	}
+	if(!stream){
+		perror("Failed to create the C output file");
+		free(c_file);
+		cleanup(&prog);
+		return EXIT_FAILURE;
+	}
+	bool success = cgen(&prog, stream, main_file.path);
+	if(fclose(stream))
+		success = false;
+
+	if(success)
+		success = build_output(c_file);
+	if(!emit_c)
+		remove(c_file);
+
+	if(success)
+		printf(GREEN_FG BOLD "Compiled %s to %s" RESET_ATTR "\n", main_file.path, output_file);
+
+	free(c_file);
+	cleanup(&prog);
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+#ifndef FERRO_CGEN_PRELUDE_H
+#define FERRO_CGEN_PRELUDE_H
+
+// Runtime copied at the top of every generated C file,
+// so the output builds with nothing but a C99 compiler and libm
+static const char cgen_prelude[] =
+"#include <stdio.h>\n"
+"#include <stdlib.h>\n"
+"#include <stdint.h>\n"
+"#include <stdbool.h>\n"
+"#include <string.h>\n"
+"#include <math.h>\n"
+"\n"
+"/* str is a view (literals) when cap is 0, an owned buffer otherwise */\n"
+"typedef struct{ const char* data; uint32_t len; uint32_t cap; } fl_str;\n"
+"#define FL_STR(s, l) ((fl_str){(s), (l), 0})\n"
+"\n"
+"static void fl_fail(const char* loc, const char* msg){\n"
+"	fflush(stdout);\n"
+"	fprintf(stderr, \"%s: runtime error: %s\\n\", loc, msg);\n"
+"	exit(EXIT_FAILURE);\n"
+"}\n"
+"\n"
+"/* Ends the program, failing if stdout could not be written to */\n"
+"static void fl_exit(int status){\n"
+"	if((fflush(stdout) || ferror(stdout)) && status == EXIT_SUCCESS){\n"
+"		fprintf(stderr, \"failed to write the output\\n\");\n"
+"		status = EXIT_FAILURE;\n"
+"	}\n"
+"	exit(status);\n"
+"}\n"
+"\n"
+"static char* fl_alloc(size_t size){\n"
+"	char* data = (char*) malloc(size ? size : 1);\n"
+"	if(!data)\n"
+"		fl_fail(\"runtime\", \"out of memory\");\n"
+"	return data;\n"
+"}\n"
+"\n"
+"/* Strings built by the current statement, freed at its end unless a variable took them */\n"
+"static char** fl_tmps;\n"
+"static size_t fl_tmp_count, fl_tmp_cap;\n"
+"\n"
+"static fl_str fl_tmp(char* data, uint32_t len){\n"
+"	if(fl_tmp_count == fl_tmp_cap){\n"
+"		fl_tmp_cap = fl_tmp_cap ? fl_tmp_cap * 2 : 16;\n"
+"		fl_tmps = (char**) realloc(fl_tmps, fl_tmp_cap * sizeof(char*));\n"
+"		if(!fl_tmps)\n"
+"			fl_fail(\"runtime\", \"out of memory\");\n"
+"	}\n"
+"	fl_tmps[fl_tmp_count++] = data;\n"
+"	return (fl_str){data, len, len ? len : 1};\n"
+"}\n"
+"\n"
+"static void fl_tmp_free(void){\n"
+"	while(fl_tmp_count)\n"
+"		free(fl_tmps[--fl_tmp_count]);\n"
+"}\n"
+"\n"
+"static fl_str fl_concat(fl_str a, fl_str b, const char* loc){\n"
+"	if(!b.len)\n"
+"		return a;\n"
+"	if(!a.len)\n"
+"		return b;\n"
+"	if((uint64_t) a.len + b.len > UINT32_MAX)\n"
+"		fl_fail(loc, \"string is too long\");\n"
+"	char* data = fl_alloc(a.len + b.len);\n"
+"	memcpy(data, a.data, a.len);\n"
+"	memcpy(data + a.len, b.data, b.len);\n"
+"	return fl_tmp(data, a.len + b.len);\n"
+"}\n"
+"\n"
+"/* Temporaries are taken over, views are kept and other variables' strings are copied */\n"
+"static void fl_str_set(fl_str* var, fl_str v){\n"
+"	if(v.cap){\n"
+"		size_t i = fl_tmp_count;\n"
+"		while(i && fl_tmps[i-1] != v.data)\n"
+"			i--;\n"
+"		if(i)\n"
+"			fl_tmps[i-1] = fl_tmps[--fl_tmp_count];\n"
+"		else{\n"
+"			char* data = fl_alloc(v.len);\n"
+"			memcpy(data, v.data, v.len);\n"
+"			v.data = data;\n"
+"			v.cap = v.len ? v.len : 1;\n"
+"		}\n"
+"	}\n"
+"	if(var->cap)\n"
+"		free((char*) var->data);\n"
+"	*var = v;\n"
+"}\n"
+"\n"
+"/* s = s + b, in place when the buffer is large enough */\n"
+"static void fl_str_append(fl_str* var, fl_str b, const char* loc){\n"
+"	uint64_t len = (uint64_t) var->len + b.len;\n"
+"	if(len > UINT32_MAX)\n"
+"		fl_fail(loc, \"string is too long\");\n"
+"	if(len > var->cap){\n"
+"		uint64_t cap = (uint64_t) var->cap * 2;\n"
+"		cap = (cap < len) ? len : (cap > UINT32_MAX) ? UINT32_MAX : cap;\n"
+"		char* data = var->cap ? (char*) realloc((char*) var->data, cap) : fl_alloc(cap);\n"
+"		if(!data)\n"
+"			fl_fail(loc, \"out of memory\");\n"
+"		if(!var->cap)\n"
+"			memcpy(data, var->data, var->len);\n"
+"		var->data = data;\n"
+"		var->cap = cap;\n"
+"	}\n"
+"	memcpy((char*) var->data + var->len, b.data, b.len);\n"
+"	var->len = len;\n"
+"}\n"
+"\n"
+"static void fl_str_free(fl_str* var){\n"
+"	if(var->cap)\n"
+"		free((char*) var->data);\n"
+"}\n"
+"\n"
+"static int fl_str_cmp(fl_str a, fl_str b){\n"
+"	int cmp = memcmp(a.data, b.data, (a.len < b.len) ? a.len : b.len);\n"
+"	return cmp ? cmp : (a.len > b.len) - (a.len < b.len);\n"
+"}\n"
+"\n"
+"static int64_t fl_div_i64(int64_t a, int64_t b, const char* loc){\n"
+"	if(!b)\n"
+"		fl_fail(loc, \"division by zero\");\n"
+"	return (b == -1) ? (int64_t)(0 - (uint64_t) a) : a / b;\n"
+"}\n"
+"\n"
+"static int64_t fl_mod_i64(int64_t a, int64_t b, const char* loc){\n"
+"	if(!b)\n"
+"		fl_fail(loc, \"modulo by zero\");\n"
+"	return (b == -1) ? 0 : a % b;\n"
+"}\n"
+"\n"
+"static uint64_t fl_div_u64(uint64_t a, uint64_t b, const char* loc){\n"
+"	if(!b)\n"
+"		fl_fail(loc, \"division by zero\");\n"
+"	return a / b;\n"
+"}\n"
+"\n"
+"static uint64_t fl_mod_u64(uint64_t a, uint64_t b, const char* loc){\n"
+"	if(!b)\n"
+"		fl_fail(loc, \"modulo by zero\");\n"
+"	return a % b;\n"
+"}\n"
+"\n"
+"/* Floats convert to integers saturated to the target's range, NaN to 0 */\n"
+"static int64_t fl_f2i(double f, int64_t min, int64_t max){\n"
+"	if(f != f)\n"
+"		return 0;\n"
+"	if(f <= (double) min)\n"
+"		return min;\n"
+"	if(f >= (double) max)\n"
+"		return max;\n"
+"	return (int64_t) f;\n"
+"}\n"
+"\n"
+"static uint64_t fl_f2u(double f){\n"
+"	if(!(f > 0.0))\n"
+"		return 0;\n"
+"	if(f >= 18446744073709551616.0)\n"
+"		return UINT64_MAX;\n"
+"	return (uint64_t) f;\n"
+"}\n"
+"\n"
+"static void fl_print_str(fl_str s){ fwrite(s.data, 1, s.len, stdout); }\n"
+"static void fl_print_i64(int64_t x){ printf(\"%lld\", (long long) x); }\n"
+"static void fl_print_u64(uint64_t x){ printf(\"%llu\", (unsigned long long) x); }\n"
+"static void fl_print_f64(double x){ printf(\"%g\", x); }\n"
+"static void fl_print_char(int8_t c){ putchar(c); }\n"
+"static void fl_print_bool(bool b){ fputs(b ? \"true\" : \"false\", stdout); }\n"
+"\n"
+"/* Reads a line from stdin, without its newline */\n"
+"static char* fl_line;\n"
+"static size_t fl_line_len, fl_line_cap;\n"
+"\n"
+"static void fl_read_line(void){\n"
+"	int c;\n"
+"	fflush(stdout);\n"
+"	fl_line_len = 0;\n"
+"	while((c = getchar()) != EOF && c != '\\n'){\n"
+"		if(fl_line_len + 1 >= fl_line_cap){\n"
+"			fl_line_cap = fl_line_cap ? fl_line_cap * 2 : 128;\n"
+"			fl_line = (char*) realloc(fl_line, fl_line_cap);\n"
+"			if(!fl_line)\n"
+"				fl_fail(\"input\", \"out of memory\");\n"
+"		}\n"
+"		fl_line[fl_line_len++] = c;\n"
+"	}\n"
+"	if(fl_line)\n"
+"		fl_line[fl_line_len] = '\\0';\n"
+"}\n"
+"\n"
+"static void fl_input_str(fl_str* var){\n"
+"	fl_read_line();\n"
+"	char* data = fl_alloc(fl_line_len);\n"
+"	if(fl_line_len)\n"
+"		memcpy(data, fl_line, fl_line_len);\n"
+"	if(var->cap)\n"
+"		free((char*) var->data);\n"
+"	*var = (fl_str){data, fl_line_len, fl_line_len ? fl_line_len : 1};\n"
+"}\n"
+"\n"
+"static int8_t fl_input_char(void){ fl_read_line(); return fl_line_len ? fl_line[0] : '\\0'; }\n"
+"static bool fl_input_bool(void){ fl_read_line(); return fl_line_len && (!strcmp(fl_line, \"true\") || atoi(fl_line)); }\n"
+"static int64_t fl_input_i64(void){ fl_read_line(); return fl_line_len ? strtoll(fl_line, NULL, 10) : 0; }\n"
+"static uint64_t fl_input_u64(void){ fl_read_line(); return fl_line_len ? strtoull(fl_line, NULL, 10) : 0; }\n"
+"static double fl_input_f64(void){ fl_read_line(); return fl_line_len ? strtod(fl_line, NULL) : 0.0; }\n"
+"static int64_t fl_getchar(void){ fflush(stdout); return getchar(); }\n"
+"\n";
+
+#endif
@@ -0,0 +1,579 @@
+// statx and AT_EMPTY_PATH
+#define _GNU_SOURCE
+
+#include "aio.h"
+#include "fstring.h"
+#include "../FL/datastructures.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef FERRO_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+bool aio_uring_enabled = true;
+
+// Steps an operation goes through, one system call each
+enum{
+	step_open,
+	step_stat,
+	step_read,
+	step_write,
+	step_close,
+	step_done
+};
+
+typedef struct{
+	uint8_t op;
+	uint8_t step;
+	bool failed;
+	bool regular;		// Read by async_read_file, a regular file with a known size
+	int fd;
+	int flags;			// Of the open
+	char* path;			// NUL terminated copy
+	char* data;			// Read buffer
+	size_t size;		// Bytes to read / write, capacity of the buffer of async_read_file
+	size_t len;			// Bytes read / written so far
+	uint64_t offset;
+	value_t value;		// Data of a write, kept until it completes
+	int64_t result;		// -errno once failed
+#ifdef FERRO_IO_URING
+	struct statx stat;
+#endif
+} aio_request;
+
+typedef DYNAMIC_ARRAY(aio_request** reqs) aio_request_list;
+typedef DYNAMIC_ARRAY(int64_t* handles) aio_handle_list;
+
+static aio_request_list requests = NEW_DYNAMIC_ARRAY(sizeof(aio_request*));	// Indexed by handle
+static aio_handle_list free_handles = NEW_DYNAMIC_ARRAY(sizeof(int64_t));
+static aio_request_list backlog = NEW_DYNAMIC_ARRAY(sizeof(aio_request*));	// Steps not submitted yet
+static size_t backlog_head = 0;
+static size_t pending = 0;	// Requests not done
+
+static char aio_message[128];
+
+// Fails the request, closing what it opened
+static void aio_fail(aio_request* req, int64_t err){
+	if(!req->failed){
+		req->failed = true;
+		req->result = err;
+	}
+	req->step = (req->op == aio_read_file && req->fd >= 0) ? step_close : step_done;
+}
+
+static void aio_advance(aio_request* req, int64_t res){
+	switch(req->step){
+	case step_open:
+		if(res < 0){
+			aio_fail(req, res);
+			break;
+		}
+		req->fd = res;
+		if(req->op == aio_open){
+			req->result = res;
+			req->step = step_done;
+		}else
+			req->step = step_stat;
+		break;
+	case step_stat:
+		if(res < 0){
+			aio_fail(req, res);
+			break;
+		}
+		// Room for one more byte, so that reaching the end takes a single read
+		req->size = (req->regular && req->size < UINT32_MAX) ? req->size + 1 : AIO_READ_CHUNK;
+		if(!(req->data = (char*) malloc(req->size))){
+			aio_fail(req, -ENOMEM);
+			break;
+		}
+		req->step = step_read;
+		break;
+	case step_read:
+		if(res < 0){
+			aio_fail(req, res);
+			break;
+		}
+		req->len += res;
+		if(req->op == aio_read){
+			req->result = req->len;
+			req->step = step_done;
+		}else if(!res || (req->regular && req->len < req->size)){
+			req->result = req->len;
+			req->step = step_close;
+		}else if(req->len == req->size){
+			if(req->size >= UINT32_MAX){
+				aio_fail(req, -EFBIG);
+				break;
+			}
+			size_t size = (req->size * 2 < UINT32_MAX) ? req->size * 2 : UINT32_MAX;
+			char* data = (char*) realloc(req->data, size);
+			if(!data){
+				aio_fail(req, -ENOMEM);
+				break;
+			}
+			req->data = data;
+			req->size = size;
+		}
+		break;
+	case step_write:
+		if(res < 0){
+			aio_fail(req, res);
+			break;
+		}
+		req->len += res;
+		if(!res || req->len == req->size){
+			req->result = req->len;
+			req->step = step_done;
+		}
+		break;
+	case step_close:
+		req->fd = -1;
+		if(res < 0)
+			aio_fail(req, res);
+		else if(req->op == aio_close)
+			req->result = 0;
+		req->step = step_done;
+		break;
+	}
+}
+
+// Advances the request with the result of its current step
+static void aio_complete(aio_request* req, int64_t res){
+	aio_advance(req, res);
+	if(req->step == step_done)
+		pending--;
+}
+
+static void aio_mem_error(void){
+	printf("Failed to allocate memory for asynchronous I/O!\n");
+	exit(EXIT_FAILURE);
+}
+
+static void aio_queue(aio_request* req){
+	if(!dynamic_array_pushback((dynamic_array_t*) &backlog, &req))
+		aio_mem_error();
+}
+
+static const char* aio_write_data(aio_request* req){
+	return value_str_data(&req->value) + req->len;
+}
+
+// Waits until a descriptor that would block is ready
+static bool aio_poll(int fd, short events){
+	struct pollfd pfd = {.fd = fd, .events = events};
+	int res;
+	while((res = poll(&pfd, 1, -1)) < 0 && errno == EINTR);
+	return res > 0;
+}
+
+// Runs the current step of a request right away
+static int64_t aio_run_step(aio_request* req){
+	ssize_t res;
+	switch(req->step){
+	case step_open:
+		while((res = open(req->path, req->flags | O_CLOEXEC, 0666)) < 0 && errno == EINTR);
+		break;
+	case step_stat: {
+		struct stat st;
+		if((res = fstat(req->fd, &st)) < 0)
+			break;
+		req->regular = S_ISREG(st.st_mode) && st.st_size > 0;
+		req->size = st.st_size;
+		break;
+	}
+	case step_read:
+		do{
+			res = pread(req->fd, req->data + req->len, req->size - req->len, req->offset + req->len);
+			if(res < 0 && errno == ESPIPE)
+				res = read(req->fd, req->data + req->len, req->size - req->len);
+		}while(res < 0 && (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && aio_poll(req->fd, POLLIN))));
+		break;
+	case step_write:
+		do{
+			res = pwrite(req->fd, aio_write_data(req), req->size - req->len, req->offset + req->len);
+			if(res < 0 && errno == ESPIPE)
+				res = write(req->fd, aio_write_data(req), req->size - req->len);
+		}while(res < 0 && (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && aio_poll(req->fd, POLLOUT))));
+		break;
+	default:
+		res = close(req->fd);
+		// The descriptor is gone either way
+		if(res < 0 && errno == EINTR)
+			res = 0;
+		break;
+	}
+	return (res < 0) ? -errno : res;
+}
+
+#ifdef FERRO_IO_URING
+
+// Submission and completion queues shared with the kernel
+static struct{
+	int fd;
+	void* sq_ring;
+	void* cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	unsigned int sq_entries, cq_entries;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	unsigned int queued;	// Entries written to the submission queue, not consumed yet
+	unsigned int inflight;	// Entries without a completion yet
+} ring = {.fd = -1};
+static bool ring_tried = false;
+
+static const uint8_t ring_ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+
+// Whether the kernel has every operation the steps use
+static bool aio_ring_probe(void){
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe* probe = (struct io_uring_probe*) calloc(1, size);
+	if(!probe)
+		return false;
+	bool supported = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+	for(size_t i = 0; supported && i < sizeof(ring_ops); i++)
+		supported = ring_ops[i] <= probe->last_op && (probe->ops[ring_ops[i]].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	return supported;
+}
+
+static void aio_ring_close(void){
+	if(ring.sqes)
+		munmap(ring.sqes, ring.sq_entries * sizeof(struct io_uring_sqe));
+	if(ring.cq_ring && ring.cq_ring != ring.sq_ring)
+		munmap(ring.cq_ring, ring.cq_ring_size);
+	if(ring.sq_ring)
+		munmap(ring.sq_ring, ring.sq_ring_size);
+	if(ring.fd >= 0)
+		close(ring.fd);
+	memset(&ring, 0, sizeof(ring));
+	ring.fd = -1;
+}
+
+// Sets the ring up the first time it is needed
+static bool aio_ring_open(void){
+	if(ring_tried)
+		return ring.fd >= 0;
+	ring_tried = true;
+	if(!aio_uring_enabled)
+		return false;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	if((ring.fd = syscall(__NR_io_uring_setup, AIO_QUEUE, &params)) < 0 || !aio_ring_probe()){
+		aio_ring_close();
+		return false;
+	}
+
+	ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	// Both rings come from one mapping when the kernel allows it
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		if(ring.cq_ring_size > ring.sq_ring_size)
+			ring.sq_ring_size = ring.cq_ring_size;
+		ring.cq_ring_size = ring.sq_ring_size;
+	}
+	ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+	if(ring.sq_ring == MAP_FAILED){
+		ring.sq_ring = NULL;
+		aio_ring_close();
+		return false;
+	}
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+		ring.cq_ring = ring.sq_ring;
+	else if((ring.cq_ring = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING)) == MAP_FAILED){
+		ring.cq_ring = NULL;
+		aio_ring_close();
+		return false;
+	}
+	ring.sq_entries = params.sq_entries;
+	ring.sqes = (struct io_uring_sqe*) mmap(NULL, ring.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+	if(ring.sqes == MAP_FAILED){
+		ring.sqes = NULL;
+		aio_ring_close();
+		return false;
+	}
+
+	char* sq = (char*) ring.sq_ring;
+	char* cq = (char*) ring.cq_ring;
+	ring.sq_head = (unsigned int*)(sq + params.sq_off.head);
+	ring.sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+	ring.sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	ring.sq_array = (unsigned int*)(sq + params.sq_off.array);
+	ring.cq_head = (unsigned int*)(cq + params.cq_off.head);
+	ring.cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+	ring.cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	ring.cq_entries = params.cq_entries;
+	return true;
+}
+
+// Writes the current step of a request to the submission queue
+static void aio_ring_prep(aio_request* req){
+	unsigned int tail = *ring.sq_tail;
+	unsigned int index = tail & *ring.sq_mask;
+	struct io_uring_sqe* sqe = &ring.sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uint64_t)(uintptr_t) req;
+	switch(req->step){
+	case step_open:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t) req->path;
+		sqe->len = 0666;
+		sqe->open_flags = req->flags | O_CLOEXEC;
+		break;
+	case step_stat:
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = req->fd;
+		sqe->addr = (uintptr_t) "";
+		sqe->len = STATX_TYPE | STATX_SIZE;
+		sqe->off = (uintptr_t) &req->stat;
+		sqe->statx_flags = AT_EMPTY_PATH;
+		break;
+	case step_read:
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = req->fd;
+		sqe->addr = (uintptr_t)(req->data + req->len);
+		sqe->len = req->size - req->len;
+		sqe->off = req->offset + req->len;
+		break;
+	case step_write:
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = req->fd;
+		sqe->addr = (uintptr_t) aio_write_data(req);
+		sqe->len = req->size - req->len;
+		sqe->off = req->offset + req->len;
+		break;
+	default:
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = req->fd;
+		break;
+	}
+	ring.sq_array[index] = index;
+	__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring.queued++;
+	ring.inflight++;
+}
+
+// Handles every completion posted so far
+static void aio_ring_reap(void){
+	unsigned int head = *ring.cq_head;
+	unsigned int tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+	for(; head != tail; head++){
+		struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+		aio_request* req = (aio_request*)(uintptr_t) cqe->user_data;
+		ring.inflight--;
+		if(req->step == step_stat && cqe->res >= 0){
+			req->regular = S_ISREG(req->stat.stx_mode) && req->stat.stx_size > 0;
+			req->size = req->stat.stx_size;
+		}
+		aio_complete(req, cqe->res);
+		if(req->step != step_done)
+			aio_queue(req);
+	}
+	__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Submits the backlog in one call, waiting for a completion if asked to
+static void aio_ring_pump(bool wait){
+	unsigned int sq_head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+	// A completion for every entry in flight has to fit the completion queue
+	while(backlog_head < backlog.size && *ring.sq_tail - sq_head < ring.sq_entries && ring.inflight < ring.cq_entries)
+		aio_ring_prep(backlog.reqs[backlog_head++]);
+	unsigned int flags = (wait && ring.inflight) ? IORING_ENTER_GETEVENTS : 0;
+	if(ring.queued || flags){
+		int res;
+		while((res = syscall(__NR_io_uring_enter, ring.fd, ring.queued, flags ? 1 : 0, flags, NULL, 0)) < 0){
+			if(errno == EAGAIN || errno == EBUSY){
+				aio_ring_reap();
+				continue;
+			}
+			if(errno != EINTR){
+				printf("Failed to submit asynchronous I/O (%s)!\n", strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+		}
+		ring.queued -= res;
+	}
+	aio_ring_reap();
+}
+
+#endif
+
+// Hands the backlog over, handling the completions
+// wait : block until at least one step completes
+static void aio_pump(bool wait){
+#ifdef FERRO_IO_URING
+	if(aio_ring_open()){
+		aio_ring_pump(wait);
+		if(backlog_head == backlog.size)
+			backlog.size = backlog_head = 0;
+		return;
+	}
+#endif
+	(void) wait;
+	// Steps queued meanwhile run in the same batch
+	while(backlog_head < backlog.size){
+		aio_request* req = backlog.reqs[backlog_head++];
+		aio_complete(req, aio_run_step(req));
+		if(req->step != step_done)
+			aio_queue(req);
+	}
+	backlog.size = backlog_head = 0;
+}
+
+static char* aio_path(value_t v){
+	char* path = (char*) malloc(v.len + 1);
+	if(!path)
+		return NULL;
+	memcpy(path, value_str_data(&v), v.len);
+	path[v.len] = '\0';
+	return path;
+}
+
+static void aio_free(aio_request* req){
+	free(req->path);
+	free(req->data);
+	value_release(req->value);
+	free(req);
+}
+
+// Starts an operation on its arguments, storing its future in handle
+const char* aio_start(uint8_t op, value_t* args, int64_t* handle){
+	aio_request* req = (aio_request*) calloc(1, sizeof(aio_request));
+	if(!req)
+		return "failed to allocate asynchronous operation";
+	req->op = op;
+	req->fd = -1;
+	switch(op){
+	case aio_open: {
+		const char* mode = value_str_data(&args[1]);
+		size_t mode_len = args[1].len;
+		if(mode_len == 1 && mode[0] == 'r')
+			req->flags = O_RDONLY;
+		else if(mode_len == 1 && mode[0] == 'w')
+			req->flags = O_WRONLY | O_CREAT | O_TRUNC;
+		else if(mode_len == 1 && mode[0] == 'a')
+			req->flags = O_WRONLY | O_CREAT | O_APPEND;
+		else if(mode_len == 2 && mode[0] == 'r' && mode[1] == '+')
+			req->flags = O_RDWR;
+		else{
+			free(req);
+			return "invalid file mode (expected \"r\", \"w\", \"a\" or \"r+\")";
+		}
+	}
+	// fallthrough
+	case aio_read_file:
+		if(!(req->path = aio_path(args[0]))){
+			free(req);
+			return "failed to allocate asynchronous operation";
+		}
+		req->step = step_open;
+		break;
+	case aio_read:
+	case aio_write:
+		if(args[1].i < 0){
+			free(req);
+			return "negative file offset";
+		}
+		req->fd = args[0].i;
+		req->offset = args[1].i;
+		if(op == aio_write){
+			req->value = args[2];
+			req->size = args[2].len;
+			value_retain(req->value);
+			req->step = step_write;
+			break;
+		}
+		if(args[2].i < 0 || args[2].i > UINT32_MAX){
+			free(req);
+			return "invalid read size";
+		}
+		req->size = args[2].i;
+		if(!(req->data = (char*) malloc(req->size ? req->size : 1))){
+			free(req);
+			return "failed to allocate read buffer";
+		}
+		req->step = step_read;
+		break;
+	default:
+		req->fd = args[0].i;
+		req->step = step_close;
+		break;
+	}
+
+	if(free_handles.size){
+		*handle = free_handles.handles[--free_handles.size];
+		requests.reqs[*handle] = req;
+	}else{
+		*handle = requests.size;
+		if(!dynamic_array_pushback((dynamic_array_t*) &requests, &req))
+			aio_mem_error();
+	}
+	pending++;
+	aio_queue(req);
+	if(backlog.size - backlog_head >= AIO_QUEUE)
+		aio_pump(false);
+	return NULL;
+}
+
+// Waits for a future and stores its result in out, freeing the future
+// want_str : the data read instead of the byte count
+const char* aio_await(int64_t handle, bool want_str, value_t* out){
+	if(handle < 0 || (size_t) handle >= requests.size || !requests.reqs[handle])
+		return "invalid future";
+	aio_request* req = requests.reqs[handle];
+	if(want_str && req->op != aio_read && req->op != aio_read_file)
+		return "await_str expects the future of a read";
+	while(req->step != step_done)
+		aio_pump(true);
+
+	const char* err = NULL;
+	if(!want_str)
+		*out = VALUE_INT(var_i64, req->result);
+	else if(req->failed){
+		snprintf(aio_message, sizeof(aio_message), "%s failed: %s", (req->op == aio_read) ? "async_read" : "async_read_file", strerror(-req->result));
+		err = aio_message;
+	}else{
+		*out = str_new(req->data, req->len);
+		if(out->type != var_str)
+			err = "failed to allocate string";
+	}
+	aio_free(req);
+	requests.reqs[handle] = NULL;
+	if(!dynamic_array_pushback((dynamic_array_t*) &free_handles, &handle))
+		aio_mem_error();
+	return err;
+}
+
+// Completes every operation started, then frees them
+void aio_finish(void){
+	while(pending)
+		aio_pump(true);
+	for(size_t i = 0; i < requests.size; i++)
+		if(requests.reqs[i])
+			aio_free(requests.reqs[i]);
+	dynamic_array_free((dynamic_array_t*) &requests);
+	dynamic_array_free((dynamic_array_t*) &free_handles);
+	dynamic_array_free((dynamic_array_t*) &backlog);
+	requests = (aio_request_list) NEW_DYNAMIC_ARRAY(sizeof(aio_request*));
+	free_handles = (aio_handle_list) NEW_DYNAMIC_ARRAY(sizeof(int64_t));
+	backlog = (aio_request_list) NEW_DYNAMIC_ARRAY(sizeof(aio_request*));
+	backlog_head = 0;
+#ifdef FERRO_IO_URING
+	aio_ring_close();
+	ring_tried = false;
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef FERRO_AIO_H
+#define FERRO_AIO_H
+
+#include "value.h"
+
+// Asynchronous file I/O behind the async_* built-ins
+// Every operation a script starts gets a future, an i64 handle that
+// await / await_str resolve. Operations are queued and only handed to the
+// kernel once the script awaits one of them (or the queue is full), so all
+// the operations started in between go in a single system call
+// Operations in flight together complete in any order: await a write
+// before closing its file or reading what it wrote
+// They run on io_uring when the kernel has it. Otherwise every batch runs
+// when it is submitted, waiting with poll for the descriptors that are not
+// ready (regular files always are)
+#define AIO_QUEUE 256			// Operations submitted at once
+#define AIO_READ_CHUNK 65536	// First read of a file whose size is unknown
+
+enum{
+	aio_open,		// async_open(path, mode): fd
+	aio_read,		// async_read(fd, offset, size): data
+	aio_write,		// async_write(fd, offset, data): bytes written
+	aio_close,		// async_close(fd): 0
+	aio_read_file,	// async_read_file(path): data
+	aio_op_count
+};
+
+extern bool aio_uring_enabled;
+
+const char* aio_start(uint8_t,value_t*,int64_t*);
+const char* aio_await(int64_t,bool,value_t*);
+void aio_finish(void);
+
+#endif
@@ -0,0 +1,130 @@
+#include "batch.h"
+#include "compiler.h"
+#include "../FL/textstyle.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <ctype.h>
+
+unsigned int batch_threads = 0;
+
+typedef DYNAMIC_ARRAY(batch_job* jobs) batch_job_list;
+static batch_job_list jobs = NEW_DYNAMIC_ARRAY(sizeof(batch_job));
+static size_t next_job = 0;		// Next job a worker takes
+
+static double batch_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Queues a script, (path) is copied
+bool batch_add(const char* path){
+	char* copy = strdup(path);
+	batch_job job = {copy, EXIT_FAILURE, 0.0, NULL, 0};
+	if(!copy || !dynamic_array_pushback((dynamic_array_t*)&jobs, &job)){
+		free(copy);
+		return false;
+	}
+	return true;
+}
+
+// Queues every script listed in a manifest, one path per line
+// Blank lines and lines starting with '#' are skipped
+bool batch_add_manifest(const char* path){
+	FILE* manifest = fopen(path, "r");
+	if(!manifest){
+		printf("failed to open manifest %s\n", path);
+		return false;
+	}
+	char line[4096];
+	bool success = true;
+	while(success && fgets(line, sizeof(line), manifest)){
+		size_t len = strlen(line);
+		while(len && isspace((unsigned char) line[len-1]))
+			line[--len] = '\0';
+		if(len && line[0] != '#')
+			success = batch_add(line);
+	}
+	fclose(manifest);
+	return success;
+}
+
+// Tokenizes, parses and compiles one script on the calling thread
+static void batch_check(batch_job* job){
+	double start = batch_clock();
+	FILE* log = open_memstream(&job->log, &job->log_size);
+	fl_output = log;
+	char* path = strdup(job->path);
+	file_t* file = path ? open_file(path) : NULL;
+	if(file && tokenize(file)){
+		node_prog prog;
+		if(parse(&prog, file)){
+			bc_chunk chunk;
+			if(compile(&chunk, &prog))
+				job->status = EXIT_SUCCESS;
+			bc_free(&chunk);
+		}
+		parser_free(&prog);
+	}
+	tk_free();
+	fl_output = NULL;
+	if(log)
+		fclose(log);
+	job->ms = batch_clock() - start;
+}
+
+static void* batch_worker(void* arg){
+	(void) arg;
+	size_t i;
+	while((i = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED)) < jobs.size)
+		batch_check(&jobs.jobs[i]);
+	return NULL;
+}
+
+// Checks every queued script, prints the results and frees the jobs
+// Fails if any script does
+int batch_run(void){
+	double start = batch_clock();
+	size_t threads = batch_threads;
+	if(!threads){
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cores > 0) ? cores : 1;
+	}
+	if(threads > jobs.size)
+		threads = jobs.size ? jobs.size : 1;
+
+	// The calling thread is a worker too
+	pthread_t* workers = (pthread_t*) malloc(threads * sizeof(pthread_t));
+	size_t started = 0;
+	while(workers && started + 1 < threads && !pthread_create(&workers[started], NULL, batch_worker, NULL))
+		started++;
+	(void) batch_worker(NULL);
+	for(size_t i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	free(workers);
+
+	size_t failed = 0;
+	for(size_t i = 0; i < jobs.size; i++){
+		batch_job* job = &jobs.jobs[i];
+		if(job->status != EXIT_SUCCESS)
+			failed++;
+		printf(
+			"%s" RESET_ATTR " exit %d %10.3f ms  %s\n",
+			(job->status == EXIT_SUCCESS) ? GREEN_FG BOLD "ok   " : RED_FG BOLD "error",
+			job->status, job->ms, job->path
+		);
+		if(job->log_size)
+			fwrite(job->log, 1, job->log_size, stdout);
+		free(job->log);
+		free((void*) job->path);
+	}
+	printf(
+		"%sbatch: %lu script(s), %lu failed, %.3f ms on %lu thread(s)" RESET_ATTR "\n",
+		failed ? RED_FG BOLD : GREEN_FG BOLD,
+		(unsigned long) jobs.size, (unsigned long) failed, batch_clock() - start, (unsigned long) (started + 1)
+	);
+	dynamic_array_free((dynamic_array_t*)&jobs);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
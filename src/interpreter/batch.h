@@ -0,0 +1,27 @@
+#ifndef FERRO_BATCH_H
+#define FERRO_BATCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Batch mode (--batch)
+// Every script is tokenized, parsed and compiled (not run) by a pool of
+// worker threads, each holding its own front end state
+// Files are loaded once and shared by every script including them
+// Diagnostics of a script are gathered while it is checked and printed
+// with its result, in the order the scripts were given
+typedef struct{
+	const char* path;
+	int status;			// EXIT_SUCCESS / EXIT_FAILURE
+	double ms;
+	char* log;			// Diagnostics
+	size_t log_size;
+} batch_job;
+
+extern unsigned int batch_threads;	// 0 for one per core
+
+bool batch_add(const char*);
+bool batch_add_manifest(const char*);
+int batch_run(void);
+
+#endif
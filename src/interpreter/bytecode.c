@@ -0,0 +1,193 @@
+#include "bytecode.h"
+#include "kernels.h"
+#include "aio.h"
+
+const char* const bc_op_names[] = {
+	"halt",
+	"loadk",
+	"move",
+	"cast",
+	"decl",
+	"getvar",
+	"setvar",
+	"append",
+	"new",
+	"getindex",
+	"setindex",
+	"push",
+	"pop",
+	"has",
+	"remove",
+	"unshare",
+	"len",
+	"string",
+	"reduce",
+	"add",
+	"sub",
+	"mul",
+	"div",
+	"mod",
+	"shl",
+	"band",
+	"neg",
+	"eq",
+	"neq",
+	"lt",
+	"leq",
+	"gt",
+	"geq",
+	"strict_eq",
+	"type_eq",
+	"and",
+	"or",
+	"xor",
+	"push_scope",
+	"pop_scope",
+	"jmp",
+	"jmpf",
+	"loop",
+	"kernel",
+	"pfor",
+	"pfor_end",
+	"print",
+	"putchar",
+	"input",
+	"getchar",
+	"flush",
+	"async",
+	"await",
+	"exit",
+};
+
+// Prints every instruction of a chunk in a debugging manner
+void bc_disassemble(bc_chunk* chunk){
+	for(size_t i = 0; i < chunk->code.size; i++){
+		bc_insn* insn = &chunk->code.insns[i];
+		printf("%04lu %-10s", (unsigned long) i, bc_op_names[insn->op]);
+		switch(insn->op){
+		case op_decl:
+		case op_getvar:
+		case op_setvar:
+		case op_getindex:
+		case op_setindex:
+		case op_push:
+		case op_pop:
+		case op_has:
+		case op_remove:
+		case op_unshare:
+		case op_input:
+		case op_getchar:{
+			token* tk = chunk->tokens.tks[i];
+			if(insn->a != BC_NONE)
+				printf(" r%u", insn->a);
+			printf(" v%u:%u %s", insn->b, insn->c, var_type_name(insn->type));
+			if(tk)
+				printf(" (%.*s)", (int) tk->strlen, tk->str);
+			break;
+		}case op_push_scope:
+		case op_pop_scope:
+			printf(" d%u #%u", insn->b, insn->c);
+			break;
+		case op_jmp:
+			printf(" @%04lu", (unsigned long) BC_TARGET(insn));
+			break;
+		case op_jmpf:
+			printf(" r%u @%04lu", insn->a, (unsigned long) BC_TARGET(insn));
+			break;
+		case op_loop:
+			printf(" #%u @%04lu", insn->a, (unsigned long) BC_TARGET(insn));
+			break;
+		case op_pfor:
+			printf(" r%u @%04lu", insn->a, (unsigned long) BC_TARGET(insn));
+			break;
+		case op_kernel:{
+			static const char* const names[] = {
+				"add", "sub", "mul", "div", "eq", "neq", "lt", "leq", "gt", "geq", "sum", "min", "max", "dot"
+			};
+			bc_kernel_loop* loop = &chunk->kernel_loops.loops[insn->a];
+			printf(" #%u %s %s v%u:%u", insn->a, names[loop->op], var_type_name(loop->type), loop->dst[0], loop->dst[1]);
+			printf(" v%u:%u", loop->a[0], loop->a[1]);
+			if(loop->op != kernel_sum)
+				printf(" v%u:%u", loop->b[0], loop->b[1]);
+			printf(" for v%u:%u < len v%u:%u", loop->index[0], loop->index[1], loop->bound[0], loop->bound[1]);
+			break;
+		}case op_reduce:{
+			static const char* const names[] = {"sum", "min", "max", "dot"};
+			printf(" r%u r%u %s %s", insn->a, insn->b, names[insn->c - kernel_sum], var_type_name(insn->type));
+			break;
+		}case op_loadk:
+			printf(" r%u k%u", insn->a, insn->b);
+			break;
+		case op_new:
+			printf(" r%u %s<", insn->a, var_type_name(insn->type));
+			if(insn->type == var_dict)
+				printf("%s, ", var_type_name(insn->c));
+			printf("%s>", var_type_name(insn->b));
+			break;
+		case op_move:
+		case op_len:
+			printf(" r%u r%u", insn->a, insn->b);
+			break;
+		case op_cast:
+			printf(" r%u r%u %s -> %s", insn->a, insn->b, var_type_name(insn->c), var_type_name(insn->type));
+			break;
+		case op_neg:
+			printf(" r%u r%u %s", insn->a, insn->b, var_type_name(insn->type));
+			break;
+		case op_add:
+		case op_sub:
+		case op_mul:
+		case op_div:
+		case op_mod:
+		case op_shl:
+		case op_band:
+		case op_eq:
+		case op_neq:
+		case op_lt:
+		case op_leq:
+		case op_gt:
+		case op_geq:
+		case op_strict_eq:
+		case op_type_eq:
+		case op_and:
+		case op_or:
+		case op_xor:
+			printf(" r%u r%u r%u %s", insn->a, insn->b, insn->c, var_type_name(insn->type));
+			break;
+		case op_print:
+			printf(" r%u #%u", insn->a, insn->b);
+			break;
+		case op_putchar:
+		case op_exit:
+			printf(" r%u", insn->a);
+			break;
+		case op_async:{
+			static const char* const names[] = {"open", "read", "write", "close", "read_file"};
+			printf(" r%u r%u %s", insn->a, insn->b, names[insn->c]);
+			break;
+		}case op_string:{
+			static const char* const names[] = {"mapfile", "slice", "find"};
+			printf(" r%u r%u %s", insn->a, insn->b, names[insn->c]);
+			break;
+		}case op_await:
+			printf(" r%u r%u %s", insn->a, insn->b, var_type_name(insn->type));
+			break;
+		}
+		putchar('\n');
+	}
+}
+
+void bc_free(bc_chunk* chunk){
+	if(!chunk)
+		return;
+	for(size_t i = 0; i < chunk->strings.size; i++)
+		free(chunk->strings.strs[i]);
+	dynamic_array_free((dynamic_array_t*)&chunk->code);
+	dynamic_array_free((dynamic_array_t*)&chunk->tokens);
+	dynamic_array_free((dynamic_array_t*)&chunk->consts);
+	dynamic_array_free((dynamic_array_t*)&chunk->strings);
+	dynamic_array_free((dynamic_array_t*)&chunk->kernel_loops);
+	chunk->reg_count = 0;
+	chunk->global_count = 0;
+	chunk->loop_count = 0;
+}
@@ -0,0 +1,137 @@
+#ifndef FERRO_BYTECODE_H
+#define FERRO_BYTECODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../FL/datastructures.h"
+#include "../FL/tokenizer.h"
+#include "variables.h"
+
+// Register bytecode
+// Every instruction is 8 bytes: an opcode, a type operand
+// and up to three 16 bit operands (registers, constants or slots)
+// Variables are addressed as V[b:c], slot c of the scope at depth b
+// Operators carry the type the compiler resolved for their operands,
+// which are converted to it beforehand (cast), so they never look at tags
+enum{
+	op_halt = 0,
+	op_loadk,		// R[a] = K[b]
+	op_move,		// R[a] = R[b]
+	op_cast,		// R[a] = R[b] (of type c) converted to type
+	op_decl,		// declare V[b:c] of type, = R[a] (or zero if a == BC_NONE)
+	op_getvar,		// R[a] = V[b:c]
+	op_setvar,		// V[b:c] = R[a]
+	op_append,		// V[b:c] = V[b:c] + R[a] (str, in place when unshared)
+	op_new,			// R[a] = new list / dict (type), of element type b and key type c
+	op_getindex,	// R[a] = V[b:c][R[a]]
+	op_setindex,	// V[b:c][R[a]] = R[a+1]
+	op_push,		// push R[a] onto list V[b:c]
+	op_pop,			// R[a] = pop list V[b:c]
+	op_has,			// R[a] = dict V[b:c] has key R[a]
+	op_remove,		// remove key R[a] from dict V[b:c]
+	op_unshare,		// give list V[b:c] a block of its own (written by a parallel for)
+	op_len,			// R[a] = length of R[b] (str, list or dict)
+	op_string,		// R[a] = string built-in c (fstring.h) on R[b] ...
+	op_reduce,		// R[a] = reduction c (kernels.h) of list R[b] (and R[b+1]), elements of type
+	op_add,			// R[a] = R[b] + R[c]
+	op_sub,			// R[a] = R[b] - R[c]
+	op_mul,			// R[a] = R[b] * R[c]
+	op_div,			// R[a] = R[b] / R[c]
+	op_mod,			// R[a] = R[b] % R[c]
+	op_shl,			// R[a] = R[b] << R[c] (integers)
+	op_band,		// R[a] = R[b] & R[c] (integers)
+	op_neg,			// R[a] = -R[b]
+	op_eq,			// R[a] = R[b] == R[c]
+	op_neq,			// R[a] = R[b] != R[c]
+	op_lt,			// R[a] = R[b] < R[c]
+	op_leq,			// R[a] = R[b] <= R[c]
+	op_gt,			// R[a] = R[b] > R[c]
+	op_geq,			// R[a] = R[b] >= R[c]
+	op_strict_eq,	// R[a] = R[b] === R[c] (same type and value)
+	op_type_eq,		// R[a] = R[b] ?= R[c] (same type)
+	op_and,			// R[a] = R[b] and R[c]
+	op_or,			// R[a] = R[b] or R[c]
+	op_xor,			// R[a] = R[b] xor R[c]
+	op_push_scope,	// open scope at depth b with c slots
+	op_pop_scope,	// close scope at depth b with c slots
+	op_jmp,			// jump to T
+	op_jmpf,		// jump to T if R[a] is false
+	op_loop,		// back edge of loop a, jump to T (its condition)
+	op_kernel,		// run kernel loop a, if it applies, in place of the loop that follows
+	op_pfor,		// run the body that follows for R[a+2] = R[a] ... R[a+1] - 1 on the pool, then jump to T
+					// (on the caller if some index is negative or does not fit the loop variable's type)
+	op_pfor_end,	// end of a parallel for body
+	op_print,		// print R[a] ... R[a+b-1]
+	op_putchar,		// putchar R[a]
+	op_input,		// read V[b:c] from stdin
+	op_getchar,		// read a character into V[b:c]
+	op_flush,		// write out buffered output
+	op_async,		// R[a] = future of asynchronous operation c (aio.h) on R[b] ...
+	op_await,		// R[a] = result of future R[b], the data read if type is str
+	op_exit,		// exit with status R[a]
+	op_count
+};
+typedef uint8_t bc_op;
+
+#define BC_NONE 0xFFFF
+#define BC_MAX_OPERAND 0xFFFE
+
+// Jump targets (T) are 32 bit instruction indices split over b:c
+#define BC_TARGET(insn) (((uint32_t)(insn)->b << 16) | (insn)->c)
+#define BC_MAX_TARGET 0xFFFFFFFF
+
+typedef struct{
+	bc_op op;
+	var_type type;
+	uint16_t a, b, c;
+} bc_insn;
+
+// Loop the compiler matched to a kernel (see compile_kernel_loop):
+//	while(index < len(bound)){ dst[index] = a[index] op b[index]; index = index + 1; }
+//	while(index < len(bound)){ dst = dst + a[index] (* b[index]); index = index + 1; }
+// Variables are (depth, slot) pairs like the operands of instructions
+typedef struct{
+	uint8_t op;			// kernel_add ... kernel_geq, or kernel_sum / kernel_dot
+	var_type type;		// Element type of a and b
+	uint16_t index[2];
+	uint16_t bound[2];
+	uint16_t dst[2];	// List, or accumulator of a reduction
+	uint16_t a[2];
+	uint16_t b[2];		// Unused by kernel_sum
+} bc_kernel_loop;
+
+typedef DYNAMIC_ARRAY(bc_insn* insns) bc_code_t;
+typedef DYNAMIC_ARRAY(value_t* values) bc_consts_t;
+typedef DYNAMIC_ARRAY(token** tks) bc_tokens_t;
+typedef DYNAMIC_ARRAY(char** strs) bc_strings_t;
+typedef DYNAMIC_ARRAY(bc_kernel_loop* loops) bc_kernel_loops_t;
+
+typedef struct{
+	bc_code_t code;
+	bc_tokens_t tokens;		// Source token of every instruction (for errors)
+	bc_consts_t consts;
+	bc_strings_t strings;	// Unescaped string literals owned by the chunk
+	bc_kernel_loops_t kernel_loops;
+	uint16_t reg_count;
+	uint16_t global_count;	// Slots of the scope at depth 0
+	uint16_t loop_count;
+} bc_chunk;
+
+#define NEW_BC_CHUNK() { \
+	NEW_DYNAMIC_ARRAY(sizeof(bc_insn)), \
+	NEW_DYNAMIC_ARRAY(sizeof(token*)), \
+	NEW_DYNAMIC_ARRAY(sizeof(value_t)), \
+	NEW_DYNAMIC_ARRAY(sizeof(char*)), \
+	NEW_DYNAMIC_ARRAY(sizeof(bc_kernel_loop)), \
+	0, 0, 0 \
+}
+
+extern const char* const bc_op_names[];
+
+void bc_disassemble(bc_chunk*);
+void bc_free(bc_chunk*);
+
+#endif
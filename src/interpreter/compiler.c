@@ -0,0 +1,1438 @@
+#include "compiler.h"
+#include "kernels.h"
+#include "aio.h"
+#include "fstring.h"
+#include "../FL/hash.h"
+#include "../FL/textstyle.h"
+
+static FL_LOCAL bc_chunk* chunk;
+static FL_LOCAL uint16_t reg_top = 0;	// First free register
+
+static bool compile_error(const char* msg, token* tk){
+	file_t* file = (tk && tk->str) ? find_file_ptr(tk->str) : NULL;
+	return tk_error(msg, tk, file ? file : parser_file);
+}
+
+static void compiler_mem_error(const char* func){
+	printf(RED_FG BOLD "compiler - %s:" YELLOW_FG " %s" RESET_ATTR "\n",func,DS_ERROR_MSG);
+	exit(EXIT_FAILURE);
+}
+
+// Parallel for being compiled (see compile_for)
+// Its body runs on several threads at once, so emit rejects whatever could
+// touch memory another iteration uses: assignments to variables declared
+// outside of it, str / list / dict values other than through subscripts,
+// input / output and exit
+typedef struct{
+	bool active;
+	bool failed;		// Only the first error is reported
+	uint16_t depth;		// Scope depth of the body
+	uint16_t slot;		// Slot of the loop variable in the body
+	token* tk;
+} compile_pfor;
+static FL_LOCAL compile_pfor pfor;
+
+static void pfor_error(const char* msg, token* tk){
+	if(pfor.failed)
+		return;
+	pfor.failed = true;
+	(void) compile_error(msg, tk ? tk : pfor.tk);
+}
+
+static void pfor_check(bc_op op, var_type type, uint16_t b, token* tk){
+	switch(op){
+	case op_print:
+	case op_putchar:
+	case op_input:
+	case op_getchar:
+	case op_flush:
+	case op_async:
+	case op_await:
+		pfor_error("input / output cannot be used in a parallel for", tk);
+		return;
+	case op_exit:
+		pfor_error("exit cannot be used in a parallel for", tk);
+		return;
+	case op_push:
+	case op_pop:
+	case op_remove:
+		pfor_error("lists and dicts cannot grow or shrink in a parallel for", tk);
+		return;
+	// Checked by pfor_subscript
+	case op_getindex:
+	case op_setindex:
+	case op_has:
+		return;
+	case op_setvar:
+		if(b < pfor.depth){
+			pfor_error("cannot assign to a variable declared outside of a parallel for", tk);
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+	if(VAR_IS_COUNTED(type))
+		pfor_error("str, list and dict values can only be used through subscripts in a parallel for", tk);
+}
+
+static void emit(bc_op op, var_type type, uint16_t a, uint16_t b, uint16_t c, token* tk){
+	bc_insn insn = {op, type, a, b, c};
+	if(pfor.active)
+		pfor_check(op, type, b, tk);
+	if(!dynamic_array_pushback((dynamic_array_t*)&chunk->code, &insn)
+		|| !dynamic_array_pushback((dynamic_array_t*)&chunk->tokens, &tk))
+		compiler_mem_error("emit");
+}
+
+// Reserves a register above every live one
+static bool alloc_reg(uint16_t* reg, token* tk){
+	if(reg_top >= BC_MAX_OPERAND)
+		return compile_error("expression needs too many registers", tk);
+	*reg = reg_top++;
+	if(reg_top > chunk->reg_count)
+		chunk->reg_count = reg_top;
+	return true;
+}
+
+// Constants already in the chunk, so that a literal repeated any number
+// of times takes one slot (open addressing, a hash of 0 is an empty slot)
+typedef struct{
+	uint32_t* hashes;
+	uint16_t* indices;
+	size_t capacity;
+	size_t size;
+} const_table;
+static FL_LOCAL const_table consts_seen;
+
+// Constants are equal when their type and bits (or str bytes) are:
+// 0.0 and -0.0 stay apart, NaNs with the same bits share a slot
+static uint32_t const_hash(value_t value){
+	uint64_t h;
+	switch(value.type){
+	case var_str: h = hash_bytes(value_str_data(&value), value.len); break;
+	case var_bool: h = value.b; break;
+	default: h = value.u;
+	}
+	h = hash_finalize(h ^ ((uint64_t) value.type << 56));
+	uint32_t h32 = (uint32_t)(h ^ (h >> 32));
+	return h32 ? h32 : 1;
+}
+
+static bool const_eq(value_t a, value_t b){
+	if(a.type != b.type)
+		return false;
+	switch(a.type){
+	case var_str: return value_eq_str(a, b);
+	case var_bool: return a.b == b.b;
+	default: return a.u == b.u;
+	}
+}
+
+static size_t const_find(uint32_t hash, value_t value, bool* found){
+	size_t mask = consts_seen.capacity - 1;
+	size_t i = hash & mask;
+	for(; consts_seen.hashes[i]; i = (i + 1) & mask){
+		if(consts_seen.hashes[i] == hash && const_eq(chunk->consts.values[consts_seen.indices[i]], value)){
+			*found = true;
+			return i;
+		}
+	}
+	*found = false;
+	return i;
+}
+
+static void const_table_grow(void){
+	const_table old = consts_seen;
+	consts_seen.capacity = old.capacity ? old.capacity * 2 : 64;
+	consts_seen.hashes = (uint32_t*) calloc(consts_seen.capacity, sizeof(uint32_t));
+	consts_seen.indices = (uint16_t*) malloc(consts_seen.capacity * sizeof(uint16_t));
+	if(!consts_seen.hashes || !consts_seen.indices)
+		compiler_mem_error("const_table_grow");
+	for(size_t i = 0; i < old.capacity; i++){
+		if(!old.hashes[i])
+			continue;
+		size_t j = old.hashes[i] & (consts_seen.capacity - 1);
+		while(consts_seen.hashes[j])
+			j = (j + 1) & (consts_seen.capacity - 1);
+		consts_seen.hashes[j] = old.hashes[i];
+		consts_seen.indices[j] = old.indices[i];
+	}
+	free(old.hashes);
+	free(old.indices);
+}
+
+static void const_table_free(void){
+	free(consts_seen.hashes);
+	free(consts_seen.indices);
+	consts_seen = (const_table){0};
+}
+
+static bool add_const(value_t value, uint16_t* index, token* tk){
+	if(consts_seen.size * 2 >= consts_seen.capacity)
+		const_table_grow();
+	uint32_t hash = const_hash(value);
+	bool found;
+	size_t slot = const_find(hash, value, &found);
+	if(found){
+		*index = consts_seen.indices[slot];
+		return true;
+	}
+	if(chunk->consts.size >= BC_MAX_OPERAND)
+		return compile_error("too many constants", tk);
+	if(!dynamic_array_pushback((dynamic_array_t*)&chunk->consts, &value))
+		compiler_mem_error("add_const");
+	*index = chunk->consts.size - 1;
+	consts_seen.hashes[slot] = hash;
+	consts_seen.indices[slot] = *index;
+	consts_seen.size++;
+	return true;
+}
+
+// Variables visible at the current point of compilation
+// Every symbol is resolved to a (scope depth, slot) pair,
+// so the VM never looks variables up by name
+typedef struct{
+	token* symbol;
+	var_type type;
+	uint16_t depth;
+	uint16_t slot;
+	var_type elem_type;		// list / dict element (value) type
+	var_type key_type;		// dict key type
+} compile_var;
+
+typedef DYNAMIC_ARRAY(compile_var* vars) compile_var_stack;
+static FL_LOCAL compile_var_stack visible_vars = NEW_DYNAMIC_ARRAY(sizeof(compile_var));
+static FL_LOCAL uint16_t scope_depth = 0;
+static FL_LOCAL uint16_t scope_slots = 0;	// Slots used by the innermost scope
+
+// Finds the innermost variable with the symbol's name
+static compile_var* resolve_var(token* symbol){
+	for(size_t i = visible_vars.size; i > 0; i--){
+		compile_var* var = &visible_vars.vars[i-1];
+		if(tk_cmp_strlen(symbol, var->symbol->str, var->symbol->strlen))
+			return var;
+	}
+	return NULL;
+}
+
+static bool declare_var(token* symbol, var_type type, var_type elem_type, var_type key_type, compile_var** out){
+	compile_var* var = resolve_var(symbol);
+	if(var && var->depth == scope_depth)
+		return compile_error("variable is already declared in this scope", symbol);
+	if(scope_slots >= BC_MAX_OPERAND)
+		return compile_error("too many variables in scope", symbol);
+	compile_var new_var = {symbol, type, scope_depth, scope_slots++, elem_type, key_type};
+	if(!dynamic_array_pushback((dynamic_array_t*)&visible_vars, &new_var))
+		compiler_mem_error("declare_var");
+	*out = &visible_vars.vars[visible_vars.size-1];
+	return true;
+}
+
+static bool lookup_var(token* symbol, compile_var** out){
+	if(!(*out = resolve_var(symbol)))
+		return compile_error("undefined variable", symbol);
+	return true;
+}
+
+#define IS_CONTAINER(x) (VAR_TYPE(x) == var_list || VAR_TYPE(x) == var_dict)
+
+// Looks up a variable used as a container of the given type
+static bool lookup_container(token* symbol, var_type type, compile_var** out){
+	if(!lookup_var(symbol, out))
+		return false;
+	if(VAR_TYPE((*out)->type) != type)
+		return compile_error((type == var_list) ? "expected a list" : "expected a dict", symbol);
+	return true;
+}
+
+// Containers are only assigned from containers of the exact same type,
+// since their elements are not converted
+static bool check_container_value(node_expr* expr, compile_var* var, token* tk){
+	compile_var* src;
+	if(expr->type != tk_symbol)
+		return compile_error("expected a variable of the same list / dict type", tk);
+	if(!lookup_var(&expr->symbol, &src))
+		return false;
+	if(VAR_TYPE(src->type) != VAR_TYPE(var->type) || src->elem_type != var->elem_type || src->key_type != var->key_type)
+		return compile_error("expected a variable of the same list / dict type", &expr->symbol);
+	return true;
+}
+
+static char unescape_char(char c){
+	switch(c){
+	case 'n': return '\n';
+	case 't': return '\t';
+	case 'r': return '\r';
+	case '0': return '\0';
+	default: return c;
+	}
+}
+
+// Builds the constant value of a literal token
+static bool literal_value(token* tk, value_t* value){
+	char buffer[64];
+	switch(tk->type){
+	case tk_char_lit:
+		*value = VALUE_INT(var_char, (tk->strlen == 2) ? unescape_char(tk->str[1]) : tk->str[0]);
+		return true;
+	case tk_bool_lit:
+		*value = VALUE_BOOL(tk_cmp_str(tk, "true"));
+		return true;
+	case tk_int_lit:
+	case tk_float_lit:
+		if(tk->strlen >= sizeof(buffer))
+			return compile_error("numeric literal is too long", tk);
+		memcpy(buffer, tk->str, tk->strlen);
+		buffer[tk->strlen] = '\0';
+		if(tk->type == tk_float_lit)
+			*value = VALUE_F64(strtod(buffer, NULL));
+		else{
+			*value = VALUE_INT(var_i64, strtoull(buffer, NULL, 10));
+			if(value->u > INT64_MAX)
+				value->type = var_u64;
+		}
+		return true;
+	case tk_str_lit:{
+		if(!memchr(tk->str, '\\', tk->strlen)){
+			*value = VALUE_STR(tk->str, tk->strlen);
+			return true;
+		}
+		char* str = (char*) malloc(tk->strlen);
+		if(!str || !dynamic_array_pushback((dynamic_array_t*)&chunk->strings, &str))
+			compiler_mem_error("literal_value");
+		size_t len = 0;
+		for(uint32_t i = 0; i < tk->strlen; i++)
+			str[len++] = (tk->str[i] == '\\' && i+1 < tk->strlen) ? unescape_char(tk->str[++i]) : tk->str[i];
+		*value = VALUE_STR(str, len);
+		return true;
+	}default:
+		return compile_error("invalid literal", tk);
+	}
+}
+
+static bc_op binary_op(token_t op){
+	switch(op){
+	case tk_plus: return op_add;
+	case tk_minus: return op_sub;
+	case tk_mul: return op_mul;
+	case tk_div: return op_div;
+	case tk_mod: return op_mod;
+	case tk_shl: return op_shl;
+	case tk_band: return op_band;
+	case tk_cmp_eq: return op_eq;
+	case tk_cmp_neq: return op_neq;
+	case tk_cmp_l: return op_lt;
+	case tk_cmp_leq: return op_leq;
+	case tk_cmp_g: return op_gt;
+	case tk_cmp_geq: return op_geq;
+	case tk_cmp_strict: return op_strict_eq;
+	case tk_cmp_type: return op_type_eq;
+	case tk_and: return op_and;
+	case tk_or: return op_or;
+	case tk_xor: return op_xor;
+	default: return op_halt;
+	}
+}
+
+// Static type checks
+// Every register and variable holds exactly the type the compiler resolved
+// for it, so type errors are reported here instead of while running
+// and operators only ever see operands of the type they were emitted for
+
+#define IS_NUMERIC(x) (VAR_TYPE(x) <= var_f64)
+
+// Type two numeric operands are converted to, as value_promote would
+// (var_none if either is not numeric)
+static var_type promote_type(var_type a, var_type b){
+	if(!IS_NUMERIC(a) || !IS_NUMERIC(b))
+		return var_none;
+	if(a == b)
+		return a;
+	if(VAR_IS_FLOAT(a) || VAR_IS_FLOAT(b))
+		return var_f64;
+	if((VAR_IS_UNSIGNED(a) && VAR_IS_UNSIGNED(b)) || a == var_u64 || b == var_u64)
+		return var_u64;
+	return var_i64;
+}
+
+// Whether value_cast converts a value of type (from) to (to)
+static bool castable(var_type from, var_type to){
+	from = VAR_TYPE(from);
+	to = VAR_TYPE(to);
+	return from == to || ((IS_NUMERIC(from) || from == var_bool) && (IS_NUMERIC(to) || to == var_bool));
+}
+
+// Converts R[reg] from type (from) to (to) if they differ
+static void emit_cast(uint16_t reg, var_type from, var_type to, token* tk){
+	if(from != to)
+		emit(op_cast, to, reg, reg, from, tk);
+}
+
+static bool expect_castable(var_type from, var_type to, const char* msg, token* tk){
+	if(!castable(from, to)){
+		char tmp[128];
+		snprintf(tmp, sizeof(tmp), "%s (%s to %s)", msg, var_type_name(from), var_type_name(to));
+		return compile_error(tmp, tk);
+	}
+	return true;
+}
+
+static bool invalid_operands(const char* msg, var_type a, var_type b, token* tk){
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), "%s (%s and %s)", msg, var_type_name(a), var_type_name(b));
+	return compile_error(tmp, tk);
+}
+
+// Checks a binary operation on R[dst] (of type *type) and R[rhs],
+// converts both to the type it operates on and emits it
+// (*type) becomes the type of the result
+static bool compile_binary(node_expr* binexpr, uint16_t dst, uint16_t rhs, var_type* type, var_type rhs_type){
+	token* tk = binexpr->binexpr.op_token;
+	bc_op op = binary_op(binexpr->binexpr.op);
+	var_type common, result = var_bool;
+	switch(op){
+	case op_add:
+	case op_sub:
+	case op_mul:
+	case op_div:
+	case op_mod:
+		if(op == op_add && *type == var_str && rhs_type == var_str)
+			common = var_str;
+		else if((common = promote_type(*type, rhs_type)) == var_none)
+			return invalid_operands("invalid operands for arithmetic operation", *type, rhs_type, tk);
+		result = common;
+		break;
+	case op_shl:
+	case op_band:
+		if(!VAR_IS_INT(common = promote_type(*type, rhs_type)))
+			return invalid_operands("invalid operands for bitwise operation", *type, rhs_type, tk);
+		result = common;
+		break;
+	case op_type_eq:
+	case op_strict_eq:
+		// Known statically once the types differ
+		if(op == op_type_eq || *type != rhs_type){
+			value_t value = VALUE_BOOL(*type == rhs_type);
+			uint16_t k;
+			if(!add_const(value, &k, tk))
+				return false;
+			emit(op_loadk, var_bool, dst, k, 0, tk);
+			*type = var_bool;
+			return true;
+		}
+		// fallthrough
+	case op_eq:
+	case op_neq:
+	case op_lt:
+	case op_leq:
+	case op_gt:
+	case op_geq:
+		if(*type == rhs_type && (*type == var_str || *type == var_bool))
+			common = *type;
+		else if((common = promote_type(*type, rhs_type)) == var_none)
+			return invalid_operands("invalid operands for comparison", *type, rhs_type, tk);
+		break;
+	case op_and:
+	case op_or:
+	case op_xor:
+		if(!castable(*type, var_bool) || !castable(rhs_type, var_bool))
+			return invalid_operands("invalid operands for logical operation", *type, rhs_type, tk);
+		common = var_bool;
+		break;
+	default:
+		return compile_error("operator not supported by the interpreter", tk);
+	}
+	emit_cast(dst, *type, common, tk);
+	emit_cast(rhs, rhs_type, common, tk);
+	emit(op, common, dst, dst, rhs, tk);
+	*type = result;
+	return true;
+}
+
+// Subscripts in a parallel for
+// Elements are only read or written in place (never counted values), dicts
+// are only read, and a list the loop writes is only indexed by the loop
+// variable itself, so no two iterations use the same element
+// Checked once the whole body is compiled, see compile_for
+typedef struct{
+	uint16_t depth, slot;
+	bool write;
+	bool by_loop_var;
+	token* tk;
+} pfor_access;
+typedef DYNAMIC_ARRAY(pfor_access* accesses) pfor_access_list;
+static FL_LOCAL pfor_access_list pfor_accesses = NEW_DYNAMIC_ARRAY(sizeof(pfor_access));
+
+static void pfor_subscript(compile_var* var, node_expr* key, bool write, token* tk){
+	if(!pfor.active)
+		return;
+	if(VAR_IS_COUNTED(var->elem_type)){
+		pfor_error("str elements cannot be used in a parallel for", tk);
+		return;
+	}
+	if(write && VAR_TYPE(var->type) == var_dict){
+		pfor_error("cannot modify a dict in a parallel for", tk);
+		return;
+	}
+	if(VAR_TYPE(var->type) != var_list)
+		return;
+	compile_var* index = (key->type == tk_symbol) ? resolve_var(&key->symbol) : NULL;
+	pfor_access access = {var->depth, var->slot, write, index && index->depth == pfor.depth && index->slot == pfor.slot, tk};
+	if(!dynamic_array_pushback((dynamic_array_t*)&pfor_accesses, &access))
+		compiler_mem_error("pfor_subscript");
+}
+
+// List indices are integers, dict keys convert to the key type
+static bool check_key(compile_var* var, var_type key_type, token* tk){
+	if(VAR_TYPE(var->type) == var_list){
+		if(!VAR_IS_INT(key_type)){
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "list index should be an integer (%s)", var_type_name(key_type));
+			return compile_error(tmp, tk);
+		}
+		return true;
+	}
+	return expect_castable(key_type, var->key_type, "key does not match the dict's key type", tk);
+}
+
+static bool compile_builtin(node_func_call*, uint16_t, var_type*);
+
+// Binary expressions along the left spine of an expression,
+// shared by every (nested) compile_expr call
+typedef DYNAMIC_ARRAY(node_expr** exprs) spine_stack;
+static FL_LOCAL spine_stack spine = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));
+
+// Compiles an expression, leaving its result in register dst
+// and its type in (type)
+// Left-deep operator chains are walked iteratively, so only
+// parenthesized / negated groups (bounded by the parser) recurse
+bool compile_expr(node_expr* expr, uint16_t dst, var_type* type){
+	size_t spine_base = spine.size;
+	while(expr->type == tk_binexpr && expr->binexpr.rhs){
+		if(!dynamic_array_pushback((dynamic_array_t*)&spine, &expr))
+			compiler_mem_error("compile_expr");
+		expr = expr->binexpr.lhs;
+	}
+
+	switch(expr->type){
+	case tk_char_lit:
+	case tk_int_lit:
+	case tk_float_lit:
+	case tk_str_lit:
+	case tk_bool_lit:{
+		value_t value;
+		uint16_t k;
+		if(!literal_value(&expr->int_lit, &value) || !add_const(value, &k, &expr->int_lit))
+			goto fail;
+		emit(op_loadk, value.type, dst, k, 0, &expr->int_lit);
+		*type = value.type;
+		break;
+	}case tk_symbol:{
+		compile_var* var;
+		if(!lookup_var(&expr->symbol, &var))
+			goto fail;
+		emit(op_getvar, var->type, dst, var->depth, var->slot, &expr->symbol);
+		*type = VAR_TYPE(var->type);
+		break;
+	}case tk_binexpr:
+		if(!compile_expr(expr->binexpr.lhs, dst, type))
+			goto fail;
+		if(expr->binexpr.op == tk_negation){
+			if(!IS_NUMERIC(*type)){
+				char tmp[64];
+				snprintf(tmp, sizeof(tmp), "invalid operand for negation (%s)", var_type_name(*type));
+				compile_error(tmp, expr->binexpr.op_token);
+				goto fail;
+			}
+			emit(op_neg, *type, dst, dst, 0, expr->binexpr.op_token);
+		}
+		break;
+	case tk_subscript:{
+		compile_var* var;
+		var_type key_type;
+		if(!lookup_var(expr->index.symbol, &var))
+			goto fail;
+		if(!IS_CONTAINER(var->type)){
+			compile_error("only lists and dicts can be indexed", expr->index.symbol);
+			goto fail;
+		}
+		if(!compile_expr(expr->index.key, dst, &key_type) || !check_key(var, key_type, expr->index.symbol))
+			goto fail;
+		pfor_subscript(var, expr->index.key, false, expr->index.symbol);
+		emit(op_getindex, var->type, dst, var->depth, var->slot, expr->index.symbol);
+		*type = var->elem_type;
+		break;
+	}case tk_func_call:
+		if(!compile_builtin(&expr->func_call, dst, type))
+			goto fail;
+		break;
+	default:
+		compile_error("expression not supported by the interpreter", NULL);
+		goto fail;
+	}
+
+	while(spine.size > spine_base){
+		node_expr* binexpr = spine.exprs[--spine.size];
+		uint16_t rhs;
+		var_type rhs_type;
+		if(!alloc_reg(&rhs, binexpr->binexpr.op_token))
+			goto fail;
+		if(!compile_expr(binexpr->binexpr.rhs, rhs, &rhs_type) || !compile_binary(binexpr, dst, rhs, type, rhs_type))
+			goto fail;
+		reg_top--;
+	}
+	return true;
+
+fail:
+	spine.size = spine_base;
+	return false;
+}
+
+// Compiles the arguments of a call into consecutive registers
+// (scalar) rejects str, list and dict arguments
+static bool compile_args(node_func_call* call, uint16_t* base, bool scalar){
+	*base = reg_top;
+	for(size_t i = 0; i < call->expr_count; i++){
+		uint16_t reg;
+		var_type type;
+		if(!alloc_reg(&reg, call->symbol) || !compile_expr(&call->exprs[i], reg, &type))
+			return false;
+		if(scalar && VAR_IS_COUNTED(type)){
+			char tmp[128];
+			snprintf(tmp, sizeof(tmp), "%.*s expects characters (%s)", (int) call->symbol->strlen, call->symbol->str, var_type_name(type));
+			return compile_error(tmp, call->symbol);
+		}
+	}
+	return true;
+}
+
+static bool expect_args(node_func_call* call, size_t count){
+	if(call->expr_count != count){
+		char msg[64];
+		snprintf(msg, sizeof(msg), "%.*s expects %lu argument(s)", (int) call->symbol->strlen, call->symbol->str, (unsigned long) count);
+		return compile_error(msg, call->symbol);
+	}
+	return true;
+}
+
+// Reductions of numeric lists, run by kernels:
+// sum(list), min(list), max(list), dot(list, list)
+static bool compile_reduce(node_func_call* call, uint8_t kernel, uint16_t dst, var_type* type){
+	compile_var* lists[2];
+	size_t count = (kernel == kernel_dot) ? 2 : 1;
+	uint16_t base;
+	if(!expect_args(call, count))
+		return false;
+	for(size_t i = 0; i < count; i++){
+		if(call->exprs[i].type != tk_symbol)
+			return compile_error("expected list variable", call->symbol);
+		if(!lookup_container(&call->exprs[i].symbol, var_list, &lists[i]))
+			return false;
+		if(!IS_NUMERIC(lists[i]->elem_type)){
+			char tmp[96];
+			snprintf(tmp, sizeof(tmp), "%.*s expects a list of numbers (list<%s>)", (int) call->symbol->strlen, call->symbol->str, var_type_name(lists[i]->elem_type));
+			return compile_error(tmp, &call->exprs[i].symbol);
+		}
+	}
+	if(count == 2 && lists[0]->elem_type != lists[1]->elem_type)
+		return invalid_operands("dot expects lists of the same element type", lists[0]->elem_type, lists[1]->elem_type, call->symbol);
+	if(!compile_args(call, &base, false))
+		return false;
+	emit(op_reduce, lists[0]->elem_type, dst, base, kernel, call->symbol);
+	reg_top = base;
+	*type = kernel_result_type(kernel, lists[0]->elem_type);
+	return true;
+}
+
+// Asynchronous file I/O (aio.h) and string built-ins (fstring.h),
+// arguments are s for str and i for integers
+typedef struct{
+	const char* name;
+	const char* args;
+} compile_typed_builtin;
+
+static const compile_typed_builtin async_builtins[aio_op_count] = {
+	[aio_open] = {"async_open", "ss"},
+	[aio_read] = {"async_read", "iii"},
+	[aio_write] = {"async_write", "iis"},
+	[aio_close] = {"async_close", "i"},
+	[aio_read_file] = {"async_read_file", "s"},
+};
+
+static const compile_typed_builtin str_builtins[str_fn_count] = {
+	[str_fn_mapfile] = {"mapfile", "s"},
+	[str_fn_slice] = {"slice", "sii"},
+	[str_fn_find] = {"find", "ssi"},
+};
+
+static bool expect_arg(node_func_call* call, size_t i, var_type type, bool str){
+	if(str ? VAR_TYPE(type) == var_str : VAR_IS_INT(type))
+		return true;
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), "%.*s expects %s as argument %lu (%s)", (int) call->symbol->strlen, call->symbol->str,
+		str ? "a str" : "an integer", (unsigned long) i + 1, var_type_name(type));
+	return compile_error(tmp, call->symbol);
+}
+
+// Compiles the arguments of a typed built-in into consecutive registers,
+// integers are cast to i64
+static bool compile_typed_args(node_func_call* call, const char* args){
+	if(!expect_args(call, strlen(args)))
+		return false;
+	for(size_t i = 0; args[i]; i++){
+		uint16_t reg;
+		var_type arg_type;
+		if(!alloc_reg(&reg, call->symbol) || !compile_expr(&call->exprs[i], reg, &arg_type)
+			|| !expect_arg(call, i, arg_type, args[i] == 's'))
+			return false;
+		if(args[i] == 'i')
+			emit_cast(reg, VAR_TYPE(arg_type), var_i64, call->symbol);
+	}
+	return true;
+}
+
+// async_*(...) starts an operation and returns its future (an i64)
+static bool compile_async(node_func_call* call, uint8_t op, uint16_t dst, var_type* type){
+	uint16_t base = reg_top;
+	if(!compile_typed_args(call, async_builtins[op].args))
+		return false;
+	emit(op_async, var_i64, dst, base, op, call->symbol);
+	reg_top = base;
+	*type = var_i64;
+	return true;
+}
+
+// mapfile and slice give a str, find an i64
+static bool compile_string(node_func_call* call, uint8_t fn, uint16_t dst, var_type* type){
+	uint16_t base = reg_top;
+	if(!compile_typed_args(call, str_builtins[fn].args))
+		return false;
+	*type = (fn == str_fn_find) ? var_i64 : var_str;
+	emit(op_string, *type, dst, base, fn, call->symbol);
+	reg_top = base;
+	return true;
+}
+
+// await(future) gives an i64 (fd, bytes read / written, or -errno),
+// await_str(future) the data of a read
+static bool compile_await(node_func_call* call, bool str, uint16_t dst, var_type* type){
+	if(!expect_args(call, 1) || !compile_expr(&call->exprs[0], dst, type) || !expect_arg(call, 0, *type, false))
+		return false;
+	emit_cast(dst, VAR_TYPE(*type), var_i64, call->symbol);
+	*type = str ? var_str : var_i64;
+	emit(op_await, *type, dst, dst, 0, call->symbol);
+	return true;
+}
+
+// Built-ins that return a value into register dst: len(x), pop(list),
+// has(dict, key), the reductions, strings and asynchronous I/O
+static bool compile_builtin(node_func_call* call, uint16_t dst, var_type* type){
+	compile_var* var;
+	for(uint8_t fn = 0; fn < str_fn_count; fn++)
+		if(tk_cmp_str(call->symbol, str_builtins[fn].name))
+			return compile_string(call, fn, dst, type);
+	for(uint8_t op = 0; op < aio_op_count; op++)
+		if(tk_cmp_str(call->symbol, async_builtins[op].name))
+			return compile_async(call, op, dst, type);
+	if(tk_cmp_str(call->symbol, "await"))
+		return compile_await(call, false, dst, type);
+	if(tk_cmp_str(call->symbol, "await_str"))
+		return compile_await(call, true, dst, type);
+	if(tk_cmp_str(call->symbol, "sum"))
+		return compile_reduce(call, kernel_sum, dst, type);
+	if(tk_cmp_str(call->symbol, "min"))
+		return compile_reduce(call, kernel_min, dst, type);
+	if(tk_cmp_str(call->symbol, "max"))
+		return compile_reduce(call, kernel_max, dst, type);
+	if(tk_cmp_str(call->symbol, "dot"))
+		return compile_reduce(call, kernel_dot, dst, type);
+	if(tk_cmp_str(call->symbol, "len")){
+		if(!expect_args(call, 1) || !compile_expr(&call->exprs[0], dst, type))
+			return false;
+		if(!VAR_IS_COUNTED(*type)){
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "len expects a str, list or dict (%s)", var_type_name(*type));
+			return compile_error(tmp, call->symbol);
+		}
+		emit(op_len, var_none, dst, dst, 0, call->symbol);
+		*type = var_i64;
+	}else if(tk_cmp_str(call->symbol, "pop")){
+		if(!expect_args(call, 1))
+			return false;
+		if(call->exprs[0].type != tk_symbol)
+			return compile_error("expected list variable", call->symbol);
+		if(!lookup_container(&call->exprs[0].symbol, var_list, &var))
+			return false;
+		if(VAR_CONST(var->type))
+			return compile_error("cannot pop from a constant", &call->exprs[0].symbol);
+		emit(op_pop, var->type, dst, var->depth, var->slot, call->symbol);
+		*type = var->elem_type;
+	}else if(tk_cmp_str(call->symbol, "has")){
+		if(!expect_args(call, 2))
+			return false;
+		if(call->exprs[0].type != tk_symbol)
+			return compile_error("expected dict variable", call->symbol);
+		if(!lookup_container(&call->exprs[0].symbol, var_dict, &var) || !compile_expr(&call->exprs[1], dst, type)
+			|| !check_key(var, *type, call->symbol))
+			return false;
+		emit(op_has, var->type, dst, var->depth, var->slot, call->symbol);
+		*type = var_bool;
+	}else
+		return compile_error("unknown function", call->symbol);
+	return true;
+}
+
+// Container built-ins used as statements:
+// push(list, value ...), remove(dict, key ...)
+// Anything else is an expression whose result is dropped
+static bool compile_builtin_stmt(node_func_call* call){
+	bool push = tk_cmp_str(call->symbol, "push");
+	if(!push && !tk_cmp_str(call->symbol, "remove")){
+		uint16_t reg;
+		var_type type;
+		return alloc_reg(&reg, call->symbol) && compile_builtin(call, reg, &type);
+	}
+	compile_var* var;
+	if(call->expr_count < 2 || call->exprs[0].type != tk_symbol)
+		return compile_error(push ? "expected list variable and value(s)" : "expected dict variable and key(s)", call->symbol);
+	if(!lookup_container(&call->exprs[0].symbol, push ? var_list : var_dict, &var))
+		return false;
+	if(VAR_CONST(var->type))
+		return compile_error("cannot modify a constant", &call->exprs[0].symbol);
+	for(size_t i = 1; i < call->expr_count; i++){
+		uint16_t reg;
+		var_type type;
+		if(!alloc_reg(&reg, call->symbol) || !compile_expr(&call->exprs[i], reg, &type))
+			return false;
+		if(push ? !expect_castable(type, var->elem_type, "value does not match the list's element type", call->symbol)
+			: !check_key(var, type, call->symbol))
+			return false;
+		emit(push ? op_push : op_remove, var->type, reg, var->depth, var->slot, call->symbol);
+		reg_top--;
+	}
+	return true;
+}
+
+// Built-ins that read into variables take symbols as arguments
+static bool compile_read_args(node_func_call* call, bc_op op){
+	if(!call->expr_count)
+		return compile_error("expected variable(s) to read into", call->symbol);
+	for(size_t i = 0; i < call->expr_count; i++){
+		compile_var* var;
+		if(call->exprs[i].type != tk_symbol)
+			return compile_error("expected variable name", call->symbol);
+		if(!lookup_var(&call->exprs[i].symbol, &var))
+			return false;
+		if(VAR_CONST(var->type))
+			return compile_error("cannot read into a constant", &call->exprs[i].symbol);
+		if(IS_CONTAINER(var->type))
+			return compile_error("cannot read into a list or dict", &call->exprs[i].symbol);
+		emit(op, var->type, BC_NONE, var->depth, var->slot, &call->exprs[i].symbol);
+	}
+	return true;
+}
+
+// Matches "s = s + a + b ...", which can append to s in place
+// The operands are limited to literals and other variables,
+// since s changes between appends
+static bool is_append(node_expr* expr, compile_var* var){
+	if(expr->type != tk_binexpr || !expr->binexpr.rhs)
+		return false;
+	while(expr->type == tk_binexpr && expr->binexpr.rhs){
+		node_expr* rhs = expr->binexpr.rhs;
+		if(expr->binexpr.op != tk_plus)
+			return false;
+		if(rhs->type == tk_symbol){
+			if(resolve_var(&rhs->symbol) == var)
+				return false;
+		}else if(rhs->type != tk_str_lit)
+			return false;
+		expr = expr->binexpr.lhs;
+	}
+	return expr->type == tk_symbol && resolve_var(&expr->symbol) == var;
+}
+
+// Appends every right hand side of the chain to the variable,
+// from the innermost to the outermost
+static bool compile_append(node_expr* expr, compile_var* var){
+	size_t spine_base = spine.size;
+	uint16_t reg;
+	for(; expr->type == tk_binexpr && expr->binexpr.rhs; expr = expr->binexpr.lhs)
+		if(!dynamic_array_pushback((dynamic_array_t*)&spine, &expr))
+			compiler_mem_error("compile_append");
+	if(!alloc_reg(&reg, &expr->symbol))
+		goto fail;
+	while(spine.size > spine_base){
+		node_expr* binexpr = spine.exprs[--spine.size];
+		var_type type;
+		if(!compile_expr(binexpr->binexpr.rhs, reg, &type))
+			goto fail;
+		if(type != var_str){
+			invalid_operands("invalid operands for arithmetic operation", var_str, type, binexpr->binexpr.op_token);
+			goto fail;
+		}
+		emit(op_append, var->type, reg, var->depth, var->slot, binexpr->binexpr.op_token);
+	}
+	return true;
+
+fail:
+	spine.size = spine_base;
+	return false;
+}
+
+// Jumps waiting for their target to be known
+typedef DYNAMIC_ARRAY(size_t* pcs) jump_list;
+static FL_LOCAL jump_list if_exits = NEW_DYNAMIC_ARRAY(sizeof(size_t));
+static FL_LOCAL jump_list loop_breaks = NEW_DYNAMIC_ARRAY(sizeof(size_t));
+
+// Loops enclosing the current point of compilation
+typedef struct{
+	uint16_t depth;		// Scope depth outside of the loop
+	size_t break_base;	// First of its breaks in loop_breaks
+} compile_loop;
+typedef DYNAMIC_ARRAY(compile_loop* loops) compile_loop_stack;
+static FL_LOCAL compile_loop_stack loops = NEW_DYNAMIC_ARRAY(sizeof(compile_loop));
+
+static void push_jump(jump_list* list, size_t pc){
+	if(!dynamic_array_pushback((dynamic_array_t*)list, &pc))
+		compiler_mem_error("push_jump");
+}
+
+// Emits a jump whose target is patched later
+static size_t emit_jump(bc_op op, uint16_t reg){
+	emit(op, var_none, reg, 0, 0, NULL);
+	return chunk->code.size - 1;
+}
+
+// Points a jump at the next instruction
+static void patch_jump(size_t pc){
+	size_t target = chunk->code.size;
+	chunk->code.insns[pc].b = target >> 16;
+	chunk->code.insns[pc].c = target & 0xFFFF;
+}
+
+static void patch_jumps(jump_list* list, size_t base){
+	while(list->size > base)
+		patch_jump(list->pcs[--list->size]);
+}
+
+// Compiles a condition, followed by a jump taken if it is false
+static bool compile_cond(node_expr* cond, size_t* jump){
+	uint16_t reg;
+	var_type type;
+	if(!alloc_reg(&reg, NULL) || !compile_expr(cond, reg, &type))
+		return false;
+	if(!castable(type, var_bool)){
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "condition should be a bool (%s)", var_type_name(type));
+		return compile_error(tmp, NULL);
+	}
+	emit_cast(reg, type, var_bool, NULL);
+	*jump = emit_jump(op_jmpf, reg);
+	reg_top--;
+	return true;
+}
+
+// Scope being compiled
+typedef struct{
+	size_t var_base;		// Its first variable in visible_vars
+	uint16_t outer_slots;
+	size_t push;			// Its op_push_scope
+} scope_mark;
+
+static bool open_scope(scope_mark* mark){
+	if(scope_depth >= BC_MAX_OPERAND)
+		return compile_error("scopes are nested too deeply", NULL);
+	*mark = (scope_mark){visible_vars.size, scope_slots, chunk->code.size};
+	scope_depth++;
+	scope_slots = 0;
+	emit(op_push_scope, var_none, 0, scope_depth, 0, NULL);
+	return true;
+}
+
+static void close_scope(scope_mark* mark){
+	// The slot count is only known once the whole scope is compiled
+	chunk->code.insns[mark->push].c = scope_slots;
+	emit(op_pop_scope, var_none, 0, scope_depth, scope_slots, NULL);
+	visible_vars.size = mark->var_base;
+	scope_slots = mark->outer_slots;
+	scope_depth--;
+}
+
+static bool compile_scope(node_scope* scope){
+	scope_mark mark;
+	bool success = true;
+	if(!open_scope(&mark))
+		return false;
+	for(size_t i = 0; i < scope->stmt_count && success; i++)
+		success = compile_stmt(&scope->stmts[i]);
+	close_scope(&mark);
+	return success;
+}
+
+// Compiles an if / elif / else chain iteratively
+static bool compile_if(node_stmt* stmt){
+	size_t exit_base = if_exits.size;
+	for(; stmt && stmt->type == tk_if; stmt = stmt->if_stmt.else_body){
+		size_t skip;
+		if(!compile_cond(&stmt->if_stmt.cond, &skip) || !compile_scope(&stmt->if_stmt.body))
+			return false;
+		if(stmt->if_stmt.else_body)
+			push_jump(&if_exits, emit_jump(op_jmp, 0));
+		patch_jump(skip);
+	}
+	if(stmt && !compile_scope(&stmt->scope))
+		return false;
+	patch_jumps(&if_exits, exit_base);
+	return true;
+}
+
+// Kernel loops
+// A loop of one of the shapes in bytecode.h (bc_kernel_loop) is preceded
+// by op_kernel, which does the work of every iteration at once when the
+// index starts in the lists and they are long enough, leaving the index
+// at the bound so the loop exits on its first check
+// Otherwise the loop runs as compiled, and reports its own errors
+// Only the loops whose kernel gives the same results are matched:
+// element-wise operators on lists of one type (no integer division)
+// and integer sums, which wrap the same in any order
+
+static compile_var* symbol_var(node_expr* expr){
+	return (expr->type == tk_symbol) ? resolve_var(&expr->symbol) : NULL;
+}
+
+// Matches list[index] on a list of numbers
+static compile_var* indexed_list(node_expr* expr, compile_var* index){
+	if(expr->type != tk_subscript || symbol_var(expr->index.key) != index)
+		return NULL;
+	compile_var* var = resolve_var(expr->index.symbol);
+	return (var && VAR_TYPE(var->type) == var_list && IS_NUMERIC(var->elem_type)) ? var : NULL;
+}
+
+static uint8_t kernel_op(token_t op){
+	switch(op){
+	case tk_plus: return kernel_add;
+	case tk_minus: return kernel_sub;
+	case tk_mul: return kernel_mul;
+	case tk_div: return kernel_div;
+	case tk_cmp_eq: return kernel_eq;
+	case tk_cmp_neq: return kernel_neq;
+	case tk_cmp_l: return kernel_lt;
+	case tk_cmp_leq: return kernel_leq;
+	case tk_cmp_g: return kernel_gt;
+	case tk_cmp_geq: return kernel_geq;
+	default: return kernel_sum;
+	}
+}
+
+static bool match_kernel_loop(node_while* loop, bc_kernel_loop* out){
+	// while(index < len(bound))
+	node_expr* cond = &loop->cond;
+	if(loop->body.stmt_count != 2 || cond->type != tk_binexpr || cond->binexpr.op != tk_cmp_l || !cond->binexpr.rhs)
+		return false;
+	compile_var* index = symbol_var(cond->binexpr.lhs);
+	node_expr* len = cond->binexpr.rhs;
+	if(!index || !VAR_IS_INT(index->type) || len->type != tk_func_call || !tk_cmp_str(len->func_call.symbol, "len")
+		|| len->func_call.expr_count != 1)
+		return false;
+	compile_var* bound = symbol_var(&len->func_call.exprs[0]);
+	if(!bound || VAR_TYPE(bound->type) != var_list)
+		return false;
+
+	// index = index + 1
+	node_stmt* step = &loop->body.stmts[1];
+	if(step->type != tk_var_assign || step->var_assign.index || resolve_var(step->var_assign.symbol) != index)
+		return false;
+	node_expr* inc = &step->var_assign.expr;
+	if(inc->type != tk_binexpr || inc->binexpr.op != tk_plus || !inc->binexpr.rhs || symbol_var(inc->binexpr.lhs) != index
+		|| inc->binexpr.rhs->type != tk_int_lit || !tk_cmp_str(&inc->binexpr.rhs->int_lit, "1"))
+		return false;
+
+	node_stmt* body = &loop->body.stmts[0];
+	if(body->type != tk_var_assign)
+		return false;
+	compile_var *dst = resolve_var(body->var_assign.symbol), *a, *b = NULL;
+	node_expr* expr = &body->var_assign.expr;
+	uint8_t op;
+	if(!dst || dst == index || VAR_CONST(dst->type) || expr->type != tk_binexpr || !expr->binexpr.rhs)
+		return false;
+	if(body->var_assign.index){
+		// dst[index] = a[index] op b[index]
+		if(VAR_TYPE(dst->type) != var_list || symbol_var(body->var_assign.index) != index
+			|| !(a = indexed_list(expr->binexpr.lhs, index)) || !(b = indexed_list(expr->binexpr.rhs, index))
+			|| a->elem_type != b->elem_type || (op = kernel_op(expr->binexpr.op)) == kernel_sum)
+			return false;
+		if(dst->elem_type != (KERNEL_IS_COMPARE(op) ? var_bool : a->elem_type) || (op == kernel_div && !VAR_IS_FLOAT(a->elem_type)))
+			return false;
+	}else{
+		// dst = dst + a[index] (* b[index])
+		node_expr* term = expr->binexpr.rhs;
+		if(!VAR_IS_INT(dst->type) || expr->binexpr.op != tk_plus || symbol_var(expr->binexpr.lhs) != dst)
+			return false;
+		if((a = indexed_list(term, index)))
+			op = kernel_sum;
+		else if(term->type == tk_binexpr && term->binexpr.op == tk_mul && term->binexpr.rhs
+			&& (a = indexed_list(term->binexpr.lhs, index)) && (b = indexed_list(term->binexpr.rhs, index))
+			&& a->elem_type == b->elem_type)
+			op = kernel_dot;
+		else
+			return false;
+		if(!VAR_IS_INT(a->elem_type))
+			return false;
+	}
+	*out = (bc_kernel_loop){
+		op, a->elem_type,
+		{index->depth, index->slot}, {bound->depth, bound->slot}, {dst->depth, dst->slot},
+		{a->depth, a->slot}, {b ? b->depth : 0, b ? b->slot : 0}
+	};
+	return true;
+}
+
+static bool compile_while(node_while* loop){
+	if(chunk->loop_count >= BC_MAX_OPERAND)
+		return compile_error("too many loops", NULL);
+	bc_kernel_loop kernel;
+	if(!pfor.active && chunk->kernel_loops.size < BC_MAX_OPERAND && match_kernel_loop(loop, &kernel)){
+		if(!dynamic_array_pushback((dynamic_array_t*)&chunk->kernel_loops, &kernel))
+			compiler_mem_error("compile_while");
+		emit(op_kernel, var_none, chunk->kernel_loops.size - 1, 0, 0, NULL);
+	}
+	size_t head = chunk->code.size, exit;
+	uint16_t id = chunk->loop_count++;
+	if(!compile_cond(&loop->cond, &exit))
+		return false;
+	compile_loop new_loop = {scope_depth, loop_breaks.size};
+	if(!dynamic_array_pushback((dynamic_array_t*)&loops, &new_loop))
+		compiler_mem_error("compile_while");
+	bool success = compile_scope(&loop->body);
+	loops.size--;
+	emit(op_loop, var_none, id, head >> 16, head & 0xFFFF, NULL);
+	patch_jump(exit);
+	patch_jumps(&loop_breaks, new_loop.break_base);
+	return success;
+}
+
+// For loops
+// The bounds are kept as i64 in R[base] and R[base+1], R[base] being the
+// index, and the loop variable is a constant declared in the body from
+// R[base+2]. A parallel for leaves the iterations to op_pfor, which runs
+// its body once per index on the pool
+
+// Declares the loop variable from R[iter] and compiles the body
+static bool compile_for_body(node_for* loop, var_type type, uint16_t iter){
+	scope_mark mark;
+	compile_var* var;
+	bool success;
+	if(!open_scope(&mark))
+		return false;
+	if((success = declare_var(loop->symbol, type | var_const, var_none, var_none, &var))){
+		emit(op_decl, type | var_const, iter, var->depth, var->slot, loop->symbol);
+		if(loop->parallel)
+			pfor = (compile_pfor){true, false, var->depth, var->slot, loop->symbol};
+	}
+	for(size_t i = 0; i < loop->body.stmt_count && success; i++)
+		success = compile_stmt(&loop->body.stmts[i]);
+	close_scope(&mark);
+	return success;
+}
+
+// Gives every outer list the body of a parallel for assigns to a block of
+// its own, which the workers can write to (see containers.h)
+static void emit_unshares(node_stmt* stmts, size_t count, size_t mark){
+	for(size_t i = 0; i < count; i++){
+		node_stmt* stmt = &stmts[i];
+		switch(stmt->type){
+		case tk_var_assign:{
+			compile_var* var = stmt->var_assign.index ? resolve_var(stmt->var_assign.symbol) : NULL;
+			if(!var || VAR_TYPE(var->type) != var_list)
+				break;
+			bool emitted = false;
+			for(size_t pc = mark; pc < chunk->code.size && !emitted; pc++)
+				emitted = chunk->code.insns[pc].b == var->depth && chunk->code.insns[pc].c == var->slot;
+			if(!emitted)
+				emit(op_unshare, var_none, 0, var->depth, var->slot, stmt->var_assign.symbol);
+			break;
+		}case tk_scope:
+			emit_unshares(stmt->scope.stmts, stmt->scope.stmt_count, mark);
+			break;
+		case tk_if:
+			for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+				if(branch->type == tk_scope){
+					emit_unshares(branch->scope.stmts, branch->scope.stmt_count, mark);
+					break;
+				}
+				emit_unshares(branch->if_stmt.body.stmts, branch->if_stmt.body.stmt_count, mark);
+			}
+			break;
+		case tk_while:
+			emit_unshares(stmt->while_stmt.body.stmts, stmt->while_stmt.body.stmt_count, mark);
+			break;
+		case tk_for:
+			emit_unshares(stmt->for_stmt.body.stmts, stmt->for_stmt.body.stmt_count, mark);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// Every subscript of a list the parallel for writes is the loop variable
+static bool check_pfor_accesses(void){
+	for(size_t i = 0; i < pfor_accesses.size; i++){
+		pfor_access* write = &pfor_accesses.accesses[i];
+		if(!write->write)
+			continue;
+		for(size_t j = 0; j < pfor_accesses.size; j++){
+			pfor_access* access = &pfor_accesses.accesses[j];
+			if(access->depth == write->depth && access->slot == write->slot && !access->by_loop_var)
+				return compile_error("a list written in a parallel for can only be indexed by the loop variable", access->tk);
+		}
+	}
+	return true;
+}
+
+// Compiles the bounds into R[base] and R[base+1], as i64
+static bool compile_for_bounds(node_for* loop, uint16_t base){
+	var_type type;
+	if(!loop->start){
+		// Indices of a list
+		uint16_t zero;
+		if(!compile_expr(&loop->end, base + 1, &type))
+			return false;
+		if(VAR_TYPE(type) != var_list){
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "expected a list or a range (%s)", var_type_name(type));
+			return compile_error(tmp, loop->symbol);
+		}
+		if(!add_const(VALUE_INT(var_i64, 0), &zero, loop->symbol))
+			return false;
+		emit(op_len, var_none, base + 1, base + 1, 0, loop->symbol);
+		emit(op_loadk, var_i64, base, zero, 0, loop->symbol);
+		return true;
+	}
+	for(uint16_t i = 0; i < 2; i++){
+		if(!compile_expr(i ? &loop->end : loop->start, base + i, &type))
+			return false;
+		if(!VAR_IS_INT(type)){
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "range bounds should be integers (%s)", var_type_name(type));
+			return compile_error(tmp, loop->symbol);
+		}
+		emit_cast(base + i, type, var_i64, loop->symbol);
+	}
+	return true;
+}
+
+static bool compile_for(node_for* loop){
+	var_type type = var_type_from_token(loop->var_type);
+	uint16_t base, end, iter, one;
+	if(!VAR_IS_INT(type)){
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "loop variable should be an integer (%s)", var_type_name(type));
+		return compile_error(tmp, loop->symbol);
+	}
+	if(loop->parallel && pfor.active)
+		return compile_error("parallel for loops cannot be nested", loop->symbol);
+	if(!loop->parallel && chunk->loop_count >= BC_MAX_OPERAND)
+		return compile_error("too many loops", loop->symbol);
+	if(!alloc_reg(&base, loop->symbol) || !alloc_reg(&end, loop->symbol) || !alloc_reg(&iter, loop->symbol)
+		|| !compile_for_bounds(loop, base))
+		return false;
+
+	if(loop->parallel){
+		pfor_accesses.size = 0;
+		emit_unshares(loop->body.stmts, loop->body.stmt_count, chunk->code.size);
+		emit(op_pfor, type, base, 0, 0, loop->symbol);
+		size_t start = chunk->code.size - 1;
+		bool success = compile_for_body(loop, type, iter) && !pfor.failed && check_pfor_accesses();
+		pfor.active = false;
+		emit(op_pfor_end, var_none, 0, 0, 0, loop->symbol);
+		patch_jump(start);
+		return success;
+	}
+
+	if(!add_const(VALUE_INT(var_i64, 1), &one, loop->symbol))
+		return false;
+	size_t head = chunk->code.size, exit;
+	uint16_t id = chunk->loop_count++;
+	emit(op_lt, var_i64, iter, base, end, loop->symbol);
+	exit = emit_jump(op_jmpf, iter);
+	emit(op_move, var_i64, iter, base, 0, loop->symbol);
+	compile_loop new_loop = {scope_depth, loop_breaks.size};
+	if(!dynamic_array_pushback((dynamic_array_t*)&loops, &new_loop))
+		compiler_mem_error("compile_for");
+	bool success = compile_for_body(loop, type, iter);
+	loops.size--;
+	emit(op_loadk, var_i64, iter, one, 0, loop->symbol);
+	emit(op_add, var_i64, base, base, iter, loop->symbol);
+	emit(op_loop, var_none, id, head >> 16, head & 0xFFFF, NULL);
+	patch_jump(exit);
+	patch_jumps(&loop_breaks, new_loop.break_base);
+	return success;
+}
+
+bool compile_stmt(node_stmt* stmt){
+	uint16_t reg_base = reg_top;
+	bool success = true;
+	switch(stmt->type){
+	case tk_var_decl:{
+		node_var_decl* decl = &stmt->var_decl;
+		var_type type = var_type_from_token(decl->var_type) | (decl->constant ? var_const : 0);
+		var_type elem_type = var_none, key_type = var_none;
+		uint16_t reg = BC_NONE;
+		compile_var* var;
+		if(IS_CONTAINER(type)){
+			elem_type = var_type_from_token(decl->elem_type);
+			if(VAR_TYPE(type) == var_dict)
+				key_type = var_type_from_token(decl->key_type);
+			compile_var container = {decl->symbol, type, 0, 0, elem_type, key_type};
+			if(!alloc_reg(&reg, decl->symbol))
+				return false;
+			if(decl->expr){
+				var_type expr_type;
+				if(!check_container_value(decl->expr, &container, decl->symbol) || !compile_expr(decl->expr, reg, &expr_type))
+					return false;
+			}else if(decl->constant)
+				return compile_error("constant needs to be initialized", decl->symbol);
+			else
+				emit(op_new, VAR_TYPE(type), reg, elem_type, key_type, decl->symbol);
+		}else if(decl->expr){
+			var_type expr_type;
+			if(!alloc_reg(&reg, decl->symbol) || !compile_expr(decl->expr, reg, &expr_type)
+				|| !expect_castable(expr_type, type, "value does not match the variable's type", decl->symbol))
+				return false;
+		}else if(decl->constant)
+			return compile_error("constant needs to be initialized", decl->symbol);
+		// Declared after the initializer, so "i32 x = x;" refers to an outer x
+		if(!declare_var(decl->symbol, type, elem_type, key_type, &var))
+			return false;
+		emit(op_decl, type, reg, var->depth, var->slot, decl->symbol);
+		break;
+	}case tk_var_assign:{
+		uint16_t reg;
+		compile_var* var;
+		if(!lookup_var(stmt->var_assign.symbol, &var))
+			return false;
+		if(VAR_CONST(var->type))
+			return compile_error("cannot assign to a constant", stmt->var_assign.symbol);
+		if(stmt->var_assign.index){
+			if(!IS_CONTAINER(var->type))
+				return compile_error("only lists and dicts can be indexed", stmt->var_assign.symbol);
+			// The index and the value go in consecutive registers
+			uint16_t value;
+			var_type key_type, value_type;
+			if(!alloc_reg(&reg, stmt->var_assign.symbol) || !alloc_reg(&value, stmt->var_assign.symbol)
+				|| !compile_expr(stmt->var_assign.index, reg, &key_type) || !check_key(var, key_type, stmt->var_assign.symbol)
+				|| !compile_expr(&stmt->var_assign.expr, value, &value_type)
+				|| !expect_castable(value_type, var->elem_type, (VAR_TYPE(var->type) == var_list)
+					? "value does not match the list's element type" : "value does not match the dict's value type", stmt->var_assign.symbol))
+				return false;
+			pfor_subscript(var, stmt->var_assign.index, true, stmt->var_assign.symbol);
+			emit(op_setindex, var->type, reg, var->depth, var->slot, stmt->var_assign.symbol);
+			break;
+		}
+		if(IS_CONTAINER(var->type) && !check_container_value(&stmt->var_assign.expr, var, stmt->var_assign.symbol))
+			return false;
+		if(VAR_TYPE(var->type) == var_str && is_append(&stmt->var_assign.expr, var)){
+			success = compile_append(&stmt->var_assign.expr, var);
+			break;
+		}
+		var_type type;
+		if(!alloc_reg(&reg, stmt->var_assign.symbol) || !compile_expr(&stmt->var_assign.expr, reg, &type))
+			return false;
+		if(!IS_CONTAINER(var->type) && !expect_castable(type, var->type, "value does not match the variable's type", stmt->var_assign.symbol))
+			return false;
+		emit(op_setvar, var->type, reg, var->depth, var->slot, stmt->var_assign.symbol);
+		break;
+	}case tk_print:{
+		uint16_t base;
+		if(!compile_args(&stmt->func_call, &base, false))
+			return false;
+		emit(op_print, var_none, base, stmt->func_call.expr_count, 0, stmt->func_call.symbol);
+		break;
+	}case tk_putchar:{
+		uint16_t base;
+		if(!compile_args(&stmt->func_call, &base, true))
+			return false;
+		for(size_t i = 0; i < stmt->func_call.expr_count; i++)
+			emit(op_putchar, var_none, base+i, 0, 0, stmt->func_call.symbol);
+		break;
+	}case tk_input:
+		success = compile_read_args(&stmt->func_call, op_input);
+		break;
+	case tk_getchar:
+		success = compile_read_args(&stmt->func_call, op_getchar);
+		break;
+	case tk_flush:
+		if(stmt->func_call.expr_count)
+			return compile_error("flush takes no arguments", stmt->func_call.symbol);
+		emit(op_flush, var_none, 0, 0, 0, stmt->func_call.symbol);
+		break;
+	case tk_exit:{
+		uint16_t reg;
+		var_type type;
+		if(!alloc_reg(&reg, NULL) || !compile_expr(&stmt->exit.expr, reg, &type))
+			return false;
+		if(VAR_IS_COUNTED(type)){
+			char tmp[64];
+			snprintf(tmp, sizeof(tmp), "exit status should be an integer (%s)", var_type_name(type));
+			return compile_error(tmp, NULL);
+		}
+		emit(op_exit, var_none, reg, 0, 0, NULL);
+		break;
+	}case tk_scope:
+		success = compile_scope(&stmt->scope);
+		break;
+	case tk_if:
+		success = compile_if(stmt);
+		break;
+	case tk_while:
+		success = compile_while(&stmt->while_stmt);
+		break;
+	case tk_for:
+		success = compile_for(&stmt->for_stmt);
+		break;
+	case tk_break:{
+		if(pfor.active && (!loops.size || loops.loops[loops.size-1].depth < pfor.depth))
+			return compile_error("break cannot leave a parallel for", NULL);
+		if(!loops.size)
+			return compile_error("break outside of a loop", NULL);
+		// Close the scopes opened inside the loop before leaving it
+		for(uint16_t depth = scope_depth; depth > loops.loops[loops.size-1].depth; depth--)
+			emit(op_pop_scope, var_none, 0, depth, 0, NULL);
+		push_jump(&loop_breaks, emit_jump(op_jmp, 0));
+		break;
+	}
+	case tk_func_call:
+		success = compile_builtin_stmt(&stmt->func_call);
+		break;
+	default:
+		return compile_error("statement not supported by the interpreter", NULL);
+	}
+	reg_top = reg_base;
+	return success;
+}
+
+// Compiles a parsed program into a bytecode chunk
+bool compile(bc_chunk* out, node_prog* prog){
+	*out = (bc_chunk) NEW_BC_CHUNK();
+	chunk = out;
+	reg_top = 0;
+	scope_depth = 0;
+	scope_slots = 0;
+	pfor = (compile_pfor){0};
+	bool success = true;
+	for(size_t i = 0; i < prog->size && success; i++)
+		success = compile_stmt(&prog->stmts[i]);
+	emit(op_halt, var_none, 0, 0, 0, NULL);
+	chunk->global_count = scope_slots;
+	dynamic_array_free((dynamic_array_t*)&spine);
+	dynamic_array_free((dynamic_array_t*)&visible_vars);
+	dynamic_array_free((dynamic_array_t*)&if_exits);
+	dynamic_array_free((dynamic_array_t*)&loop_breaks);
+	dynamic_array_free((dynamic_array_t*)&loops);
+	dynamic_array_free((dynamic_array_t*)&pfor_accesses);
+	const_table_free();
+	return success;
+}
@@ -0,0 +1,11 @@
+#ifndef FERRO_COMPILER_H
+#define FERRO_COMPILER_H
+
+#include "../FL/parser.h"
+#include "bytecode.h"
+
+bool compile_expr(node_expr*,uint16_t,var_type*);
+bool compile_stmt(node_stmt*);
+bool compile(bc_chunk*,node_prog*);
+
+#endif
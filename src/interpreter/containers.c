@@ -0,0 +1,482 @@
+#include "containers.h"
+#include "fstring.h"
+#include "heap.h"
+#include "../FL/hash.h"
+
+#define LIST_START 8
+#define DICT_START 8
+
+// Types a container can hold
+bool container_elem_type(var_type type){
+	return VAR_TYPE(type) <= var_bool;
+}
+
+static uint8_t elem_size(var_type type){
+	switch(type){
+	case var_char:
+	case var_i8:
+	case var_u8:
+	case var_bool: return 1;
+	case var_i16:
+	case var_u16: return 2;
+	case var_i32:
+	case var_u32:
+	case var_f32: return 4;
+	case var_str: return sizeof(value_t);
+	default: return 8;
+	}
+}
+
+static value_t elem_load(var_type type, const char* p){
+	value_t v = {.type = type};
+	switch(type){
+	case var_char:
+	case var_i8: v.i = *(const int8_t*) p; break;
+	case var_u8: v.u = *(const uint8_t*) p; break;
+	case var_i16: v.i = *(const int16_t*) p; break;
+	case var_u16: v.u = *(const uint16_t*) p; break;
+	case var_i32: v.i = *(const int32_t*) p; break;
+	case var_u32: v.u = *(const uint32_t*) p; break;
+	case var_f32: v.f32 = *(const float*) p; break;
+	case var_bool: v.b = *(const bool*) p; break;
+	case var_str: v = *(const value_t*) p; break;
+	default: memcpy(&v.u, p, 8); break;
+	}
+	return v;
+}
+
+// Stores a value already converted to the element type
+static void elem_store(var_type type, char* p, value_t v){
+	switch(type){
+	case var_char:
+	case var_i8:
+	case var_u8: *(uint8_t*) p = (uint8_t) v.u; break;
+	case var_i16:
+	case var_u16: *(uint16_t*) p = (uint16_t) v.u; break;
+	case var_i32:
+	case var_u32: *(uint32_t*) p = (uint32_t) v.u; break;
+	case var_f32: *(float*) p = v.f32; break;
+	case var_bool: *(bool*) p = v.b; break;
+	case var_str: *(value_t*) p = v; break;
+	default: memcpy(p, &v.u, 8); break;
+	}
+}
+
+// Releases the str elements of a buffer
+static void elems_release(var_type type, char* data, size_t count){
+	if(type != var_str)
+		return;
+	for(size_t i = 0; i < count; i++)
+		value_release(((value_t*) data)[i]);
+}
+
+static void elems_retain(var_type type, char* data, size_t count){
+	if(type != var_str)
+		return;
+	for(size_t i = 0; i < count; i++)
+		value_retain(((value_t*) data)[i]);
+}
+
+static void dict_free_arrays(dict_block* dict){
+	heap_free(dict->hashes, dict->capacity * sizeof(uint32_t));
+	heap_free(dict->keys, dict->capacity * dict->key_size);
+	heap_free(dict->values, dict->capacity * dict->value_size);
+}
+
+// Releases the elements of a dead container from *cursor on,
+// at most (budget) of them, and frees it once they are all released
+// Returns true once the container is freed
+bool container_release(value_t v, size_t* cursor, size_t budget){
+	if(v.type == var_list){
+		list_block* list = v.list;
+		size_t count = list->size - *cursor;
+		if(count > budget)
+			count = budget;
+		elems_release(list->type, list->data + *cursor * list->elem_size, count);
+		if((*cursor += count) < list->size)
+			return false;
+		heap_free(list->data, list->capacity * list->elem_size);
+		heap_free(list, sizeof(list_block));
+		return true;
+	}
+	dict_block* dict = v.dict;
+	size_t end = (dict->capacity - *cursor > budget) ? *cursor + budget : dict->capacity;
+	if(dict->key_type == var_str || dict->value_type == var_str){
+		for(size_t i = *cursor; i < end; i++){
+			if(!dict->hashes[i])
+				continue;
+			elems_release(dict->key_type, dict->keys + i * dict->key_size, 1);
+			elems_release(dict->value_type, dict->values + i * dict->value_size, 1);
+		}
+	}else
+		end = dict->capacity;
+	if((*cursor = end) < dict->capacity)
+		return false;
+	dict_free_arrays(dict);
+	heap_free(dict, sizeof(dict_block));
+	return true;
+}
+
+// Called when the last reference dies
+// Containers with more counted elements than a step releases
+// are handed to the heap to be released incrementally
+void container_free(value_t v){
+	size_t counted;
+	if(v.type == var_list)
+		counted = (v.list->type == var_str) ? v.list->size : 0;
+	else
+		counted = (v.dict->key_type == var_str || v.dict->value_type == var_str) ? v.dict->capacity : 0;
+	if(counted > heap_budget){
+		heap_defer(v);
+		return;
+	}
+	size_t cursor = 0;
+	(void) container_release(v, &cursor, SIZE_MAX);
+}
+
+size_t container_size(value_t v){
+	return (v.type == var_list) ? v.list->size : v.dict->size;
+}
+
+// Iterates over the elements (in slot order for a dict)
+// Keys are only set for dicts, neither is retained
+bool container_next(value_t v, size_t* it, value_t* key, value_t* value){
+	if(v.type == var_list){
+		if(*it >= v.list->size)
+			return false;
+		*value = elem_load(v.list->type, v.list->data + (*it)++ * v.list->elem_size);
+		return true;
+	}
+	dict_block* dict = v.dict;
+	while(*it < dict->capacity && !dict->hashes[*it])
+		(*it)++;
+	if(*it >= dict->capacity)
+		return false;
+	*key = elem_load(dict->key_type, dict->keys + *it * dict->key_size);
+	*value = elem_load(dict->value_type, dict->values + *it * dict->value_size);
+	(*it)++;
+	return true;
+}
+
+// list
+
+value_t list_new(var_type type){
+	list_block* list = (list_block*) heap_alloc(sizeof(list_block));
+	if(!list)
+		return (value_t){.type = var_none};
+	*list = (list_block){1, type, elem_size(type), 0, 0, NULL};
+	return VALUE_LIST(list);
+}
+
+// Gives the variable its own copy of a shared list before it is written to
+const char* list_unshare(value_t* v){
+	list_block* list = v->list;
+	if(list->refs == 1)
+		return NULL;
+	list_block* copy = (list_block*) heap_alloc(sizeof(list_block));
+	char* data = list->size ? (char*) heap_alloc(list->size * list->elem_size) : NULL;
+	if(!copy || (list->size && !data)){
+		heap_free(copy, sizeof(list_block));
+		heap_free(data, list->size * list->elem_size);
+		return "failed to allocate list";
+	}
+	*copy = (list_block){1, list->type, list->elem_size, list->size, list->size, data};
+	if(list->size)
+		memcpy(data, list->data, list->size * list->elem_size);
+	elems_retain(list->type, data, list->size);
+	list->refs--;
+	v->list = copy;
+	return NULL;
+}
+
+// Resolves an index, negative indices count from the end
+static const char* list_index(list_block* list, value_t index, size_t* at){
+	if(!VAR_IS_INT(index.type))
+		return "list index should be an integer";
+	int64_t i = VAR_IS_UNSIGNED(index.type) && index.u > INT64_MAX ? INT64_MAX : index.i;
+	if(i < 0)
+		i += list->size;
+	if(i < 0 || (uint64_t) i >= list->size)
+		return "list index out of range";
+	*at = i;
+	return NULL;
+}
+
+const char* list_push(value_t* v, value_t elem){
+	const char* err;
+	if(!value_cast(&elem, v->list->type))
+		return "value does not match the list's element type";
+	if((err = list_unshare(v)))
+		return err;
+	list_block* list = v->list;
+	if(list->size == list->capacity){
+		size_t capacity = list->capacity ? list->capacity * 2 : LIST_START;
+		char* data = (char*) heap_realloc(list->data, list->capacity * list->elem_size, capacity * list->elem_size);
+		if(!data)
+			return "failed to allocate list";
+		list->data = data;
+		list->capacity = capacity;
+	}
+	value_retain(elem);
+	elem_store(list->type, list->data + list->size++ * list->elem_size, elem);
+	return NULL;
+}
+
+const char* list_get(value_t v, value_t index, value_t* out){
+	size_t at;
+	const char* err = list_index(v.list, index, &at);
+	if(err)
+		return err;
+	*out = elem_load(v.list->type, v.list->data + at * v.list->elem_size);
+	value_retain(*out);
+	return NULL;
+}
+
+const char* list_set(value_t* v, value_t index, value_t elem){
+	size_t at;
+	const char* err = list_index(v->list, index, &at);
+	if(err)
+		return err;
+	if(!value_cast(&elem, v->list->type))
+		return "value does not match the list's element type";
+	if((err = list_unshare(v)))
+		return err;
+	char* p = v->list->data + at * v->list->elem_size;
+	value_retain(elem);
+	elems_release(v->list->type, p, 1);
+	elem_store(v->list->type, p, elem);
+	return NULL;
+}
+
+// Removes the last element, the reference it held moves to out
+const char* list_pop(value_t* v, value_t* out){
+	const char* err;
+	if(!v->list->size)
+		return "pop from an empty list";
+	if((err = list_unshare(v)))
+		return err;
+	list_block* list = v->list;
+	*out = elem_load(list->type, list->data + --list->size * list->elem_size);
+	return NULL;
+}
+
+// dict
+
+// Hash of a key converted to the key type, never 0 (empty slot)
+static uint32_t key_hash(value_t key){
+	uint64_t h;
+	switch(key.type){
+	case var_str:
+		h = hash_bytes(value_str_data(&key), key.len);
+		break;
+	case var_f32:{
+		uint32_t bits = 0;
+		if(key.f32 != 0.0f)
+			memcpy(&bits, &key.f32, sizeof(bits));
+		h = hash_finalize(bits);
+		break;
+	}
+	case var_bool:
+		h = hash_finalize(key.b);
+		break;
+	default:
+		h = hash_finalize((key.type == var_f64 && key.f == 0.0) ? 0 : key.u);
+	}
+	uint32_t h32 = (uint32_t)(h ^ (h >> 32));
+	return h32 ? h32 : 1;
+}
+
+static bool key_eq(dict_block* dict, size_t slot, value_t key){
+	const char* p = dict->keys + slot * dict->key_size;
+	if(dict->key_type == var_str)
+		return value_eq_str(*(const value_t*) p, key);
+	value_t stored = elem_load(dict->key_type, p);
+	switch(key.type){
+	case var_f32: return stored.f32 == key.f32 || (stored.f32 != stored.f32 && key.f32 != key.f32);
+	case var_f64: return stored.f == key.f || (stored.f != stored.f && key.f != key.f);
+	case var_bool: return stored.b == key.b;
+	default: return stored.u == key.u;
+	}
+}
+
+// Slot of a key, or of the empty slot where it would go
+static size_t dict_find(dict_block* dict, value_t key, uint32_t hash, bool* found){
+	size_t mask = dict->capacity - 1;
+	size_t i = hash & mask;
+	for(; dict->hashes[i]; i = (i + 1) & mask){
+		if(dict->hashes[i] == hash && key_eq(dict, i, key)){
+			*found = true;
+			return i;
+		}
+	}
+	*found = false;
+	return i;
+}
+
+value_t dict_new(var_type key_type, var_type value_type){
+	dict_block* dict = (dict_block*) heap_alloc(sizeof(dict_block));
+	if(!dict)
+		return (value_t){.type = var_none};
+	*dict = (dict_block){1, key_type, value_type, elem_size(key_type), elem_size(value_type), 0, 0, NULL, NULL, NULL};
+	return VALUE_DICT(dict);
+}
+
+static bool dict_alloc(dict_block* dict, size_t capacity){
+	dict->capacity = capacity;
+	dict->hashes = (uint32_t*) heap_alloc(capacity * sizeof(uint32_t));
+	dict->keys = (char*) heap_alloc(capacity * dict->key_size);
+	dict->values = (char*) heap_alloc(capacity * dict->value_size);
+	if(!dict->hashes || !dict->keys || !dict->values){
+		dict_free_arrays(dict);
+		return false;
+	}
+	memset(dict->hashes, 0, capacity * sizeof(uint32_t));
+	return true;
+}
+
+// Rehashes into (capacity) slots, moving the keys and values
+static bool dict_resize(dict_block* dict, size_t capacity){
+	dict_block old = *dict;
+	if(!dict_alloc(dict, capacity)){
+		*dict = old;
+		return false;
+	}
+	size_t mask = capacity - 1;
+	for(size_t i = 0; i < old.capacity; i++){
+		if(!old.hashes[i])
+			continue;
+		size_t j = old.hashes[i] & mask;
+		while(dict->hashes[j])
+			j = (j + 1) & mask;
+		dict->hashes[j] = old.hashes[i];
+		memcpy(dict->keys + j * dict->key_size, old.keys + i * dict->key_size, dict->key_size);
+		memcpy(dict->values + j * dict->value_size, old.values + i * dict->value_size, dict->value_size);
+	}
+	dict_free_arrays(&old);
+	return true;
+}
+
+static const char* dict_unshare(value_t* v){
+	dict_block* dict = v->dict;
+	if(dict->refs == 1)
+		return NULL;
+	dict_block* copy = (dict_block*) heap_alloc(sizeof(dict_block));
+	if(!copy)
+		return "failed to allocate dict";
+	*copy = *dict;
+	copy->refs = 1;
+	copy->hashes = NULL;
+	copy->keys = copy->values = NULL;
+	copy->capacity = 0;
+	if(dict->capacity){
+		if(!dict_alloc(copy, dict->capacity)){
+			heap_free(copy, sizeof(dict_block));
+			return "failed to allocate dict";
+		}
+		memcpy(copy->hashes, dict->hashes, dict->capacity * sizeof(uint32_t));
+		memcpy(copy->keys, dict->keys, dict->capacity * dict->key_size);
+		memcpy(copy->values, dict->values, dict->capacity * dict->value_size);
+		for(size_t i = 0; i < dict->capacity; i++){
+			if(!dict->hashes[i])
+				continue;
+			elems_retain(copy->key_type, copy->keys + i * copy->key_size, 1);
+			elems_retain(copy->value_type, copy->values + i * copy->value_size, 1);
+		}
+	}
+	dict->refs--;
+	v->dict = copy;
+	return NULL;
+}
+
+static const char* dict_key(dict_block* dict, value_t* key){
+	if(!value_cast(key, dict->key_type))
+		return "key does not match the dict's key type";
+	return NULL;
+}
+
+const char* dict_get(value_t v, value_t key, value_t* out){
+	dict_block* dict = v.dict;
+	const char* err = dict_key(dict, &key);
+	bool found = false;
+	if(err)
+		return err;
+	size_t slot = dict->capacity ? dict_find(dict, key, key_hash(key), &found) : 0;
+	if(!found)
+		return "key not found in dict";
+	*out = elem_load(dict->value_type, dict->values + slot * dict->value_size);
+	value_retain(*out);
+	return NULL;
+}
+
+const char* dict_has(value_t v, value_t key, bool* out){
+	dict_block* dict = v.dict;
+	const char* err = dict_key(dict, &key);
+	if(err)
+		return err;
+	*out = false;
+	if(dict->capacity)
+		(void) dict_find(dict, key, key_hash(key), out);
+	return NULL;
+}
+
+const char* dict_set(value_t* v, value_t key, value_t value){
+	const char* err;
+	bool found;
+	if((err = dict_key(v->dict, &key)))
+		return err;
+	if(!value_cast(&value, v->dict->value_type))
+		return "value does not match the dict's value type";
+	if((err = dict_unshare(v)))
+		return err;
+	dict_block* dict = v->dict;
+	// Kept at most 3/4 full, so probes stay short
+	if((dict->size + 1) * 4 > dict->capacity * 3 && !dict_resize(dict, dict->capacity ? dict->capacity * 2 : DICT_START))
+		return "failed to allocate dict";
+	uint32_t hash = key_hash(key);
+	size_t slot = dict_find(dict, key, hash, &found);
+	char* p = dict->values + slot * dict->value_size;
+	value_retain(value);
+	if(found)
+		elems_release(dict->value_type, p, 1);
+	else{
+		value_retain(key);
+		dict->hashes[slot] = hash;
+		elem_store(dict->key_type, dict->keys + slot * dict->key_size, key);
+		dict->size++;
+	}
+	elem_store(dict->value_type, p, value);
+	return NULL;
+}
+
+// Removal shifts the following entries of the probe sequence back,
+// so lookups never need tombstones
+const char* dict_remove(value_t* v, value_t key){
+	const char* err;
+	bool found = false;
+	if((err = dict_key(v->dict, &key)))
+		return err;
+	if(v->dict->capacity)
+		(void) dict_find(v->dict, key, key_hash(key), &found);
+	if(!found)
+		return NULL;
+	if((err = dict_unshare(v)))
+		return err;
+	dict_block* dict = v->dict;
+	size_t mask = dict->capacity - 1;
+	size_t hole = dict_find(dict, key, key_hash(key), &found);
+	elems_release(dict->key_type, dict->keys + hole * dict->key_size, 1);
+	elems_release(dict->value_type, dict->values + hole * dict->value_size, 1);
+	for(size_t i = (hole + 1) & mask; dict->hashes[i]; i = (i + 1) & mask){
+		size_t home = dict->hashes[i] & mask;
+		// Entries whose home slot is cyclically in (hole, i] stay in place
+		if(((i - home) & mask) < ((i - hole) & mask))
+			continue;
+		dict->hashes[hole] = dict->hashes[i];
+		memcpy(dict->keys + hole * dict->key_size, dict->keys + i * dict->key_size, dict->key_size);
+		memcpy(dict->values + hole * dict->value_size, dict->values + i * dict->value_size, dict->value_size);
+		hole = i;
+	}
+	dict->hashes[hole] = 0;
+	dict->size--;
+	return NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef FERRO_CONTAINERS_H
+#define FERRO_CONTAINERS_H
+
+#include <stddef.h>
+
+#include "value.h"
+
+// list and dict store their elements unboxed, at the width of their
+// declared type (an i32 element takes 4 bytes, a str one a value_t)
+// Like str, they are shared by reference counting and copied
+// before being written to while shared
+
+// Contiguous typed buffer with amortized growth
+typedef struct list_block{
+	uint32_t refs;
+	var_type type;			// Element type
+	uint8_t elem_size;
+	size_t size;
+	size_t capacity;
+	char* data;
+} list_block;
+
+// Open addressing hash map with linear probing
+// hashes[i] is 0 for an empty slot, keys / values are parallel arrays
+typedef struct dict_block{
+	uint32_t refs;
+	var_type key_type;
+	var_type value_type;
+	uint8_t key_size;
+	uint8_t value_size;
+	size_t size;
+	size_t capacity;		// Power of two, 0 before the first insertion
+	uint32_t* hashes;
+	char* keys;
+	char* values;
+} dict_block;
+
+#define VALUE_LIST(_l) ((value_t){.list = (_l), .type = var_list, .flags = VALUE_REF})
+#define VALUE_DICT(_d) ((value_t){.dict = (_d), .type = var_dict, .flags = VALUE_REF})
+
+// Operations that can fail return an error message, NULL on success
+// Elements are converted to the container's types, and the values
+// they return hold their own reference
+
+bool container_elem_type(var_type);
+void container_free(value_t);
+bool container_release(value_t,size_t*,size_t);
+size_t container_size(value_t);
+bool container_next(value_t,size_t*,value_t*,value_t*);
+
+value_t list_new(var_type);
+const char* list_push(value_t*,value_t);
+const char* list_get(value_t,value_t,value_t*);
+const char* list_set(value_t*,value_t,value_t);
+const char* list_pop(value_t*,value_t*);
+const char* list_unshare(value_t*);
+
+value_t dict_new(var_type,var_type);
+const char* dict_get(value_t,value_t,value_t*);
+const char* dict_set(value_t*,value_t,value_t);
+const char* dict_has(value_t,value_t,bool*);
+const char* dict_remove(value_t*,value_t);
+
+#endif
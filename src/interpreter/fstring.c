@@ -0,0 +1,204 @@
+#include "fstring.h"
+#include "heap.h"
+#include "../FL/filemanager.h"
+
+#include <errno.h>
+
+static str_block* str_block_alloc(size_t capacity){
+	if(capacity > UINT32_MAX)
+		return NULL;
+	str_block* block = (str_block*) heap_alloc(sizeof(str_block) + capacity);
+	if(!block)
+		return NULL;
+	block->refs = 1;
+	block->capacity = capacity;
+	return block;
+}
+
+void str_block_free(str_block* block){
+	heap_free(block, sizeof(str_block) + block->capacity);
+}
+
+// Creates an owned copy of (len) bytes
+// Short strings are stored inline and never allocate
+// Returns a value of type var_none if allocation failed
+value_t str_new(const char* data, size_t len){
+	value_t v = VALUE_STR(NULL, len);
+	if(len <= VALUE_INLINE_MAX){
+		v.flags = VALUE_INLINE;
+		memcpy(v.inline_str, data, len);
+		return v;
+	}
+	str_block* block = str_block_alloc(len);
+	if(!block)
+		return (value_t){.type = var_none};
+	memcpy(block->data, data, len);
+	v.str = block->data;
+	v.flags = VALUE_REF;
+	return v;
+}
+
+// Concatenates two strings into a new value
+bool str_concat(value_t* dst, value_t a, value_t b){
+	size_t len = (size_t) a.len + b.len;
+	if(len > UINT32_MAX)
+		return false;
+	if(!b.len){
+		value_retain(a);
+		*dst = a;
+		return true;
+	}else if(!a.len){
+		value_retain(b);
+		*dst = b;
+		return true;
+	}
+	value_t v = VALUE_STR(NULL, len);
+	char* data;
+	if(len <= VALUE_INLINE_MAX){
+		v.flags = VALUE_INLINE;
+		data = v.inline_str;
+	}else{
+		str_block* block = str_block_alloc(len);
+		if(!block)
+			return false;
+		v.str = data = block->data;
+		v.flags = VALUE_REF;
+	}
+	memcpy(data, value_str_data(&a), a.len);
+	memcpy(data + a.len, value_str_data(&b), b.len);
+	*dst = v;
+	return true;
+}
+
+// Appends a string to another in place
+// The block is only reused if dst holds its single reference,
+// otherwise it is copied first (copy on write)
+// Capacity grows geometrically, so repeated appends are amortized
+bool str_append(value_t* dst, value_t b){
+	size_t len = (size_t) dst->len + b.len;
+	if(len > UINT32_MAX)
+		return false;
+	if(!b.len)
+		return true;
+	if((dst->flags & VALUE_REF) && STR_BLOCK(*dst)->refs == 1 && STR_BLOCK(*dst)->capacity >= len){
+		memcpy((char*) dst->str + dst->len, value_str_data(&b), b.len);
+		dst->len = len;
+		return true;
+	}
+	if(len <= VALUE_INLINE_MAX){
+		value_t v;
+		if(!str_concat(&v, *dst, b))
+			return false;
+		value_release(*dst);
+		*dst = v;
+		return true;
+	}
+	str_block* block;
+	size_t capacity = (dst->len * 2 > len) ? dst->len * 2 : len;
+	if((dst->flags & VALUE_REF) && STR_BLOCK(*dst)->refs == 1){
+		str_block* old = STR_BLOCK(*dst);
+		block = (str_block*) heap_realloc(old, sizeof(str_block) + old->capacity, sizeof(str_block) + capacity);
+		if(!block)
+			return false;
+		block->capacity = capacity;
+	}else{
+		if(!(block = str_block_alloc(capacity)))
+			return false;
+		memcpy(block->data, value_str_data(dst), dst->len);
+		value_release(*dst);
+	}
+	memcpy(block->data + dst->len, value_str_data(&b), b.len);
+	*dst = VALUE_STR(block->data, len);
+	dst->flags = VALUE_REF;
+	return true;
+}
+
+// Files mapped by mapfile, their views are not counted so they stay
+// mapped until the program ends
+typedef struct{
+	const char* contents;
+	size_t size;
+} str_mapping;
+typedef DYNAMIC_ARRAY(str_mapping* maps) str_mapping_list;
+static str_mapping_list mappings = NEW_DYNAMIC_ARRAY(sizeof(str_mapping));
+
+static char str_message[128];
+
+static const char* str_mapfile(value_t path, value_t* out){
+	char* cpath = (char*) malloc(path.len + 1);
+	if(!cpath)
+		return "failed to allocate string";
+	memcpy(cpath, value_str_data(&path), path.len);
+	cpath[path.len] = '\0';
+	str_mapping map;
+	bool mapped = map_file(cpath, false, &map.contents, &map.size);
+	int err = errno;
+	free(cpath);
+	if(!mapped){
+		snprintf(str_message, sizeof(str_message), "mapfile failed: %s", strerror(err));
+		return str_message;
+	}
+	if(map.size > UINT32_MAX){
+		unmap_file(map.contents, map.size, false);
+		return "mapfile failed: file too large for a str";
+	}
+	if(map.contents && !dynamic_array_pushback((dynamic_array_t*) &mappings, &map)){
+		unmap_file(map.contents, map.size, false);
+		return "failed to allocate mapping";
+	}
+	*out = VALUE_STR(map.contents ? map.contents : "", map.size);
+	return NULL;
+}
+
+static const char* str_slice(value_t s, int64_t begin, int64_t end, value_t* out){
+	if(begin < 0 || end < begin || end > s.len)
+		return "slice out of range";
+	const char* data = value_str_data(&s) + begin;
+	if(!(s.flags & (VALUE_REF | VALUE_INLINE))){
+		*out = VALUE_STR(data, end - begin);
+		return NULL;
+	}
+	*out = str_new(data, end - begin);
+	return (out->type == var_str) ? NULL : "failed to allocate string";
+}
+
+static int64_t str_find(value_t s, value_t needle, int64_t from){
+	if(from > s.len || needle.len > s.len - from)
+		return -1;
+	if(!needle.len)
+		return from;
+	const char* data = value_str_data(&s);
+	const char* pattern = value_str_data(&needle);
+	const char* last = data + s.len - needle.len;
+	for(const char* at = data + from; at <= last; at++){
+		if(!(at = (const char*) memchr(at, pattern[0], last - at + 1)))
+			break;
+		if(!memcmp(at + 1, pattern + 1, needle.len - 1))
+			return at - data;
+	}
+	return -1;
+}
+
+// Runs string built-in (fn) on args, storing its result in out
+// Returns an error message or NULL
+const char* str_call(uint8_t fn, value_t* args, value_t* out){
+	switch(fn){
+	case str_fn_mapfile:
+		return str_mapfile(args[0], out);
+	case str_fn_slice:
+		return str_slice(args[0], args[1].i, args[2].i, out);
+	default:
+		if(args[2].i < 0)
+			return "negative index";
+		*out = VALUE_INT(var_i64, str_find(args[0], args[1], args[2].i));
+		return NULL;
+	}
+}
+
+// Unmaps the files mapped by mapfile, once nothing can view them
+void str_unmap_files(void){
+	for(size_t i = 0; i < mappings.size; i++)
+		unmap_file(mappings.maps[i].contents, mappings.maps[i].size, false);
+	dynamic_array_free((dynamic_array_t*) &mappings);
+	mappings = (str_mapping_list) NEW_DYNAMIC_ARRAY(sizeof(str_mapping));
+}
@@ -0,0 +1,59 @@
+#ifndef FERRO_STRING_H
+#define FERRO_STRING_H
+
+#include <stddef.h>
+
+#include "value.h"
+#include "containers.h"
+
+// Heap storage of a str, shared between values by reference counting
+// Blocks are only written to while they have a single reference
+typedef struct{
+	uint32_t refs;
+	uint32_t capacity;
+	char data[];
+} str_block;
+
+#define STR_BLOCK(_v) ((str_block*)((_v).str - offsetof(str_block, data)))
+
+value_t str_new(const char*,size_t);
+bool str_concat(value_t*,value_t,value_t);
+bool str_append(value_t*,value_t);
+void str_block_free(str_block*);
+
+// String built-ins, run by op_string
+// A str that is neither inline nor counted is a view of memory that lives
+// until the program ends (constants, mapped files): it is sliced without
+// copying anything
+enum{
+	str_fn_mapfile,	// mapfile(path): the file, mapped read-only
+	str_fn_slice,	// slice(s, begin, end): bytes [begin, end) of s
+	str_fn_find,	// find(s, needle, from): first index of needle from (from) on, -1 if none
+	str_fn_count
+};
+
+const char* str_call(uint8_t,value_t*,value_t*);
+void str_unmap_files(void);
+
+// Takes a reference to the heap block of a value, if it has one
+static inline void value_retain(value_t v){
+	if(!(v.flags & VALUE_REF))
+		return;
+	if(v.type == var_str)
+		STR_BLOCK(v)->refs++;
+	else
+		(*v.refs)++;
+}
+
+// Drops a reference to the heap block of a value, if it has one
+static inline void value_release(value_t v){
+	if(!(v.flags & VALUE_REF))
+		return;
+	if(v.type == var_str){
+		if(!--STR_BLOCK(v)->refs)
+			str_block_free(STR_BLOCK(v));
+	}else if(!--*v.refs)
+		container_free(v);
+}
+
+#endif
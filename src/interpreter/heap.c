@@ -0,0 +1,202 @@
+#include "heap.h"
+#include "containers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+heap_stats_t heap_stats = {0};
+size_t heap_budget = HEAP_BUDGET;
+bool heap_show_stats = false;
+
+#define HEAP_CLASSES (HEAP_SMALL_MAX / HEAP_CLASS)
+#define HEAP_CLASS_OF(_size) (((_size) + HEAP_CLASS - 1) / HEAP_CLASS - 1)
+
+// Freed small blocks, linked through their first bytes
+typedef struct heap_free_block{
+	struct heap_free_block* next;
+} heap_free_block;
+static heap_free_block* free_lists[HEAP_CLASSES] = {NULL};
+
+// Arenas small blocks are bumped out of, kept until heap_finish
+typedef DYNAMIC_ARRAY(char** ptrs) heap_arena_list;
+static heap_arena_list arenas = NEW_DYNAMIC_ARRAY(sizeof(char*));
+static char* bump = NULL;
+static char* bump_end = NULL;
+
+// Containers being released incrementally
+typedef struct{
+	value_t v;
+	size_t cursor;		// Next element to release
+} heap_pending;
+typedef DYNAMIC_ARRAY(heap_pending* items) heap_pending_list;
+static heap_pending_list pending = NEW_DYNAMIC_ARRAY(sizeof(heap_pending));
+
+static uint64_t start_time = 0;
+
+static uint64_t heap_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Called before the program runs, allocation rates are measured from here
+void heap_setup(void){
+	start_time = heap_clock();
+}
+
+static void heap_count(size_t size){
+	heap_stats.allocs++;
+	heap_stats.bytes += size;
+	heap_stats.live += size;
+	if(heap_stats.live > heap_stats.peak)
+		heap_stats.peak = heap_stats.live;
+}
+
+static void* heap_alloc_small(size_t class){
+	size_t size = (class + 1) * HEAP_CLASS;
+	if(free_lists[class]){
+		heap_free_block* block = free_lists[class];
+		free_lists[class] = block->next;
+		return block;
+	}
+	if(bump_end - bump < (ptrdiff_t) size){
+		char* arena = (char*) malloc(HEAP_ARENA);
+		if(!arena || !dynamic_array_pushback((dynamic_array_t*)&arenas, &arena)){
+			free(arena);
+			return NULL;
+		}
+		// The tail of the previous arena is too small to matter
+		bump = arena;
+		bump_end = arena + HEAP_ARENA;
+	}
+	void* p = bump;
+	bump += size;
+	return p;
+}
+
+// Allocates (size) bytes, freed with heap_free(p, size)
+// Allocation also paces the incremental release of dead containers
+void* heap_alloc(size_t size){
+	void* p;
+	if(pending.size)
+		heap_step();
+	if(size && size <= HEAP_SMALL_MAX){
+		if((p = heap_alloc_small(HEAP_CLASS_OF(size))))
+			heap_stats.pooled++;
+	}else
+		p = malloc(size ? size : 1);
+	if(p)
+		heap_count(size);
+	return p;
+}
+
+void heap_free(void* p, size_t size){
+	if(!p)
+		return;
+	heap_stats.live -= size;
+	if(size && size <= HEAP_SMALL_MAX){
+		heap_free_block* block = (heap_free_block*) p;
+		size_t class = HEAP_CLASS_OF(size);
+		block->next = free_lists[class];
+		free_lists[class] = block;
+	}else
+		free(p);
+}
+
+// Resizes a block, keeping it in place when it stays in its size class
+void* heap_realloc(void* p, size_t old_size, size_t size){
+	if(!p)
+		return heap_alloc(size);
+	bool old_small = old_size && old_size <= HEAP_SMALL_MAX;
+	bool small = size && size <= HEAP_SMALL_MAX;
+	if(old_small && small && HEAP_CLASS_OF(old_size) == HEAP_CLASS_OF(size)){
+		heap_stats.live += size - old_size;
+		return p;
+	}
+	if(!old_small && !small){
+		void* q = realloc(p, size);
+		if(!q)
+			return NULL;
+		heap_count(size);
+		heap_stats.allocs--;
+		heap_stats.live -= old_size;
+		return q;
+	}
+	void* q = heap_alloc(size);
+	if(!q)
+		return NULL;
+	memcpy(q, p, (old_size < size) ? old_size : size);
+	heap_free(p, old_size);
+	return q;
+}
+
+// Queues a dead container whose elements are released over several steps
+void heap_defer(value_t v){
+	heap_pending item = {v, 0};
+	heap_stats.deferred++;
+	// Without room to queue it, it is released at once
+	if(!dynamic_array_pushback((dynamic_array_t*)&pending, &item)){
+		size_t cursor = 0;
+		while(!container_release(v, &cursor, SIZE_MAX));
+	}
+}
+
+
+// Releases up to heap_budget elements of the queued containers
+void heap_step(void){
+	if(!pending.size)
+		return;
+	uint64_t start = heap_clock();
+	size_t released = 0;
+	while(pending.size && released < heap_budget){
+		// Releasing elements can queue more containers over this item
+		heap_pending item = pending.items[--pending.size];
+		value_t v = item.v;
+		size_t cursor = item.cursor;
+		bool done = container_release(v, &cursor, heap_budget - released);
+		released += cursor - item.cursor;
+		if(!done){
+			heap_pending rest = {v, cursor};
+			if(!dynamic_array_pushback((dynamic_array_t*)&pending, &rest))
+				while(!container_release(v, &cursor, SIZE_MAX));
+		}
+	}
+	uint64_t pause = heap_clock() - start;
+	heap_stats.steps++;
+	heap_stats.total_pause_ns += pause;
+	if(pause > heap_stats.max_pause_ns)
+		heap_stats.max_pause_ns = pause;
+	if(released > heap_stats.max_step)
+		heap_stats.max_step = released;
+}
+
+// Drains the queue and gives the arenas back, once no value is left
+void heap_finish(void){
+	while(pending.size){
+		heap_pending item = pending.items[--pending.size];
+		while(!container_release(item.v, &item.cursor, SIZE_MAX));
+	}
+	dynamic_array_free((dynamic_array_t*)&pending);
+	for(size_t i = 0; i < arenas.size; i++)
+		free(arenas.ptrs[i]);
+	dynamic_array_free((dynamic_array_t*)&arenas);
+	memset(free_lists, 0, sizeof(free_lists));
+	bump = bump_end = NULL;
+}
+
+void heap_print_stats(void){
+	double seconds = (heap_clock() - start_time) / 1e9;
+	fprintf(stderr,
+		"heap: %llu allocations (%llu pooled), %llu bytes, peak %llu bytes live\n"
+		"heap: %.0f allocations/s, %.0f bytes/s\n"
+		"heap: %llu containers released incrementally in %llu steps of at most %llu elements\n"
+		"heap: pauses %.3f ms total, %.3f ms max (budget %lu elements)\n",
+		(unsigned long long) heap_stats.allocs, (unsigned long long) heap_stats.pooled,
+		(unsigned long long) heap_stats.bytes, (unsigned long long) heap_stats.peak,
+		seconds > 0 ? heap_stats.allocs / seconds : 0.0, seconds > 0 ? heap_stats.bytes / seconds : 0.0,
+		(unsigned long long) heap_stats.deferred, (unsigned long long) heap_stats.steps,
+		(unsigned long long) heap_stats.max_step,
+		heap_stats.total_pause_ns / 1e6, heap_stats.max_pause_ns / 1e6, (unsigned long) heap_budget);
+}
@@ -0,0 +1,53 @@
+#ifndef FERRO_HEAP_H
+#define FERRO_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../FL/datastructures.h"
+#include "value.h"
+
+// Memory of the counted runtime objects (str, list, dict)
+// Values are reclaimed by reference counting as soon as they die,
+// and since containers only hold primitives and str, no cycle can
+// keep garbage alive: there is nothing for a tracing pass to find
+// What remains is making allocation cheap and bounding the work
+// a single release can do:
+// - Small blocks come from size classes carved out of large arenas
+//   with a bump pointer, and are recycled through free lists
+// - A container dying with many counted elements is released
+//   incrementally, a bounded number of elements per step
+#define HEAP_ARENA 64*KB
+#define HEAP_CLASS 16
+#define HEAP_SMALL_MAX 512
+#define HEAP_BUDGET 4096
+
+typedef struct{
+	uint64_t allocs;		// Blocks allocated
+	uint64_t pooled;		// ... of which came from a size class
+	uint64_t bytes;			// Bytes allocated
+	uint64_t live;			// Bytes currently allocated
+	uint64_t peak;			// Highest live
+	uint64_t deferred;		// Containers released incrementally
+	uint64_t steps;			// Incremental release steps
+	uint64_t max_step;		// Most elements released by a step
+	uint64_t max_pause_ns;	// Longest step
+	uint64_t total_pause_ns;
+} heap_stats_t;
+
+extern heap_stats_t heap_stats;
+extern size_t heap_budget;		// Elements released per step
+extern bool heap_show_stats;
+
+void* heap_alloc(size_t);
+void* heap_realloc(void*,size_t,size_t);
+void heap_free(void*,size_t);
+
+void heap_setup(void);
+void heap_defer(value_t);
+void heap_step(void);
+void heap_finish(void);
+void heap_print_stats(void);
+
+#endif
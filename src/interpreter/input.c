@@ -0,0 +1,208 @@
+#include "input.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Unread input is buffer[start..end]
+// The buffer only grows for lines longer than it
+static char* buffer = NULL;
+static size_t capacity = 0;
+static size_t start = 0;
+static size_t end = 0;
+static bool eof = false;
+
+// Reads the next block of stdin after the unread input
+// Returns false at the end of input (or on a read error)
+static bool input_fill(void){
+	if(eof)
+		return false;
+	if(start){
+		memmove(buffer, buffer + start, end - start);
+		end -= start;
+		start = 0;
+	}
+	if(end == capacity){
+		size_t new_capacity = capacity ? capacity * 2 : INPUT_BLOCK;
+		char* new_buffer = (char*) realloc(buffer, new_capacity);
+		if(!new_buffer){
+			eof = true;
+			return false;
+		}
+		buffer = new_buffer;
+		capacity = new_capacity;
+	}
+	ssize_t count;
+	do
+		count = read(STDIN_FILENO, buffer + end, capacity - end);
+	while(count < 0 && errno == EINTR);
+	if(count <= 0){
+		eof = true;
+		return false;
+	}
+	end += count;
+	return true;
+}
+
+static const char* find_newline(const char* p, const char* last){
+#ifdef __SSE2__
+	const __m128i newline = _mm_set1_epi8('\n');
+	for(; last - p >= 16; p += 16){
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) p), newline));
+		if(mask)
+			return p + __builtin_ctz(mask);
+	}
+#endif
+	return (p < last) ? (const char*) memchr(p, '\n', last - p) : NULL;
+}
+
+// Reads a line from stdin, without its newline
+// The line points into the input buffer and stays valid until the next read
+// Returns false at the end of input (with an empty line)
+bool input_line(const char** line, size_t* len){
+	size_t scanned = start;
+	for(;;){
+		const char* newline = find_newline(buffer + scanned, buffer + end);
+		if(newline){
+			*line = buffer + start;
+			*len = newline - *line;
+			start = newline - buffer + 1;
+			return true;
+		}
+		scanned = end - start;
+		if(!input_fill()){
+			*line = buffer ? buffer + start : "";
+			*len = end - start;
+			start = end;
+			return *len != 0;
+		}
+		scanned += start;
+	}
+}
+
+// Returns the next byte of stdin, or EOF
+int input_getchar(void){
+	if(start == end && !input_fill())
+		return EOF;
+	return (unsigned char) buffer[start++];
+}
+
+void input_free(void){
+	free(buffer);
+	buffer = NULL;
+	capacity = start = end = 0;
+	eof = false;
+}
+
+// Number parsing works on the buffer directly, with the same results
+// as strtoll / strtoull / strtod on the line
+
+static const char* skip_space(const char* str, const char* last, bool* negative){
+	while(str < last && isspace((unsigned char) *str))
+		str++;
+	*negative = false;
+	if(str < last && (*str == '-' || *str == '+'))
+		*negative = (*str++ == '-');
+	return str;
+}
+
+// Accumulates digits, returns false on overflow
+static bool parse_digits(const char** str, const char* last, uint64_t* value){
+	uint64_t u = 0;
+	bool overflow = false;
+	for(; *str < last && (unsigned)(**str - '0') < 10; (*str)++){
+		unsigned digit = **str - '0';
+		if(u > (UINT64_MAX - digit) / 10)
+			overflow = true;
+		else
+			u = u * 10 + digit;
+	}
+	*value = u;
+	return !overflow;
+}
+
+int64_t input_parse_i64(const char* str, size_t len){
+	const char* last = str + len;
+	bool negative;
+	uint64_t u;
+	str = skip_space(str, last, &negative);
+	bool valid = parse_digits(&str, last, &u);
+	if(negative)
+		return (!valid || u > (uint64_t) INT64_MAX + 1) ? INT64_MIN : (int64_t)(0 - u);
+	return (!valid || u > INT64_MAX) ? INT64_MAX : (int64_t) u;
+}
+
+uint64_t input_parse_u64(const char* str, size_t len){
+	const char* last = str + len;
+	bool negative;
+	uint64_t u;
+	str = skip_space(str, last, &negative);
+	if(!parse_digits(&str, last, &u))
+		return UINT64_MAX;
+	return negative ? 0 - u : u;
+}
+
+static double parse_f64_slow(const char* str, size_t len){
+	char tmp[128];
+	char* copy = (len < sizeof(tmp)) ? tmp : (char*) malloc(len + 1);
+	if(!copy)
+		return 0.0;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	double f = strtod(copy, NULL);
+	if(copy != tmp)
+		free(copy);
+	return f;
+}
+
+// Decimals with at most 19 digits and a small exponent are exact in a double
+// (Clinger's fast path), anything else goes through strtod
+double input_parse_f64(const char* str, size_t len){
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* begin = str;
+	const char* last = str + len;
+	bool negative;
+	str = skip_space(str, last, &negative);
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	const char* first = str;
+	for(; str < last && (unsigned)(*str - '0') < 10; str++, digits++)
+		mantissa = mantissa * 10 + (*str - '0');
+	if(str < last && *str == '.'){
+		for(str++; str < last && (unsigned)(*str - '0') < 10; str++, digits++, exponent--)
+			mantissa = mantissa * 10 + (*str - '0');
+	}
+	if(str == first || (str - first == 1 && *first == '.'))
+		return parse_f64_slow(begin, len);
+	if(str < last && (*str == 'e' || *str == 'E')){
+		const char* e = str + 1;
+		bool e_negative = false;
+		if(e < last && (*e == '-' || *e == '+'))
+			e_negative = (*e++ == '-');
+		if(e < last && (unsigned)(*e - '0') < 10){
+			int e_value = 0;
+			for(; e < last && (unsigned)(*e - '0') < 10; e++)
+				if(e_value < 10000)
+					e_value = e_value * 10 + (*e - '0');
+			exponent += e_negative ? -e_value : e_value;
+			str = e;
+		}
+	}
+	// Hex floats, or more digits than a u64 holds exactly
+	if((str < last && (*str == 'x' || *str == 'X')) || digits > 19 || mantissa > (UINT64_C(1) << 53)
+		|| exponent < -22 || exponent > 22)
+		return parse_f64_slow(begin, len);
+
+	double f = (double) mantissa;
+	f = (exponent < 0) ? f / powers[-exponent] : f * powers[exponent];
+	return negative ? -f : f;
+}
@@ -0,0 +1,23 @@
+#ifndef FERRO_INPUT_H
+#define FERRO_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../FL/datastructures.h"
+
+// Read-ahead standard input for input / getchar
+// stdin is read in large blocks with read(2), lines are found in place
+// and numbers are parsed straight from the buffer
+#define INPUT_BLOCK 64*KB
+
+bool input_line(const char**,size_t*);
+int input_getchar(void);
+void input_free(void);
+
+int64_t input_parse_i64(const char*,size_t);
+uint64_t input_parse_u64(const char*,size_t);
+double input_parse_f64(const char*,size_t);
+
+#endif
@@ -2,14 +2,35 @@
 #include "../FL/textstyle.h"
 #include "../FL/tokenizer.h"
 #include "../FL/parser.h"
+#include "../FL/stats.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "variables.h"
+#include "compiler.h"
+#include "optimizer.h"
+#include "vm.h"
+#include "output.h"
+#include "heap.h"
+#include "profile.h"
+#include "batch.h"
+#include "server.h"
+#include "pool.h"
+#include "aio.h"
+#ifdef FERRO_JIT
+#include "jit.h"
+#endif
+
+// Print the tokens, statement types and bytecode (--dump)
+static bool dump = false;
+
+// Check every input file instead of running one (--batch)
+static bool batch_mode = false;
 
-#define FERRO_DEBUG
+// Socket to serve scripts on (--serve)
+static const char* serve_path = NULL;
 
 static void show_usage(const char* msg){
 	if(msg){
@@ -18,43 +39,190 @@ static void show_usage(const char* msg){
 	}
 	printf(
 		RESET_ATTR "Usage:" BOLD DEFAULT_FG " ferro_interpreter [-options] <main.fs>\n"
+		RESET_ATTR "      " BOLD DEFAULT_FG " ferro_interpreter --batch [-options] <scripts.fs...>\n"
+		RESET_ATTR "      " BOLD DEFAULT_FG " ferro_interpreter --serve=<socket> [-options]\n"
 		RESET_ATTR "Options:\n"
 		"	-h : Help\n"
+		"	--max-depth=<n> : Maximum expression nesting depth (default %d)\n"
+		"	--buffer=<auto|line|full> : Output buffering (default auto, line buffered on a terminal)\n"
+		"	--gc-budget=<n> : Elements a dead container releases per step (default %d)\n"
+		"	--gc-stats : Print allocation and release statistics on exit\n"
+		"	--threads=<n> : Threads running parallel for loops (default one per core)\n"
+		"	--dump : Print the tokens, parsed statement types and bytecode\n"
+		"	--passes=<all|none|pass,...> : Optimization passes to run (default all:\n"
+		"	                               const-prop, dce, strength, cse, dse)\n"
+		"	--no-pass=<pass> : Skip one optimization pass\n"
+		"	--stats[=<text|json>] : Print the time and counts of every phase and file to stderr (default text)\n"
+		"	--batch : Tokenize, parse and compile every input file without running them, on a thread pool\n"
+		"	--manifest=<file> : Add the scripts listed in <file> (one per line) to the batch\n"
+		"	--jobs=<n> : Worker threads of the batch (default one per core)\n"
+		"	--serve=<socket> : Keep compiled scripts cached and run the ones ferro_client sends on <socket>\n"
+		"	                   (--buffer, --gc-budget, --gc-stats, --threads, --no-io-uring and the JIT options apply per script)\n"
+		"	--profile[=<file>] : Sample the running line %d times per second, write folded stacks to <file> (default " PROFILE_DEFAULT_PATH ")\n"
+#ifdef FERRO_IO_URING
+		"	--no-io-uring : Run the async_* built-ins on plain system calls instead of io_uring\n"
+#endif
+#ifdef FERRO_JIT
+		"	--no-jit : Interpret hot loops instead of compiling them\n"
+		"	--jit-threshold=<n> : Iterations before a loop is compiled (default %d)\n"
+#endif
+		, PARSER_MAX_DEPTH, HEAP_BUDGET, PROFILE_HZ
+#ifdef FERRO_JIT
+		, JIT_THRESHOLD
+#endif
 	);
 	exit(EXIT_FAILURE);
 }
 
 static file_t main_file = {NULL, NULL, 0};
 
+// Options that only change how a compiled program runs,
+// also applied to each script of --serve
+// Returns false if (arg) is not one, sets (error) if its value is invalid
+static bool runtime_option(const char* arg, const char** error){
+	*error = NULL;
+	if(!strncmp(arg,"--buffer=",9)){
+		if(!strcmp(arg+9,"auto"))
+			output_mode = output_auto;
+		else if(!strcmp(arg+9,"line"))
+			output_mode = output_line;
+		else if(!strcmp(arg+9,"full"))
+			output_mode = output_full;
+		else
+			*error = "Invalid buffering mode.";
+	}else if(!strncmp(arg,"--gc-budget=",12)){
+		char* end = NULL;
+		unsigned long budget = strtoul(arg+12,&end,10);
+		if(!budget || !end || *end)
+			*error = "Invalid release budget.";
+		else
+			heap_budget = budget;
+	}else if(!strcmp(arg,"--gc-stats"))
+		heap_show_stats = true;
+	else if(!strncmp(arg,"--threads=",10)){
+		char* end = NULL;
+		unsigned long threads = strtoul(arg+10,&end,10);
+		if(!threads || threads > 1024 || !end || *end)
+			*error = "Invalid thread count.";
+		else
+			pool_threads = threads;
+	}
+#ifdef FERRO_IO_URING
+	else if(!strcmp(arg,"--no-io-uring"))
+		aio_uring_enabled = false;
+#endif
+#ifdef FERRO_JIT
+	else if(!strcmp(arg,"--no-jit"))
+		jit_enabled = false;
+	else if(!strncmp(arg,"--jit-threshold=",16)){
+		char* end = NULL;
+		unsigned long threshold = strtoul(arg+16,&end,10);
+		if(!threshold || threshold > UINT32_MAX || !end || *end)
+			*error = "Invalid JIT threshold.";
+		else
+			jit_threshold = threshold;
+	}
+#endif
+	else
+		return false;
+	return true;
+}
+
 static bool init_interpreter(int argc, char* argv[]){
 	if(argc < 2)
 		show_usage("Missing input file.");
 
 	char* input_file = NULL;
+	for(int i = 1; i < argc; i++)
+		if(!strcmp(argv[i],"--batch"))
+			batch_mode = true;
 	for(int i = 1; i < argc; i++){
 		if(argv[i][0] == '-'){
 			switch(argv[i][1]){
 			case 'h':
 				show_usage(NULL);
-			case '-':
-				if(!strcmp(argv[i],"--help"))
+			case '-':{
+				const char* error = NULL;
+				if(runtime_option(argv[i],&error)){
+					if(error)
+						show_usage(error);
+				}else if(!strcmp(argv[i],"--help"))
 						show_usage(NULL);
-				else{
+				else if(!strncmp(argv[i],"--max-depth=",12)){
+					char* end = NULL;
+					unsigned long depth = strtoul(argv[i]+12,&end,10);
+					if(!depth || !end || *end)
+						show_usage("Invalid maximum depth.");
+					parser_max_depth = depth;
+				}else if(!strcmp(argv[i],"--dump"))
+					dump = true;
+				else if(!strncmp(argv[i],"--passes=",9)){
+					if(!opt_select(argv[i]+9))
+						show_usage("Invalid optimization pass list.");
+				}else if(!strncmp(argv[i],"--no-pass=",10)){
+					if(!opt_disable(argv[i]+10))
+						show_usage("Invalid optimization pass.");
+				}
+				else if(!strcmp(argv[i],"--stats") || !strcmp(argv[i],"--stats=text"))
+					stats_format = stats_text;
+				else if(!strcmp(argv[i],"--stats=json"))
+					stats_format = stats_json;
+				else if(!strcmp(argv[i],"--batch"))
+					continue;
+				else if(!strncmp(argv[i],"--manifest=",11)){
+					if(!batch_mode)
+						show_usage("--manifest requires --batch.");
+					if(!batch_add_manifest(argv[i]+11))
+						return false;
+				}else if(!strncmp(argv[i],"--jobs=",7)){
+					char* end = NULL;
+					unsigned long jobs = strtoul(argv[i]+7,&end,10);
+					if(!jobs || jobs > 1024 || !end || *end)
+						show_usage("Invalid job count.");
+					batch_threads = jobs;
+				}else if(!strncmp(argv[i],"--serve=",8)){
+					if(!argv[i][8])
+						show_usage("Invalid socket path.");
+					serve_path = argv[i]+8;
+				}else if(!strcmp(argv[i],"--profile"))
+					profile_path = PROFILE_DEFAULT_PATH;
+				else if(!strncmp(argv[i],"--profile=",10)){
+					if(!argv[i][10])
+						show_usage("Invalid profile path.");
+					profile_path = argv[i]+10;
+				}else{
 					char tmp[512];
 					sprintf(tmp,"Invalid argument %.*s",450,argv[i]);
 					show_usage(tmp);
 				}
 				break;
-			default:{
+			}default:{
 				char tmp[32];
 				sprintf(tmp,"Invalid argument %.*s",2,argv[i]);
 				show_usage(tmp);
 			}}
+		}else if(batch_mode){
+			if(!batch_add(argv[i]))
+				return false;
 		}else if(input_file)
-			show_usage("Too many input files (only one required).");
+			show_usage("Too many input files (only one required, or use --batch).");
 		else
 			input_file = argv[i];
 	}
+	if(batch_mode){
+		if(stats_format || profile_path || dump || serve_path)
+			show_usage("--stats, --profile, --dump and --serve do not apply to --batch.");
+		return true;
+	}
+	if(serve_path){
+		if(stats_format || profile_path || dump)
+			show_usage("--stats, --profile and --dump do not apply to --serve.");
+		if(input_file)
+			show_usage("--serve takes no input file (scripts come from ferro_client).");
+		return true;
+	}
+	if(!input_file)
+		show_usage("Missing input file.");
 
 	main_file.path = (char*) malloc(strlen(input_file)+1);
 	if(!main_file.path){
@@ -70,7 +238,12 @@ static bool init_interpreter(int argc, char* argv[]){
 	return true;
 }
 
-static void cleanup(node_prog* prog){
+static void cleanup(node_prog* prog, bc_chunk* chunk){
+	if(stats_format){
+		stats_print(stderr);
+		stats_free();
+	}
+	bc_free(chunk);
 	parser_free(prog);
 	tk_free();
 	free_file_list();
@@ -78,46 +251,102 @@ static void cleanup(node_prog* prog){
 
 int main(int argc, char* argv[]){
 	if(!init_interpreter(argc, argv)){
-		cleanup(NULL);
+		cleanup(NULL, NULL);
 		return EXIT_FAILURE;
 	}
+	if(batch_mode){
+		int status = batch_run();
+		free_file_list();
+		return status;
+	}
+	if(serve_path)
+		return serve_run(serve_path, runtime_option);
 
 	if(!tokenize(&main_file)){
-		cleanup(NULL);
+		cleanup(NULL, NULL);
 		return EXIT_FAILURE;
 	}
 
-	printf(GREEN_FG BOLD "Tokenization complete!" RESET_ATTR "\n");
+	// Progress goes with the text stats, never into the script's output
+	// (nor around the JSON ones)
+	if(stats_format == stats_text)
+		fprintf(stderr, GREEN_FG BOLD "Tokenization complete!" RESET_ATTR "\n");
 
-#ifdef FERRO_DEBUG
-	{
-	printf("\n" YELLOW_FG BOLD "TOKENS:" RESET_ATTR "\n");
-	token* tk;
-	while((tk = tk_consume(0))){
-		tk_print_token(tk);
-		putchar(' ');
-	}
-	printf("\n\n");
+	if(dump){
+		printf("\n" YELLOW_FG BOLD "TOKENS:" RESET_ATTR "\n");
+		token* tk;
+		tk_rewind();
+		while((tk = tk_consume(0))){
+			tk_print_token(tk);
+			putchar(' ');
+		}
+		printf("\n\n");
 	}
-#endif
 
 	node_prog prog;
+	uint64_t start = stats_format ? stats_clock() : 0;
 	if(!parse(&prog, &main_file)){
-		cleanup(&prog);
+		cleanup(&prog, NULL);
+		return EXIT_FAILURE;
+	}
+	if(stats_format){
+		stats_phase("parse", stats_clock() - start, "nodes", parser_count_nodes(&prog));
+		stats_arena_peak = parser_arena_used();
+	}
+
+	if(dump){
+		printf("\n" YELLOW_FG BOLD "PARSING NODES:" RESET_ATTR "\n");
+		for(size_t i = 0; i < prog.size; i++)
+			printf("%i ",(int)prog.stmts[i].type);
+		printf("\n\n");
+	}
+
+	if(stats_format == stats_text)
+		fprintf(stderr, GREEN_FG BOLD "Parsing complete!" RESET_ATTR "\n");
+
+	bc_chunk chunk;
+	start = stats_format ? stats_clock() : 0;
+	if(!compile(&chunk, &prog)){
+		cleanup(&prog, &chunk);
 		return EXIT_FAILURE;
 	}
+	if(stats_format)
+		stats_phase("compile", stats_clock() - start, "instructions", chunk.code.size);
 
-#ifdef FERRO_DEBUG
-	{
-	printf("\n" YELLOW_FG BOLD "PARSING NODES:" RESET_ATTR "\n");
-	for(size_t i = 0; i < prog.size; i++)
-		printf("%i ",(int)prog.stmts[i].type);
-	printf("\n\n");
+	// The passes only see a program that compiled, which is compiled again
+	// if they rewrote it
+	if(opt_any()){
+		size_t rewritten = optimize(&prog);
+		if(stats_format)
+			for(size_t i = 0; i < opt_pass_count; i++)
+				if(opt_passes[i].enabled)
+					stats_phase(opt_passes[i].name, opt_passes[i].ns, "rewrites", opt_passes[i].rewrites);
+		if(rewritten){
+			bc_free(&chunk);
+			start = stats_format ? stats_clock() : 0;
+			if(!compile(&chunk, &prog)){
+				cleanup(&prog, &chunk);
+				return EXIT_FAILURE;
+			}
+			if(stats_format)
+				stats_phase("recompile", stats_clock() - start, "instructions", chunk.code.size);
+		}
+	}
+
+	if(dump){
+		printf("\n" YELLOW_FG BOLD "BYTECODE:" RESET_ATTR "\n");
+		bc_disassemble(&chunk);
+		printf("\n");
 	}
-#endif
 
-	printf(GREEN_FG BOLD "Parsing complete!" RESET_ATTR "\n");
+	start = stats_format ? stats_clock() : 0;
+	int status = vm_run(&chunk);
+	if(stats_format)
+		stats_phase("run", stats_clock() - start, NULL, 0);
+	// Tokens are still alive, so samples can be mapped back to lines
+	if(profile_path && !profile_report(&chunk) && status == EXIT_SUCCESS)
+		status = EXIT_FAILURE;
 
-	cleanup(&prog);
-	return 0;
+	cleanup(&prog, &chunk);
+	return status;
 }
\ No newline at end of file
@@ -0,0 +1,599 @@
+#include "jit.h"
+#include "vm.h"
+#include "output.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool jit_enabled = true;
+uint32_t jit_threshold = JIT_THRESHOLD;
+
+// x86-64 registers used by the templates
+// rbx holds the register file for the whole compiled loop
+enum{
+	RAX = 0,
+	RCX = 1,
+	RDX = 2,
+	RBX = 3,
+	RSI = 6,
+	RDI = 7,
+};
+
+// Condition codes (jcc / setcc)
+enum{
+	CC_B = 0x2,
+	CC_AE = 0x3,
+	CC_E = 0x4,
+	CC_NE = 0x5,
+	CC_A = 0x7,
+	CC_P = 0xA,
+	CC_NP = 0xB,
+	CC_L = 0xC,
+	CC_GE = 0xD,
+	CC_LE = 0xE,
+	CC_G = 0xF,
+};
+
+// Offsets into a value_t
+#define VAL_TYPE 12
+#define VAL_FLAGS 13
+#define REG(x) ((int32_t)(x) * (int32_t) sizeof(value_t))
+
+// Machine code of the loop being compiled
+typedef DYNAMIC_ARRAY(uint8_t* bytes) jit_code;
+static jit_code code = NEW_DYNAMIC_ARRAY(sizeof(uint8_t));
+
+// rel32 operands waiting for the offset of a pc (or its exit stub)
+typedef struct{
+	size_t at;
+	uint32_t pc;
+	bool exit;
+} jit_fixup;
+typedef DYNAMIC_ARRAY(jit_fixup* fixups) jit_fixup_list;
+static jit_fixup_list fixups = NEW_DYNAMIC_ARRAY(sizeof(jit_fixup));
+
+// Exit stubs emitted so far (offset of the stub and the pc it exits with)
+static jit_fixup_list stubs = NEW_DYNAMIC_ARRAY(sizeof(jit_fixup));
+
+// Offset of the template of every pc in the loop
+typedef DYNAMIC_ARRAY(size_t* offsets) jit_label_list;
+static jit_label_list labels = NEW_DYNAMIC_ARRAY(sizeof(size_t));
+
+static bool jit_failed;
+
+static void emit8(uint8_t byte){
+	if(!dynamic_array_pushback((dynamic_array_t*)&code, &byte))
+		jit_failed = true;
+}
+
+static void emit_bytes(const uint8_t* bytes, size_t count){
+	for(size_t i = 0; i < count; i++)
+		emit8(bytes[i]);
+}
+#define EMIT(...) emit_bytes((const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+static void emit32(uint32_t x){
+	for(int i = 0; i < 4; i++)
+		emit8(x >> (i * 8));
+}
+
+static void emit64(uint64_t x){
+	emit32(x);
+	emit32(x >> 32);
+}
+
+// ModRM + disp32 for [base + disp]
+static void emit_mem(uint8_t reg, uint8_t base, int32_t disp){
+	emit8(0x80 | (reg << 3) | base);
+	emit32(disp);
+}
+
+// REX.W opcode reg, [base + disp]
+static void emit_wide(uint8_t op, uint8_t reg, uint8_t base, int32_t disp){
+	EMIT(0x48, op);
+	emit_mem(reg, base, disp);
+}
+#define emit_load(_r, _b, _d) emit_wide(0x8B, (_r), (_b), (_d))
+#define emit_store(_r, _b, _d) emit_wide(0x89, (_r), (_b), (_d))
+
+// SSE2 prefix 0F opcode xmm, [base + disp]
+static void emit_sse(uint8_t prefix, uint8_t op, uint8_t xmm, uint8_t base, int32_t disp){
+	EMIT(prefix, 0x0F, op);
+	emit_mem(xmm, base, disp);
+}
+
+static void emit_movzx_type(uint8_t reg, uint8_t base, int32_t disp){
+	EMIT(0x0F, 0xB6);
+	emit_mem(reg, base, disp + VAL_TYPE);
+}
+
+static void emit_cmp_type(uint8_t base, int32_t disp, var_type type){
+	emit8(0x80);
+	emit_mem(7, base, disp + VAL_TYPE);
+	emit8(type);
+}
+
+static void emit_mov_imm64(uint8_t reg, uint64_t imm){
+	EMIT(0x48, 0xB8 + reg);
+	emit64(imm);
+}
+
+static void emit_call(void* func){
+	emit_mov_imm64(RAX, (uint64_t)(uintptr_t) func);
+	EMIT(0xFF, 0xD0);
+}
+
+// Sets the tag of a value written by a template
+static void emit_set_type(uint8_t base, int32_t disp, var_type type){
+	emit8(0xC7);
+	emit_mem(0, base, disp + 8);
+	emit32(0);
+	emit8(0xC7);
+	emit_mem(0, base, disp + VAL_TYPE);
+	emit32(type);
+}
+
+// Jumps with a rel32 patched later
+static size_t emit_jcc(uint8_t cc){
+	EMIT(0x0F, 0x80 | cc);
+	emit32(0);
+	return code.size - 4;
+}
+
+static size_t emit_jmp(void){
+	emit8(0xE9);
+	emit32(0);
+	return code.size - 4;
+}
+
+static void patch_rel32(size_t at, size_t target){
+	if(jit_failed)
+		return;
+	int32_t rel = (int32_t)(target - (at + 4));
+	memcpy(code.bytes + at, &rel, 4);
+}
+
+static void patch_here(size_t at){
+	patch_rel32(at, code.size);
+}
+
+static void add_fixup(size_t at, uint32_t pc, bool exit){
+	jit_fixup fixup = {at, pc, exit};
+	if(!dynamic_array_pushback((dynamic_array_t*)&fixups, &fixup))
+		jit_failed = true;
+}
+
+// Leaves the compiled code, the VM resumes at pc
+static void guard(uint8_t cc, uint32_t pc){
+	add_fixup(emit_jcc(cc), pc, true);
+}
+
+static void exit_to(uint32_t pc){
+	add_fixup(emit_jmp(), pc, true);
+}
+
+// Registers holding a counted string must be released by the VM
+static void guard_dst(uint16_t reg, uint32_t pc){
+	emit8(0xF6);
+	emit_mem(0, RBX, REG(reg) + VAL_FLAGS);
+	emit8(VALUE_REF);
+	guard(CC_NE, pc);
+}
+
+// Loads the address of the first slot of a scope depth into rcx
+// var_frames / var_slots are reloaded every time, since a scope
+// opened by the loop may move them
+// Their addresses are the main thread's, the only one running JIT code
+static void emit_frame(uint16_t depth){
+	emit_mov_imm64(RCX, (uint64_t)(uintptr_t) &var_slots.slots);
+	emit_load(RCX, RCX, 0);
+	if(!depth)
+		return;
+	emit_mov_imm64(RDX, (uint64_t)(uintptr_t) &var_frames.bases);
+	emit_load(RDX, RDX, 0);
+	emit_load(RDX, RDX, depth * sizeof(size_t));
+	EMIT(0x48, 0xC1, 0xE2, 0x04);	// shl rdx, 4
+	EMIT(0x48, 0x01, 0xD1);			// add rcx, rdx
+}
+
+// Loads an operand of a float operation into xmm, converting integers
+// Jumps to the exit of pc if the operand is neither
+static void emit_load_f64(uint8_t xmm, uint16_t reg, uint32_t pc){
+	emit_movzx_type(RDX, RBX, REG(reg));
+	EMIT(0x83, 0xFA, var_f64);		// cmp edx, var_f64
+	size_t not_float = emit_jcc(CC_NE);
+	emit_sse(0xF2, 0x10, xmm, RBX, REG(reg));	// movsd xmm, [r]
+	size_t done = emit_jmp();
+	patch_here(not_float);
+	EMIT(0x83, 0xFA, var_i64);		// cmp edx, var_i64
+	guard(CC_A, pc);
+	EMIT(0x83, 0xFA, var_u64);		// cmp edx, var_u64
+	guard(CC_E, pc);
+	EMIT(0xF2, 0x48, 0x0F, 0x2A);	// cvtsi2sd xmm, [r]
+	emit_mem(xmm, RBX, REG(reg));
+	patch_here(done);
+}
+
+// Stores al as a bool in R[a]
+static void emit_store_bool(uint16_t a){
+	EMIT(0x0F, 0xB6, 0xC0);			// movzx eax, al
+	emit_store(RAX, RBX, REG(a));
+	emit_set_type(RBX, REG(a), var_bool);
+}
+
+// Comparison of x and y in xmm0 / xmm1, leaves the result in al
+// seta / setae are false when the operands are unordered, so the ordered
+// comparisons take the operand that should be greater first
+static void emit_float_cmp(bc_op op){
+	switch(op){
+	case op_lt:
+		EMIT(0x66, 0x0F, 0x2E, 0xC8);	// ucomisd xmm1, xmm0
+		EMIT(0x0F, 0x90 | CC_A, 0xC0);	// seta al
+		break;
+	case op_leq:
+		EMIT(0x66, 0x0F, 0x2E, 0xC8);	// ucomisd xmm1, xmm0
+		EMIT(0x0F, 0x90 | CC_AE, 0xC0);	// setae al
+		break;
+	case op_gt:
+		EMIT(0x66, 0x0F, 0x2E, 0xC1);	// ucomisd xmm0, xmm1
+		EMIT(0x0F, 0x90 | CC_A, 0xC0);	// seta al
+		break;
+	case op_geq:
+		EMIT(0x66, 0x0F, 0x2E, 0xC1);	// ucomisd xmm0, xmm1
+		EMIT(0x0F, 0x90 | CC_AE, 0xC0);	// setae al
+		break;
+	default:
+		EMIT(0x66, 0x0F, 0x2E, 0xC1);	// ucomisd xmm0, xmm1
+		EMIT(0x0F, 0x90 | CC_E, 0xC0);	// sete al
+		EMIT(0x0F, 0x90 | CC_NP, 0xC1);	// setnp cl
+		EMIT(0x20, 0xC8);				// and al, cl
+		if(op == op_neq)
+			EMIT(0x34, 0x01);			// xor al, 1
+	}
+}
+
+static bool is_cmp(bc_op op){
+	return op == op_eq || op == op_neq || op == op_lt || op == op_leq || op == op_gt || op == op_geq;
+}
+
+// Arithmetic and comparisons on i64 and f64 operands, the only types
+// with templates: the compiler already converted both operands to
+// the instruction's type, so no tag is checked
+// Returns false for the other types
+static bool jit_binary(bc_insn* insn, uint32_t pc){
+	int32_t x = REG(insn->b), y = REG(insn->c), dst = REG(insn->a);
+	if(insn->type == var_f64){
+		if(insn->op == op_mod || insn->op == op_shl || insn->op == op_band)
+			return false;
+		guard_dst(insn->a, pc);
+		emit_sse(0xF2, 0x10, 0, RBX, x);	// movsd xmm0, [x]
+		emit_sse(0xF2, 0x10, 1, RBX, y);	// movsd xmm1, [y]
+		if(is_cmp(insn->op)){
+			emit_float_cmp(insn->op);
+			emit_store_bool(insn->a);
+		}else{
+			static const uint8_t sse_ops[] = {[op_add] = 0x58, [op_sub] = 0x5C, [op_mul] = 0x59, [op_div] = 0x5E};
+			EMIT(0xF2, 0x0F, sse_ops[insn->op], 0xC1);	// op xmm0, xmm1
+			emit_sse(0xF2, 0x11, 0, RBX, dst);			// movsd [dst], xmm0
+			emit_set_type(RBX, dst, var_f64);
+		}
+		return true;
+	}
+	if(insn->type != var_i64)
+		return false;
+	guard_dst(insn->a, pc);
+	switch(insn->op){
+	case op_add:
+	case op_sub:
+	case op_mul:
+		emit_load(RAX, RBX, x);
+		if(insn->op == op_mul){
+			EMIT(0x48, 0x0F, 0xAF);		// imul rax, [y]
+			emit_mem(RAX, RBX, y);
+		}else
+			emit_wide((insn->op == op_add) ? 0x03 : 0x2B, RAX, RBX, y);
+		emit_store(RAX, RBX, dst);
+		emit_set_type(RBX, dst, var_i64);
+		break;
+	case op_shl:
+		emit_load(RCX, RBX, y);
+		emit_load(RAX, RBX, x);
+		EMIT(0x48, 0xD3, 0xE0);			// shl rax, cl
+		emit_store(RAX, RBX, dst);
+		emit_set_type(RBX, dst, var_i64);
+		break;
+	case op_band:
+		emit_load(RAX, RBX, x);
+		emit_wide(0x23, RAX, RBX, y);	// and rax, [y]
+		emit_store(RAX, RBX, dst);
+		emit_set_type(RBX, dst, var_i64);
+		break;
+	case op_div:
+	case op_mod:
+		// Division by zero / -1 is left to the VM's checks
+		emit_load(RCX, RBX, y);
+		EMIT(0x48, 0x85, 0xC9);			// test rcx, rcx
+		guard(CC_E, pc);
+		EMIT(0x48, 0x83, 0xF9, 0xFF);	// cmp rcx, -1
+		guard(CC_E, pc);
+		emit_load(RAX, RBX, x);
+		EMIT(0x48, 0x99);				// cqo
+		EMIT(0x48, 0xF7, 0xF9);			// idiv rcx
+		emit_store((insn->op == op_div) ? RAX : RDX, RBX, dst);
+		emit_set_type(RBX, dst, var_i64);
+		break;
+	default:{
+		static const uint8_t int_cc[] = {[op_eq] = CC_E, [op_neq] = CC_NE, [op_lt] = CC_L, [op_leq] = CC_LE, [op_gt] = CC_G, [op_geq] = CC_GE};
+		emit_load(RAX, RBX, x);
+		emit_wide(0x3B, RAX, RBX, y);	// cmp rax, [y]
+		EMIT(0x0F, 0x90 | int_cc[insn->op], 0xC0);
+		emit_store_bool(insn->a);
+	}}
+	return true;
+}
+
+// Wraps rax to the width of an integer tag
+static void emit_wrap(var_type type){
+	switch(type){
+	case var_char:
+	case var_i8: EMIT(0x48, 0x0F, 0xBE, 0xC0); break;	// movsx rax, al
+	case var_u8: EMIT(0x0F, 0xB6, 0xC0); break;			// movzx eax, al
+	case var_i16: EMIT(0x48, 0x0F, 0xBF, 0xC0); break;	// movsx rax, ax
+	case var_u16: EMIT(0x0F, 0xB7, 0xC0); break;		// movzx eax, ax
+	case var_i32: EMIT(0x48, 0x63, 0xC0); break;		// movsxd rax, eax
+	case var_u32: EMIT(0x89, 0xC0); break;				// mov eax, eax
+	}
+}
+
+// Stores R[a] into V[b:c], converting it to the variable's type
+// (decl with a == BC_NONE stores the zero value)
+// Returns false for types the templates do not handle
+static bool jit_store_var(bc_insn* insn, uint32_t pc){
+	var_type type = VAR_TYPE(insn->type);
+	int32_t src = REG(insn->a);
+	if(type != var_bool && type != var_f64 && !VAR_IS_INT(type))
+		return false;
+	if(insn->a == BC_NONE)
+		EMIT(0x31, 0xC0);				// xor eax, eax
+	else if(type == var_f64){
+		emit_load_f64(0, insn->a, pc);
+		EMIT(0x66, 0x48, 0x0F, 0x7E, 0xC0);	// movq rax, xmm0
+	}else if(type == var_bool){
+		emit_cmp_type(RBX, src, var_bool);
+		guard(CC_NE, pc);
+		emit_load(RAX, RBX, src);
+	}else{
+		emit_movzx_type(RAX, RBX, src);
+		EMIT(0x83, 0xF8, var_i64);		// cmp eax, var_i64
+		guard(CC_A, pc);
+		emit_load(RAX, RBX, src);
+		emit_wrap(type);
+	}
+	emit_frame(insn->b);
+	emit_store(RAX, RCX, REG(insn->c));
+	emit_set_type(RCX, REG(insn->c), type);
+	return true;
+}
+
+// Emits the template of a single instruction
+// Returns false if the instruction always goes back to the VM
+static bool jit_insn(bc_chunk* chunk, bc_insn* insn, uint32_t pc, uint32_t head, uint32_t end){
+	switch(insn->op){
+	case op_loadk:
+		guard_dst(insn->a, pc);
+		emit_mov_imm64(RAX, (uint64_t)(uintptr_t) &chunk->consts.values[insn->b]);
+		emit_sse(0xF3, 0x6F, 0, RAX, 0);				// movdqu xmm0, [k]
+		emit_sse(0xF3, 0x7F, 0, RBX, REG(insn->a));	// movdqu [dst], xmm0
+		return true;
+	case op_move:
+		emit8(0xF6);
+		emit_mem(0, RBX, REG(insn->b) + VAL_FLAGS);
+		emit8(VALUE_REF);
+		guard(CC_NE, pc);
+		guard_dst(insn->a, pc);
+		emit_sse(0xF3, 0x6F, 0, RBX, REG(insn->b));
+		emit_sse(0xF3, 0x7F, 0, RBX, REG(insn->a));
+		return true;
+	case op_getvar:
+		// str, list and dict variables hold counted references
+		if(VAR_IS_COUNTED(insn->type))
+			break;
+		guard_dst(insn->a, pc);
+		emit_frame(insn->b);
+		emit_sse(0xF3, 0x6F, 0, RCX, REG(insn->c));
+		emit_sse(0xF3, 0x7F, 0, RBX, REG(insn->a));
+		return true;
+	case op_decl:
+	case op_setvar:
+		if(!jit_store_var(insn, pc))
+			break;
+		return true;
+	case op_add:
+	case op_sub:
+	case op_mul:
+	case op_div:
+	case op_mod:
+	case op_shl:
+	case op_band:
+	case op_eq:
+	case op_neq:
+	case op_lt:
+	case op_leq:
+	case op_gt:
+	case op_geq:
+		if(!jit_binary(insn, pc))
+			break;
+		return true;
+	case op_neg:{
+		int32_t x = REG(insn->b), dst = REG(insn->a);
+		if(insn->type != var_f64 && insn->type != var_i64)
+			break;
+		guard_dst(insn->a, pc);
+		emit_load(RAX, RBX, x);
+		if(insn->type == var_f64)
+			EMIT(0x48, 0x0F, 0xBA, 0xF8, 0x3F);	// btc rax, 63
+		else
+			EMIT(0x48, 0xF7, 0xD8);			// neg rax
+		emit_store(RAX, RBX, dst);
+		emit_set_type(RBX, dst, insn->type);
+		return true;
+	}case op_cast:{
+		// Integers are kept extended to 64 bits, so converting them
+		// to i64 only changes the tag (u64 to f64 has no template)
+		// The register converted in place never holds a counted value
+		int32_t x = REG(insn->b), dst = REG(insn->a);
+		if(!VAR_IS_INT(insn->c) || (insn->type != var_i64 && (insn->type != var_f64 || insn->c == var_u64)))
+			break;
+		if(insn->type == var_f64){
+			EMIT(0xF2, 0x48, 0x0F, 0x2A);	// cvtsi2sd xmm0, [x]
+			emit_mem(0, RBX, x);
+			emit_sse(0xF2, 0x11, 0, RBX, dst);
+		}else{
+			emit_load(RAX, RBX, x);
+			emit_store(RAX, RBX, dst);
+		}
+		emit_set_type(RBX, dst, insn->type);
+		return true;
+	}case op_and:
+	case op_or:
+	case op_xor:{
+		static const uint8_t logic_ops[] = {[op_and] = 0x22, [op_or] = 0x0A, [op_xor] = 0x32};
+		guard_dst(insn->a, pc);
+		EMIT(0x8A);						// mov al, [x]
+		emit_mem(RAX, RBX, REG(insn->b));
+		emit8(logic_ops[insn->op]);		// op al, [y]
+		emit_mem(RAX, RBX, REG(insn->c));
+		emit_store_bool(insn->a);
+		return true;
+	}case op_push_scope:
+		EMIT(0xBF);						// mov edi, slots
+		emit32(insn->c);
+		emit_call((void*) push_var_scope);
+		EMIT(0x84, 0xC0);				// test al, al
+		guard(CC_E, pc);
+		return true;
+	case op_pop_scope:
+		emit_call((void*) pop_var_scope);
+		return true;
+	case op_print:
+		EMIT(0x48, 0x8D);				// lea rdi, [R[a]]
+		emit_mem(RDI, RBX, REG(insn->a));
+		EMIT(0xBE);						// mov esi, count
+		emit32(insn->b);
+		emit_call((void*) vm_print);
+		return true;
+	case op_putchar:
+		EMIT(0x48, 0x8D);
+		emit_mem(RDI, RBX, REG(insn->a));
+		emit_call((void*) vm_putchar);
+		EMIT(0x84, 0xC0);
+		guard(CC_E, pc);
+		return true;
+	case op_flush:
+		emit_call((void*) output_flush);
+		return true;
+	case op_jmpf:
+		emit8(0x80);					// cmp byte [cond], 0
+		emit_mem(7, RBX, REG(insn->a));
+		emit8(0);
+		// fallthrough
+	case op_jmp:
+	case op_loop:{
+		uint32_t target = BC_TARGET(insn);
+		size_t at = (insn->op == op_jmpf) ? emit_jcc(CC_E) : emit_jmp();
+		add_fixup(at, target, target < head || target > end);
+		return true;
+	}default:
+		break;
+	}
+	exit_to(pc);
+	return false;
+}
+
+// Compiles the loop closed by a back edge, from its condition to the back edge
+// Gives up (for good) on loops that would mostly run in the VM anyway
+jit_fn jit_compile_loop(jit_state* jit, bc_insn* back_edge){
+	jit_loop* loop = &jit->loops[back_edge->a];
+	bc_chunk* chunk = jit->chunk;
+	uint32_t head = BC_TARGET(back_edge), end = back_edge - chunk->code.insns;
+	size_t unsupported = 0;
+	loop->failed = true;
+	jit_failed = false;
+	code.size = fixups.size = stubs.size = labels.size = 0;
+
+	EMIT(0x53);								// push rbx
+	EMIT(0x48, 0x89, 0xFB);					// mov rbx, rdi
+	for(uint32_t pc = head; pc <= end; pc++){
+		size_t offset = code.size;
+		if(!dynamic_array_pushback((dynamic_array_t*)&labels, &offset))
+			jit_failed = true;
+		if(!jit_insn(chunk, &chunk->code.insns[pc], pc, head, end))
+			unsupported++;
+	}
+	if(unsupported * 8 > (size_t)(end - head + 1))
+		return NULL;
+
+	size_t epilogue = code.size;
+	EMIT(0x5B);								// pop rbx
+	EMIT(0xC3);								// ret
+
+	// One exit stub per pc the code can leave at
+	for(size_t i = 0; i < fixups.size && !jit_failed; i++){
+		jit_fixup* fixup = &fixups.fixups[i];
+		if(!fixup->exit){
+			patch_rel32(fixup->at, labels.offsets[fixup->pc - head]);
+			continue;
+		}
+		size_t stub = SIZE_MAX;
+		for(size_t j = 0; j < stubs.size && stub == SIZE_MAX; j++)
+			if(stubs.fixups[j].pc == fixup->pc)
+				stub = stubs.fixups[j].at;
+		if(stub == SIZE_MAX){
+			jit_fixup new_stub = {code.size, fixup->pc, true};
+			if(!dynamic_array_pushback((dynamic_array_t*)&stubs, &new_stub))
+				jit_failed = true;
+			stub = code.size;
+			EMIT(0xB8);						// mov eax, pc
+			emit32(fixup->pc);
+			patch_rel32(emit_jmp(), epilogue);
+		}
+		patch_rel32(fixup->at, stub);
+	}
+	if(jit_failed)
+		return NULL;
+
+	// Written while mapped read / write, executed read / exec only (W^X)
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = (code.size + page - 1) / page * page;
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED)
+		return NULL;
+	memcpy(mem, code.bytes, code.size);
+	if(mprotect(mem, size, PROT_READ | PROT_EXEC)){
+		munmap(mem, size);
+		return NULL;
+	}
+	loop->code = mem;
+	loop->code_size = size;
+	loop->fn = (jit_fn) mem;
+	loop->failed = false;
+	return loop->fn;
+}
+
+bool jit_setup(jit_state* jit, bc_chunk* chunk){
+	jit->chunk = chunk;
+	jit->loops = (jit_loop*) calloc(chunk->loop_count ? chunk->loop_count : 1, sizeof(jit_loop));
+	return jit->loops != NULL;
+}
+
+void jit_free(jit_state* jit){
+	for(uint16_t i = 0; jit->loops && i < jit->chunk->loop_count; i++)
+		if(jit->loops[i].code)
+			munmap(jit->loops[i].code, jit->loops[i].code_size);
+	free(jit->loops);
+	jit->loops = NULL;
+	dynamic_array_free((dynamic_array_t*)&code);
+	dynamic_array_free((dynamic_array_t*)&fixups);
+	dynamic_array_free((dynamic_array_t*)&stubs);
+	dynamic_array_free((dynamic_array_t*)&labels);
+}
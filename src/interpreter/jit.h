@@ -0,0 +1,48 @@
+#ifndef FERRO_JIT_H
+#define FERRO_JIT_H
+
+#include "bytecode.h"
+
+// Baseline x86-64 JIT
+// Hot loops are translated by stitching a machine code template per
+// instruction. Registers and variables stay in memory, so the VM and the
+// compiled code can hand over at any instruction: a template whose type
+// guard fails exits with its pc and the VM executes that instruction.
+
+// Back edges a loop takes before it is compiled
+#define JIT_THRESHOLD 1000
+
+extern bool jit_enabled;
+extern uint32_t jit_threshold;
+
+// Runs a compiled loop from its head
+// Returns the pc the VM resumes at
+typedef uint32_t (*jit_fn)(value_t*);
+
+typedef struct{
+	jit_fn fn;
+	void* code;
+	size_t code_size;
+	uint32_t count;
+	bool failed;
+} jit_loop;
+
+typedef struct{
+	bc_chunk* chunk;
+	jit_loop* loops;
+} jit_state;
+
+bool jit_setup(jit_state*,bc_chunk*);
+jit_fn jit_compile_loop(jit_state*,bc_insn*);
+void jit_free(jit_state*);
+
+// Called on every back edge (op_loop)
+// Returns the compiled loop once it is hot, NULL otherwise
+static inline jit_fn jit_hot_loop(jit_state* jit, bc_insn* back_edge){
+	jit_loop* loop = &jit->loops[back_edge->a];
+	if(loop->fn || loop->failed || ++loop->count < jit_threshold)
+		return loop->fn;
+	return jit_compile_loop(jit, back_edge);
+}
+
+#endif
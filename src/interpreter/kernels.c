@@ -0,0 +1,270 @@
+#include "kernels.h"
+
+// Kernels are written once over GCC vector types of KERNEL_VECTOR bytes
+// and expanded once per instruction set, the compiler lowers the vectors
+// to two SSE2 operations or one AVX2 operation
+// The last partial vector of a buffer is padded with zeroes
+#define KERNEL_VECTOR 32
+#define KERNEL_LANES(_ctype) (KERNEL_VECTOR / sizeof(_ctype))
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KERNELS_AVX2
+#define KERNEL_BASE_ISA "sse2"
+#else
+#define KERNEL_BASE_ISA "generic"
+#endif
+
+#define KERNEL_TARGET_base
+#define KERNEL_TARGET_avx2 __attribute__((target("avx2")))
+
+typedef void (*kernel_map_fn)(char*,const char*,const char*,size_t);
+typedef void (*kernel_compare_fn)(bool*,const char*,const char*,size_t,bool);
+typedef value_t (*kernel_reduce_fn)(const char*,const char*,size_t);
+
+typedef struct{
+	kernel_map_fn map[kernel_div + 1];		// NULL for integer division
+	kernel_compare_fn compare[3];			// eq, lt, leq
+	kernel_reduce_fn reduce[4];				// sum, min, max, dot
+} kernel_set;
+
+// Element types: name, C type, type the arithmetic is done in
+// (unsigned for integers, so they wrap) and same width integer
+#define KERNEL_INT_TYPES(_x, ...) \
+	_x(char, int8_t, uint8_t, int8_t, __VA_ARGS__) \
+	_x(u8, uint8_t, uint8_t, int8_t, __VA_ARGS__) \
+	_x(i8, int8_t, uint8_t, int8_t, __VA_ARGS__) \
+	_x(u16, uint16_t, uint16_t, int16_t, __VA_ARGS__) \
+	_x(i16, int16_t, uint16_t, int16_t, __VA_ARGS__) \
+	_x(u32, uint32_t, uint32_t, int32_t, __VA_ARGS__) \
+	_x(i32, int32_t, uint32_t, int32_t, __VA_ARGS__) \
+	_x(u64, uint64_t, uint64_t, int64_t, __VA_ARGS__) \
+	_x(i64, int64_t, uint64_t, int64_t, __VA_ARGS__)
+#define KERNEL_FLOAT_TYPES(_x, ...) \
+	_x(f32, float, float, int32_t, __VA_ARGS__) \
+	_x(f64, double, double, int64_t, __VA_ARGS__)
+
+// Runs _body over every vector x (and y) of a and b, count of its lanes are elements
+#define KERNEL_FOR_VECTORS(_ctype, _vtype, _body) \
+	for(size_t i = 0; i < n; i += KERNEL_LANES(_ctype)){ \
+		size_t count = (n - i < KERNEL_LANES(_ctype)) ? n - i : KERNEL_LANES(_ctype); \
+		_vtype x, y; \
+		if(count == KERNEL_LANES(_ctype)){ \
+			memcpy(&x, a + i * sizeof(_ctype), KERNEL_VECTOR); \
+			memcpy(&y, b + i * sizeof(_ctype), KERNEL_VECTOR); \
+		}else{ \
+			memset(&x, 0, KERNEL_VECTOR); \
+			memset(&y, 0, KERNEL_VECTOR); \
+			memcpy(&x, a + i * sizeof(_ctype), count * sizeof(_ctype)); \
+			memcpy(&y, b + i * sizeof(_ctype), count * sizeof(_ctype)); \
+		} \
+		_body \
+	}
+
+#define KERNEL_MAP(_t, _ctype, _atype, _isa, _name, _op) \
+	static KERNEL_TARGET_##_isa void _name##_##_t##_##_isa(char* dst, const char* a, const char* b, size_t n){ \
+		typedef _atype vec __attribute__((vector_size(KERNEL_VECTOR))); \
+		KERNEL_FOR_VECTORS(_ctype, vec, { \
+			x = x _op y; \
+			memcpy(dst + i * sizeof(_ctype), &x, count * sizeof(_ctype)); \
+		}) \
+	}
+
+// Lanes of a vector comparison are 0 or -1
+#define KERNEL_COMPARE(_t, _ctype, _isa, _name, _op) \
+	static KERNEL_TARGET_##_isa void _name##_##_t##_##_isa(bool* dst, const char* a, const char* b, size_t n, bool negate){ \
+		typedef _ctype vec __attribute__((vector_size(KERNEL_VECTOR))); \
+		KERNEL_FOR_VECTORS(_ctype, vec, { \
+			__typeof__(x _op y) mask = x _op y; \
+			for(size_t k = 0; k < count; k++) \
+				dst[i + k] = (mask[k] != 0) != negate; \
+		}) \
+	}
+
+#define KERNEL_COMPARES(_t, _ctype, _isa) \
+	KERNEL_COMPARE(_t, _ctype, _isa, eq, ==) \
+	KERNEL_COMPARE(_t, _ctype, _isa, lt, <) \
+	KERNEL_COMPARE(_t, _ctype, _isa, leq, <=)
+
+// Integer reductions are plain loops the compiler vectorizes,
+// since integer addition and min / max do not depend on the order
+#define KERNEL_INT(_t, _ctype, _atype, _itype, _isa) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, add, +) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, sub, -) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, mul, *) \
+	KERNEL_COMPARES(_t, _ctype, _isa) \
+	static KERNEL_TARGET_##_isa value_t sum_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		(void) b; \
+		const _ctype* p = (const _ctype*) a; \
+		uint64_t sum = 0; \
+		for(size_t i = 0; i < n; i++) \
+			sum += (uint64_t) p[i]; \
+		return VALUE_INT(VAR_IS_UNSIGNED(var_##_t) ? var_u64 : var_i64, sum); \
+	} \
+	static KERNEL_TARGET_##_isa value_t dot_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		const _ctype *p = (const _ctype*) a, *q = (const _ctype*) b; \
+		uint64_t sum = 0; \
+		for(size_t i = 0; i < n; i++) \
+			sum += (uint64_t)(_ctype)((uint64_t) p[i] * (uint64_t) q[i]); \
+		return VALUE_INT(VAR_IS_UNSIGNED(var_##_t) ? var_u64 : var_i64, sum); \
+	} \
+	static KERNEL_TARGET_##_isa value_t min_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		(void) b; \
+		const _ctype* p = (const _ctype*) a; \
+		_ctype m = p[0]; \
+		for(size_t i = 1; i < n; i++) \
+			m = (p[i] < m) ? p[i] : m; \
+		return VALUE_INT(var_##_t, m); \
+	} \
+	static KERNEL_TARGET_##_isa value_t max_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		(void) b; \
+		const _ctype* p = (const _ctype*) a; \
+		_ctype m = p[0]; \
+		for(size_t i = 1; i < n; i++) \
+			m = (p[i] > m) ? p[i] : m; \
+		return VALUE_INT(var_##_t, m); \
+	}
+
+// Float sums keep four f64 lanes, so their order is the same on every
+// instruction set, and dot products are rounded to the element type first
+// min / max keep, in each lane, the first element smaller (greater) than
+// every one before it, like "if(x < m) m = x" would
+#define KERNEL_FLOAT_SUM(_t, _ctype, _isa, _name, _term) \
+	static KERNEL_TARGET_##_isa value_t _name##_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		typedef _ctype quad __attribute__((vector_size(4 * sizeof(_ctype)))); \
+		typedef double dquad __attribute__((vector_size(4 * sizeof(double)))); \
+		dquad sum = {0}; \
+		size_t i = 0; \
+		for(; i + 4 <= n; i += 4){ \
+			quad x, y = {0}; \
+			memcpy(&x, a + i * sizeof(_ctype), sizeof(x)); \
+			if(b) \
+				memcpy(&y, b + i * sizeof(_ctype), sizeof(y)); \
+			(void) y; \
+			sum += __builtin_convertvector(_term, dquad); \
+		} \
+		double total = sum[0] + sum[1] + sum[2] + sum[3]; \
+		for(; i < n; i++){ \
+			_ctype x = ((const _ctype*) a)[i], y = b ? ((const _ctype*) b)[i] : 0; \
+			(void) y; \
+			total += (double)(_term); \
+		} \
+		return VALUE_F64(total); \
+	}
+
+#define KERNEL_FLOAT_EXTREMUM(_t, _ctype, _itype, _isa, _name, _op) \
+	static KERNEL_TARGET_##_isa value_t _name##_##_t##_##_isa(const char* a, const char* b, size_t n){ \
+		typedef _ctype vec __attribute__((vector_size(KERNEL_VECTOR))); \
+		typedef _itype ivec __attribute__((vector_size(KERNEL_VECTOR))); \
+		(void) b; \
+		const _ctype* p = (const _ctype*) a; \
+		vec m; \
+		for(size_t k = 0; k < KERNEL_LANES(_ctype); k++) \
+			m[k] = p[0]; \
+		size_t i = 0; \
+		for(; i + KERNEL_LANES(_ctype) <= n; i += KERNEL_LANES(_ctype)){ \
+			vec x; \
+			memcpy(&x, a + i * sizeof(_ctype), sizeof(x)); \
+			ivec take = x _op m; \
+			m = (vec)(((ivec) x & take) | ((ivec) m & ~take)); \
+		} \
+		_ctype result = m[0]; \
+		for(size_t k = 1; k < KERNEL_LANES(_ctype); k++) \
+			if(m[k] _op result) \
+				result = m[k]; \
+		for(; i < n; i++) \
+			if(p[i] _op result) \
+				result = p[i]; \
+		value_t v = {.type = var_##_t}; \
+		memcpy(&v, &result, sizeof(result)); \
+		return v; \
+	}
+
+#define KERNEL_FLOAT(_t, _ctype, _atype, _itype, _isa) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, add, +) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, sub, -) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, mul, *) \
+	KERNEL_MAP(_t, _ctype, _atype, _isa, div, /) \
+	KERNEL_COMPARES(_t, _ctype, _isa) \
+	KERNEL_FLOAT_SUM(_t, _ctype, _isa, sum, x) \
+	KERNEL_FLOAT_SUM(_t, _ctype, _isa, dot, x * y) \
+	KERNEL_FLOAT_EXTREMUM(_t, _ctype, _itype, _isa, min, <) \
+	KERNEL_FLOAT_EXTREMUM(_t, _ctype, _itype, _isa, max, >)
+
+#define KERNEL_INT_ENTRY(_t, _ctype, _atype, _itype, _isa) \
+	[var_##_t] = { \
+		{add_##_t##_##_isa, sub_##_t##_##_isa, mul_##_t##_##_isa, NULL}, \
+		{eq_##_t##_##_isa, lt_##_t##_##_isa, leq_##_t##_##_isa}, \
+		{sum_##_t##_##_isa, min_##_t##_##_isa, max_##_t##_##_isa, dot_##_t##_##_isa} \
+	},
+#define KERNEL_FLOAT_ENTRY(_t, _ctype, _atype, _itype, _isa) \
+	[var_##_t] = { \
+		{add_##_t##_##_isa, sub_##_t##_##_isa, mul_##_t##_##_isa, div_##_t##_##_isa}, \
+		{eq_##_t##_##_isa, lt_##_t##_##_isa, leq_##_t##_##_isa}, \
+		{sum_##_t##_##_isa, min_##_t##_##_isa, max_##_t##_##_isa, dot_##_t##_##_isa} \
+	},
+
+#define KERNEL_SET(_isa) \
+	KERNEL_INT_TYPES(KERNEL_INT, _isa) \
+	KERNEL_FLOAT_TYPES(KERNEL_FLOAT, _isa) \
+	static const kernel_set kernels_##_isa[var_f64 + 1] = { \
+		KERNEL_INT_TYPES(KERNEL_INT_ENTRY, _isa) \
+		KERNEL_FLOAT_TYPES(KERNEL_FLOAT_ENTRY, _isa) \
+	};
+
+KERNEL_SET(base)
+#ifdef KERNELS_AVX2
+KERNEL_SET(avx2)
+#endif
+
+static const kernel_set* kernels = NULL;
+const char* kernel_isa = NULL;
+
+void kernels_setup(void){
+	if(kernels)
+		return;
+#ifdef KERNELS_AVX2
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		kernels = kernels_avx2;
+		kernel_isa = "avx2";
+		return;
+	}
+#endif
+	kernels = kernels_base;
+	kernel_isa = KERNEL_BASE_ISA;
+}
+
+bool kernel_map(uint8_t op, var_type type, char* dst, const char* a, const char* b, size_t n){
+	kernels_setup();
+	if(VAR_TYPE(type) > var_f64)
+		return false;
+	const kernel_set* set = &kernels[VAR_TYPE(type)];
+	switch(op){
+	case kernel_eq: set->compare[0]((bool*) dst, a, b, n, false); return true;
+	case kernel_neq: set->compare[0]((bool*) dst, a, b, n, true); return true;
+	case kernel_lt: set->compare[1]((bool*) dst, a, b, n, false); return true;
+	case kernel_leq: set->compare[2]((bool*) dst, a, b, n, false); return true;
+	// Swapped rather than negated, comparisons with NaN are false
+	case kernel_gt: set->compare[1]((bool*) dst, b, a, n, false); return true;
+	case kernel_geq: set->compare[2]((bool*) dst, b, a, n, false); return true;
+	default:
+		if(op > kernel_div || !set->map[op])
+			return false;
+		set->map[op](dst, a, b, n);
+		return true;
+	}
+}
+
+value_t kernel_reduce(uint8_t op, var_type type, const char* a, const char* b, size_t n){
+	kernels_setup();
+	return kernels[VAR_TYPE(type)].reduce[op - kernel_sum](a, b, n);
+}
+
+var_type kernel_result_type(uint8_t op, var_type type){
+	type = VAR_TYPE(type);
+	if(op == kernel_min || op == kernel_max)
+		return type;
+	if(VAR_IS_FLOAT(type))
+		return var_f64;
+	return VAR_IS_UNSIGNED(type) ? var_u64 : var_i64;
+}
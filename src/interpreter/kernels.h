@@ -0,0 +1,53 @@
+#ifndef FERRO_KERNELS_H
+#define FERRO_KERNELS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "value.h"
+
+// Kernels over the contiguous elements of numeric lists
+// Every kernel is built for the SSE2 baseline of x86-64 and for AVX2,
+// the set matching the CPU is picked once by kernels_setup
+//
+// Element-wise operations give exactly the results of the matching
+// operator applied to each pair of elements (integers wrap to their width)
+// Integer reductions add in 64 bits (as an i64 / u64 accumulator would)
+// and dot multiplies at the element width, like a[i] * b[i]
+// Float reductions add in f64, over four lanes summed at the end
+enum{
+	kernel_add,
+	kernel_sub,
+	kernel_mul,
+	kernel_div,		// Floats only
+	kernel_eq,
+	kernel_neq,
+	kernel_lt,
+	kernel_leq,
+	kernel_gt,
+	kernel_geq,
+	kernel_sum,
+	kernel_min,
+	kernel_max,
+	kernel_dot
+};
+#define KERNEL_IS_COMPARE(op) ((op) >= kernel_eq && (op) <= kernel_geq)
+#define KERNEL_IS_REDUCE(op) ((op) >= kernel_sum)
+
+extern const char* kernel_isa;		// "avx2", "sse2" or "generic"
+
+void kernels_setup(void);
+
+// dst[i] = a[i] op b[i] for i < n, a bool buffer for comparisons
+// Fails if there is no kernel for the operation on that type
+bool kernel_map(uint8_t,var_type,char*,const char*,const char*,size_t);
+
+// Reduces n elements of a (and b for kernel_dot)
+// min and max expect at least one element
+value_t kernel_reduce(uint8_t,var_type,const char*,const char*,size_t);
+
+// Type of what kernel_reduce returns for elements of a type
+var_type kernel_result_type(uint8_t,var_type);
+
+#endif
@@ -0,0 +1,941 @@
+#include "optimizer.h"
+#include "value.h"
+#include "kernels.h"
+#include "../FL/stats.h"
+#include "../FL/textstyle.h"
+
+#define IS_NUMERIC(x) (VAR_TYPE(x) <= var_f64)
+#define OPT_CSE_MAX 16		// Temporaries introduced for a single statement
+
+opt_pass_t opt_passes[opt_pass_count] = {
+	[opt_const_prop] = {"const-prop", true, 0, 0},
+	[opt_dce] = {"dce", true, 0, 0},
+	[opt_strength] = {"strength", true, 0, 0},
+	[opt_cse] = {"cse", true, 0, 0},
+	[opt_dse] = {"dse", true, 0, 0}
+};
+
+// Variable visible while walking, resolved like the compiler does
+typedef struct{
+	token* symbol;
+	var_type type;
+	var_type elem_type;
+	node_expr* value;	// Literal a constant stands for (const-prop)
+} opt_var;
+
+// What the walk of an expression found out
+typedef struct{
+	var_type type;
+	bool pure;			// No side effects and cannot fail
+	uint32_t nodes;
+	uint64_t hash;
+} opt_info;
+
+typedef struct{
+	node_expr* expr;
+	opt_info info;
+} opt_candidate;
+
+typedef DYNAMIC_ARRAY(opt_var* vars) opt_var_stack;
+typedef DYNAMIC_ARRAY(node_expr** exprs) opt_expr_stack;
+typedef DYNAMIC_ARRAY(opt_candidate* cands) opt_candidate_list;
+
+static FL_LOCAL uint8_t pass;
+static FL_LOCAL size_t rewrites;
+static FL_LOCAL opt_var_stack vars = NEW_DYNAMIC_ARRAY(sizeof(opt_var));
+static FL_LOCAL opt_expr_stack spine = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));	// Pending binary nodes
+static FL_LOCAL opt_expr_stack work = NEW_DYNAMIC_ARRAY(sizeof(node_expr*));		// Untyped traversals
+static FL_LOCAL opt_candidate_list candidates = NEW_DYNAMIC_ARRAY(sizeof(opt_candidate));
+static FL_LOCAL bool collecting = false;	// Record CSE candidates while walking
+static FL_LOCAL size_t temp_count = 0;
+
+static void optimizer_mem_error(const char* func){
+	printf(RED_FG BOLD "optimizer - %s:" YELLOW_FG " %s" RESET_ATTR "\n",func,DS_ERROR_MSG);
+	exit(EXIT_FAILURE);
+}
+
+static opt_pass_t* find_pass(const char* name, size_t len){
+	for(size_t i = 0; i < opt_pass_count; i++)
+		if(strlen(opt_passes[i].name) == len && !strncmp(opt_passes[i].name, name, len))
+			return &opt_passes[i];
+	return NULL;
+}
+
+// Enables only the passes of a comma separated list, "all" or "none"
+bool opt_select(const char* list){
+	bool all = !strcmp(list, "all");
+	for(size_t i = 0; i < opt_pass_count; i++)
+		opt_passes[i].enabled = all;
+	if(all || !strcmp(list, "none"))
+		return true;
+	while(*list){
+		const char* end = strchr(list, ',');
+		size_t len = end ? (size_t)(end - list) : strlen(list);
+		opt_pass_t* found = find_pass(list, len);
+		if(!found)
+			return false;
+		found->enabled = true;
+		list += len + (end ? 1 : 0);
+	}
+	return true;
+}
+
+bool opt_disable(const char* name){
+	opt_pass_t* found = find_pass(name, strlen(name));
+	if(found)
+		found->enabled = false;
+	return found != NULL;
+}
+
+bool opt_any(void){
+	for(size_t i = 0; i < opt_pass_count; i++)
+		if(opt_passes[i].enabled)
+			return true;
+	return false;
+}
+
+static bool same_name(token* a, token* b){
+	return tk_cmp_strlen(a, b->str, b->strlen);
+}
+
+static opt_var* resolve(token* symbol){
+	for(size_t i = vars.size; i > 0; i--)
+		if(same_name(symbol, vars.vars[i-1].symbol))
+			return &vars.vars[i-1];
+	return NULL;
+}
+
+static void declare(token* symbol, var_type type, var_type elem_type, node_expr* value){
+	opt_var var = {symbol, type, elem_type, value};
+	if(!dynamic_array_pushback((dynamic_array_t*)&vars, &var))
+		optimizer_mem_error("declare");
+}
+
+static void push_expr(opt_expr_stack* stack, node_expr* expr){
+	if(!dynamic_array_pushback((dynamic_array_t*)stack, &expr))
+		optimizer_mem_error("push_expr");
+}
+
+static bool int_literal(node_expr* expr, uint64_t* value){
+	char buffer[64];
+	if(expr->type != tk_int_lit || expr->int_lit.strlen >= sizeof(buffer))
+		return false;
+	memcpy(buffer, expr->int_lit.str, expr->int_lit.strlen);
+	buffer[expr->int_lit.strlen] = '\0';
+	*value = strtoull(buffer, NULL, 10);
+	return true;
+}
+
+// Type the compiler gives a literal, var_none for anything else
+static var_type literal_type(node_expr* expr){
+	uint64_t value;
+	switch(expr->type){
+	case tk_char_lit: return var_char;
+	case tk_int_lit: return (int_literal(expr, &value) && value > INT64_MAX) ? var_u64 : var_i64;
+	case tk_float_lit: return var_f64;
+	case tk_str_lit: return var_str;
+	case tk_bool_lit: return var_bool;
+	default: return var_none;
+	}
+}
+
+// Copies text made by a pass into the parser arena
+// (rounded up so the nodes allocated after it stay aligned)
+static const char* arena_text(const char* text, size_t len){
+	char* str = (char*) parser_alloc((len + 7) & ~(size_t)7);
+	memcpy(str, text, len);
+	return str;
+}
+
+static node_expr* new_int_literal(uint64_t value){
+	char buffer[24];
+	int len = snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long) value);
+	node_expr* node = (node_expr*) parser_alloc(sizeof(node_expr));
+	*node = (node_expr){.int_lit = {tk_int_lit, len, arena_text(buffer, len)}};
+	return node;
+}
+
+static token_t type_token(var_type type){
+	static const token_t tokens[] = {
+		[var_char] = tk_char, [var_u8] = tk_u8, [var_i8] = tk_i8, [var_u16] = tk_u16, [var_i16] = tk_i16,
+		[var_u32] = tk_u32, [var_i32] = tk_i32, [var_u64] = tk_u64, [var_i64] = tk_i64,
+		[var_f32] = tk_f32, [var_f64] = tk_f64, [var_str] = tk_str, [var_bool] = tk_bool
+	};
+	return tokens[type];
+}
+
+static uint64_t hash_mix(uint64_t h, uint64_t v){
+	return h ^ (v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2));
+}
+
+static uint64_t hash_token(token* tk){
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for(uint32_t i = 0; i < tk->strlen; i++)
+		h = (h ^ (uint8_t) tk->str[i]) * 0x100000001B3ULL;
+	return h;
+}
+
+// Types as in compile_binary
+static var_type promote(var_type a, var_type b){
+	if(!IS_NUMERIC(a) || !IS_NUMERIC(b))
+		return var_none;
+	if(a == b)
+		return a;
+	if(VAR_IS_FLOAT(a) || VAR_IS_FLOAT(b))
+		return var_f64;
+	if((VAR_IS_UNSIGNED(a) && VAR_IS_UNSIGNED(b)) || a == var_u64 || b == var_u64)
+		return var_u64;
+	return var_i64;
+}
+
+static var_type binary_type(token_t op, var_type a, var_type b){
+	switch(op){
+	case tk_plus:
+		if(a == var_str && b == var_str)
+			return var_str;
+		// fallthrough
+	case tk_minus:
+	case tk_mul:
+	case tk_div:
+	case tk_mod:
+	case tk_shl:
+	case tk_band:
+		return promote(a, b);
+	default:
+		return var_bool;
+	}
+}
+
+static var_type call_type(node_func_call* call){
+	if(tk_cmp_str(call->symbol, "len"))
+		return var_i64;
+	if(tk_cmp_str(call->symbol, "has"))
+		return var_bool;
+	if(tk_cmp_str(call->symbol, "mapfile") || tk_cmp_str(call->symbol, "slice"))
+		return var_str;
+	if(tk_cmp_str(call->symbol, "find"))
+		return var_i64;
+	// Futures of asynchronous I/O and what they resolve to
+	if(tk_cmp_str(call->symbol, "await_str"))
+		return var_str;
+	if(tk_cmp_str(call->symbol, "await") || (call->symbol->strlen > 6 && !strncmp(call->symbol->str, "async_", 6)))
+		return var_i64;
+	opt_var* list = (call->expr_count && call->exprs[0].type == tk_symbol) ? resolve(&call->exprs[0].symbol) : NULL;
+	if(!list)
+		return var_none;
+	if(tk_cmp_str(call->symbol, "pop"))
+		return list->elem_type;
+	if(tk_cmp_str(call->symbol, "sum"))
+		return kernel_result_type(kernel_sum, list->elem_type);
+	if(tk_cmp_str(call->symbol, "min"))
+		return kernel_result_type(kernel_min, list->elem_type);
+	if(tk_cmp_str(call->symbol, "max"))
+		return kernel_result_type(kernel_max, list->elem_type);
+	if(tk_cmp_str(call->symbol, "dot"))
+		return kernel_result_type(kernel_dot, list->elem_type);
+	return var_none;
+}
+
+// x * 2^k becomes x << k for integer x, the shift wraps like the product
+// x % 2^k becomes x & (2^k - 1) for x of an unsigned type, which is never
+// negative once promoted (to i64, or u64 for u64)
+static void reduce_strength(node_binexpr* bin, var_type lhs_type, var_type rhs_type){
+	uint64_t value;
+	if(bin->op == tk_mul){
+		node_expr* other;
+		if(int_literal(bin->rhs, &value) && VAR_IS_INT(lhs_type))
+			other = bin->lhs;
+		else if(int_literal(bin->lhs, &value) && VAR_IS_INT(rhs_type))
+			other = bin->rhs;
+		else
+			return;
+		if(value < 2 || value > (UINT64_C(1) << 62) || (value & (value - 1)))
+			return;
+		bin->lhs = other;
+		bin->rhs = new_int_literal(__builtin_ctzll(value));
+		bin->op = tk_shl;
+	}else if(bin->op == tk_mod){
+		if(!VAR_IS_UNSIGNED(lhs_type))
+			return;
+		if(!int_literal(bin->rhs, &value) || !value || value > INT64_MAX || (value & (value - 1)))
+			return;
+		bin->rhs = new_int_literal(value - 1);
+		bin->op = tk_band;
+	}else
+		return;
+	rewrites++;
+}
+
+static opt_info walk_expr(node_expr*);
+
+static opt_info walk_leaf(node_expr* expr){
+	opt_info info = {var_none, true, 1, expr->type};
+	switch(expr->type){
+	case tk_symbol:{
+		opt_var* var = resolve(&expr->symbol);
+		if(pass == opt_const_prop && var && var->value){
+			*expr = *var->value;
+			rewrites++;
+			return walk_expr(expr);
+		}
+		info.type = var ? VAR_TYPE(var->type) : var_none;
+		info.hash = hash_mix(info.hash, hash_token(&expr->symbol));
+		break;
+	}case tk_char_lit:
+	case tk_int_lit:
+	case tk_float_lit:
+	case tk_str_lit:
+	case tk_bool_lit:
+		info.type = literal_type(expr);
+		info.hash = hash_mix(info.hash, hash_token(&expr->int_lit));
+		break;
+	case tk_binexpr:{	// Group or negation
+		opt_info inner = walk_expr(expr->binexpr.lhs);
+		info.type = inner.type;
+		info.pure = inner.pure;
+		info.nodes += inner.nodes;
+		info.hash = hash_mix(hash_mix(info.hash, expr->binexpr.op), inner.hash);
+		break;
+	}case tk_subscript:{
+		opt_info key = walk_expr(expr->index.key);
+		opt_var* var = resolve(expr->index.symbol);
+		info.type = var ? var->elem_type : var_none;
+		info.pure = false;
+		info.nodes += key.nodes;
+		break;
+	}case tk_func_call:{
+		node_func_call* call = &expr->func_call;
+		info.pure = tk_cmp_str(call->symbol, "len");
+		for(size_t i = 0; i < call->expr_count; i++){
+			opt_info arg = walk_expr(&call->exprs[i]);
+			info.pure = info.pure && arg.pure;
+			info.nodes += arg.nodes;
+		}
+		info.type = call_type(call);
+		break;
+	}default:
+		info.pure = false;
+	}
+	return info;
+}
+
+static opt_info walk_binary(node_expr* expr, opt_info lhs){
+	node_binexpr* bin = &expr->binexpr;
+	opt_info rhs = walk_expr(bin->rhs);
+	if(pass == opt_strength)
+		reduce_strength(bin, lhs.type, rhs.type);
+	var_type type = binary_type(bin->op, lhs.type, rhs.type);
+	bool can_fail = (bin->op == tk_div && !VAR_IS_FLOAT(type)) || bin->op == tk_mod;
+	opt_info info = {
+		type, lhs.pure && rhs.pure && !can_fail && type != var_none,
+		lhs.nodes + rhs.nodes + 1, hash_mix(hash_mix(bin->op, lhs.hash), rhs.hash)
+	};
+	if(collecting && info.pure && (IS_NUMERIC(type) || type == var_bool)){
+		opt_candidate candidate = {expr, info};
+		if(!dynamic_array_pushback((dynamic_array_t*)&candidates, &candidate))
+			optimizer_mem_error("walk_binary");
+	}
+	return info;
+}
+
+// Post-order walk, left-deep chains are iterated
+static opt_info walk_expr(node_expr* expr){
+	size_t base = spine.size;
+	while(expr->type == tk_binexpr && expr->binexpr.rhs){
+		push_expr(&spine, expr);
+		expr = expr->binexpr.lhs;
+	}
+	opt_info info = walk_leaf(expr);
+	while(spine.size > base)
+		info = walk_binary(spine.exprs[--spine.size], info);
+	return info;
+}
+
+// Literal (or negated literal) of the declared type a constant is initialized with
+static node_expr* constant_value(node_var_decl* decl){
+	if(!decl->constant || !decl->expr)
+		return NULL;
+	node_expr* lit = decl->expr;
+	if(lit->type == tk_binexpr && !lit->binexpr.rhs && lit->binexpr.op == tk_negation)
+		lit = lit->binexpr.lhs;
+	var_type type = literal_type(lit);
+	if(lit != decl->expr && !IS_NUMERIC(type))
+		return NULL;
+	return (type != var_none && type == var_type_from_token(decl->var_type)) ? decl->expr : NULL;
+}
+
+static void walk_block(node_stmt**,size_t*,node_prog*);
+
+static void walk_args(node_func_call* call){
+	for(size_t i = 0; i < call->expr_count; i++)
+		walk_expr(&call->exprs[i]);
+}
+
+// Walks the expressions of a statement that has no body
+static void walk_simple(node_stmt* stmt){
+	switch(stmt->type){
+	case tk_var_decl:
+		if(stmt->var_decl.expr)
+			walk_expr(stmt->var_decl.expr);
+		break;
+	case tk_var_assign:
+		if(stmt->var_assign.index)
+			walk_expr(stmt->var_assign.index);
+		walk_expr(&stmt->var_assign.expr);
+		break;
+	case tk_print:
+	case tk_putchar:
+	case tk_func_call:
+		walk_args(&stmt->func_call);
+		break;
+	case tk_exit:
+		walk_expr(&stmt->exit.expr);
+		break;
+	default:
+		break;
+	}
+}
+
+static void walk_stmt(node_stmt* stmt){
+	switch(stmt->type){
+	case tk_var_decl:{
+		node_var_decl* decl = &stmt->var_decl;
+		var_type type = var_type_from_token(decl->var_type);
+		walk_simple(stmt);
+		declare(decl->symbol, type, (type == var_list || type == var_dict) ? var_type_from_token(decl->elem_type) : var_none,
+			(pass == opt_const_prop) ? constant_value(decl) : NULL);
+		break;
+	}case tk_scope:
+		walk_block(&stmt->scope.stmts, &stmt->scope.stmt_count, NULL);
+		break;
+	case tk_if:
+		for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+			if(branch->type == tk_scope){
+				walk_block(&branch->scope.stmts, &branch->scope.stmt_count, NULL);
+				break;
+			}
+			walk_expr(&branch->if_stmt.cond);
+			walk_block(&branch->if_stmt.body.stmts, &branch->if_stmt.body.stmt_count, NULL);
+		}
+		break;
+	case tk_while:
+		walk_expr(&stmt->while_stmt.cond);
+		walk_block(&stmt->while_stmt.body.stmts, &stmt->while_stmt.body.stmt_count, NULL);
+		break;
+	case tk_for:{
+		// The loop variable is declared in the body
+		size_t base = vars.size;
+		if(stmt->for_stmt.start)
+			walk_expr(stmt->for_stmt.start);
+		walk_expr(&stmt->for_stmt.end);
+		declare(stmt->for_stmt.symbol, var_type_from_token(stmt->for_stmt.var_type), var_none, NULL);
+		walk_block(&stmt->for_stmt.body.stmts, &stmt->for_stmt.body.stmt_count, NULL);
+		vars.size = base;
+		break;
+	}default:
+		walk_simple(stmt);
+	}
+}
+
+// Structural equality of two expressions
+static bool same_expr(node_expr* a, node_expr* b){
+	size_t base = work.size;
+	push_expr(&work, a);
+	push_expr(&work, b);
+	bool same = true;
+	while(same && work.size > base){
+		b = work.exprs[--work.size];
+		a = work.exprs[--work.size];
+		if(a->type != b->type){
+			same = false;
+			continue;
+		}
+		switch(a->type){
+		case tk_binexpr:
+			same = a->binexpr.op == b->binexpr.op && !a->binexpr.rhs == !b->binexpr.rhs;
+			if(same && a->binexpr.rhs){
+				push_expr(&work, a->binexpr.rhs);
+				push_expr(&work, b->binexpr.rhs);
+			}
+			push_expr(&work, a->binexpr.lhs);
+			push_expr(&work, b->binexpr.lhs);
+			break;
+		case tk_func_call:
+			same = same_name(a->func_call.symbol, b->func_call.symbol) && a->func_call.expr_count == b->func_call.expr_count;
+			for(size_t i = 0; same && i < a->func_call.expr_count; i++){
+				push_expr(&work, &a->func_call.exprs[i]);
+				push_expr(&work, &b->func_call.exprs[i]);
+			}
+			break;
+		case tk_subscript:
+			same = false;
+			break;
+		default:	// Literals and symbols
+			same = same_name(&a->symbol, &b->symbol);
+		}
+	}
+	work.size = base;
+	return same;
+}
+
+static int compare_candidates(const void* a, const void* b){
+	const opt_info* x = &((const opt_candidate*) a)->info;
+	const opt_info* y = &((const opt_candidate*) b)->info;
+	if(x->nodes != y->nodes)
+		return (x->nodes < y->nodes) ? 1 : -1;
+	return (x->hash != y->hash) ? ((x->hash < y->hash) ? -1 : 1) : 0;
+}
+
+// Moves the largest subexpression repeated in a statement into a new
+// temporary declared before it (*temp), if that saves work
+static bool hoist_common(node_stmt* stmt, node_stmt* temp){
+	candidates.size = 0;
+	collecting = true;
+	walk_simple(stmt);
+	collecting = false;
+	if(candidates.size < 2)
+		return false;
+	qsort(candidates.cands, candidates.size, sizeof(opt_candidate), compare_candidates);
+	for(size_t i = 0, j; i < candidates.size; i = j){
+		opt_candidate* first = &candidates.cands[i];
+		size_t count = 1;
+		for(j = i + 1; j < candidates.size && !compare_candidates(first, &candidates.cands[j]); j++)
+			if(same_expr(first->expr, candidates.cands[j].expr))
+				candidates.cands[i + count++] = candidates.cands[j];
+		// Every occurrence past the first saves its nodes, the temporary costs a store and a load
+		if(count < 2 || (count - 1) * first->info.nodes <= count + 1)
+			continue;
+
+		char buffer[24];
+		int len = snprintf(buffer, sizeof(buffer), "$cse%zu", temp_count++);
+		token* name = (token*) parser_alloc(sizeof(token));
+		*name = (token){tk_symbol, len, arena_text(buffer, len)};
+		node_expr* init = (node_expr*) parser_alloc(sizeof(node_expr));
+		*init = *first->expr;
+		for(size_t k = 0; k < count; k++)
+			*candidates.cands[i + k].expr = (node_expr){.symbol = *name};
+		*temp = (node_stmt){.var_decl = {tk_var_decl, type_token(first->info.type), name, init, false, tk_invalid, tk_invalid}};
+		declare(name, first->info.type, var_none, NULL);
+		rewrites += count;
+		return true;
+	}
+	return false;
+}
+
+static void push_stmt(node_prog* list, node_stmt* stmt){
+	if(!dynamic_array_pushback((dynamic_array_t*)list, stmt))
+		optimizer_mem_error("push_stmt");
+}
+
+// Walks a block for const-prop, strength and cse, which may add statements
+// to it (the program itself if prog is given, else a parser arena array)
+static void walk_block(node_stmt** stmts, size_t* count, node_prog* prog){
+	size_t base = vars.size;
+	node_prog out = NEW_DYNAMIC_ARRAY(sizeof(node_stmt));
+	bool rebuilt = false;
+	for(size_t i = 0; i < *count; i++){
+		node_stmt* stmt = &(*stmts)[i];
+		node_stmt temp;
+		bool simple = stmt->type != tk_scope && stmt->type != tk_if && stmt->type != tk_while && stmt->type != tk_for;
+		for(size_t n = 0; pass == opt_cse && simple && n < OPT_CSE_MAX && hoist_common(stmt, &temp); n++){
+			if(!rebuilt){
+				for(size_t k = 0; k < i; k++)
+					push_stmt(&out, &(*stmts)[k]);
+				rebuilt = true;
+			}
+			push_stmt(&out, &temp);
+		}
+		walk_stmt(stmt);
+		if(rebuilt)
+			push_stmt(&out, stmt);
+	}
+	vars.size = base;
+	if(!rebuilt)
+		return;
+	if(prog){
+		dynamic_array_free((dynamic_array_t*)prog);
+		*prog = out;
+		return;
+	}
+	*stmts = (node_stmt*) parser_alloc(out.size * sizeof(node_stmt));
+	memcpy(*stmts, out.stmts, out.size * sizeof(node_stmt));
+	*count = out.size;
+	dynamic_array_free((dynamic_array_t*)&out);
+}
+
+// Dead code
+
+static bool literal_truth(node_expr* expr, bool* truth){
+	uint64_t value;
+	if(expr->type == tk_bool_lit){
+		*truth = tk_cmp_str(&expr->bool_lit, "true");
+		return true;
+	}
+	if(int_literal(expr, &value)){
+		*truth = value != 0;
+		return true;
+	}
+	return false;
+}
+
+static void dce_block(node_stmt*,size_t*);
+
+// Drops the branches of an if chain whose condition is false, a branch
+// whose condition is true becomes the else of the chain
+// Returns false if no branch is left
+static bool dce_if(node_stmt* stmt){
+	node_stmt* head = NULL;
+	node_stmt** tail = &head;
+	for(node_stmt* branch = stmt; branch; ){
+		if(branch->type == tk_scope){
+			dce_block(branch->scope.stmts, &branch->scope.stmt_count);
+			*tail = branch;
+			tail = NULL;
+			break;
+		}
+		node_stmt* next = branch->if_stmt.else_body;
+		bool truth;
+		if(literal_truth(&branch->if_stmt.cond, &truth)){
+			rewrites++;
+			if(!truth){
+				branch = next;
+				continue;
+			}
+			node_stmt* body = (node_stmt*) parser_alloc(sizeof(node_stmt));
+			body->scope = branch->if_stmt.body;
+			body->type = tk_scope;
+			dce_block(body->scope.stmts, &body->scope.stmt_count);
+			*tail = body;
+			tail = NULL;
+			break;
+		}
+		dce_block(branch->if_stmt.body.stmts, &branch->if_stmt.body.stmt_count);
+		*tail = branch;
+		tail = &branch->if_stmt.else_body;
+		branch = next;
+	}
+	if(tail)
+		*tail = NULL;
+	if(!head)
+		return false;
+	*stmt = *head;
+	return true;
+}
+
+static void dce_block(node_stmt* stmts, size_t* count){
+	size_t kept = 0;
+	for(size_t i = 0; i < *count; i++){
+		node_stmt* stmt = &stmts[i];
+		bool truth;
+		if(stmt->type == tk_if && !dce_if(stmt))
+			continue;
+		if(stmt->type == tk_while){
+			if(literal_truth(&stmt->while_stmt.cond, &truth) && !truth){
+				rewrites++;
+				continue;
+			}
+			dce_block(stmt->while_stmt.body.stmts, &stmt->while_stmt.body.stmt_count);
+		}else if(stmt->type == tk_for)
+			dce_block(stmt->for_stmt.body.stmts, &stmt->for_stmt.body.stmt_count);
+		else if(stmt->type == tk_scope){
+			dce_block(stmt->scope.stmts, &stmt->scope.stmt_count);
+			if(!stmt->scope.stmt_count){
+				rewrites++;
+				continue;
+			}
+		}
+		stmts[kept++] = *stmt;
+		// Nothing after exit / break runs
+		if(stmt->type == tk_exit || stmt->type == tk_break){
+			rewrites += *count - i - 1;
+			break;
+		}
+	}
+	*count = kept;
+}
+
+// Dead stores
+
+static bool expr_mentions(node_expr* expr, token* name){
+	size_t base = work.size;
+	bool found = false;
+	push_expr(&work, expr);
+	while(!found && work.size > base){
+		expr = work.exprs[--work.size];
+		switch(expr->type){
+		case tk_symbol:
+			found = same_name(&expr->symbol, name);
+			break;
+		case tk_binexpr:
+			push_expr(&work, expr->binexpr.lhs);
+			if(expr->binexpr.rhs)
+				push_expr(&work, expr->binexpr.rhs);
+			break;
+		case tk_subscript:
+			found = same_name(expr->index.symbol, name);
+			push_expr(&work, expr->index.key);
+			break;
+		case tk_func_call:
+			for(size_t i = 0; i < expr->func_call.expr_count; i++)
+				push_expr(&work, &expr->func_call.exprs[i]);
+			break;
+		case tk_sizeof:
+		case tk_typeof:
+			found = same_name(expr->size_of.symbol, name);
+			break;
+		default:
+			break;
+		}
+	}
+	work.size = base;
+	return found;
+}
+
+// No side effects and cannot fail, without types (so no division)
+static bool expr_pure(node_expr* expr){
+	size_t base = work.size;
+	bool pure = true;
+	push_expr(&work, expr);
+	while(pure && work.size > base){
+		expr = work.exprs[--work.size];
+		switch(expr->type){
+		case tk_char_lit:
+		case tk_int_lit:
+		case tk_float_lit:
+		case tk_str_lit:
+		case tk_bool_lit:
+		case tk_symbol:
+			break;
+		case tk_binexpr:
+			pure = expr->binexpr.op != tk_div && expr->binexpr.op != tk_mod;
+			push_expr(&work, expr->binexpr.lhs);
+			if(expr->binexpr.rhs)
+				push_expr(&work, expr->binexpr.rhs);
+			break;
+		case tk_func_call:
+			pure = tk_cmp_str(expr->func_call.symbol, "len");
+			for(size_t i = 0; i < expr->func_call.expr_count; i++)
+				push_expr(&work, &expr->func_call.exprs[i]);
+			break;
+		default:
+			pure = false;
+		}
+	}
+	work.size = base;
+	return pure;
+}
+
+static bool block_mentions(node_stmt*,size_t,token*);
+
+static bool stmt_mentions(node_stmt* stmt, token* name){
+	switch(stmt->type){
+	case tk_var_decl:
+		return same_name(stmt->var_decl.symbol, name) || (stmt->var_decl.expr && expr_mentions(stmt->var_decl.expr, name));
+	case tk_var_assign:
+		return same_name(stmt->var_assign.symbol, name) || expr_mentions(&stmt->var_assign.expr, name)
+			|| (stmt->var_assign.index && expr_mentions(stmt->var_assign.index, name));
+	case tk_print:
+	case tk_putchar:
+	case tk_input:
+	case tk_getchar:
+	case tk_flush:
+	case tk_func_call:
+		for(size_t i = 0; i < stmt->func_call.expr_count; i++)
+			if(expr_mentions(&stmt->func_call.exprs[i], name))
+				return true;
+		return false;
+	case tk_exit:
+		return expr_mentions(&stmt->exit.expr, name);
+	case tk_scope:
+		return block_mentions(stmt->scope.stmts, stmt->scope.stmt_count, name);
+	case tk_if:
+		for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+			if(branch->type == tk_scope)
+				return block_mentions(branch->scope.stmts, branch->scope.stmt_count, name);
+			if(expr_mentions(&branch->if_stmt.cond, name)
+				|| block_mentions(branch->if_stmt.body.stmts, branch->if_stmt.body.stmt_count, name))
+				return true;
+		}
+		return false;
+	case tk_while:
+		return expr_mentions(&stmt->while_stmt.cond, name)
+			|| block_mentions(stmt->while_stmt.body.stmts, stmt->while_stmt.body.stmt_count, name);
+	case tk_for:
+		return same_name(stmt->for_stmt.symbol, name) || (stmt->for_stmt.start && expr_mentions(stmt->for_stmt.start, name))
+			|| expr_mentions(&stmt->for_stmt.end, name)
+			|| block_mentions(stmt->for_stmt.body.stmts, stmt->for_stmt.body.stmt_count, name);
+	default:
+		return false;
+	}
+}
+
+static bool block_mentions(node_stmt* stmts, size_t count, token* name){
+	for(size_t i = 0; i < count; i++)
+		if(stmt_mentions(&stmts[i], name))
+			return true;
+	return false;
+}
+
+// name = <pure expression not reading name>
+static bool plain_store(node_stmt* stmt, token* name){
+	return stmt->type == tk_var_assign && !stmt->var_assign.index && same_name(stmt->var_assign.symbol, name)
+		&& expr_pure(&stmt->var_assign.expr) && !expr_mentions(&stmt->var_assign.expr, name);
+}
+
+// Whether the only uses of name are plain stores
+static bool only_stores(node_stmt* stmts, size_t count, token* name){
+	for(size_t i = 0; i < count; i++){
+		node_stmt* stmt = &stmts[i];
+		switch(stmt->type){
+		case tk_scope:
+			if(!only_stores(stmt->scope.stmts, stmt->scope.stmt_count, name))
+				return false;
+			break;
+		case tk_if:
+			for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+				if(branch->type == tk_scope){
+					if(!only_stores(branch->scope.stmts, branch->scope.stmt_count, name))
+						return false;
+					break;
+				}
+				if(expr_mentions(&branch->if_stmt.cond, name)
+					|| !only_stores(branch->if_stmt.body.stmts, branch->if_stmt.body.stmt_count, name))
+					return false;
+			}
+			break;
+		case tk_while:
+			if(expr_mentions(&stmt->while_stmt.cond, name)
+				|| !only_stores(stmt->while_stmt.body.stmts, stmt->while_stmt.body.stmt_count, name))
+				return false;
+			break;
+		default:
+			if(!plain_store(stmt, name) && stmt_mentions(stmt, name))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void remove_stores(node_stmt* stmts, size_t* count, token* name){
+	size_t kept = 0;
+	for(size_t i = 0; i < *count; i++){
+		node_stmt* stmt = &stmts[i];
+		if(stmt->type == tk_scope)
+			remove_stores(stmt->scope.stmts, &stmt->scope.stmt_count, name);
+		else if(stmt->type == tk_while)
+			remove_stores(stmt->while_stmt.body.stmts, &stmt->while_stmt.body.stmt_count, name);
+		else if(stmt->type == tk_if){
+			for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+				if(branch->type == tk_scope){
+					remove_stores(branch->scope.stmts, &branch->scope.stmt_count, name);
+					break;
+				}
+				remove_stores(branch->if_stmt.body.stmts, &branch->if_stmt.body.stmt_count, name);
+			}
+		}else if(plain_store(stmt, name)){
+			rewrites++;
+			continue;
+		}
+		stmts[kept++] = *stmt;
+	}
+	*count = kept;
+}
+
+// Statements that run in order with nothing else in between
+static bool straight_line(node_stmt* stmt){
+	switch(stmt->type){
+	case tk_var_decl:
+	case tk_var_assign:
+	case tk_print:
+	case tk_putchar:
+	case tk_input:
+	case tk_getchar:
+	case tk_flush:
+	case tk_func_call:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void dse_block(node_stmt* stmts, size_t* count){
+	for(size_t i = 0; i < *count; i++){
+		node_stmt* stmt = &stmts[i];
+		if(stmt->type == tk_scope)
+			dse_block(stmt->scope.stmts, &stmt->scope.stmt_count);
+		else if(stmt->type == tk_while)
+			dse_block(stmt->while_stmt.body.stmts, &stmt->while_stmt.body.stmt_count);
+		else if(stmt->type == tk_for)
+			dse_block(stmt->for_stmt.body.stmts, &stmt->for_stmt.body.stmt_count);
+		else if(stmt->type == tk_if){
+			for(node_stmt* branch = stmt; branch; branch = branch->if_stmt.else_body){
+				if(branch->type == tk_scope){
+					dse_block(branch->scope.stmts, &branch->scope.stmt_count);
+					break;
+				}
+				dse_block(branch->if_stmt.body.stmts, &branch->if_stmt.body.stmt_count);
+			}
+		}
+	}
+
+	size_t kept = 0;
+	for(size_t i = 0; i < *count; i++){
+		node_stmt* stmt = &stmts[i];
+		// Variables never read: the declaration and every store to them go
+		if(stmt->type == tk_var_decl && (!stmt->var_decl.expr || expr_pure(stmt->var_decl.expr))
+			&& only_stores(stmts + i + 1, *count - i - 1, stmt->var_decl.symbol)){
+			size_t rest = *count - i - 1;
+			remove_stores(stmts + i + 1, &rest, stmt->var_decl.symbol);
+			*count = i + 1 + rest;
+			rewrites++;
+			continue;
+		}
+		// Stores overwritten before anything reads them
+		if(stmt->type == tk_var_assign && !stmt->var_assign.index && expr_pure(&stmt->var_assign.expr)){
+			token* name = stmt->var_assign.symbol;
+			bool dead = false;
+			for(size_t j = i + 1; j < *count && straight_line(&stmts[j]); j++){
+				node_stmt* next = &stmts[j];
+				dead = next->type == tk_var_assign && !next->var_assign.index && same_name(next->var_assign.symbol, name)
+					&& !expr_mentions(&next->var_assign.expr, name);
+				if(dead || stmt_mentions(next, name))
+					break;
+			}
+			if(dead){
+				rewrites++;
+				continue;
+			}
+		}
+		stmts[kept++] = *stmt;
+	}
+	*count = kept;
+}
+
+// Runs the enabled passes in order, returns how many rewrites they made
+size_t optimize(node_prog* prog){
+	size_t total = 0;
+	temp_count = 0;
+	for(pass = 0; pass < opt_pass_count; pass++){
+		opt_pass_t* current = &opt_passes[pass];
+		current->ns = 0;
+		current->rewrites = 0;
+		if(!current->enabled)
+			continue;
+		uint64_t start = stats_clock();
+		rewrites = 0;
+		if(pass == opt_dce)
+			dce_block(prog->stmts, &prog->size);
+		else if(pass == opt_dse)
+			dse_block(prog->stmts, &prog->size);
+		else
+			walk_block(&prog->stmts, &prog->size, prog);
+		current->ns = stats_clock() - start;
+		current->rewrites = rewrites;
+		total += rewrites;
+	}
+	dynamic_array_free((dynamic_array_t*)&vars);
+	dynamic_array_free((dynamic_array_t*)&spine);
+	dynamic_array_free((dynamic_array_t*)&work);
+	dynamic_array_free((dynamic_array_t*)&candidates);
+	return total;
+}
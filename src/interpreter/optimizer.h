@@ -0,0 +1,34 @@
+#ifndef FERRO_OPTIMIZER_H
+#define FERRO_OPTIMIZER_H
+
+#include "../FL/parser.h"
+
+// Optimization passes over the AST, in the order they run
+// They only rewrite a program that compiled, so they never hide or change
+// a diagnostic, and they keep its output and runtime errors: types are
+// resolved like the compiler does, and only code that has no side
+// effects and cannot fail is moved or removed
+enum{
+	opt_const_prop,		// Uses of constants initialized with a literal become the literal
+	opt_dce,			// Branches on literal conditions, code after exit / break
+	opt_strength,		// x * 2^k to x << k, unsigned x % 2^k to x & (2^k - 1)
+	opt_cse,			// Subexpressions repeated in a statement computed once, before it
+	opt_dse,			// Stores overwritten before being read, variables never read
+	opt_pass_count
+};
+
+typedef struct{
+	const char* name;
+	bool enabled;
+	uint64_t ns;		// Time spent by the last run
+	size_t rewrites;	// Nodes rewritten or statements removed by the last run
+} opt_pass_t;
+
+extern opt_pass_t opt_passes[opt_pass_count];
+
+bool opt_select(const char*);
+bool opt_disable(const char*);
+bool opt_any(void);
+size_t optimize(node_prog*);
+
+#endif
@@ -0,0 +1,136 @@
+#include "output.h"
+#include "containers.h"
+
+#include <unistd.h>
+#include <errno.h>
+
+uint8_t output_mode = output_auto;
+char output_buffer[OUTPUT_BLOCK];
+size_t output_size = 0;
+int output_error = 0;
+
+// Resolves the buffering mode, called before the program runs
+// Anything printed through stdio so far (diagnostics) goes out first
+void output_setup(void){
+	fflush(stdout);
+	output_error = 0;
+	if(output_mode == output_auto)
+		output_mode = isatty(STDOUT_FILENO) ? output_line : output_full;
+}
+
+// Once a write failed, the rest of the output is dropped
+static void output_write_all(const char* data, size_t len){
+	while(len && !output_error){
+		ssize_t written = write(STDOUT_FILENO, data, len);
+		if(written < 0){
+			if(errno != EINTR)
+				output_error = errno;
+			continue;
+		}
+		data += written;
+		len -= written;
+	}
+}
+
+// Writes out the buffered output
+// Returns false if stdout could not be written to, now or by an earlier
+// flush (output_error holds the errno of the first failed write)
+bool output_flush(void){
+	output_write_all(output_buffer, output_size);
+	output_size = 0;
+	return !output_error;
+}
+
+void output_write(const char* data, size_t len){
+	if(output_size + len > OUTPUT_BLOCK){
+		(void) output_flush();
+		// Larger than the block, skip the copy
+		if(len >= OUTPUT_BLOCK){
+			output_write_all(data, len);
+			return;
+		}
+	}
+	memcpy(output_buffer + output_size, data, len);
+	output_size += len;
+}
+
+static void output_u64(uint64_t u){
+	char digits[20];
+	char* p = digits + sizeof(digits);
+	do{
+		*--p = '0' + u % 10;
+		u /= 10;
+	}while(u);
+	output_write(p, digits + sizeof(digits) - p);
+}
+
+static void output_i64(int64_t i){
+	if(i < 0){
+		output_char('-');
+		output_u64(0 - (uint64_t) i);
+	}else
+		output_u64(i);
+}
+
+static void output_f64(double f){
+	char tmp[32];
+	int len = snprintf(tmp, sizeof(tmp), "%g", f);
+	if(len > 0)
+		output_write(tmp, (len < (int) sizeof(tmp)) ? (size_t) len : sizeof(tmp) - 1);
+}
+
+// Formats a value the way print shows it
+void output_value(value_t v){
+	switch(v.type){
+	case var_char:
+		output_char((char) v.i);
+		break;
+	case var_u8:
+	case var_u16:
+	case var_u32:
+	case var_u64:
+		output_u64(v.u);
+		break;
+	case var_i8:
+	case var_i16:
+	case var_i32:
+	case var_i64:
+		output_i64(v.i);
+		break;
+	case var_f32:
+		output_f64(v.f32);
+		break;
+	case var_f64:
+		output_f64(v.f);
+		break;
+	case var_str:
+		output_write(value_str_data(&v), v.len);
+		break;
+	case var_bool:
+		if(v.b)
+			output_write("true", 4);
+		else
+			output_write("false", 5);
+		break;
+	case var_list:
+	case var_dict:{
+		// Elements are never containers, so this recurses once
+		value_t key, elem;
+		size_t it = 0;
+		bool first = true;
+		output_char((v.type == var_list) ? '[' : '{');
+		while(container_next(v, &it, &key, &elem)){
+			if(!first)
+				output_write(", ", 2);
+			first = false;
+			if(v.type == var_dict){
+				output_value(key);
+				output_write(": ", 2);
+			}
+			output_value(elem);
+		}
+		output_char((v.type == var_list) ? ']' : '}');
+		break;
+	}
+	}
+}
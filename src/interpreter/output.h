@@ -0,0 +1,37 @@
+#ifndef FERRO_OUTPUT_H
+#define FERRO_OUTPUT_H
+
+#include "value.h"
+#include "../FL/datastructures.h"
+
+// Buffered standard output for print / putchar
+// Output is gathered in one large block and handed to the kernel with a
+// single write(2) when the block is full, before reading stdin,
+// on flush(), and when the program ends
+#define OUTPUT_BLOCK 64*KB
+
+enum{
+	output_auto = 0,	// Line buffered if stdout is a terminal
+	output_line,		// Flushed after every newline
+	output_full,		// Flushed only when the block is full
+};
+
+extern uint8_t output_mode;
+extern char output_buffer[OUTPUT_BLOCK];
+extern size_t output_size;
+extern int output_error;
+
+void output_setup(void);
+bool output_flush(void);
+void output_write(const char*,size_t);
+void output_value(value_t);
+
+static inline void output_char(char c){
+	if(output_size == OUTPUT_BLOCK)
+		(void) output_flush();
+	output_buffer[output_size++] = c;
+	if(c == '\n' && output_mode == output_line)
+		(void) output_flush();
+}
+
+#endif
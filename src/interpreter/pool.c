@@ -0,0 +1,204 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+unsigned int pool_threads = 0;
+
+// Iterations a worker has left, one cache line each
+typedef struct{
+	pthread_mutex_t lock;
+	uint64_t begin, end;
+} __attribute__((aligned(64))) pool_range;
+
+static pthread_t* threads = NULL;
+static unsigned int thread_count = 0;	// Started, worker 0 is the caller of pool_run
+static pool_range* ranges = NULL;
+
+static pthread_mutex_t task_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t task_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t task_done = PTHREAD_COND_INITIALIZER;
+static pool_task* task = NULL;
+static uint64_t generation = 0;		// Tasks handed out
+static unsigned int running = 0;	// Threads still on the current task
+static bool stopping = false;
+static bool aborted = false;
+
+static uint64_t pool_clock(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Workers pool_run uses, the caller included
+unsigned int pool_size(void){
+	if(threads)
+		return thread_count + 1;
+	unsigned int size = pool_threads;
+	if(!size){
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		size = (cores > 0) ? cores : 1;
+	}
+	return size;
+}
+
+// Takes up to grain iterations from the worker's range,
+// stealing the back half of the largest range once it is empty
+static bool pool_take(unsigned int id, uint64_t grain, uint64_t* begin, uint64_t* end){
+	unsigned int size = thread_count + 1;
+	pool_range* own = &ranges[id];
+	while(true){
+		pthread_mutex_lock(&own->lock);
+		if(own->begin < own->end){
+			*begin = own->begin;
+			*end = (own->end - own->begin > grain) ? own->begin + grain : own->end;
+			own->begin = *end;
+			pthread_mutex_unlock(&own->lock);
+			return true;
+		}
+		pthread_mutex_unlock(&own->lock);
+
+		pool_range* victim = NULL;
+		uint64_t largest = 0;
+		for(unsigned int i = 1; i < size; i++){
+			pool_range* range = &ranges[(id + i) % size];
+			pthread_mutex_lock(&range->lock);
+			uint64_t left = range->end - range->begin;
+			pthread_mutex_unlock(&range->lock);
+			if(left > largest){
+				largest = left;
+				victim = range;
+			}
+		}
+		if(!victim)
+			return false;
+		pthread_mutex_lock(&victim->lock);
+		uint64_t stolen_begin = victim->begin + (victim->end - victim->begin) / 2, stolen_end = victim->end;
+		victim->end = stolen_begin;
+		pthread_mutex_unlock(&victim->lock);
+		// Emptied meanwhile, look again
+		if(stolen_begin >= stolen_end)
+			continue;
+		pthread_mutex_lock(&own->lock);
+		own->begin = stolen_begin;
+		own->end = stolen_end;
+		pthread_mutex_unlock(&own->lock);
+	}
+}
+
+static void pool_work(pool_task* current, unsigned int id){
+	uint64_t grain = 1, begin, end;
+	current->enter(current->ctx, id);
+	while(!__atomic_load_n(&aborted, __ATOMIC_RELAXED) && pool_take(id, grain, &begin, &end)){
+		uint64_t start = pool_clock();
+		if(!current->run(current->ctx, id, begin, end)){
+			__atomic_store_n(&aborted, true, __ATOMIC_RELAXED);
+			break;
+		}
+		uint64_t ns = pool_clock() - start;
+		if(ns < POOL_CHUNK_MIN_NS && grain < (UINT64_C(1) << 32))
+			grain *= 2;
+		else if(ns > POOL_CHUNK_MAX_NS && grain > 1)
+			grain /= 2;
+	}
+	current->leave(current->ctx, id);
+}
+
+static void* pool_thread(void* arg){
+	unsigned int id = (unsigned int)(uintptr_t) arg;
+	uint64_t seen = 0;
+	pthread_mutex_lock(&task_lock);
+	while(true){
+		while(!stopping && generation == seen)
+			pthread_cond_wait(&task_ready, &task_lock);
+		if(stopping)
+			break;
+		seen = generation;
+		pool_task* current = task;
+		pthread_mutex_unlock(&task_lock);
+		pool_work(current, id);
+		pthread_mutex_lock(&task_lock);
+		if(!--running)
+			pthread_cond_signal(&task_done);
+	}
+	pthread_mutex_unlock(&task_lock);
+	return NULL;
+}
+
+// Starts the threads, fewer if some fail to start
+static void pool_start(void){
+	unsigned int size = pool_size();
+	ranges = (pool_range*) aligned_alloc(64, size * sizeof(pool_range));
+	threads = (pthread_t*) malloc(size * sizeof(pthread_t));
+	if(!ranges || !threads){
+		free(ranges);
+		free(threads);
+		ranges = NULL;
+		threads = NULL;
+		return;
+	}
+	for(unsigned int i = 0; i < size; i++)
+		pthread_mutex_init(&ranges[i].lock, NULL);
+	// Generations start over with the threads
+	generation = 0;
+	while(thread_count + 1 < size && !pthread_create(&threads[thread_count], NULL, pool_thread, (void*)(uintptr_t)(thread_count + 1)))
+		thread_count++;
+}
+
+// Runs iterations [0, count) of a task on every worker
+// Returns false if the task stopped early
+bool pool_run(pool_task* new_task, uint64_t count){
+	if(!threads)
+		pool_start();
+	unsigned int size = thread_count + 1;
+	// Without threads the caller runs everything
+	if(!ranges){
+		new_task->enter(new_task->ctx, 0);
+		bool success = new_task->run(new_task->ctx, 0, 0, count);
+		new_task->leave(new_task->ctx, 0);
+		return success;
+	}
+	for(unsigned int i = 0; i < size; i++){
+		ranges[i].begin = count / size * i + ((i < count % size) ? i : count % size);
+		ranges[i].end = ranges[i].begin + count / size + (i < count % size);
+	}
+	aborted = false;
+
+	pthread_mutex_lock(&task_lock);
+	task = new_task;
+	generation++;
+	running = thread_count;
+	pthread_cond_broadcast(&task_ready);
+	pthread_mutex_unlock(&task_lock);
+
+	pool_work(new_task, 0);
+
+	pthread_mutex_lock(&task_lock);
+	while(running)
+		pthread_cond_wait(&task_done, &task_lock);
+	task = NULL;
+	pthread_mutex_unlock(&task_lock);
+	return !aborted;
+}
+
+// Joins the threads
+void pool_stop(void){
+	if(!threads)
+		return;
+	pthread_mutex_lock(&task_lock);
+	stopping = true;
+	pthread_cond_broadcast(&task_ready);
+	pthread_mutex_unlock(&task_lock);
+	for(unsigned int i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	for(unsigned int i = 0; i < thread_count + 1; i++)
+		pthread_mutex_destroy(&ranges[i].lock);
+	free(threads);
+	free(ranges);
+	threads = NULL;
+	ranges = NULL;
+	thread_count = 0;
+	stopping = false;
+}
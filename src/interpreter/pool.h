@@ -0,0 +1,34 @@
+#ifndef FERRO_POOL_H
+#define FERRO_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Work-stealing thread pool running the iterations of parallel for loops
+// Every worker starts with an even share of the iterations and takes
+// chunks from the front of its range. A chunk grows while it takes less
+// than POOL_CHUNK_MIN_NS and shrinks past POOL_CHUNK_MAX_NS, so cheap
+// bodies are not dominated by the bookkeeping and costly ones stay
+// stealable. A worker whose range is empty steals the back half of the
+// largest range left
+// The threads are started by the first loop and kept until pool_stop
+#define POOL_CHUNK_MIN_NS 20000
+#define POOL_CHUNK_MAX_NS 500000
+
+extern unsigned int pool_threads;	// 0 for one per core
+
+typedef struct{
+	// Before the first and after the last chunk of a worker (0 is the caller)
+	void (*enter)(void*,unsigned int);
+	void (*leave)(void*,unsigned int);
+	// Runs iterations [begin, end), returning false stops every worker
+	bool (*run)(void*,unsigned int,uint64_t,uint64_t);
+	void* ctx;
+} pool_task;
+
+unsigned int pool_size(void);
+bool pool_run(pool_task*,uint64_t);
+void pool_stop(void);
+
+#endif
@@ -0,0 +1,288 @@
+#include "profile.h"
+#include "../FL/filemanager.h"
+
+#include <sys/time.h>
+
+const char* profile_path = NULL;
+FL_LOCAL const bc_insn* volatile profile_ip = NULL;
+volatile sig_atomic_t profile_in_jit = 0;
+
+// Hits of every instruction, interpreted and as JIT code
+static const bc_insn* code_base = NULL;
+static size_t code_size = 0;
+static uint32_t* hits = NULL;
+static uint32_t* jit_hits = NULL;
+static volatile uint32_t outside_hits = 0;	// Samples outside of the VM loop
+static struct sigaction old_action;
+
+// Only touches the counters, so it is async signal safe
+static void profile_sample(int sig){
+	(void) sig;
+	const bc_insn* ip = profile_ip;
+	if(!ip || (size_t)(ip - code_base) >= code_size){
+		outside_hits++;
+		return;
+	}
+	(profile_in_jit ? jit_hits : hits)[ip - code_base]++;
+}
+
+bool profile_start(bc_chunk* chunk){
+	code_base = chunk->code.insns;
+	code_size = chunk->code.size;
+	hits = (uint32_t*) calloc(code_size ? code_size : 1, sizeof(uint32_t));
+	jit_hits = (uint32_t*) calloc(code_size ? code_size : 1, sizeof(uint32_t));
+	if(!hits || !jit_hits){
+		free(hits);
+		free(jit_hits);
+		hits = jit_hits = NULL;
+		return false;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = profile_sample;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if(sigaction(SIGPROF, &action, &old_action))
+		return false;
+	struct itimerval timer = {{0, 1000000 / PROFILE_HZ}, {0, 1000000 / PROFILE_HZ}};
+	if(setitimer(ITIMER_PROF, &timer, NULL)){
+		sigaction(SIGPROF, &old_action, NULL);
+		return false;
+	}
+	return true;
+}
+
+void profile_stop(void){
+	struct itimerval timer = {{0, 0}, {0, 0}};
+	(void) setitimer(ITIMER_PROF, &timer, NULL);
+	(void) sigaction(SIGPROF, &old_action, NULL);
+	profile_ip = NULL;
+}
+
+// Line numbers, with the newlines of every file looked up once
+typedef DYNAMIC_ARRAY(const char** ptrs) profile_newlines;
+typedef struct{
+	file_t* file;
+	profile_newlines newlines;
+} profile_lines;
+typedef DYNAMIC_ARRAY(profile_lines* files) profile_line_cache;
+static profile_line_cache line_cache = NEW_DYNAMIC_ARRAY(sizeof(profile_lines));
+
+static unsigned int profile_line(file_t* file, const char* ptr){
+	profile_lines* lines = NULL;
+	for(size_t i = 0; i < line_cache.size && !lines; i++)
+		if(line_cache.files[i].file == file)
+			lines = &line_cache.files[i];
+	if(!lines){
+		profile_lines new_lines = {file, NEW_DYNAMIC_ARRAY(sizeof(const char*))};
+		for(const char* str = file->contents; (str = memchr(str, '\n', file->contents + file->size - str)); str++)
+			if(!dynamic_array_pushback((dynamic_array_t*)&new_lines.newlines, &str))
+				return file_line(file, ptr);
+		if(!dynamic_array_pushback((dynamic_array_t*)&line_cache, &new_lines)){
+			dynamic_array_free((dynamic_array_t*)&new_lines.newlines);
+			return file_line(file, ptr);
+		}
+		lines = &line_cache.files[line_cache.size-1];
+	}
+	// Newlines before ptr
+	size_t lo = 0, hi = lines->newlines.size;
+	while(lo < hi){
+		size_t mid = (lo + hi) / 2;
+		if(lines->newlines.ptrs[mid] < ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo + 1;
+}
+
+// Appends the "path:line" frame of a token
+static bool append_frame(char** stack, size_t* len, const token* tk){
+	file_t* file = (tk && tk->str) ? find_file_ptr(tk->str) : NULL;
+	const char* path = file ? file->path : "[unknown]";
+	unsigned int line = file ? profile_line(file, tk->str) : 0;
+	size_t size = *len + strlen(path) + 16;
+	char* str = (char*) realloc(*stack, size);
+	if(!str)
+		return false;
+	*len += snprintf(str + *len, size - *len, *len ? ";%s:%u" : "%s:%u", path, line);
+	*stack = str;
+	return true;
+}
+
+typedef struct{
+	size_t order;		// Index of the token in tk_array
+	const token* tk;
+	uint64_t hits;
+	uint64_t jit_hits;
+	char* stack;		// Folded stack, the last frame is the line itself
+} profile_sample_t;
+
+// Tokens of tk_array sorted by their position in the source
+// Expression nodes hold copies of their tokens, which are found again
+// through the text they point to
+typedef struct{
+	const char* str;
+	size_t index;
+} profile_token_pos;
+
+static int cmp_pos(const void* a, const void* b){
+	const char* x = ((const profile_token_pos*) a)->str;
+	const char* y = ((const profile_token_pos*) b)->str;
+	return (x > y) - (x < y);
+}
+
+static size_t token_order(const profile_token_pos* positions, size_t count, const token* tk){
+	if(!tk)
+		return SIZE_MAX;
+	if(tk >= tk_array.tks && tk < tk_array.tks + tk_array.size)
+		return tk - tk_array.tks;
+	size_t lo = 0, hi = count;
+	while(lo < hi){
+		size_t mid = (lo + hi) / 2;
+		if(positions[mid].str < tk->str)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < count && positions[lo].str == tk->str) ? positions[lo].index : SIZE_MAX;
+}
+
+static int cmp_order(const void* a, const void* b){
+	size_t x = ((const profile_sample_t*) a)->order, y = ((const profile_sample_t*) b)->order;
+	return (x > y) - (x < y);
+}
+
+static int cmp_stack(const void* a, const void* b){
+	return strcmp(((const profile_sample_t*) a)->stack, ((const profile_sample_t*) b)->stack);
+}
+
+static const char* leaf(const char* stack){
+	const char* last = strrchr(stack, ';');
+	return last ? last + 1 : stack;
+}
+
+static int cmp_leaf(const void* a, const void* b){
+	return strcmp(leaf(((const profile_sample_t*) a)->stack), leaf(((const profile_sample_t*) b)->stack));
+}
+
+static int cmp_hits(const void* a, const void* b){
+	uint64_t x = ((const profile_sample_t*) a)->hits + ((const profile_sample_t*) a)->jit_hits;
+	uint64_t y = ((const profile_sample_t*) b)->hits + ((const profile_sample_t*) b)->jit_hits;
+	return (x < y) - (x > y);
+}
+
+// Merges neighbours that compare equal, summing their hits
+static size_t merge_samples(profile_sample_t* samples, size_t count, int (*cmp)(const void*, const void*)){
+	size_t out = 0;
+	for(size_t i = 0; i < count; i++){
+		if(out && !cmp(&samples[out-1], &samples[i])){
+			samples[out-1].hits += samples[i].hits;
+			samples[out-1].jit_hits += samples[i].jit_hits;
+			free(samples[i].stack);
+		}else
+			samples[out++] = samples[i];
+	}
+	return out;
+}
+
+// Writes the folded stacks (one "frame;frame count" per line,
+// as flame graph tools expect) and prints the hits of every line
+bool profile_report(bc_chunk* chunk){
+	if(!hits)
+		return false;
+	bool success = true;
+	size_t count = 0;
+	uint64_t total = outside_hits;
+	profile_sample_t* samples = (profile_sample_t*) malloc((code_size ? code_size : 1) * sizeof(profile_sample_t));
+	profile_token_pos* positions = (profile_token_pos*) malloc((tk_array.size ? tk_array.size : 1) * sizeof(profile_token_pos));
+	if(!samples || !positions){
+		success = false;
+		goto done;
+	}
+	for(size_t i = 0; i < tk_array.size; i++)
+		positions[i] = (profile_token_pos){tk_array.tks[i].str, i};
+	qsort(positions, tk_array.size, sizeof(profile_token_pos), cmp_pos);
+	for(size_t pc = 0; pc < code_size; pc++){
+		if(!hits[pc] && !jit_hits[pc])
+			continue;
+		// Jumps and scope instructions have no token of their own
+		const token* tk = NULL;
+		for(size_t i = pc + 1; i > 0 && !tk; i--)
+			tk = chunk->tokens.tks[i-1];
+		for(size_t i = pc + 1; i < code_size && !tk; i++)
+			tk = chunk->tokens.tks[i];
+		samples[count++] = (profile_sample_t){token_order(positions, tk_array.size, tk), tk, hits[pc], jit_hits[pc], NULL};
+		total += hits[pc] + jit_hits[pc];
+	}
+
+	// Tokens between an include and its end come from the included file,
+	// so one pass over the tokens gives the include chain of every sample
+	qsort(samples, count, sizeof(profile_sample_t), cmp_order);
+	typedef DYNAMIC_ARRAY(token** tks) include_stack;
+	include_stack includes = NEW_DYNAMIC_ARRAY(sizeof(token*));
+	size_t s = 0;
+	for(size_t i = 0; i < tk_array.size && s < count; i++){
+		token* tk = &tk_array.tks[i];
+		if(tk->type == tk_include && !dynamic_array_pushback((dynamic_array_t*)&includes, &tk))
+			success = false;
+		else if(tk->type == tk_end_include && includes.size)
+			includes.size--;
+		for(; s < count && samples[s].order == i; s++){
+			size_t len = 0;
+			for(size_t j = 0; j < includes.size; j++)
+				success = append_frame(&samples[s].stack, &len, includes.tks[j]) && success;
+			success = append_frame(&samples[s].stack, &len, samples[s].tk) && success;
+		}
+	}
+	dynamic_array_free((dynamic_array_t*)&includes);
+	for(; s < count; s++){
+		size_t len = 0;
+		success = append_frame(&samples[s].stack, &len, samples[s].tk) && success;
+	}
+	if(!success)
+		goto done;
+
+	qsort(samples, count, sizeof(profile_sample_t), cmp_stack);
+	count = merge_samples(samples, count, cmp_stack);
+	FILE* out = fopen(profile_path, "w");
+	if(!out){
+		fprintf(stderr, "profile: cannot open %s\n", profile_path);
+		success = false;
+		goto done;
+	}
+	for(size_t i = 0; i < count; i++){
+		if(samples[i].hits)
+			fprintf(out, "%s %llu\n", samples[i].stack, (unsigned long long) samples[i].hits);
+		if(samples[i].jit_hits)
+			fprintf(out, "%s;[jit] %llu\n", samples[i].stack, (unsigned long long) samples[i].jit_hits);
+	}
+	if(outside_hits)
+		fprintf(out, "[runtime] %llu\n", (unsigned long long) outside_hits);
+	success = !fclose(out);
+
+	fprintf(stderr, "profile: %llu samples at %d Hz, folded stacks written to %s\n",
+		(unsigned long long) total, PROFILE_HZ, profile_path);
+	qsort(samples, count, sizeof(profile_sample_t), cmp_leaf);
+	count = merge_samples(samples, count, cmp_leaf);
+	qsort(samples, count, sizeof(profile_sample_t), cmp_hits);
+	fprintf(stderr, "%10s %10s %7s  %s\n", "hits", "jit", "%", "line");
+	for(size_t i = 0; i < count; i++){
+		uint64_t line_hits = samples[i].hits + samples[i].jit_hits;
+		fprintf(stderr, "%10llu %10llu %6.2f%%  %s\n", (unsigned long long) line_hits,
+			(unsigned long long) samples[i].jit_hits, total ? 100.0 * line_hits / total : 0.0, leaf(samples[i].stack));
+	}
+
+done:
+	for(size_t i = 0; samples && i < count; i++)
+		free(samples[i].stack);
+	free(samples);
+	free(positions);
+	for(size_t i = 0; i < line_cache.size; i++)
+		dynamic_array_free((dynamic_array_t*)&line_cache.files[i].newlines);
+	dynamic_array_free((dynamic_array_t*)&line_cache);
+	free(hits);
+	free(jit_hits);
+	hits = jit_hits = NULL;
+	return success;
+}
@@ -0,0 +1,27 @@
+#ifndef FERRO_PROFILE_H
+#define FERRO_PROFILE_H
+
+#include <signal.h>
+
+#include "bytecode.h"
+
+// Sampling profiler (--profile)
+// A SIGPROF timer interrupts the program PROFILE_HZ times per second of
+// CPU time, and the handler counts a hit for the instruction the VM is on
+// Hits are mapped back to file:line (through the include chain) only
+// once the program ends, so sampling costs a store per instruction
+#define PROFILE_HZ 1000
+#define PROFILE_DEFAULT_PATH "ferro.folded"
+
+extern const char* profile_path;		// Folded stacks output, NULL when off
+
+// Instruction being executed, and whether it is a loop running as JIT code
+// (per thread, parallel for loops run on the calling thread while profiling)
+extern FL_LOCAL const bc_insn* volatile profile_ip;
+extern volatile sig_atomic_t profile_in_jit;
+
+bool profile_start(bc_chunk*);
+void profile_stop(void);
+bool profile_report(bc_chunk*);
+
+#endif
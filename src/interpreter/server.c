@@ -0,0 +1,470 @@
+#include "server.h"
+#include "compiler.h"
+#include "optimizer.h"
+#include "vm.h"
+#include "../FL/textstyle.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// What a file looked like on disk when it was loaded
+typedef struct{
+	file_t* file;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	bool exists;
+} serve_stamp;
+
+typedef DYNAMIC_ARRAY(file_t** files) serve_file_list;
+
+// A compiled program with everything its bytecode points into
+typedef struct{
+	char* cwd;
+	char* script;
+	serve_file_list deps;		// Script and headers
+	uint64_t last_used;
+	tk_array_t tokens;
+	macro_array_t macros;
+	tk_use_list uses;			// Copies of macro bodies the tree points into
+	node_prog prog;
+	parser_arena_list arenas;
+	bc_chunk chunk;
+} serve_program;
+
+// Script running for a client still waiting for its exit status
+typedef struct{
+	pid_t pid;
+	int client;
+} serve_pending;
+
+typedef DYNAMIC_ARRAY(serve_stamp* stamps) serve_stamp_list;
+typedef DYNAMIC_ARRAY(serve_program** programs) serve_program_list;
+typedef DYNAMIC_ARRAY(serve_pending* pending) serve_pending_list;
+
+static serve_stamp_list stamps = NEW_DYNAMIC_ARRAY(sizeof(serve_stamp));
+static serve_program_list programs = NEW_DYNAMIC_ARRAY(sizeof(serve_program*));
+static serve_pending_list pending = NEW_DYNAMIC_ARRAY(sizeof(serve_pending));
+static uint64_t serve_uses = 0;
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};		// Written by the signal handlers
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig){
+	int saved = errno;
+	if(sig != SIGCHLD)
+		serve_stop = 1;
+	(void) !write(wake_pipe[1], "", 1);
+	errno = saved;
+}
+
+static void stamp_file(serve_stamp* stamp){
+	struct stat st;
+	stamp->exists = !stat(stamp->file->path, &st);
+	if(stamp->exists){
+		stamp->dev = st.st_dev;
+		stamp->ino = st.st_ino;
+		stamp->size = st.st_size;
+		stamp->mtime = st.st_mtim;
+	}
+}
+
+static bool stamp_changed(serve_stamp* stamp){
+	struct stat st;
+	if(stat(stamp->file->path, &st))
+		return stamp->exists;
+	return !stamp->exists || st.st_dev != stamp->dev || st.st_ino != stamp->ino || st.st_size != stamp->size
+		|| st.st_mtim.tv_sec != stamp->mtime.tv_sec || st.st_mtim.tv_nsec != stamp->mtime.tv_nsec;
+}
+
+static serve_stamp* find_stamp(file_t* file){
+	for(size_t i = 0; i < stamps.size; i++)
+		if(stamps.stamps[i].file == file)
+			return &stamps.stamps[i];
+	return NULL;
+}
+
+static void free_program(serve_program* program){
+	bc_free(&program->chunk);
+	dynamic_array_free((dynamic_array_t*)&program->prog);
+	parser_free_arenas(&program->arenas);
+	dynamic_array_free((dynamic_array_t*)&program->tokens);
+	dynamic_array_free((dynamic_array_t*)&program->macros);
+	tk_free_uses(&program->uses);
+	dynamic_array_free((dynamic_array_t*)&program->deps);
+	free(program->cwd);
+	free(program->script);
+	free(program);
+}
+
+static void drop_program(size_t i){
+	free_program(programs.programs[i]);
+	programs.programs[i] = programs.programs[--programs.size];
+}
+
+static bool program_depends(serve_program* program, file_t* file){
+	for(size_t i = 0; i < program->deps.size; i++)
+		if(program->deps.files[i] == file)
+			return true;
+	return false;
+}
+
+// Drops the programs built from a changed file and loads it again
+// A file that is gone stays closed until something includes it again
+static void refresh_file(serve_stamp* stamp){
+	for(size_t i = programs.size; i-- > 0;)
+		if(program_depends(programs.programs[i], stamp->file))
+			drop_program(i);
+	stamp_file(stamp);
+	if(!stamp->exists || !load_file(stamp->file))
+		close_file(stamp->file);
+}
+
+// Checks the files of (program), or every loaded file if NULL
+static void refresh_files(serve_program* program){
+	if(!program){
+		for(size_t i = 0; i < stamps.size; i++)
+			if(stamp_changed(&stamps.stamps[i]))
+				refresh_file(&stamps.stamps[i]);
+		return;
+	}
+	// (program) itself is dropped on the first change,
+	// then every other file is checked too
+	for(size_t i = 0; i < program->deps.size; i++){
+		serve_stamp* stamp = find_stamp(program->deps.files[i]);
+		if(stamp && stamp_changed(stamp)){
+			refresh_file(stamp);
+			refresh_files(NULL);
+			return;
+		}
+	}
+}
+
+// Cached program of (script) run from (cwd), still up to date
+static serve_program* find_program(const char* cwd, const char* script){
+	for(size_t i = 0; i < programs.size; i++){
+		serve_program* program = programs.programs[i];
+		if(!strcmp(program->cwd, cwd) && !strcmp(program->script, script)){
+			refresh_files(program);
+			// Dropped if it changed
+			return (i < programs.size && programs.programs[i] == program) ? program : NULL;
+		}
+	}
+	refresh_files(NULL);
+	return NULL;
+}
+
+static bool add_dep(serve_program* program, file_t* file){
+	if(!file || program_depends(program, file))
+		return true;
+	if(!dynamic_array_pushback((dynamic_array_t*)&program->deps, &file))
+		return false;
+	if(!find_stamp(file)){
+		serve_stamp stamp = {file, 0, 0, 0, {0, 0}, false};
+		stamp_file(&stamp);
+		if(!dynamic_array_pushback((dynamic_array_t*)&stamps, &stamp))
+			return false;
+	}
+	return true;
+}
+
+// Takes the front end state of a compiled program and caches it (freed
+// if that fails), making room by dropping the least recently used program
+static serve_program* keep_program(const char* cwd, const char* script, file_t* file, node_prog* prog, bc_chunk* chunk){
+	serve_program* program = (serve_program*) malloc(sizeof(serve_program));
+	if(!program){
+		bc_free(chunk);
+		parser_free(prog);
+		return NULL;
+	}
+	*program = (serve_program){
+		strdup(cwd), strdup(script), NEW_DYNAMIC_ARRAY(sizeof(file_t*)), 0,
+		tk_array, macro_array, tk_uses, *prog, NEW_DYNAMIC_ARRAY(sizeof(arena_t)), *chunk
+	};
+	tk_array = (tk_array_t) NEW_DYNAMIC_ARRAY(sizeof(token));
+	macro_array = (macro_array_t) NEW_DYNAMIC_ARRAY(sizeof(macro));
+	tk_uses = (tk_use_list) NEW_DYNAMIC_ARRAY(sizeof(tk_use));
+	parser_take_arenas(&program->arenas);
+
+	bool success = program->cwd && program->script && add_dep(program, file);
+	for(size_t i = 0; success && i < program->tokens.size; i++)
+		if(program->tokens.tks[i].type == tk_include)
+			success = add_dep(program, find_file(program->tokens.tks[i].str, program->tokens.tks[i].strlen));
+	if(success && programs.size >= SERVE_MAX_PROGRAMS){
+		size_t oldest = 0;
+		for(size_t i = 1; i < programs.size; i++)
+			if(programs.programs[i]->last_used < programs.programs[oldest]->last_used)
+				oldest = i;
+		drop_program(oldest);
+	}
+	if(!success || !dynamic_array_pushback((dynamic_array_t*)&programs, &program)){
+		free_program(program);
+		return NULL;
+	}
+	return program;
+}
+
+// Builds (script), diagnostics go to the client's stdout (out)
+static serve_program* build_program(const char* cwd, const char* script, int out){
+	int log_fd = dup(out);
+	FILE* log = (log_fd >= 0) ? fdopen(log_fd, "w") : NULL;
+	if(!log && log_fd >= 0)
+		close(log_fd);
+	fl_output = log;
+
+	serve_program* program = NULL;
+	char* path = strdup(script);
+	file_t* file = path ? open_file(path) : NULL;
+	if(file && tokenize(file)){
+		node_prog prog;
+		bc_chunk chunk = NEW_BC_CHUNK();
+		bool built = parse(&prog, file) && compile(&chunk, &prog);
+		// Optimized like ferro_interpreter does, once per cached program
+		if(built && opt_any() && optimize(&prog)){
+			bc_free(&chunk);
+			built = compile(&chunk, &prog);
+		}
+		if(!built){
+			bc_free(&chunk);
+			parser_free(&prog);
+		}else if(!(program = keep_program(cwd, script, file, &prog, &chunk)))
+			fprintf(FL_OUTPUT, "serve: failed to cache %s\n", script);
+	}
+	parser_free(NULL);
+	tk_free();
+
+	fl_output = NULL;
+	if(log)
+		fclose(log);
+	return program;
+}
+
+static void reply(int client, int32_t status){
+	(void) send(client, &status, sizeof(status), MSG_NOSIGNAL);
+	close(client);
+}
+
+// Runs in the forked process, never returns
+static void run_program(serve_program* program, int fds[3], const char* options, const char* end, serve_option_fn apply){
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+	close(listen_fd);
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	for(size_t i = 0; i < pending.size; i++)
+		close(pending.pending[i].client);
+	for(int i = 0; i < 3; i++)
+		if(dup2(fds[i], i) < 0)
+			_exit(EXIT_FAILURE);
+
+	for(; options < end; options += strlen(options) + 1){
+		const char* error = NULL;
+		if(!apply(options, &error) || error){
+			printf(BOLD YELLOW_FG "! %s" RESET_ATTR " %s\n", error ? error : "Invalid argument", options);
+			fflush(stdout);
+			_exit(EXIT_FAILURE);
+		}
+	}
+
+	// Runtime errors look up their macro expansions
+	tk_array = program->tokens;
+	macro_array = program->macros;
+	tk_uses = program->uses;
+	int status = vm_run(&program->chunk);
+	fflush(NULL);
+	_exit(status);
+}
+
+// Reads a request and its fds, (payload) is NUL terminated
+static bool receive_request(int client, int fds[3], char** payload, uint32_t* size){
+	uint32_t length = 0;
+	size_t got = 0;
+	union{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(3 * sizeof(int))];
+	} control;
+	struct iovec iov = {&length, sizeof(length)};
+	struct msghdr msg = {0};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	ssize_t n = recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+	if(n <= 0)
+		return false;
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+		return false;
+	memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+	for(got = n; got < sizeof(length); got += n)
+		if((n = recv(client, (char*)&length + got, sizeof(length) - got, 0)) <= 0)
+			return false;
+	if(!length || length > SERVE_MAX_REQUEST || !(*payload = (char*) malloc(length + 1)))
+		return false;
+	for(got = 0; got < length; got += n)
+		if((n = recv(client, *payload + got, length - got, 0)) <= 0)
+			return false;
+	(*payload)[length] = '\0';
+	*size = length;
+	return true;
+}
+
+static void serve_client(int client, serve_option_fn apply){
+	int fds[3] = {-1, -1, -1};
+	char* payload = NULL;
+	uint32_t size = 0;
+	struct timeval timeout = {2, 0};	// A client never blocks the server for long
+	(void) setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if(!receive_request(client, fds, &payload, &size) || payload[size-1]){
+		if(fds[1] >= 0)
+			dprintf(fds[1], "serve: invalid request\n");
+		reply(client, EXIT_FAILURE);
+		goto done;
+	}
+	const char* cwd = payload;
+	const char* script = cwd + strlen(cwd) + 1;
+	const char* options = (script < payload + size) ? script + strlen(script) + 1 : script;
+	if(script >= payload + size || !*script || chdir(cwd)){
+		dprintf(fds[1], "serve: invalid working directory or script\n");
+		reply(client, EXIT_FAILURE);
+		goto done;
+	}
+
+	serve_program* program = find_program(cwd, script);
+	if(!program && !(program = build_program(cwd, script, fds[1]))){
+		reply(client, EXIT_FAILURE);
+		goto done;
+	}
+	program->last_used = ++serve_uses;
+
+	fflush(NULL);
+	serve_pending job = {fork(), client};
+	if(!job.pid)
+		run_program(program, fds, options, payload + size, apply);
+	if(job.pid < 0 || !dynamic_array_pushback((dynamic_array_t*)&pending, &job)){
+		dprintf(fds[1], "serve: failed to start %s\n", script);
+		reply(client, EXIT_FAILURE);
+	}
+
+done:
+	for(int i = 0; i < 3; i++)
+		if(fds[i] >= 0)
+			close(fds[i]);
+	free(payload);
+}
+
+// Sends the exit status of every finished script to its client
+// False once there is no child left to wait for
+static bool reap(int flags){
+	int wstatus;
+	pid_t pid;
+	while((pid = waitpid(-1, &wstatus, flags)) > 0){
+		int32_t status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+		for(size_t i = 0; i < pending.size; i++)
+			if(pending.pending[i].pid == pid){
+				reply(pending.pending[i].client, status);
+				pending.pending[i] = pending.pending[--pending.size];
+				break;
+			}
+	}
+	return pid == 0;
+}
+
+// Binds (path), replacing a socket no server listens on anymore
+static int serve_listen(const char* path){
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)){
+		printf("serve: socket path %s is too long\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0){
+		perror("serve: socket");
+		return -1;
+	}
+	if(!connect(fd, (struct sockaddr*)&addr, sizeof(addr))){
+		printf("serve: a server is already listening on %s\n", path);
+		close(fd);
+		return -1;
+	}
+	if(errno == ECONNREFUSED)
+		unlink(path);
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)){
+		printf("serve: failed to listen on %s\n%s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Serves requests on the Unix socket at (path) until SIGINT / SIGTERM
+int serve_run(const char* path, serve_option_fn apply){
+	file_resolve_paths = true;
+	if(pipe(wake_pipe) || (listen_fd = serve_listen(path)) < 0)
+		return EXIT_FAILURE;
+	for(int i = 0; i < 2; i++){
+		fcntl(wake_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(wake_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	struct sigaction action = {0};
+	action.sa_handler = serve_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGCHLD, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf(GREEN_FG BOLD "serve: listening on %s" RESET_ATTR "\n", path);
+	fflush(stdout);
+	while(!serve_stop){
+		struct pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+		if(poll(fds, 2, -1) < 0){
+			if(errno == EINTR)
+				continue;
+			perror("serve: poll");
+			break;
+		}
+		if(fds[1].revents & POLLIN){
+			char drain[64];
+			while(read(wake_pipe[0], drain, sizeof(drain)) > 0);
+			reap(WNOHANG);
+		}
+		if(fds[0].revents & POLLIN){
+			int client = accept(listen_fd, NULL, NULL);
+			if(client >= 0){
+				fcntl(client, F_SETFD, FD_CLOEXEC);
+				serve_client(client, apply);
+			}
+		}
+	}
+
+	// Running scripts still answer their clients
+	close(listen_fd);
+	unlink(path);
+	while(pending.size && reap(0));
+	for(size_t i = 0; i < programs.size; i++)
+		free_program(programs.programs[i]);
+	dynamic_array_free((dynamic_array_t*)&programs);
+	dynamic_array_free((dynamic_array_t*)&stamps);
+	dynamic_array_free((dynamic_array_t*)&pending);
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	free_file_list();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+#ifndef FERRO_SERVER_H
+#define FERRO_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Resident mode (--serve=<socket>), driven by ferro_client
+// Compiled programs stay cached, keyed by working directory and script,
+// and every request forks a process running the cached bytecode on the
+// client's own stdin, stdout and stderr
+// Files a program was built from are checked (stat) before it is reused:
+// a change drops every program depending on the file and reloads it
+//
+// A request is a uint32_t length followed by that many bytes of NUL
+// terminated strings: the client's working directory, the absolute path
+// of the script and then its runtime options
+// The client's fds 0, 1 and 2 come along with it (SCM_RIGHTS)
+// The reply is the int32_t exit status of the script
+#define SERVE_MAX_REQUEST (64*1024)
+#define SERVE_MAX_PROGRAMS 256
+
+// Applies a runtime option in the process running a script
+// Returns false if (arg) is not one, sets (error) if its value is invalid
+typedef bool (*serve_option_fn)(const char* arg, const char** error);
+
+int serve_run(const char*, serve_option_fn);
+
+#endif
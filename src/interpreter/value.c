@@ -0,0 +1,138 @@
+#include "value.h"
+
+static const char* const var_type_names[] = {
+	"char", "u8", "i8", "u16", "i16", "u32", "i32",
+	"u64", "i64", "f32", "f64", "str", "bool", "list", "dict", "none"
+};
+
+var_type var_type_from_token(token_t type){
+	switch(type){
+	case tk_char: return var_char;
+	case tk_i8: return var_i8;
+	case tk_u8: return var_u8;
+	case tk_i16: return var_i16;
+	case tk_u16: return var_u16;
+	case tk_i32: return var_i32;
+	case tk_u32: return var_u32;
+	case tk_i64: return var_i64;
+	case tk_u64: return var_u64;
+	case tk_f32: return var_f32;
+	case tk_f64: return var_f64;
+	case tk_str: return var_str;
+	case tk_bool: return var_bool;
+	case tk_list: return var_list;
+	case tk_dict: return var_dict;
+	default: return var_none;
+	}
+}
+
+const char* var_type_name(var_type type){
+	return (VAR_TYPE(type) <= var_none) ? var_type_names[VAR_TYPE(type)] : "invalid";
+}
+
+// Floats convert to integers saturated to the target's range,
+// NaN converts to 0 (a plain C cast is undefined for both)
+static int64_t f64_to_i64(double f){
+	if(f != f)
+		return 0;
+	if(f <= (double) INT64_MIN)
+		return INT64_MIN;
+	if(f >= 9223372036854775808.0)
+		return INT64_MAX;
+	return (int64_t) f;
+}
+
+static uint64_t f64_to_u64(double f){
+	if(!(f > 0.0))
+		return 0;
+	if(f >= 18446744073709551616.0)
+		return UINT64_MAX;
+	return (uint64_t) f;
+}
+
+static int64_t saturate(int64_t i, int64_t min, int64_t max){
+	return (i < min) ? min : (i > max) ? max : i;
+}
+
+int64_t value_as_i64(value_t v){
+	switch(v.type){
+	case var_f32: return f64_to_i64(v.f32);
+	case var_f64: return f64_to_i64(v.f);
+	case var_bool: return v.b;
+	default: return v.i;
+	}
+}
+
+double value_as_f64(value_t v){
+	switch(v.type){
+	case var_f32: return v.f32;
+	case var_f64: return v.f;
+	case var_bool: return v.b;
+	default: return VAR_IS_UNSIGNED(v.type) ? (double) v.u : (double) v.i;
+	}
+}
+
+// Converts a value to another type, wrapping integers to its width
+// and saturating floats to its range
+// Returns false if the conversion is not possible (e.g. i32 to str)
+bool value_cast(value_t* v, var_type type){
+	type = VAR_TYPE(type);
+	if(v->type == type)
+		return true;
+	if(type >= var_str && type != var_bool)
+		return false;
+	if(v->type >= var_str && v->type != var_bool)
+		return false;
+	value_t r = {.type = type};
+	if(VAR_IS_FLOAT(v->type) && VAR_IS_INT(type)){
+		switch(type){
+		case var_char:
+		case var_i8: r.i = saturate(value_as_i64(*v), INT8_MIN, INT8_MAX); break;
+		case var_u8: r.i = saturate(value_as_i64(*v), 0, UINT8_MAX); break;
+		case var_i16: r.i = saturate(value_as_i64(*v), INT16_MIN, INT16_MAX); break;
+		case var_u16: r.i = saturate(value_as_i64(*v), 0, UINT16_MAX); break;
+		case var_i32: r.i = saturate(value_as_i64(*v), INT32_MIN, INT32_MAX); break;
+		case var_u32: r.i = saturate(value_as_i64(*v), 0, UINT32_MAX); break;
+		case var_u64: r.u = f64_to_u64(value_as_f64(*v)); break;
+		default: r.i = value_as_i64(*v);
+		}
+		*v = r;
+		return true;
+	}
+	switch(type){
+	case var_char:
+	case var_i8: r.i = (int8_t) value_as_i64(*v); break;
+	case var_u8: r.i = (uint8_t) value_as_i64(*v); break;
+	case var_i16: r.i = (int16_t) value_as_i64(*v); break;
+	case var_u16: r.i = (uint16_t) value_as_i64(*v); break;
+	case var_i32: r.i = (int32_t) value_as_i64(*v); break;
+	case var_u32: r.i = (uint32_t) value_as_i64(*v); break;
+	case var_i64: r.i = value_as_i64(*v); break;
+	case var_u64: r.u = (uint64_t) value_as_i64(*v); break;
+	case var_f32: r.f32 = (float) value_as_f64(*v); break;
+	case var_f64: r.f = value_as_f64(*v); break;
+	case var_bool: r.b = VAR_IS_FLOAT(v->type) ? value_as_f64(*v) != 0.0 : v->i != 0; break;
+	default: return false;
+	}
+	*v = r;
+	return true;
+}
+
+// Converts two numeric operands to a common tag
+// Mismatched integers become i64, or u64 if both are unsigned or one is
+// u64 (as in C, a u64 mixed with a signed integer stays unsigned),
+// anything mixed with a float becomes f64
+bool value_promote(value_t* a, value_t* b){
+	if(a->type == b->type)
+		return true;
+	if(a->type >= var_str || b->type >= var_str)
+		return false;
+	var_type type;
+	if(VAR_IS_FLOAT(a->type) || VAR_IS_FLOAT(b->type))
+		type = var_f64;
+	else if((VAR_IS_UNSIGNED(a->type) && VAR_IS_UNSIGNED(b->type)) || a->type == var_u64 || b->type == var_u64)
+		type = var_u64;
+	else
+		type = var_i64;
+	return value_cast(a, type) && value_cast(b, type);
+}
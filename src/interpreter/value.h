@@ -0,0 +1,179 @@
+#ifndef FERRO_VALUE_H
+#define FERRO_VALUE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "../FL/tokenizer.h"
+
+enum{
+	var_char = 0,
+	var_u8,
+	var_i8,
+	var_u16,
+	var_i16,
+	var_u32,
+	var_i32,
+	var_u64,
+	var_i64,
+	var_f32,
+	var_f64,
+	var_str,
+	var_bool,
+	var_list,
+	var_dict,
+	var_none,
+	var_const = 0x80
+};
+#define VAR_TYPE(x) ((x) & 0x7F)
+#define VAR_CONST(x) ((x) & 0x80)
+#define VAR_IS_FLOAT(x) (VAR_TYPE(x) == var_f32 || VAR_TYPE(x) == var_f64)
+#define VAR_IS_UNSIGNED(x) (VAR_TYPE(x) == var_u8 || VAR_TYPE(x) == var_u16 || VAR_TYPE(x) == var_u32 || VAR_TYPE(x) == var_u64)
+#define VAR_IS_INT(x) (VAR_TYPE(x) <= var_i64)
+#define VAR_IS_COUNTED(x) (VAR_TYPE(x) == var_str || VAR_TYPE(x) == var_list || VAR_TYPE(x) == var_dict)
+
+typedef uint8_t var_type;
+
+struct list_block;
+struct dict_block;
+
+// Tagged runtime value, always 16 bytes and never boxed
+// Integers are kept sign / zero extended to 64 bits,
+// so values of the same tag compare and combine directly
+// A str is either a view (source literals), stored inline
+// if it is short enough, or a reference counted heap block
+// list and dict always point to a counted block (see containers.h)
+typedef struct{
+	union{
+		int64_t i;
+		uint64_t u;
+		double f;
+		float f32;
+		bool b;
+		const char* str;
+		char inline_str[8];
+		struct list_block* list;
+		struct dict_block* dict;
+		uint32_t* refs;		// Reference count of a list / dict block
+	};
+	uint32_t len;		// Length of str
+	var_type type;
+	uint8_t flags;
+	uint16_t reserved;
+} value_t;
+
+// value_t flags
+#define VALUE_REF 0x01		// Holds a counted reference to a heap block
+#define VALUE_INLINE 0x02	// str bytes live in inline_str
+#define VALUE_INLINE_MAX 8
+
+_Static_assert(sizeof(value_t) == 16, "value_t should be 16 bytes");
+
+#define VALUE_INT(_t, _v) ((value_t){.i = (_v), .type = (_t)})
+#define VALUE_F64(_v) ((value_t){.f = (_v), .type = var_f64})
+#define VALUE_F32(_v) ((value_t){.f32 = (_v), .type = var_f32})
+#define VALUE_BOOL(_v) ((value_t){.b = (_v), .type = var_bool})
+#define VALUE_STR(_s, _l) ((value_t){.str = (_s), .len = (_l), .type = var_str})
+
+var_type var_type_from_token(token_t);
+const char* var_type_name(var_type);
+
+int64_t value_as_i64(value_t);
+double value_as_f64(value_t);
+bool value_cast(value_t*,var_type);
+bool value_promote(value_t*,value_t*);
+
+// Arithmetic helpers, one per integer tag
+// The operation runs on 64 bits and is wrapped to the tag's width
+// _signed guards the division by -1, which overflows for the minimum value
+#define VALUE_INT_HELPERS(_t, _ctype, _field, _signed) \
+	static inline value_t value_add_##_t(value_t a, value_t b){ return VALUE_INT(var_##_t, (_ctype)(a.u + b.u)); } \
+	static inline value_t value_sub_##_t(value_t a, value_t b){ return VALUE_INT(var_##_t, (_ctype)(a.u - b.u)); } \
+	static inline value_t value_mul_##_t(value_t a, value_t b){ return VALUE_INT(var_##_t, (_ctype)(a.u * b.u)); } \
+	static inline value_t value_neg_##_t(value_t a){ return VALUE_INT(var_##_t, (_ctype)(0 - a.u)); } \
+	static inline value_t value_shl_##_t(value_t a, value_t b){ return VALUE_INT(var_##_t, (_ctype)(a.u << (b.u & 63))); } \
+	static inline value_t value_band_##_t(value_t a, value_t b){ return VALUE_INT(var_##_t, (_ctype)(a.u & b.u)); } \
+	static inline value_t value_div_##_t(value_t a, value_t b){ \
+		if(_signed && b.i == -1) return value_neg_##_t(a); \
+		return VALUE_INT(var_##_t, (_ctype)((_ctype)a._field / (_ctype)b._field)); \
+	} \
+	static inline value_t value_mod_##_t(value_t a, value_t b){ \
+		if(_signed && b.i == -1) return VALUE_INT(var_##_t, 0); \
+		return VALUE_INT(var_##_t, (_ctype)((_ctype)a._field % (_ctype)b._field)); \
+	} \
+	static inline bool value_eq_##_t(value_t a, value_t b){ return a._field == b._field; } \
+	static inline bool value_lt_##_t(value_t a, value_t b){ return a._field < b._field; } \
+	static inline bool value_leq_##_t(value_t a, value_t b){ return a._field <= b._field; } \
+	static inline bool value_gt_##_t(value_t a, value_t b){ return a._field > b._field; } \
+	static inline bool value_geq_##_t(value_t a, value_t b){ return a._field >= b._field; }
+
+// Arithmetic helpers, one per floating point tag
+#define VALUE_FLOAT_HELPERS(_t, _ctype, _field) \
+	static inline value_t value_add_##_t(value_t a, value_t b){ return (value_t){._field = a._field + b._field, .type = var_##_t}; } \
+	static inline value_t value_sub_##_t(value_t a, value_t b){ return (value_t){._field = a._field - b._field, .type = var_##_t}; } \
+	static inline value_t value_mul_##_t(value_t a, value_t b){ return (value_t){._field = a._field * b._field, .type = var_##_t}; } \
+	static inline value_t value_div_##_t(value_t a, value_t b){ return (value_t){._field = a._field / b._field, .type = var_##_t}; } \
+	static inline value_t value_neg_##_t(value_t a){ return (value_t){._field = -a._field, .type = var_##_t}; } \
+	static inline bool value_eq_##_t(value_t a, value_t b){ return a._field == b._field; } \
+	static inline bool value_lt_##_t(value_t a, value_t b){ return a._field < b._field; } \
+	static inline bool value_leq_##_t(value_t a, value_t b){ return a._field <= b._field; } \
+	static inline bool value_gt_##_t(value_t a, value_t b){ return a._field > b._field; } \
+	static inline bool value_geq_##_t(value_t a, value_t b){ return a._field >= b._field; }
+
+VALUE_INT_HELPERS(char, int8_t, i, 1)
+VALUE_INT_HELPERS(i8, int8_t, i, 1)
+VALUE_INT_HELPERS(u8, uint8_t, u, 0)
+VALUE_INT_HELPERS(i16, int16_t, i, 1)
+VALUE_INT_HELPERS(u16, uint16_t, u, 0)
+VALUE_INT_HELPERS(i32, int32_t, i, 1)
+VALUE_INT_HELPERS(u32, uint32_t, u, 0)
+VALUE_INT_HELPERS(i64, int64_t, i, 1)
+VALUE_INT_HELPERS(u64, uint64_t, u, 0)
+VALUE_FLOAT_HELPERS(f32, float, f32)
+VALUE_FLOAT_HELPERS(f64, double, f)
+
+static inline value_t value_mod_f32(value_t a, value_t b){ return VALUE_F32(fmodf(a.f32, b.f32)); }
+static inline value_t value_mod_f64(value_t a, value_t b){ return VALUE_F64(fmod(a.f, b.f)); }
+
+static inline bool value_eq_bool(value_t a, value_t b){ return a.b == b.b; }
+static inline bool value_lt_bool(value_t a, value_t b){ return a.b < b.b; }
+static inline bool value_leq_bool(value_t a, value_t b){ return a.b <= b.b; }
+static inline bool value_gt_bool(value_t a, value_t b){ return a.b > b.b; }
+static inline bool value_geq_bool(value_t a, value_t b){ return a.b >= b.b; }
+
+static inline const char* value_str_data(const value_t* v){
+	return (v->flags & VALUE_INLINE) ? v->inline_str : v->str;
+}
+
+static inline int value_str_cmp(value_t a, value_t b){
+	int cmp = memcmp(value_str_data(&a), value_str_data(&b), (a.len < b.len) ? a.len : b.len);
+	return cmp ? cmp : (a.len > b.len) - (a.len < b.len);
+}
+static inline bool value_eq_str(value_t a, value_t b){ return a.len == b.len && !memcmp(value_str_data(&a), value_str_data(&b), a.len); }
+static inline bool value_lt_str(value_t a, value_t b){ return value_str_cmp(a, b) < 0; }
+static inline bool value_leq_str(value_t a, value_t b){ return value_str_cmp(a, b) <= 0; }
+static inline bool value_gt_str(value_t a, value_t b){ return value_str_cmp(a, b) > 0; }
+static inline bool value_geq_str(value_t a, value_t b){ return value_str_cmp(a, b) >= 0; }
+
+// Expand to the cases of a switch over the integer / numeric tags,
+// calling the helper specialized for each tag
+#define VALUE_INT_CASES(_helper, ...) \
+	case var_char: _helper(char, __VA_ARGS__); break; \
+	case var_i8: _helper(i8, __VA_ARGS__); break; \
+	case var_u8: _helper(u8, __VA_ARGS__); break; \
+	case var_i16: _helper(i16, __VA_ARGS__); break; \
+	case var_u16: _helper(u16, __VA_ARGS__); break; \
+	case var_i32: _helper(i32, __VA_ARGS__); break; \
+	case var_u32: _helper(u32, __VA_ARGS__); break; \
+	case var_i64: _helper(i64, __VA_ARGS__); break; \
+	case var_u64: _helper(u64, __VA_ARGS__); break;
+#define VALUE_NUMERIC_CASES(_helper, ...) \
+	VALUE_INT_CASES(_helper, __VA_ARGS__) \
+	case var_f32: _helper(f32, __VA_ARGS__); break; \
+	case var_f64: _helper(f64, __VA_ARGS__); break;
+
+#endif
@@ -0,0 +1,80 @@
+#include "variables.h"
+#include "fstring.h"
+
+FL_LOCAL var_slot_stack var_slots = NEW_DYNAMIC_ARRAY(sizeof(variable_t));
+FL_LOCAL var_frame_stack var_frames = NEW_DYNAMIC_ARRAY(sizeof(size_t));
+
+// Opens the global scope
+bool setup_variables(uint16_t global_count){
+	return push_var_scope(global_count);
+}
+
+// Opens a new scope with (slots) empty variable slots
+bool push_var_scope(uint16_t slots){
+	size_t base = var_slots.size;
+	if(var_slots.memsize - var_slots.size < slots){
+		size_t memsize = var_slots.memsize ? var_slots.memsize : DYNAMIC_ARRAY_START;
+		while(memsize - var_slots.size < slots)
+			memsize = DYNAMIC_ARRAY_GROW(memsize);
+		variable_t* new_slots = (variable_t*) realloc(var_slots.slots, memsize * sizeof(variable_t));
+		if(!new_slots){
+			printf("variable slots: failed to allocate memory\n");
+			return false;
+		}
+		var_slots.slots = new_slots;
+		var_slots.memsize = memsize;
+	}
+	memset(var_slots.slots + base, 0, slots * sizeof(variable_t));
+	var_slots.size += slots;
+	if(!dynamic_array_pushback((dynamic_array_t*)&var_frames, &base)){
+		printf("variable scopes: %s\n", DS_ERROR_MSG);
+		return false;
+	}
+	return true;
+}
+
+// Closes the innermost scope, releasing the strings it holds
+void pop_var_scope(void){
+	if(!var_frames.size)
+		return;
+	size_t base = var_frames.bases[--var_frames.size];
+	for(size_t i = base; i < var_slots.size; i++)
+		value_release(var_slots.slots[i]);
+	var_slots.size = base;
+}
+
+// Resets a slot to the zero value of its type
+void declare_variable(variable_t* var, var_type type){
+	*var = (variable_t){.type = VAR_TYPE(type)};
+}
+
+// Starts the stacks of a worker thread on a copy of another thread's,
+// sharing the values it holds
+bool copy_variables(const var_slot_stack* slots, const var_frame_stack* frames){
+	var_slots.slots = (variable_t*) malloc((slots->size ? slots->size : 1) * sizeof(variable_t));
+	var_frames.bases = (size_t*) malloc((frames->size ? frames->size : 1) * sizeof(size_t));
+	if(!var_slots.slots || !var_frames.bases){
+		drop_variables();
+		return false;
+	}
+	memcpy(var_slots.slots, slots->slots, slots->size * sizeof(variable_t));
+	memcpy(var_frames.bases, frames->bases, frames->size * sizeof(size_t));
+	var_slots.size = var_slots.memsize = slots->size;
+	var_frames.size = var_frames.memsize = frames->size;
+	return true;
+}
+
+// Frees the stacks of a worker, the values are left to the thread they were copied from
+void drop_variables(void){
+	free(var_slots.slots);
+	free(var_frames.bases);
+	var_slots = (var_slot_stack) NEW_DYNAMIC_ARRAY(sizeof(variable_t));
+	var_frames = (var_frame_stack) NEW_DYNAMIC_ARRAY(sizeof(size_t));
+}
+
+void free_variables(void){
+	while(var_frames.size)
+		pop_var_scope();
+	dynamic_array_free((dynamic_array_t*)&var_frames);
+	dynamic_array_free((dynamic_array_t*)&var_slots);
+}
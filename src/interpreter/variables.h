@@ -8,79 +8,31 @@
 
 #include "../FL/datastructures.h"
 #include "../FL/tokenizer.h"
-
-enum{
-	var_char = 0,
-	var_u8,
-	var_i8,
-	var_u16,
-	var_i16,
-	var_u32,
-	var_i32,
-	var_u64,
-	var_i64,
-	var_str,
-	var_bool,
-	var_const = 0x80
-};
-#define VAR_TYPE(x) ((x) & 0x7F)
-#define VAR_CONST(x) ((x) & 0x80)
-
-typedef uint8_t var_type;
-
-typedef struct{
-	const char* str;
-	size_t size;
-} var_symbol;
-
-typedef struct{
-	void* value;
-	var_type type;
-} variable_t;
-
-typedef struct{
-	var_symbol name;
-	variable_t var;
-} var_pair;
-
-hashtable_t variables = (hashtable_t) NEW_HASHTABLE(10);
-
-static bool cmp_strlen(const char* str1, size_t strlen1, const char* str2, size_t strlen2){
-	if(strlen1 != strlen2)
-		return false;
-	for(size_t i = 0; i < strlen1; i++, str1++, str2++)
-		if(*str1 != *str2)
-			return false;
-	return true;
-}
-
-static bool cmp_var_pair(const void* a, const void* b){
-	return cmp_strlen(
-		((var_symbol*)a)->str, ((var_symbol*)a)->size,
-		((var_symbol*)b)->str, ((var_symbol*)b)->size
-	);
-}
-
-static size_t hash_var_pair(const void* p){
-	size_t result = ((var_symbol*)p)->size;
-	const char* str = ((var_symbol*)p)->str;
-	for(size_t i = 0; i < ((var_symbol*)p)->size; i++, str++)
-		result += *str;
-	return result;
-}
-
-bool setup_variables(){
-	if(!hashtable_setup(&variables, sizeof(var_pair))){
-		printf("variable table: %s\n", DS_ERROR_MSG);
-		return false;
-	}
-	variables.cmp_func = cmp_var_pair;
-	variables.hashing_func = hash_var_pair;
-	return true;
-}
-
-variable_t* get_variable(var_symbol name){
-
+#include "value.h"
+
+// Variables live unboxed in their slot, tagged with their type
+typedef value_t variable_t;
+
+// Variable slots of every open scope, stored contiguously
+// var_frames holds the index of the first slot of each scope depth
+// Every thread has its own, workers of a parallel for start on a copy
+// of the caller's
+typedef DYNAMIC_ARRAY(variable_t* slots) var_slot_stack;
+typedef DYNAMIC_ARRAY(size_t* bases) var_frame_stack;
+extern FL_LOCAL var_slot_stack var_slots;
+extern FL_LOCAL var_frame_stack var_frames;
+
+bool setup_variables(uint16_t);
+bool push_var_scope(uint16_t);
+void pop_var_scope(void);
+void declare_variable(variable_t*,var_type);
+bool copy_variables(const var_slot_stack*,const var_frame_stack*);
+void drop_variables(void);
+void free_variables(void);
+
+// Variable at a (scope depth, slot) pair resolved by the compiler
+static inline variable_t* get_variable(uint16_t depth, uint16_t slot){
+	return &var_slots.slots[var_frames.bases[depth] + slot];
 }
 
-#endif
\ No newline at end of file
+#endif
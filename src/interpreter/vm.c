@@ -0,0 +1,709 @@
+#include "vm.h"
+#include "fstring.h"
+#include "output.h"
+#include "input.h"
+#include "heap.h"
+#include "profile.h"
+#include "containers.h"
+#include "kernels.h"
+#include "pool.h"
+#include "aio.h"
+#ifdef FERRO_JIT
+#include "jit.h"
+#endif
+#include "../FL/textstyle.h"
+
+static int vm_error(bc_chunk* chunk, bc_insn* ip, const char* msg){
+	token* tk = chunk->tokens.tks[ip - chunk->code.insns];
+	(void) output_flush();
+	file_t* file = (tk && tk->str) ? find_file_ptr(tk->str) : NULL;
+	if(file){
+		char tmp[128];
+		snprintf(tmp, sizeof(tmp), "runtime error: %s", msg);
+		(void) tk_error(tmp, tk, file);
+	}else
+		printf("\n" RESET_ATTR RED_FG BOLD "runtime error: %s" RESET_ATTR "\n", msg);
+	return EXIT_FAILURE;
+}
+
+// A thread running bytecode: the main one, or a worker of a parallel for
+typedef struct{
+	bc_chunk* chunk;
+	value_t* regs;
+#ifdef FERRO_JIT
+	jit_state* jit;			// JIT code only runs on the main thread
+#endif
+	bool deferred;			// Errors are recorded, the main thread reports them
+	bc_insn* error_ip;
+	const char* error_msg;
+} vm_thread;
+
+static int vm_fail(vm_thread* thread, bc_insn* ip, const char* msg){
+	if(!thread->deferred)
+		return vm_error(thread->chunk, ip, msg);
+	thread->error_ip = ip;
+	thread->error_msg = msg;
+	return EXIT_FAILURE;
+}
+
+// Reads a line from stdin and converts it to the variable's type
+static const char* vm_input(variable_t* var){
+	const char* line;
+	size_t len;
+	(void) input_line(&line, &len);
+	value_t v;
+	switch(var->type){
+	case var_str:
+		v = str_new(line, len);
+		if(v.type == var_none)
+			return "failed to allocate input string";
+		break;
+	case var_char:
+		v = VALUE_INT(var_char, len ? line[0] : '\0');
+		break;
+	case var_bool:
+		v = VALUE_BOOL((len == 4 && !memcmp(line, "true", 4)) || input_parse_i64(line, len));
+		break;
+	case var_f32:
+	case var_f64:
+		v = VALUE_F64(input_parse_f64(line, len));
+		break;
+	default:
+		if(VAR_IS_UNSIGNED(var->type))
+			v = VALUE_INT(var_u64, input_parse_u64(line, len));
+		else
+			v = VALUE_INT(var_i64, input_parse_i64(line, len));
+	}
+	(void) value_cast(&v, var->type);
+	value_release(*var);
+	*var = v;
+	return NULL;
+}
+
+// Prints count values followed by a newline
+void vm_print(value_t* args, uint16_t count){
+	for(uint16_t i = 0; i < count; i++)
+		output_value(args[i]);
+	output_char('\n');
+}
+
+bool vm_putchar(const value_t* c){
+	if(VAR_IS_COUNTED(c->type))
+		return false;
+	output_char((char) value_as_i64(*c));
+	return true;
+}
+
+// Every dispatch publishes ip for the profiler's signal handler
+#ifdef VM_COMPUTED_GOTO
+#define VM_DISPATCH() { profile_ip = ip; goto *dispatch_table[ip->op]; }
+#define VM_CASE(x) do_##x
+#define VM_NEXT() { ip++; VM_DISPATCH(); }
+#else
+#define VM_DISPATCH() continue
+#define VM_CASE(x) case op_##x
+#define VM_NEXT() { ip++; continue; }
+#endif
+
+#define R(x) regs[(x)]
+// Registers own their value, so the one overwritten is released
+#define VM_SET(_r, _v) do{ value_t _old = R(_r); R(_r) = (_v); value_release(_old); }while(0)
+#define VM_ERROR(_msg) do{ status = vm_fail(thread, ip, (_msg)); goto done; }while(0)
+
+// Operands of binary instructions, both of the instruction's type
+// (the compiler converted them), so the helper is picked by ip->type
+#define VM_OPERANDS() \
+	value_t x = R(ip->b), y = R(ip->c)
+
+#define VM_ARITH_CASE(_t, _op) VM_SET(ip->a, value_##_op##_##_t(x, y))
+#define VM_ARITH(_op) { \
+		VM_OPERANDS(); \
+		switch(ip->type){ \
+		VALUE_NUMERIC_CASES(VM_ARITH_CASE, _op) \
+		default: VM_ERROR("invalid operands for arithmetic operation"); \
+		} \
+		VM_NEXT(); \
+	}
+
+#define VM_INT_ARITH(_op) { \
+		VM_OPERANDS(); \
+		switch(ip->type){ \
+		VALUE_INT_CASES(VM_ARITH_CASE, _op) \
+		default: VM_ERROR("invalid operands for bitwise operation"); \
+		} \
+		VM_NEXT(); \
+	}
+
+#define VM_CMP_CASE(_t, _cmp) result = value_##_cmp##_##_t(x, y)
+#define VM_CMP(_cmp, _negate) { \
+		VM_OPERANDS(); \
+		bool result; \
+		switch(ip->type){ \
+		VALUE_NUMERIC_CASES(VM_CMP_CASE, _cmp) \
+		case var_str: VM_CMP_CASE(str, _cmp); break; \
+		case var_bool: VM_CMP_CASE(bool, _cmp); break; \
+		default: VM_ERROR("invalid operands for comparison"); \
+		} \
+		VM_SET(ip->a, VALUE_BOOL(result != (_negate))); \
+		VM_NEXT(); \
+	}
+
+#define VM_LOGIC(_op) { \
+		VM_SET(ip->a, VALUE_BOOL(R(ip->b).b _op R(ip->c).b)); \
+		VM_NEXT(); \
+	}
+
+#define VM_NEG_CASE(_t, _unused) VM_SET(ip->a, value_neg_##_t(x))
+
+// Runs a loop matched by the compiler (bc_kernel_loop) with a kernel
+// Does nothing unless the index starts in the lists and they are long
+// enough, the loop then runs as compiled
+static void vm_kernel_loop(bc_kernel_loop* loop){
+	variable_t* index = get_variable(loop->index[0], loop->index[1]);
+	size_t n = get_variable(loop->bound[0], loop->bound[1])->list->size;
+	if(index->i < 0 || (uint64_t) index->i >= n)
+		return;
+	size_t start = index->i;
+	value_t end = VALUE_INT(var_i64, n);
+	if(!value_cast(&end, index->type) || end.u != n)
+		return;
+
+	variable_t* dst = get_variable(loop->dst[0], loop->dst[1]);
+	if(!KERNEL_IS_REDUCE(loop->op) && (dst->list->size < n || list_unshare(dst)))
+		return;
+	// Read after unsharing, dst may be one of them
+	list_block* a = get_variable(loop->a[0], loop->a[1])->list;
+	list_block* b = (loop->op == kernel_sum) ? NULL : get_variable(loop->b[0], loop->b[1])->list;
+	if(a->size < n || (b && b->size < n))
+		return;
+	const char* a_data = a->data + start * a->elem_size;
+	const char* b_data = b ? b->data + start * b->elem_size : NULL;
+	if(KERNEL_IS_REDUCE(loop->op)){
+		value_t sum = kernel_reduce(loop->op, loop->type, a_data, b_data, n - start);
+		value_t acc = VALUE_INT(var_u64, dst->u + sum.u);
+		(void) value_cast(&acc, dst->type);
+		*dst = acc;
+	}else if(!kernel_map(loop->op, loop->type, dst->list->data + start * dst->list->elem_size, a_data, b_data, n - start))
+		return;
+	*index = end;
+}
+
+static bool vm_pfor(vm_thread*,bc_insn*);
+
+// Runs from ip until the program ends, or the parallel for body it is in does
+// Returns the exit status
+static int vm_exec(vm_thread* thread, bc_insn* ip){
+	int status = EXIT_SUCCESS;
+	bc_chunk* chunk = thread->chunk;
+	value_t* regs = thread->regs;
+	value_t* consts = chunk->consts.values;
+#ifdef FERRO_JIT
+	jit_state* jit = thread->jit;
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+	static const void* const dispatch_table[op_count] = {
+		[op_halt] = &&do_halt,
+		[op_loadk] = &&do_loadk,
+		[op_move] = &&do_move,
+		[op_cast] = &&do_cast,
+		[op_decl] = &&do_decl,
+		[op_getvar] = &&do_getvar,
+		[op_setvar] = &&do_setvar,
+		[op_append] = &&do_append,
+		[op_new] = &&do_new,
+		[op_getindex] = &&do_getindex,
+		[op_setindex] = &&do_setindex,
+		[op_push] = &&do_push,
+		[op_pop] = &&do_pop,
+		[op_has] = &&do_has,
+		[op_remove] = &&do_remove,
+		[op_unshare] = &&do_unshare,
+		[op_len] = &&do_len,
+		[op_string] = &&do_string,
+		[op_reduce] = &&do_reduce,
+		[op_add] = &&do_add,
+		[op_sub] = &&do_sub,
+		[op_mul] = &&do_mul,
+		[op_div] = &&do_div,
+		[op_mod] = &&do_mod,
+		[op_shl] = &&do_shl,
+		[op_band] = &&do_band,
+		[op_neg] = &&do_neg,
+		[op_eq] = &&do_eq,
+		[op_neq] = &&do_neq,
+		[op_lt] = &&do_lt,
+		[op_leq] = &&do_leq,
+		[op_gt] = &&do_gt,
+		[op_geq] = &&do_geq,
+		[op_strict_eq] = &&do_strict_eq,
+		[op_type_eq] = &&do_type_eq,
+		[op_and] = &&do_and,
+		[op_or] = &&do_or,
+		[op_xor] = &&do_xor,
+		[op_push_scope] = &&do_push_scope,
+		[op_pop_scope] = &&do_pop_scope,
+		[op_jmp] = &&do_jmp,
+		[op_jmpf] = &&do_jmpf,
+		[op_loop] = &&do_loop,
+		[op_kernel] = &&do_kernel,
+		[op_pfor] = &&do_pfor,
+		[op_pfor_end] = &&do_pfor_end,
+		[op_print] = &&do_print,
+		[op_putchar] = &&do_putchar,
+		[op_input] = &&do_input,
+		[op_getchar] = &&do_getchar,
+		[op_flush] = &&do_flush,
+		[op_async] = &&do_async,
+		[op_await] = &&do_await,
+		[op_exit] = &&do_exit,
+	};
+	VM_DISPATCH();
+#else
+	for(;;) switch((profile_ip = ip)->op){
+#endif
+
+	// String constants are views, they are never counted
+	VM_CASE(loadk):
+		VM_SET(ip->a, consts[ip->b]);
+		VM_NEXT();
+	VM_CASE(move):
+		value_retain(R(ip->b));
+		VM_SET(ip->a, R(ip->b));
+		VM_NEXT();
+	VM_CASE(cast):{
+		value_t v = R(ip->b);
+		if(!value_cast(&v, ip->type))
+			VM_ERROR("invalid conversion");
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}
+	// decl and setvar move the value out of R[a], which is a temporary
+	VM_CASE(decl):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		value_release(*var);
+		declare_variable(var, ip->type);
+		if(ip->a != BC_NONE){
+			value_t v = R(ip->a);
+			if(!value_cast(&v, ip->type))
+				VM_ERROR("value does not match the variable's type");
+			*var = v;
+			R(ip->a) = (value_t){.type = var_none};
+		}
+		VM_NEXT();
+	}VM_CASE(getvar):{
+		value_t v = *get_variable(ip->b, ip->c);
+		value_retain(v);
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}VM_CASE(setvar):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		value_t v = R(ip->a);
+		if(!value_cast(&v, var->type))
+			VM_ERROR("value does not match the variable's type");
+		value_release(*var);
+		*var = v;
+		R(ip->a) = (value_t){.type = var_none};
+		VM_NEXT();
+	}VM_CASE(append):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		if(var->type != var_str || R(ip->a).type != var_str)
+			VM_ERROR("invalid operands for binary operation");
+		if(!str_append(var, R(ip->a)))
+			VM_ERROR("failed to allocate string");
+		VM_NEXT();
+	}
+	// Containers are modified through their variable, so a shared
+	// block is copied first (see containers.h)
+	VM_CASE(new):{
+		if(!container_elem_type(ip->b) || (ip->type == var_dict && !container_elem_type(ip->c)))
+			VM_ERROR("invalid element type");
+		value_t v = (ip->type == var_list) ? list_new(ip->b) : dict_new(ip->c, ip->b);
+		if(v.type == var_none)
+			VM_ERROR("failed to allocate container");
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}VM_CASE(getindex):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		value_t v;
+		const char* err = (var->type == var_list) ? list_get(*var, R(ip->a), &v) : dict_get(*var, R(ip->a), &v);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}VM_CASE(setindex):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		const char* err = (var->type == var_list) ? list_set(var, R(ip->a), R(ip->a+1)) : dict_set(var, R(ip->a), R(ip->a+1));
+		if(err)
+			VM_ERROR(err);
+		VM_NEXT();
+	}VM_CASE(push):{
+		const char* err = list_push(get_variable(ip->b, ip->c), R(ip->a));
+		if(err)
+			VM_ERROR(err);
+		VM_NEXT();
+	}VM_CASE(pop):{
+		value_t v;
+		const char* err = list_pop(get_variable(ip->b, ip->c), &v);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}VM_CASE(has):{
+		bool found;
+		const char* err = dict_has(*get_variable(ip->b, ip->c), R(ip->a), &found);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, VALUE_BOOL(found));
+		VM_NEXT();
+	}VM_CASE(remove):{
+		const char* err = dict_remove(get_variable(ip->b, ip->c), R(ip->a));
+		if(err)
+			VM_ERROR(err);
+		VM_NEXT();
+	}VM_CASE(unshare):{
+		const char* err = list_unshare(get_variable(ip->b, ip->c));
+		if(err)
+			VM_ERROR(err);
+		VM_NEXT();
+	}VM_CASE(len):{
+		value_t v = R(ip->b);
+		uint64_t len;
+		if(v.type == var_str)
+			len = v.len;
+		else if(v.type == var_list || v.type == var_dict)
+			len = container_size(v);
+		else
+			VM_ERROR("len expects a str, list or dict");
+		VM_SET(ip->a, VALUE_INT(var_i64, len));
+		VM_NEXT();
+	}VM_CASE(string):{
+		value_t v;
+		const char* err = str_call(ip->c, &R(ip->b), &v);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}VM_CASE(reduce):{
+		list_block* a = R(ip->b).list;
+		list_block* b = (ip->c == kernel_dot) ? R(ip->b + 1).list : NULL;
+		if(b && b->size != a->size)
+			VM_ERROR("dot expects lists of the same length");
+		if(!a->size && ip->c != kernel_sum && ip->c != kernel_dot)
+			VM_ERROR((ip->c == kernel_min) ? "min of an empty list" : "max of an empty list");
+		VM_SET(ip->a, kernel_reduce(ip->c, ip->type, a->data, b ? b->data : NULL, a->size));
+		VM_NEXT();
+	}
+	VM_CASE(add):
+		if(ip->type == var_str){
+			value_t v;
+			if(!str_concat(&v, R(ip->b), R(ip->c)))
+				VM_ERROR("failed to allocate string");
+			VM_SET(ip->a, v);
+			VM_NEXT();
+		}
+		VM_ARITH(add)
+	VM_CASE(sub):
+		VM_ARITH(sub)
+	VM_CASE(mul):
+		VM_ARITH(mul)
+	VM_CASE(div):
+		if(VAR_IS_INT(ip->type) && !R(ip->c).i)
+			VM_ERROR("division by zero");
+		VM_ARITH(div)
+	VM_CASE(mod):
+		if(VAR_IS_INT(ip->type) && !R(ip->c).i)
+			VM_ERROR("modulo by zero");
+		VM_ARITH(mod)
+	VM_CASE(shl):
+		VM_INT_ARITH(shl)
+	VM_CASE(band):
+		VM_INT_ARITH(band)
+	VM_CASE(neg):{
+		value_t x = R(ip->b);
+		switch(ip->type){
+		VALUE_NUMERIC_CASES(VM_NEG_CASE, 0)
+		default: VM_ERROR("invalid operand for negation");
+		}
+		VM_NEXT();
+	}
+	VM_CASE(eq):
+		VM_CMP(eq, false)
+	VM_CASE(neq):
+		VM_CMP(eq, true)
+	VM_CASE(lt):
+		VM_CMP(lt, false)
+	VM_CASE(leq):
+		VM_CMP(leq, false)
+	VM_CASE(gt):
+		VM_CMP(gt, false)
+	VM_CASE(geq):
+		VM_CMP(geq, false)
+	// Operands of different types are folded by the compiler
+	VM_CASE(strict_eq):
+		VM_CMP(eq, false)
+	VM_CASE(type_eq):
+		VM_SET(ip->a, VALUE_BOOL(R(ip->b).type == R(ip->c).type));
+		VM_NEXT();
+	VM_CASE(and):
+		VM_LOGIC(&&)
+	VM_CASE(or):
+		VM_LOGIC(||)
+	VM_CASE(xor):
+		VM_LOGIC(!=)
+	VM_CASE(push_scope):
+		if(!push_var_scope(ip->c))
+			VM_ERROR("failed to open scope");
+		VM_NEXT();
+	VM_CASE(pop_scope):
+		pop_var_scope();
+		VM_NEXT();
+	VM_CASE(jmp):
+		ip = chunk->code.insns + BC_TARGET(ip);
+		VM_DISPATCH();
+	// Conditions are converted to bool by the compiler
+	VM_CASE(jmpf):
+		if(R(ip->a).b)
+			VM_NEXT();
+		ip = chunk->code.insns + BC_TARGET(ip);
+		VM_DISPATCH();
+	VM_CASE(loop):
+#ifdef FERRO_JIT
+		if(jit){
+			jit_fn fn = jit_hot_loop(jit, ip);
+			if(fn){
+				profile_in_jit = 1;
+				ip = chunk->code.insns + fn(regs);
+				profile_in_jit = 0;
+				VM_DISPATCH();
+			}
+		}
+#endif
+		ip = chunk->code.insns + BC_TARGET(ip);
+		VM_DISPATCH();
+	VM_CASE(kernel):
+		vm_kernel_loop(&chunk->kernel_loops.loops[ip->a]);
+		VM_NEXT();
+	VM_CASE(pfor):
+		if(!vm_pfor(thread, ip)){
+			status = EXIT_FAILURE;
+			goto done;
+		}
+		ip = chunk->code.insns + BC_TARGET(ip);
+		VM_DISPATCH();
+	VM_CASE(pfor_end):
+		goto done;
+	VM_CASE(print):
+		vm_print(&R(ip->a), ip->b);
+		VM_NEXT();
+	VM_CASE(putchar):
+		if(!vm_putchar(&R(ip->a)))
+			VM_ERROR("putchar expects a character");
+		VM_NEXT();
+	VM_CASE(input):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		(void) output_flush();
+		const char* err = vm_input(var);
+		if(err)
+			VM_ERROR(err);
+		VM_NEXT();
+	}VM_CASE(getchar):{
+		variable_t* var = get_variable(ip->b, ip->c);
+		(void) output_flush();
+		value_t v = VALUE_INT(var_i64, input_getchar());
+		if(!value_cast(&v, var->type))
+			VM_ERROR("getchar expects a character variable");
+		value_release(*var);
+		*var = v;
+		VM_NEXT();
+	}VM_CASE(flush):
+		(void) output_flush();
+		VM_NEXT();
+	VM_CASE(async):{
+		int64_t handle;
+		const char* err = aio_start(ip->c, &R(ip->b), &handle);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, VALUE_INT(var_i64, handle));
+		VM_NEXT();
+	}VM_CASE(await):{
+		value_t v;
+		const char* err = aio_await(R(ip->b).i, ip->type == var_str, &v);
+		if(err)
+			VM_ERROR(err);
+		VM_SET(ip->a, v);
+		VM_NEXT();
+	}
+	VM_CASE(exit):
+		if(VAR_IS_COUNTED(R(ip->a).type))
+			VM_ERROR("exit status should be an integer");
+		status = (int) value_as_i64(R(ip->a));
+		goto done;
+	VM_CASE(halt):
+		goto done;
+
+#ifndef VM_COMPUTED_GOTO
+	}
+#endif
+
+done:
+	return status;
+}
+
+// Parallel for
+// Every worker runs the body with registers of its own and a copy of the
+// variable stacks of the main thread, which joins them as worker 0 (the
+// only one running JIT code, see jit.c). The
+// compiler only lets the body write its own variables and the elements of
+// lists indexed by the loop variable, so the workers share nothing else
+// Short loops, and every loop while profiling, run on the main thread
+
+// Loops shorter than this run on the main thread, waking the pool costs more
+#define VM_PFOR_MIN 64
+
+typedef struct{
+	vm_thread* caller;
+	bc_insn* body;
+	int64_t start;
+	uint16_t iter;		// Register of the index
+	const var_slot_stack* slots;
+	const var_frame_stack* frames;
+	vm_thread* workers;
+	vm_thread* failed;	// First worker to fail
+} vm_pfor_task;
+
+static void vm_pfor_enter(void* ctx, unsigned int id){
+	vm_pfor_task* task = (vm_pfor_task*) ctx;
+	vm_thread* worker = &task->workers[id];
+	*worker = (vm_thread){.chunk = task->caller->chunk, .regs = task->caller->regs, .deferred = true};
+	if(!id){
+#ifdef FERRO_JIT
+		worker->jit = task->caller->jit;
+#endif
+		return;
+	}
+	worker->regs = (value_t*) calloc(worker->chunk->reg_count, sizeof(value_t));
+	if(worker->regs && !copy_variables(task->slots, task->frames)){
+		free(worker->regs);
+		worker->regs = NULL;
+	}
+}
+
+static void vm_pfor_leave(void* ctx, unsigned int id){
+	vm_pfor_task* task = (vm_pfor_task*) ctx;
+	if(!id)
+		return;
+	// Only the values of the body's scopes are the worker's, and they are never counted
+	free(task->workers[id].regs);
+	drop_variables();
+}
+
+static bool vm_pfor_run(void* ctx, unsigned int id, uint64_t begin, uint64_t end){
+	vm_pfor_task* task = (vm_pfor_task*) ctx;
+	vm_thread* worker = &task->workers[id];
+	bool success = worker->regs != NULL;
+	if(!success){
+		worker->error_ip = task->body - 1;
+		worker->error_msg = "failed to start a parallel for worker";
+	}
+	for(uint64_t i = begin; i < end && success; i++){
+		worker->regs[task->iter] = VALUE_INT(var_i64, task->start + (int64_t) i);
+		success = vm_exec(worker, task->body) == EXIT_SUCCESS;
+	}
+	if(!success){
+		vm_thread* none = NULL;
+		(void) __atomic_compare_exchange_n(&task->failed, &none, worker, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	}
+	return success;
+}
+
+// Runs the body of a parallel for once per index, returns false on a runtime error
+static bool vm_pfor(vm_thread* thread, bc_insn* ip){
+	int64_t start = thread->regs[ip->a].i, end = thread->regs[ip->a+1].i;
+	if(start >= end)
+		return true;
+	uint64_t count = (uint64_t) end - (uint64_t) start;
+	// Negative indices, or indices the loop variable wraps, could reach the same element twice
+	value_t last = VALUE_INT(var_i64, end - 1);
+	bool serial = start < 0 || !value_cast(&last, ip->type) || last.i != end - 1
+		|| count < VM_PFOR_MIN || profile_path || pool_size() <= 1;
+	vm_thread* workers = serial ? NULL : (vm_thread*) calloc(pool_size(), sizeof(vm_thread));
+	// Worker 0 changes the stacks of the main thread while the others copy them
+	var_slot_stack slots = {var_slots.size, var_slots.size, sizeof(variable_t), NULL};
+	var_frame_stack frames = {var_frames.size, var_frames.size, sizeof(size_t), NULL};
+	if(workers){
+		slots.slots = (variable_t*) malloc(slots.size * sizeof(variable_t));
+		frames.bases = (size_t*) malloc(frames.size * sizeof(size_t));
+		if(!slots.slots || !frames.bases){
+			free(workers);
+			workers = NULL;
+		}else{
+			memcpy(slots.slots, var_slots.slots, slots.size * sizeof(variable_t));
+			memcpy(frames.bases, var_frames.bases, frames.size * sizeof(size_t));
+		}
+	}
+	if(!workers){
+		free(slots.slots);
+		free(frames.bases);
+		for(int64_t i = start; i < end; i++){
+			thread->regs[ip->a+2] = VALUE_INT(var_i64, i);
+			if(vm_exec(thread, ip + 1) != EXIT_SUCCESS)
+				return false;
+		}
+		return true;
+	}
+
+	vm_pfor_task task = {thread, ip + 1, start, ip->a + 2, &slots, &frames, workers, NULL};
+	pool_task pool = {vm_pfor_enter, vm_pfor_leave, vm_pfor_run, &task};
+	(void) pool_run(&pool, count);
+	if(task.failed)
+		(void) vm_error(thread->chunk, task.failed->error_ip, task.failed->error_msg);
+	free(slots.slots);
+	free(frames.bases);
+	free(workers);
+	return !task.failed;
+}
+
+// Executes a compiled chunk
+// Returns the exit status of the program
+int vm_run(bc_chunk* chunk){
+	output_setup();
+	heap_setup();
+	if(profile_path && !profile_start(chunk))
+		printf("vm: failed to start the profiler\n");
+	value_t* regs = (value_t*) calloc(chunk->reg_count ? chunk->reg_count : 1, sizeof(value_t));
+	if(!regs || !setup_variables(chunk->global_count)){
+		printf("vm: failed to allocate registers\n");
+		free(regs);
+		return EXIT_FAILURE;
+	}
+	vm_thread main_thread = {.chunk = chunk, .regs = regs};
+#ifdef FERRO_JIT
+	jit_state jit_loops;
+	main_thread.jit = (jit_enabled && jit_setup(&jit_loops, chunk)) ? &jit_loops : NULL;
+#endif
+	int status = vm_exec(&main_thread, chunk->code.insns);
+
+	pool_stop();
+	aio_finish();
+	if(profile_path)
+		profile_stop();
+	if(!output_flush()){
+		fprintf(stderr, RED_FG BOLD "vm: failed to write the output: %s" RESET_ATTR "\n", strerror(output_error));
+		status = EXIT_FAILURE;
+	}
+#ifdef FERRO_JIT
+	if(main_thread.jit)
+		jit_free(main_thread.jit);
+#endif
+	for(uint16_t i = 0; i < chunk->reg_count; i++)
+		value_release(regs[i]);
+	free(regs);
+	free_variables();
+	input_free();
+	if(heap_show_stats)
+		heap_print_stats();
+	heap_finish();
+	str_unmap_files();
+	return status;
+}
@@ -0,0 +1,15 @@
+#ifndef FERRO_VM_H
+#define FERRO_VM_H
+
+#include "bytecode.h"
+
+// Computed goto dispatch needs the GNU "labels as values" extension
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO
+#endif
+
+int vm_run(bc_chunk*);
+void vm_print(value_t*,uint16_t);
+bool vm_putchar(const value_t*);
+
+#endif
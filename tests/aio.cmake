@@ -0,0 +1,8 @@
+# Runs aio.fs like run_script.cmake from a directory of its own, where it
+# writes its files
+# cmake -DDIR=<dir> -DINTERPRETER=<path> [-DOPTIONS=<list>] -P aio.cmake
+file(REMOVE_RECURSE "${DIR}")
+file(MAKE_DIRECTORY "${DIR}")
+file(COPY "${CMAKE_CURRENT_LIST_DIR}/aio.fs" "${CMAKE_CURRENT_LIST_DIR}/aio.out" DESTINATION "${DIR}")
+set(SCRIPT "${DIR}/aio.fs")
+include("${CMAKE_CURRENT_LIST_DIR}/run_script.cmake")
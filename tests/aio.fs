@@ -0,0 +1,63 @@
+// Asynchronous file I/O: more operations in flight than one submission
+// takes, files written then read back, and failures as -errno
+list<str> digits;
+for(i64 i : 0, 10){
+	push(digits, "");
+}
+digits[0] = "0"; digits[1] = "1"; digits[2] = "2"; digits[3] = "3"; digits[4] = "4";
+digits[5] = "5"; digits[6] = "6"; digits[7] = "7"; digits[8] = "8"; digits[9] = "9";
+list<str> names;
+list<i64> fds;
+for(i64 i : 0, 300){
+	str name = "file" + digits[i / 100] + digits[i / 10 % 10] + digits[i % 10];
+	push(names, name);
+	push(fds, async_open(name, "w"));
+}
+list<i64> futures;
+for(i64 i : fds){
+	fds[i] = await(fds[i]);
+	push(futures, async_write(fds[i], 0, names[i] + "\n"));
+}
+i64 written = 0;
+for(i64 i : futures){
+	written = written + await(futures[i]);
+	futures[i] = async_close(fds[i]);
+}
+i64 closed = 0;
+for(i64 i : futures){
+	closed = closed + await(futures[i]);
+	futures[i] = async_read_file(names[i]);
+}
+i64 bytes = 0;
+i64 same = 0;
+for(i64 i : futures){
+	str data = await_str(futures[i]);
+	bytes = bytes + len(data);
+	if(data == names[i] + "\n"){
+		same = same + 1;
+	}
+}
+print(written, " ", closed, " ", bytes, " ", same);
+// A file larger than the first read of a file of unknown size
+str block = "0123456789";
+for(i64 i : 0, 14){
+	block = block + block;
+}
+i64 fd = await(async_open("big", "w"));
+print(await(async_write(fd, 0, block)), " ", await(async_write(fd, len(block), "end")));
+print(await(async_close(fd)));
+str whole = await_str(async_read_file("big"));
+print(len(whole), " ", whole == block + "end");
+fd = await(async_open("big", "r"));
+i64 middle = async_read(fd, 100005, 10);
+i64 tail = async_read(fd, len(block), 100);
+i64 past = async_read(fd, 1000000, 10);
+print(await_str(middle), " ", await_str(tail), " ", len(await_str(past)));
+// Appending, then reading and writing the same file
+fd = await(async_open("big", "a"));
+print(await(async_write(fd, 0, "!")), " ", await(async_close(fd)));
+fd = await(async_open("big", "r+"));
+print(await(async_write(fd, 0, "ab")), " ", await_str(async_read(fd, 0, 4)), " ", await_str(async_read(fd, len(block), 10)));
+print(await(async_close(fd)));
+// Failures give -errno, a future may be awaited once
+print(await(async_open("missing/file", "r")), " ", await(async_read_file("missing")), " ", await(async_close(fd)));
@@ -0,0 +1,4 @@
+// A future is freed once awaited
+i64 future = async_read_file("aio_error.fs");
+print(len(await_str(future)));
+print(await(future));
@@ -0,0 +1,38 @@
+# Checks scripts with --batch on several threads: every script listed in
+# the manifest, each many times so the workers overlap, then again with
+# one that does not compile
+# cmake -DDIR=<dir> -DINTERPRETER=<path> -P batch.cmake
+set(tests "${CMAKE_CURRENT_LIST_DIR}")
+set(scripts casts dicts heap kernels macros nan wrap)
+set(manifest "")
+foreach(round RANGE 1 8)
+	foreach(script ${scripts})
+		string(APPEND manifest "${script}.fs\n")
+	endforeach()
+endforeach()
+file(MAKE_DIRECTORY "${DIR}")
+file(WRITE "${DIR}/manifest" "${manifest}")
+
+execute_process(
+	COMMAND "${INTERPRETER}" --batch --jobs=4 "--manifest=${DIR}/manifest"
+	WORKING_DIRECTORY "${tests}"
+	INPUT_FILE /dev/null
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+	RESULT_VARIABLE status
+)
+if(NOT status EQUAL 0 OR NOT output MATCHES "batch: 56 script.s., 0 failed, [0-9.]+ ms on 4 thread")
+	message(FATAL_ERROR "--batch exited with ${status}:\n${output}")
+endif()
+
+execute_process(
+	COMMAND "${INTERPRETER}" --batch --jobs=4 "--manifest=${DIR}/manifest" macro_compile_error.fs
+	WORKING_DIRECTORY "${tests}"
+	INPUT_FILE /dev/null
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+	RESULT_VARIABLE status
+)
+if(status EQUAL 0 OR NOT output MATCHES "error[^\n]* exit 1 [^\n]*macro_compile_error.fs.*in expansion of macro TWICE.*batch: 57 script.s., 1 failed")
+	message(FATAL_ERROR "--batch with a failing script exited with ${status}:\n${output}")
+endif()
@@ -0,0 +1,28 @@
+// Floats converted to integers saturate to the integer's range, NaN gives 0
+f64 zero = 0.0;
+f64 nan = zero / zero;
+f64 inf = 1.0 / zero;
+f64 big = 1000000000000000000000000000000.0;
+i64 a = nan;
+i64 b = inf;
+i64 c = -inf;
+u64 d = big;
+u64 e = -5.5;
+i32 f = big;
+i8 g = -1000.0;
+u8 h = 300.7;
+u16 k = nan;
+i64 l = -7.9;
+print(a, " ", b, " ", c);
+print(d, " ", e);
+print(f, " ", g, " ", h, " ", k, " ", l);
+// The same stores in a loop hot enough for the JIT
+i64 sum = 0;
+i64 i = 0;
+while(i < 3000){
+	i64 x = inf;
+	i64 y = nan;
+	if(x == b and y == 0){ sum = sum + 1; }
+	i = i + 1;
+}
+print(sum);
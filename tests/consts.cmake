@@ -0,0 +1,14 @@
+# Writes a script with more literals than there are constant slots, all
+# of them repeated, then runs it like run_script.cmake
+# cmake -DDIR=<dir> -DINTERPRETER=<path> [-DOPTIONS=<list>] -P consts.cmake
+set(SCRIPT "${DIR}/consts.fs")
+set(lines "")
+foreach(i RANGE 1 1000)
+	string(APPEND lines "x = x + 1;\nx = x - 2;\nx = x + 3;\ns = \"ab\";\n")
+endforeach()
+string(REPEAT "${lines}" 20 script)
+string(PREPEND script "i64 x = 0;\nstr s = \"\";\n")
+string(APPEND script "print(x);\nprint(s);\n")
+file(WRITE "${SCRIPT}" "${script}")
+file(WRITE "${DIR}/consts.out" "40000\nab\n")
+include("${CMAKE_CURRENT_LIST_DIR}/run_script.cmake")
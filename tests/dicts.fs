@@ -0,0 +1,46 @@
+// Dicts: growth, overwrites, removal with backward shift, copies on write
+dict<i64, i64> squares;
+i64 i = 0;
+while(i < 1000){
+	squares[i] = i * i;
+	i = i + 1;
+}
+print(len(squares), " ", squares[0], " ", squares[999], " ", has(squares, 1000));
+i = 0;
+while(i < 1000){
+	remove(squares, i);
+	i = i + 2;
+}
+i64 sum = 0;
+i = 0;
+while(i < 1000){
+	if(has(squares, i)){ sum = sum + squares[i]; }
+	i = i + 1;
+}
+print(len(squares), " ", sum, " ", has(squares, 500), " ", has(squares, 501));
+// str keys, overwriting and counting
+dict<str, i32> counts;
+list<str> words;
+push(words, "a", "bb", "a", "ccc", "bb", "a", "");
+i = 0;
+while(i < len(words)){
+	str w = words[i];
+	if(has(counts, w)){
+		counts[w] = counts[w] + 1;
+	}else{
+		counts[w] = 1;
+	}
+	i = i + 1;
+}
+print(len(counts), " ", counts["a"], " ", counts["bb"], " ", counts["ccc"], " ", counts[""]);
+// Assignment shares the table until one side writes
+dict<str, i32> copy = counts;
+copy["a"] = 100;
+remove(copy, "bb");
+print(counts["a"], " ", has(counts, "bb"), " ", copy["a"], " ", has(copy, "bb"));
+// 0.0 and -0.0 are the same key
+dict<f64, str> names;
+names[0.0] = "zero";
+names[-0.0] = "still zero";
+names[1.5] = "one and a half";
+print(len(names), " ", names[0.0], " ", names[1.5]);
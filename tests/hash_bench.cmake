@@ -0,0 +1,56 @@
+# Runs ferro_bench_hash on hash_corpus.fs and checks what hashtable_stats
+# reported for each hash against the histogram: every set counted once,
+# every identifier in one set, the fullest set and the load factor
+# hash_sum has to collide on the anagrams, the other hashes must not
+# cmake -DBENCH=<path> -P hash_bench.cmake
+execute_process(
+	COMMAND "${BENCH}" --passes=1 "${CMAKE_CURRENT_LIST_DIR}/hash_corpus.fs"
+	INPUT_FILE /dev/null
+	OUTPUT_VARIABLE output
+	ERROR_VARIABLE output
+	RESULT_VARIABLE status
+)
+string(ASCII 27 escape)
+string(REGEX REPLACE "${escape}\\[[0-9;]*m" "" output "${output}")
+if(NOT status EQUAL 0 OR NOT output MATCHES "40 identifiers, 20 distinct")
+	message(FATAL_ERROR "ferro_bench_hash exited with ${status}:\n${output}")
+endif()
+set(number "([0-9]+)")
+foreach(hash sum fnv1a dict wyhash xxh3)
+	if(NOT output MATCHES "\n${hash} +[0-9.]+ +${number} +${number} +${number} +${number} +${number} +([0-9.]+) +${number}\n")
+		message(FATAL_ERROR "No statistics for ${hash}:\n${output}")
+	endif()
+	set(collisions ${CMAKE_MATCH_1})
+	set(sets ${CMAKE_MATCH_3})
+	set(used ${CMAKE_MATCH_4})
+	set(max_chain ${CMAKE_MATCH_5})
+	set(load ${CMAKE_MATCH_6})
+	if(NOT output MATCHES "\n${hash} +${number} +${number} +${number} +${number} +${number} +${number} +${number} +${number} *\n")
+		message(FATAL_ERROR "No histogram for ${hash}:\n${output}")
+	endif()
+	set(counted 0)
+	set(pairs 0)
+	set(fullest 0)
+	foreach(size RANGE 0 7)
+		math(EXPR group "${size} + 1")
+		set(count ${CMAKE_MATCH_${group}})
+		math(EXPR counted "${counted} + ${count}")
+		math(EXPR pairs "${pairs} + ${size} * ${count}")
+		if(count GREATER 0)
+			set(fullest ${size})
+		endif()
+	endforeach()
+	math(EXPR empty "${sets} - ${used}")
+	# The load factor is printed rounded to 2 digits
+	string(REPLACE "." "" load_digits "${load}")
+	math(EXPR load_error "${load_digits} * ${sets} - 2000")
+	if(NOT counted EQUAL sets OR NOT CMAKE_MATCH_1 EQUAL empty OR NOT pairs EQUAL 20
+		OR NOT fullest EQUAL max_chain OR load_error LESS -${sets} OR load_error GREATER ${sets})
+		message(FATAL_ERROR "Statistics of ${hash} do not match its histogram:\n${output}")
+	endif()
+	if(hash STREQUAL "sum" AND collisions LESS 7)
+		message(FATAL_ERROR "hash_sum should collide on the anagrams:\n${output}")
+	elseif(NOT hash STREQUAL "sum" AND NOT collisions EQUAL 0)
+		message(FATAL_ERROR "${hash} collides on distinct identifiers:\n${output}")
+	endif()
+endforeach()
@@ -0,0 +1,24 @@
+// Identifiers for the ferro_bench_hash test: anagrams, which hash_sum
+// cannot tell apart, and enough names to make the tables grow
+i64 listen = 1;
+i64 silent = 2;
+i64 enlist = 3;
+i64 tinsel = 4;
+i64 evil = 5;
+i64 vile = 6;
+i64 live = 7;
+i64 veil = 8;
+i64 ab = 9;
+i64 ba = 10;
+i64 width = 11;
+i64 height = 12;
+i64 depth = 13;
+i64 count = 14;
+i64 total = 15;
+i64 index = 16;
+i64 offset = 17;
+i64 length = 18;
+i64 stride = 19;
+i64 result = 20;
+print(listen + silent + enlist + tinsel + evil + vile + live + veil + ab + ba);
+print(width + height + depth + count + total + index + offset + length + stride + result);
@@ -0,0 +1,18 @@
+// Dead containers of heap strings are released a budget at a time,
+// and their memory is reused by the next round
+i64 total = 0;
+i64 round = 0;
+while(round < 50){
+	list<str> l;
+	dict<i64, str> d;
+	i64 i = 0;
+	while(i < 2000){
+		str s = "abcdefghij" + "klmnopqrstuvwxyz";
+		push(l, s);
+		d[i] = s + "!";
+		i = i + 1;
+	}
+	total = total + len(l) + len(d) + len(d[1999]);
+	round = round + 1;
+}
+print(total);
@@ -0,0 +1,71 @@
+# Writes a script reading every input type, then enough lines to cross
+# several read-ahead blocks and a line longer than a block, with the input
+# to go with it, then runs it like run_script.cmake
+# Each run needs its own directory
+# cmake -DDIR=<dir> -DINTERPRETER=<path> [-DOPTIONS=<list>] -P input.cmake
+file(MAKE_DIRECTORY "${DIR}")
+set(SCRIPT "${DIR}/input.fs")
+set(INPUT "${DIR}/input.in")
+file(WRITE "${SCRIPT}" "i64 a = 0;
+u64 b = 0;
+i64 c = 0;
+i32 d = 0;
+f64 e = 0.0;
+f64 f = 0.0;
+bool g = false;
+bool h = false;
+str s = \"\";
+char k = ' ';
+input(a);
+input(b);
+input(c);
+input(d);
+input(e);
+input(f);
+input(g);
+input(h);
+input(s);
+input(k);
+print(a, \" \", b, \" \", c, \" \", d);
+print(e, \" \", f, \" \", g, \" \", h);
+print(s, \" \", k);
+char x = ' ';
+getchar(x);
+putchar(x);
+getchar(x);
+putchar(x);
+getchar(x);
+putchar(x);
+i64 n = 0;
+i64 sum = 0;
+i64 i = 0;
+while(i < 20000){
+	input(n);
+	sum = sum + n;
+	i = i + 1;
+}
+print(sum);
+input(s);
+print(len(s));
+input(s);
+print(s);
+input(s);
+print(len(s));
+")
+set(lines "  -42\n18446744073709551615\n99999999999999999999\n4294967297\n3.25\n-1.5e3\ntrue\n0\nhello world\nxyz\nAB\n")
+set(numbers "")
+foreach(i RANGE 0 19999)
+	string(APPEND numbers "${i}\n")
+endforeach()
+string(REPEAT "0123456789" 10000 long)
+file(WRITE "${INPUT}" "${lines}${numbers}${long}\nlast line\n")
+file(WRITE "${DIR}/input.out" "-42 18446744073709551615 9223372036854775807 1
+3.25 -1500 true false
+hello world x
+AB
+199990000
+100000
+last line
+0
+")
+include("${CMAKE_CURRENT_LIST_DIR}/run_script.cmake")
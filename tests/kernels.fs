@@ -0,0 +1,49 @@
+// Element-wise loops and reductions run as kernels, over lengths that
+// leave a partial last vector
+list<u8> a;
+list<u8> b;
+list<u8> s;
+list<f64> x;
+list<f64> y;
+list<bool> gt;
+list<bool> geq;
+f64 zero = 0.0;
+f64 nan = zero / zero;
+i64 i = 0;
+while(i < 37){
+	push(a, i * 10);
+	push(b, 200);
+	push(s, 0);
+	push(x, i);
+	push(y, 18.0);
+	push(gt, false);
+	push(geq, false);
+	i = i + 1;
+}
+x[3] = nan;
+i64 k = 0;
+while(k < len(a)){
+	s[k] = a[k] + b[k];
+	k = k + 1;
+}
+k = 0;
+while(k < len(x)){
+	gt[k] = x[k] > y[k];
+	k = k + 1;
+}
+k = 0;
+while(k < len(x)){
+	geq[k] = x[k] >= y[k];
+	k = k + 1;
+}
+i64 count = 0;
+k = 0;
+while(k < len(x)){
+	if(gt[k]){ count = count + 1; }
+	if(geq[k]){ count = count + 100; }
+	k = k + 1;
+}
+print(s[0], " ", s[5], " ", s[36], " ", sum(s), " ", min(s), " ", max(s));
+print(count);
+x[3] = 3.0;
+print(sum(x), " ", dot(x, y), " ", min(x), " ", max(x));
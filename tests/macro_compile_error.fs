@@ -0,0 +1,6 @@
+// A compile error in a macro body points at the use it came from
+#define TWICE s * 2
+str s = "ferro";
+i64 n = 1;
+n = n * 2;
+n = TWICE;
@@ -0,0 +1,7 @@
+// A runtime error in a macro body points at the use it came from
+#define INNER 10 / d
+#define OUTER INNER + 1
+i64 d = 2;
+print(OUTER);
+d = 0;
+print(OUTER);
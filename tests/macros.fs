@@ -0,0 +1,21 @@
+// Macros, #ifdef / #ifndef and a header guarded against a second include
+#include "macros.fh"
+#include "macros.fh"
+#define GREETING "hello"
+print(GREETING, " ", header_value);
+#ifdef SCALE
+print("SCALE defined");
+#endif
+#ifndef MISSING
+print("MISSING undefined");
+#endif
+#ifdef MISSING
+print("unreachable");
+#endif
+i64 total = SCALE * SCALE + SCALE;
+print(total);
+#ifndef MISSING
+#ifdef GREETING
+print("nested");
+#endif
+#endif
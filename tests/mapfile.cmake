@@ -0,0 +1,22 @@
+# Writes a log to scan, an empty file and one filling a page exactly, then
+# runs mapfile.fs over them like run_script.cmake
+# cmake -DDIR=<dir> -DINTERPRETER=<path> [-DOPTIONS=<list>] -P mapfile.cmake
+file(REMOVE_RECURSE "${DIR}")
+file(MAKE_DIRECTORY "${DIR}")
+file(COPY "${CMAKE_CURRENT_LIST_DIR}/mapfile.fs" "${CMAKE_CURRENT_LIST_DIR}/mapfile.out" DESTINATION "${DIR}")
+set(block "")
+foreach(i RANGE 1 1000)
+	if(i EQUAL 500)
+		string(APPEND block "ERROR disk full\n")
+	else()
+		string(APPEND block "INFO request served in ${i} ms\n")
+	endif()
+endforeach()
+string(REPEAT "${block}" 100 log)
+string(REPEAT "x" 5000 last)
+file(WRITE "${DIR}/log.txt" "${log}${last}")
+file(WRITE "${DIR}/empty.txt" "")
+string(REPEAT "0123456789abcdef" 256 page)
+file(WRITE "${DIR}/page.txt" "${page}")
+set(SCRIPT "${DIR}/mapfile.fs")
+include("${CMAKE_CURRENT_LIST_DIR}/run_script.cmake")
@@ -0,0 +1,35 @@
+// mapfile views a file, slices of the view are views too
+str log = mapfile("log.txt");
+i64 lines = 0;
+i64 errors = 0;
+i64 longest = 0;
+i64 served = 0;
+i64 at = 0;
+while(at < len(log)){
+	i64 end = find(log, "\n", at);
+	if(end < 0){
+		end = len(log);
+	}
+	str line = slice(log, at, end);
+	if(find(line, "ERROR", 0) >= 0){
+		errors = errors + 1;
+	}
+	if(find(line, "served in 1000 ms", 0) > 0){
+		served = served + 1;
+	}
+	if(len(line) > longest){
+		longest = len(line);
+	}
+	lines = lines + 1;
+	at = end + 1;
+}
+print(len(log), " ", lines, " ", errors, " ", served, " ", longest);
+str empty = mapfile("empty.txt");
+print(len(empty), " ", find(empty, "", 0), " ", find(empty, "x", 0), " ", len(slice(empty, 0, 0)));
+str page = mapfile("page.txt");
+print(len(page), " ", slice(page, 4090, 4096), " ", find(page, "f0", 0), " ", find(page, "fe", 0));
+// Slices of strings built at run time are copies
+str built = "ab" + "cabc";
+str part = slice(built, 1, 4);
+built = "";
+print(part, " ", find(part, "ca", 0), " ", find(part, "a", 3), " ", find(part, "", 3), " ", find(part, "bcax", 0));
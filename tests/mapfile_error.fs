@@ -0,0 +1,4 @@
+// Slices stay within their str
+str page = mapfile("mapfile_error.fs");
+print(slice(page, 0, 2));
+print(slice(page, 3, len(page) + 1));
@@ -0,0 +1,22 @@
+// Ordered comparisons with NaN are false, == too and != is true
+f64 zero = 0.0;
+f64 nan = zero / zero;
+f64 one = 1.0;
+print(nan > one, " ", nan >= one, " ", nan < one, " ", nan <= one);
+print(one > nan, " ", one >= nan, " ", nan == nan, " ", nan != nan);
+f32 zf = 0.0;
+f32 nf = zf / zf;
+print(nf > 1.0, " ", nf >= 1.0, " ", nf < 1.0, " ", nf <= 1.0);
+print(2.0 > one, " ", one >= one, " ", "b" > "a", " ", "a" >= "b");
+// The same comparisons in a loop hot enough for the JIT
+i64 counts = 0;
+i64 i = 0;
+while(i < 3000){
+	if(nan > one){ counts = counts + 1; }
+	if(nan >= one){ counts = counts + 10; }
+	if(one > nan){ counts = counts + 100; }
+	if(one >= nan){ counts = counts + 1000; }
+	if(one >= one){ counts = counts + 10000; }
+	i = i + 1;
+}
+print(counts);
@@ -0,0 +1,32 @@
+# Writes a script printing several blocks of output, with flushes in the
+# middle and a line longer than the block, then runs it like run_script.cmake
+# Each run needs its own directory
+# cmake -DDIR=<dir> (-DINTERPRETER=<path> [-DOPTIONS=<list>] | -DCOMPILER=<path> -DBINARY=<path>) -P output.cmake
+file(MAKE_DIRECTORY "${DIR}")
+set(SCRIPT "${DIR}/output.fs")
+file(WRITE "${SCRIPT}" "i64 i = 0;
+while(i < 10000){
+	print(\"line \", i, \" \", i * 7);
+	if(i % 1000 == 999){ flush(); }
+	i = i + 1;
+}
+putchar('<');
+str s = \"\";
+i = 0;
+while(i < 8000){
+	s = s + \"0123456789\";
+	i = i + 1;
+}
+print(s);
+putchar('>');
+putchar('\\n');
+")
+set(expected "")
+foreach(i RANGE 0 9999)
+	math(EXPR seven "${i} * 7")
+	string(APPEND expected "line ${i} ${seven}\n")
+endforeach()
+string(REPEAT "0123456789" 8000 long)
+string(APPEND expected "<${long}\n>\n")
+file(WRITE "${DIR}/output.out" "${expected}")
+include("${CMAKE_CURRENT_LIST_DIR}/run_script.cmake")
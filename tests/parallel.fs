@@ -0,0 +1,58 @@
+// For loops, and parallel ones over enough indices to be split across
+// the workers (whatever --threads is, the output is the same)
+list<i64> squares;
+list<f64> halves;
+list<u8> small;
+list<i64> copy;
+dict<i64, i64> weights;
+for(i64 i : 0, 100000){
+	push(squares, 0);
+	push(halves, 0.0);
+	push(small, 0);
+}
+for(i64 i : 0, 10){
+	weights[i] = i * 3;
+}
+i64 offset = 7;
+for [parallel](i64 i : 0, 100000){
+	i64 sq = i * i;
+	squares[i] = sq + offset;
+	halves[i] = i / 2.0;
+	small[i] = i;
+}
+copy = squares;
+// Writes go to a block of its own, the copy keeps the old elements
+for [parallel](i64 i : squares){
+	if(i % 2 == 0){
+		squares[i] = weights[i % 10];
+	}else{
+		i64 k = 0;
+		i64 sum = 0;
+		while(k < 10){
+			sum = sum + weights[k];
+			k = k + 1;
+		}
+		squares[i] = sum;
+	}
+}
+i64 total = 0;
+f64 half_total = 0.0;
+u64 small_total = 0;
+for(i64 i : squares){
+	total = total + squares[i];
+	half_total = half_total + halves[i];
+	small_total = small_total + small[i];
+}
+print(total, " ", half_total, " ", small_total);
+print(copy[0], " ", copy[99999], " ", squares[99998], " ", squares[99999]);
+// Too short to be split, and empty or reversed ranges
+for [parallel](i64 i : 0, 10){
+	squares[i] = i;
+}
+for [parallel](i64 i : 5, 5){
+	squares[i] = 0;
+}
+for [parallel](i64 i : 10, 0){
+	squares[i] = 0;
+}
+print(squares[9], " ", squares[5]);
@@ -0,0 +1,10 @@
+// A runtime error in a worker is reported once, by the main thread
+list<i64> values;
+for(i64 i : 0, 100000){
+	push(values, i + 1);
+}
+values[76543] = 0;
+for [parallel](i64 i : values){
+	values[i] = 1000000 / values[i];
+}
+print("not reached");
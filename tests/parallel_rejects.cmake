@@ -0,0 +1,40 @@
+# Checks that the compiler rejects parallel for bodies whose iterations
+# would not be independent, one script per rule (@ stands for ;)
+# cmake -DDIR=<dir> -DINTERPRETER=<path> -P parallel_rejects.cmake
+set(header "list<i64> values;\ndict<i64, i64> weights;\nstr name = \"values\";\ni64 sum = 0;\n")
+set(cases
+	"sum = sum + values[i]@|cannot assign to a variable declared outside of a parallel for"
+	"values[i + 1] = 0@|a list written in a parallel for can only be indexed by the loop variable"
+	"values[i] = values[0]@|a list written in a parallel for can only be indexed by the loop variable"
+	"push(values, i)@|lists and dicts cannot grow or shrink in a parallel for"
+	"weights[i] = 0@|cannot modify a dict in a parallel for"
+	"print(i)@|input / output cannot be used in a parallel for"
+	"exit(1)@|exit cannot be used in a parallel for"
+	"str copy = name@|str, list and dict values can only be used through subscripts in a parallel for"
+	"break@|break cannot leave a parallel for"
+	"for [parallel](i64 j : 0, 10){ sum = 0@ }|parallel for loops cannot be nested"
+)
+file(MAKE_DIRECTORY "${DIR}")
+set(n 0)
+foreach(case ${cases})
+	string(FIND "${case}" "|" bar)
+	string(SUBSTRING "${case}" 0 ${bar} body)
+	string(REPLACE "@" ";" body "${body}")
+	math(EXPR bar "${bar} + 1")
+	string(SUBSTRING "${case}" ${bar} -1 expected)
+	math(EXPR n "${n} + 1")
+	set(script "${DIR}/reject${n}.fs")
+	file(WRITE "${script}" "${header}for [parallel](i64 i : 0, 100){\n\t${body}\n}\n")
+	execute_process(
+		COMMAND "${INTERPRETER}" "${script}"
+		WORKING_DIRECTORY "${DIR}"
+		INPUT_FILE /dev/null
+		OUTPUT_VARIABLE output
+		ERROR_VARIABLE output
+		RESULT_VARIABLE status
+	)
+	string(FIND "${output}" "${expected}" found)
+	if(status EQUAL 0 OR found EQUAL -1)
+		message(FATAL_ERROR "'${body}' in a parallel for exited with ${status}:\n${output}\nExpected '${expected}'")
+	endif()
+endforeach()
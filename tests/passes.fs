@@ -0,0 +1,52 @@
+// Each optimizer pass has something to rewrite, the output is the same
+// whichever of them run
+// const-prop: constants are replaced by their value
+const i64 WIDTH = 16;
+const f64 SCALE = -0.5;
+const str NAME = "grid";
+print(NAME, " ", WIDTH * WIDTH, " ", SCALE * 4.0);
+// dce: branches on literals, loops that never run, code after break
+if(false){
+	print("never");
+}elif(true){
+	print("taken");
+}else{
+	print("never either");
+}
+while(0){
+	print("never");
+}
+i64 n = 0;
+while(true){
+	n = n + 1;
+	if(n == 3){
+		break;
+		print("after break");
+	}
+}
+print(n);
+// strength: products and unsigned remainders by powers of two
+i64 x = 0 - 7;
+u32 u = 4000000000;
+u64 big = 18446744073709551615;
+print(x * 8, " ", 8 * x, " ", x * 1, " ", x * 6);
+print(u % 16, " ", big % 1024, " ", x % 4, " ", u * 4);
+// cse: a subexpression repeated within a statement is computed once
+i64 a = 12;
+i64 b = 30;
+print((a + b) * (a + b) - (a + b) * 2);
+i64 c = (a * b + 1) * (a * b + 1);
+print(c);
+// dse: stores overwritten before they are read, variables never read
+i64 s = 1;
+s = 2;
+s = 3;
+print(s);
+i64 unused = 5;
+unused = 6;
+// A division may fail, so a store of one is kept
+i64 zero = 0;
+i64 t = 1;
+t = 1 / (zero + 1);
+t = 7;
+print(t);
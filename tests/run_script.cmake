@@ -0,0 +1,69 @@
+# Runs a script and compares its output with <script>.out
+# cmake -DSCRIPT=<file.fs> -DINTERPRETER=<path> [-DOPTIONS=<list>] -P run_script.cmake
+# cmake -DSCRIPT=<file.fs> -DCOMPILER=<path> -DBINARY=<path> -P run_script.cmake
+# -DINPUT=<file> is read as stdin (default /dev/null), -DOUTPUT=<file>
+# sends stdout to a file instead, -DFAIL=<regex> expects the run (or the
+# compilation) to fail with an error matching it, -DERRORS=<regex> has to match stderr of a
+# successful run
+# Scripts run from their directory, where their headers are
+get_filename_component(dir "${SCRIPT}" DIRECTORY)
+if(NOT FAIL)
+	string(REGEX REPLACE "\\.fs$" ".out" expected_file "${SCRIPT}")
+	file(READ "${expected_file}" expected)
+endif()
+
+if(COMPILER)
+	execute_process(
+		COMMAND "${COMPILER}" -o "${BINARY}" "${SCRIPT}"
+		WORKING_DIRECTORY "${dir}"
+		INPUT_FILE /dev/null
+		OUTPUT_VARIABLE compile_output
+		ERROR_VARIABLE compile_output
+		RESULT_VARIABLE status
+	)
+	if(NOT status EQUAL 0)
+		if(FAIL AND compile_output MATCHES "${FAIL}")
+			return()
+		endif()
+		message(FATAL_ERROR "ferro_compiler failed (${status}):\n${compile_output}")
+	endif()
+	set(command "${BINARY}")
+else()
+	set(command "${INTERPRETER}" ${OPTIONS} "${SCRIPT}")
+endif()
+
+if(NOT INPUT)
+	set(INPUT /dev/null)
+endif()
+if(OUTPUT)
+	set(output_args OUTPUT_FILE "${OUTPUT}")
+else()
+	set(output_args OUTPUT_VARIABLE output)
+endif()
+execute_process(
+	COMMAND ${command}
+	WORKING_DIRECTORY "${dir}"
+	INPUT_FILE "${INPUT}"
+	${output_args}
+	ERROR_VARIABLE errors
+	RESULT_VARIABLE status
+)
+string(JOIN " " command_line ${command})
+if(FAIL)
+	if(status EQUAL 0)
+		message(FATAL_ERROR "${command_line} succeeded, expected it to fail with '${FAIL}'")
+	endif()
+	if(NOT "${output}${errors}" MATCHES "${FAIL}")
+		message(FATAL_ERROR "${command_line} failed with:\n${output}${errors}\nExpected '${FAIL}'")
+	endif()
+	return()
+endif()
+if(NOT status EQUAL 0)
+	message(FATAL_ERROR "${command_line} exited with ${status}:\n${output}${errors}")
+endif()
+if(NOT output STREQUAL expected)
+	message(FATAL_ERROR "Output of ${command_line}:\n${output}\nExpected:\n${expected}")
+endif()
+if(ERRORS AND NOT errors MATCHES "${ERRORS}")
+	message(FATAL_ERROR "stderr of ${command_line}:\n${errors}\nExpected '${ERRORS}'")
+endif()
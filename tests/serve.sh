@@ -0,0 +1,43 @@
+#!/bin/sh
+# Runs a script twice through ferro_interpreter --serve and ferro_client,
+# editing it in between: the second run should see the edit, not the
+# cached compilation of the first
+# serve.sh <ferro_interpreter> <ferro_client>
+interpreter="$1"
+client="$2"
+dir=$(mktemp -d) || exit 1
+server=
+cleanup(){
+	[ -n "$server" ] && kill "$server" 2>/dev/null && wait "$server" 2>/dev/null
+	rm -rf "$dir"
+}
+trap cleanup EXIT
+fail(){
+	echo "serve: $*" >&2
+	exit 1
+}
+
+"$interpreter" --serve="$dir/socket" </dev/null >"$dir/server.log" 2>&1 &
+server=$!
+tries=0
+while [ ! -S "$dir/socket" ]; do
+	tries=$((tries + 1))
+	[ "$tries" -gt 100 ] && fail "server did not start: $(cat "$dir/server.log")"
+	sleep 0.05
+done
+
+printf 'i64 x = 6;\nprint(x * 7);\n' >"$dir/script.fs"
+out=$(cd "$dir" && "$client" socket script.fs </dev/null) || fail "first run failed: $out"
+[ "$out" = "42" ] || fail "first run printed '$out', expected '42'"
+out=$(cd "$dir" && "$client" socket script.fs </dev/null) || fail "cached run failed: $out"
+[ "$out" = "42" ] || fail "cached run printed '$out', expected '42'"
+
+# Longer than before, so the edit shows even within one timestamp tick
+printf 'i64 x = 6;\nprint(x * 7 + 100);\n' >"$dir/script.fs"
+out=$(cd "$dir" && "$client" socket script.fs </dev/null) || fail "run after the edit failed: $out"
+[ "$out" = "142" ] || fail "run after the edit printed '$out', expected '142'"
+
+# Options apply to one run only
+out=$(cd "$dir" && "$client" socket script.fs --no-jit --threads=1 </dev/null) || fail "run with options failed: $out"
+[ "$out" = "142" ] || fail "run with options printed '$out', expected '142'"
+exit 0
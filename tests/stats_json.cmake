@@ -0,0 +1,39 @@
+# Runs a script with --stats=json and parses what it writes to stderr,
+# which has to be the JSON document alone
+# cmake -DSCRIPT=<file.fs> -DINTERPRETER=<path> [-DREWRITES=<list>] -P stats_json.cmake
+# Every optimizer pass of REWRITES has to rewrite something
+get_filename_component(dir "${SCRIPT}" DIRECTORY)
+execute_process(
+	COMMAND "${INTERPRETER}" --stats=json "${SCRIPT}"
+	WORKING_DIRECTORY "${dir}"
+	INPUT_FILE /dev/null
+	OUTPUT_QUIET
+	ERROR_VARIABLE stats
+	RESULT_VARIABLE status
+)
+if(NOT status EQUAL 0)
+	message(FATAL_ERROR "${INTERPRETER} --stats=json ${SCRIPT} exited with ${status}:\n${stats}")
+endif()
+string(JSON files ERROR_VARIABLE error LENGTH "${stats}" files)
+if(error)
+	message(FATAL_ERROR "--stats=json wrote invalid JSON (${error}):\n${stats}")
+endif()
+string(JSON phases LENGTH "${stats}" phases)
+math(EXPR last "${phases} - 1")
+string(JSON last_phase GET "${stats}" phases ${last} name)
+if(files LESS 1 OR NOT last_phase STREQUAL "run")
+	message(FATAL_ERROR "--stats=json is missing files or phases:\n${stats}")
+endif()
+foreach(pass ${REWRITES})
+	set(count)
+	math(EXPR last "${phases} - 1")
+	foreach(i RANGE ${last})
+		string(JSON name GET "${stats}" phases ${i} name)
+		if(name STREQUAL pass)
+			string(JSON count GET "${stats}" phases ${i} rewrites)
+		endif()
+	endforeach()
+	if(NOT count OR count LESS 1)
+		message(FATAL_ERROR "The ${pass} pass rewrote nothing in ${SCRIPT}:\n${stats}")
+	endif()
+endforeach()
@@ -0,0 +1,23 @@
+// A u64 mixed with a signed integer or a literal stays unsigned,
+// as in C, so values above INT64_MAX divide and compare as unsigned
+u64 big = 18446744073709551615;
+u64 high = 9223372036854775808;
+i64 three = 3;
+print(big / 3, " ", big / three, " ", big % 7, " ", big % 8);
+print(high / 4, " ", high * 2, " ", (high + 5) * 4, " ", high + high / 2);
+print(big > 100, " ", big >= three, " ", big < 100, " ", 100 < big, " ", high > 9223372036854775807);
+// Narrower unsigned types still mix with signed ones as i64
+u32 small = 5;
+i32 neg = -7;
+print(small + neg, " ", small % 4, " ", neg < small);
+// The same operations in a loop hot enough for the JIT
+u64 count = 0;
+i64 i = 0;
+while(i < 3000){
+	u64 x = big - i;
+	if(x > 100){ count = count + 1; }
+	if(x / 2 > high / 2){ count = count + 1; }
+	if(x % 4 == 3 - i % 4){ count = count + 1; }
+	i = i + 1;
+}
+print(count);
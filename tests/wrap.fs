@@ -0,0 +1,33 @@
+// Integers wrap to the width of their type
+i8 a = 127;
+a = a + 1;
+u8 b = 255;
+b = b + 1;
+i16 c = 0 - 32768;
+c = c - 1;
+u16 d = 0;
+d = d - 1;
+i32 e = 2147483647;
+e = e * 2;
+u32 f = 4294967295;
+f = f + 2;
+i64 g = 9223372036854775807;
+g = g + 1;
+u64 h = 0;
+h = h - 1;
+print(a, " ", b, " ", c, " ", d);
+print(e, " ", f);
+print(g, " ", h);
+// Division and modulo by -1 of the smallest value do not trap
+i64 m = 0 - 9223372036854775807 - 1;
+i64 q = m / (0 - 1);
+i64 r = m % (0 - 1);
+print(q, " ", r);
+// Wrapping in a loop hot enough for the JIT
+i32 w = 0;
+i64 i = 0;
+while(i < 5000){
+	w = w + 1000000;
+	i = i + 1;
+}
+print(w);